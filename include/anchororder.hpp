@@ -0,0 +1,121 @@
+#ifndef CARE_ANCHORORDER_HPP
+#define CARE_ANCHORORDER_HPP
+
+#include <config.hpp>
+
+#include <cpureadstorage.hpp>
+#include <cpusequencehasher.hpp>
+#include <parallelradixsort.hpp>
+#include <sequencehelpers.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <omp.h>
+
+namespace care{
+
+    /*
+        Returns the read ids [0, numReads) sorted by the min-hash of the first hash function.
+        Reads which are processed consecutively in this order are likely to overlap, i.e. they share many candidates.
+        Ties are ordered by read id. Reads shorter than kmerSize are placed at the end.
+
+        For paired-end reads, both reads of a pair are kept adjacent (mate 1 first), and pairs are ordered by the smaller
+        min-hash of both reads. numReads must be even in this case.
+
+        The reads are distributed into buckets by their min-hash with a parallel radix sort. 
+        The order is also used to renumber the reads in the read storage (ChunkedReadStorage::reorderReads).
+    */
+    inline std::vector<read_number> makeLocalityAwareAnchorOrder(
+        const CpuReadStorage& readStorage,
+        std::size_t numReads,
+        int kmerSize,
+        int numThreads
+    ){
+        const bool pairedEnd = readStorage.isPairedEnd();
+        assert(!pairedEnd || numReads % 2 == 0);
+
+        const std::size_t encodedSequencePitchInInts2Bit = SequenceHelpers::getEncodedNumInts2Bit(readStorage.getSequenceLengthUpperBound());
+        const std::size_t numKeys = pairedEnd ? numReads / 2 : numReads;
+        constexpr std::size_t chunksize = 4096;
+        const std::size_t numChunks = SDIV(numReads, chunksize);
+
+        std::vector<kmer_type> minhashes(numReads);
+
+        #pragma omp parallel num_threads(numThreads)
+        {
+            CPUSequenceHasher<kmer_type> hasher;
+            std::vector<unsigned int> sequences(chunksize * encodedSequencePitchInInts2Bit);
+            std::vector<read_number> readIds(chunksize);
+            std::vector<int> lengths(chunksize);
+
+            #pragma omp for schedule(dynamic, 1)
+            for(std::size_t chunk = 0; chunk < numChunks; chunk++){
+                const read_number first = chunk * chunksize;
+                const int num = std::min(chunksize, numReads - first);
+
+                std::iota(readIds.begin(), readIds.begin() + num, first);
+                readStorage.gatherSequenceLengths(lengths.data(), readIds.data(), num);
+                readStorage.gatherContiguousSequences(sequences.data(), encodedSequencePitchInInts2Bit, first, num);
+
+                for(int i = 0; i < num; i++){
+                    if(lengths[i] >= kmerSize){
+                        hasher.hashInto(
+                            minhashes.begin() + first + i,
+                            sequences.data() + i * encodedSequencePitchInInts2Bit,
+                            lengths[i],
+                            kmerSize,
+                            1,
+                            0
+                        );
+                    }else{
+                        minhashes[first + i] = std::numeric_limits<kmer_type>::max();
+                    }
+                }
+            }
+        }
+
+        std::vector<kmer_type> keys(numKeys);
+        std::vector<read_number> keyOrder(numKeys);
+
+        #pragma omp parallel for num_threads(numThreads)
+        for(std::size_t k = 0; k < numKeys; k++){
+            keys[k] = pairedEnd ? std::min(minhashes[2 * k], minhashes[2 * k + 1]) : minhashes[k];
+            keyOrder[k] = k;
+        }
+
+        {
+            //the sort is stable, so ties are ordered by read id
+            std::vector<kmer_type> keysTmp(numKeys);
+            std::vector<read_number> keyOrderTmp(numKeys);
+
+            parallelRadixSortPairs(
+                keys.data(),
+                keyOrder.data(),
+                keysTmp.data(),
+                keyOrderTmp.data(),
+                numKeys,
+                numThreads
+            );
+        }
+
+        if(!pairedEnd){
+            return keyOrder;
+        }
+
+        std::vector<read_number> order(numReads);
+        for(std::size_t k = 0; k < numKeys; k++){
+            order[2 * k] = 2 * keyOrder[k];
+            order[2 * k + 1] = 2 * keyOrder[k] + 1;
+        }
+
+        return order;
+    }
+
+}
+
+#endif
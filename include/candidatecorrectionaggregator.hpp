@@ -0,0 +1,335 @@
+#ifndef CARE_CANDIDATECORRECTIONAGGREGATOR_HPP
+#define CARE_CANDIDATECORRECTIONAGGREGATOR_HPP
+
+#include <config.hpp>
+
+#include <correctedsequence.hpp>
+#include <corrector_common.hpp>
+#include <serializedobjectstorage.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace care{
+
+    /*
+        Concurrent table, keyed by read id, which combines the candidate corrections of a read as soon as they are produced,
+        instead of storing each of them as partial result.
+
+        When the partial results are merged, candidate corrections of a read are only used if the read has a low quality
+        anchor correction, and only in two ways: whether there are at least two candidate corrections, and whether
+        all corrections (anchor and candidates) are equal. Thus it is sufficient to keep at most two candidate corrections per read:
+        the first one, and either a second equal one, or one which differs from the first one.
+        The merged output is identical to the output without aggregation.
+
+        Two candidate corrections of the same read are equal if their serialized data, excluding the shift, is equal.
+        The edit representation of a corrected sequence is unique. A read with edits and a read without edits
+        cannot have equal sequences because a sequence is only stored without edits if there are too many edits,
+        or if the read contains N, in which case all corrections of this read are stored without edits.
+
+        The table is split into shards which are protected by separate locks. Each shard is an open addressing table of
+        fixed size slots, which refer to the serialized corrections in a byte array of the shard.
+
+        If the memory of the table exceeds its limit, the corrections of a shard are returned to the caller of add, 
+        who stores them as partial results, and the shard is cleared. This does not change the merged output:
+        per read, the stored corrections of all flushes together still contain at least two corrections if there were at least two,
+        and a pair of different corrections if not all corrections are equal.
+    */
+    class CandidateCorrectionAggregator{
+    public:
+        CandidateCorrectionAggregator(int numThreads)
+            : shards(computeNumShards(numThreads))
+        {
+            numShardsLog2 = 0;
+            while((std::size_t(1) << numShardsLog2) < shards.size()){
+                numShardsLog2++;
+            }
+        }
+
+        /*
+            tcs must be a candidate correction. If the table exceeds its memory limit, the aggregated corrections 
+            of the shard of tcs are appended to overflow, and must be stored as partial results by the caller.
+        */
+        void add(const TempCorrectedSequence& tcs, SerializedCorrectionBatch& overflow){
+            assert(tcs.type == TempCorrectedSequenceType::Candidate);
+
+            //serialize outside of the lock
+            thread_local std::vector<std::uint8_t> serialized;
+            serialized.resize(tcs.getSerializedNumBytes());
+            auto end = tcs.copyToContiguousMemory(serialized.data(), serialized.data() + serialized.size());
+            assert(end != nullptr);
+            (void)end;
+
+            Shard& shard = shards[getShard(tcs.readId)];
+            std::lock_guard<std::mutex> lg(shard.mutex);
+
+            const std::size_t bytesBefore = shard.getMemoryInBytes();
+
+            shard.numAddedCorrections++;
+
+            //record offsets are 32 bit
+            if(shard.records.size() + serialized.size() > std::numeric_limits<std::uint32_t>::max()){
+                flushShard(shard, overflow);
+            }
+
+            Slot& slot = findOrInsertSlot(shard, tcs.readId);
+
+            if(slot.numCorrections == 0){
+                slot.firstOffset = appendRecord(shard, serialized);
+                slot.numCorrections = 1;
+            }else if(slot.numCorrections == 1){
+                slot.secondOffset = appendRecord(shard, serialized);
+                slot.numCorrections = 2;
+                slot.hasDifferentCorrections = !isEqualCorrection(shard.records.data() + slot.firstOffset, serialized.data());
+            }else if(!slot.hasDifferentCorrections){
+                if(!isEqualCorrection(shard.records.data() + slot.firstOffset, serialized.data())){
+                    slot.secondOffset = appendRecord(shard, serialized);
+                    slot.hasDifferentCorrections = true;
+                }
+            }
+
+            updateMemory(bytesBefore, shard.getMemoryInBytes());
+
+            if(memoryBytes.load(std::memory_order_relaxed) > memoryLimit.load(std::memory_order_relaxed)){
+                const std::size_t bytesBeforeFlush = shard.getMemoryInBytes();
+                flushShard(shard, overflow);
+                updateMemory(bytesBeforeFlush, shard.getMemoryInBytes());
+            }
+        }
+
+        /*
+            Insert the remaining candidate corrections into partialResults, and clear the table.
+            Candidate corrections of reads which have been corrected as high quality anchor, or which could not be corrected
+            as anchor, are not used during merging and are discarded. Must not be called concurrently to add.
+            If originalReadIds is not null, the corrections are stored for the original reads of each read 
+            (see CpuReadStorage::getOriginalReadIds and getOriginalReadIdOffsets).
+        */
+        void moveToPartialResults(
+            SerializedObjectStorage& partialResults, 
+            const ReadCorrectionFlags& correctionFlags, 
+            const read_number* originalReadIds = nullptr,
+            const read_number* originalReadIdOffsets = nullptr
+        ){
+            auto insert = [&](std::uint8_t* begin){
+                std::uint8_t* const end = begin + getSerializedNumBytes(begin);
+                if(originalReadIds == nullptr){
+                    partialResults.insert(begin, end);
+                    numStoredCorrections++;
+                }else{
+                    SerializedCorrectionBatch::forEachOriginalReadId(begin, end, originalReadIds, originalReadIdOffsets, 
+                        [&](const std::uint8_t* b, const std::uint8_t* e){
+                            partialResults.insert(b, e);
+                            numStoredCorrections++;
+                        }
+                    );
+                }
+            };
+
+            for(auto& shard : shards){
+                for(const Slot& slot : shard.slots){
+                    if(slot.numCorrections == 0){
+                        continue;
+                    }
+                    if(correctionFlags.isCorrectedAsHQAnchor(slot.readId) || correctionFlags.isNotCorrectedAsAnchor(slot.readId)){
+                        continue;
+                    }
+
+                    insert(shard.records.data() + slot.firstOffset);
+
+                    if(slot.numCorrections > 1){
+                        insert(shard.records.data() + slot.secondOffset);
+                    }
+                }
+
+                clearShard(shard);
+            }
+
+            memoryBytes = 0;
+        }
+
+        //may be called concurrently to add
+        std::size_t getMemoryInBytes() const noexcept{
+            return memoryBytes.load(std::memory_order_relaxed);
+        }
+
+        //may be called concurrently to add
+        void setMemoryLimit(std::size_t bytes) noexcept{
+            memoryLimit.store(bytes, std::memory_order_relaxed);
+        }
+
+        void printStatistics(std::ostream& os) const{
+            std::size_t numAddedCorrections = 0;
+            std::size_t numFlushedCorrections = 0;
+            for(const auto& shard : shards){
+                numAddedCorrections += shard.numAddedCorrections;
+                numFlushedCorrections += shard.numFlushedCorrections;
+            }
+
+            os << "Aggregated " << numAddedCorrections << " candidate corrections into " 
+                << (numStoredCorrections + numFlushedCorrections) << " partial results";
+            if(numFlushedCorrections > 0){
+                os << ", " << numFlushedCorrections << " of them were stored early because of the memory limit";
+            }
+            os << "\n";
+        }
+
+    private:
+        //slot is empty if numCorrections == 0
+        struct Slot{
+            read_number readId;
+            std::uint16_t numCorrections; //at most 2
+            std::uint16_t hasDifferentCorrections;
+            std::uint32_t firstOffset;
+            std::uint32_t secondOffset;
+        };
+
+        static_assert(sizeof(Slot) == 16);
+
+        struct alignas(64) Shard{
+            std::mutex mutex{};
+            //linear probing. the number of slots is 0 or a power of two, and at most half of the slots are occupied
+            std::vector<Slot> slots{};
+            std::size_t numOccupiedSlots = 0;
+            std::vector<std::uint8_t> records{};
+            std::size_t numAddedCorrections = 0;
+            std::size_t numFlushedCorrections = 0;
+
+            std::size_t getMemoryInBytes() const noexcept{
+                return slots.capacity() * sizeof(Slot) + records.capacity();
+            }
+        };
+
+        static std::size_t computeNumShards(int numThreads){
+            std::size_t num = 1;
+            while(num < std::size_t(64) * std::max(1, numThreads)){
+                num *= 2;
+            }
+            return num;
+        }
+
+        static std::uint64_t hashReadId(read_number readId) noexcept{
+            return std::uint64_t(readId) * 11400714819323198485ull;
+        }
+
+        //the upper bits of the hash select the shard, the lower bits select the slot
+        std::size_t getShard(read_number readId) const noexcept{
+            if(numShardsLog2 == 0) return 0;
+
+            return hashReadId(readId) >> (64 - numShardsLog2);
+        }
+
+        static std::size_t getFirstSlot(read_number readId, std::size_t numSlots) noexcept{
+            return (hashReadId(readId) >> 16) & (numSlots - 1);
+        }
+
+        static Slot& findOrInsertSlot(Shard& shard, read_number readId){
+            if(2 * (shard.numOccupiedSlots + 1) > shard.slots.size()){
+                std::vector<Slot> newSlots(std::max(std::size_t(16), 2 * shard.slots.size()), Slot{0, 0, 0, 0, 0});
+                for(const Slot& slot : shard.slots){
+                    if(slot.numCorrections != 0){
+                        std::size_t i = getFirstSlot(slot.readId, newSlots.size());
+                        while(newSlots[i].numCorrections != 0){
+                            i = (i + 1) & (newSlots.size() - 1);
+                        }
+                        newSlots[i] = slot;
+                    }
+                }
+                std::swap(shard.slots, newSlots);
+            }
+
+            const std::size_t mask = shard.slots.size() - 1;
+            std::size_t i = getFirstSlot(readId, shard.slots.size());
+            while(shard.slots[i].numCorrections != 0){
+                if(shard.slots[i].readId == readId){
+                    return shard.slots[i];
+                }
+                i = (i + 1) & mask;
+            }
+
+            shard.numOccupiedSlots++;
+            shard.slots[i].readId = readId;
+            return shard.slots[i];
+        }
+
+        static std::uint32_t appendRecord(Shard& shard, const std::vector<std::uint8_t>& serialized){
+            const std::uint32_t offset = shard.records.size();
+            shard.records.insert(shard.records.end(), serialized.begin(), serialized.end());
+            return offset;
+        }
+
+        static void clearShard(Shard& shard){
+            std::vector<Slot>{}.swap(shard.slots);
+            std::vector<std::uint8_t>{}.swap(shard.records);
+            shard.numOccupiedSlots = 0;
+        }
+
+        static void flushShard(Shard& shard, SerializedCorrectionBatch& overflow){
+            for(const Slot& slot : shard.slots){
+                if(slot.numCorrections == 0){
+                    continue;
+                }
+
+                const std::uint8_t* const first = shard.records.data() + slot.firstOffset;
+                overflow.appendSerialized(first, first + getSerializedNumBytes(first));
+                shard.numFlushedCorrections++;
+
+                if(slot.numCorrections > 1){
+                    const std::uint8_t* const second = shard.records.data() + slot.secondOffset;
+                    overflow.appendSerialized(second, second + getSerializedNumBytes(second));
+                    shard.numFlushedCorrections++;
+                }
+            }
+
+            clearShard(shard);
+        }
+
+        void updateMemory(std::size_t bytesBefore, std::size_t bytesAfter) noexcept{
+            if(bytesAfter >= bytesBefore){
+                memoryBytes.fetch_add(bytesAfter - bytesBefore, std::memory_order_relaxed);
+            }else{
+                memoryBytes.fetch_sub(bytesBefore - bytesAfter, std::memory_order_relaxed);
+            }
+        }
+
+        static constexpr std::uint32_t numBytesMask = (std::uint32_t(1) << 29) - 1;
+        static constexpr std::size_t headerBytes = sizeof(read_number) + sizeof(std::uint32_t);
+
+        static std::size_t getSerializedNumBytes(const std::uint8_t* ptr){
+            std::uint32_t flags;
+            std::memcpy(&flags, ptr + sizeof(read_number), sizeof(std::uint32_t));
+            return headerBytes + (flags & numBytesMask);
+        }
+
+        //compare serialized candidate corrections of the same read, ignoring the shift
+        static bool isEqualCorrection(const std::uint8_t* lhs, const std::uint8_t* rhs){
+            std::uint32_t lflags;
+            std::uint32_t rflags;
+            std::memcpy(&lflags, lhs + sizeof(read_number), sizeof(std::uint32_t));
+            std::memcpy(&rflags, rhs + sizeof(read_number), sizeof(std::uint32_t));
+
+            if(lflags != rflags){
+                return false;
+            }
+
+            const std::size_t dataBytesWithoutShift = (lflags & numBytesMask) - sizeof(int);
+
+            return std::memcmp(lhs + headerBytes, rhs + headerBytes, dataBytesWithoutShift) == 0;
+        }
+
+        int numShardsLog2{};
+        std::vector<Shard> shards{};
+        std::size_t numStoredCorrections{0};
+        std::atomic<std::size_t> memoryBytes{0};
+        std::atomic<std::size_t> memoryLimit{std::numeric_limits<std::size_t>::max()};
+    };
+
+}
+
+#endif
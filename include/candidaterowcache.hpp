@@ -0,0 +1,238 @@
+#ifndef CARE_CANDIDATEROWCACHE_HPP
+#define CARE_CANDIDATEROWCACHE_HPP
+
+#include <config.hpp>
+
+#include <cpureadstorage.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace care{
+
+    /*
+        Direct-mapped cache of read rows which is used by a single thread, keyed by read id.
+
+        Neighbouring anchors share most of their candidates, which would otherwise be gathered from the read storage
+        again and again. The cache stores the sequence length and the 2-bit encoded sequence of a read,
+        and independently the decoded quality scores, so quality scores do not need to be decompressed on each access.
+
+        Reads which are not found in the cache are gathered from the read storage with a single call per request
+        and replace the previous entries in their slots.
+    */
+    class CandidateRowCache{
+    public:
+        struct Statistics{
+            std::size_t sequenceHits = 0;
+            std::size_t sequenceMisses = 0;
+            std::size_t qualityHits = 0;
+            std::size_t qualityMisses = 0;
+
+            Statistics& operator+=(const Statistics& rhs) noexcept{
+                sequenceHits += rhs.sequenceHits;
+                sequenceMisses += rhs.sequenceMisses;
+                qualityHits += rhs.qualityHits;
+                qualityMisses += rhs.qualityMisses;
+
+                return *this;
+            }
+
+            void print(std::ostream& os) const{
+                auto percent = [](std::size_t hits, std::size_t misses){
+                    return (hits + misses) > 0 ? 100.0 * hits / (hits + misses) : 0.0;
+                };
+
+                const auto oldPrecision = os.precision();
+
+                os << "# candidate row cache: sequence hit rate " << std::fixed << std::setprecision(2)
+                    << percent(sequenceHits, sequenceMisses) << " % (" << sequenceHits << " / " << (sequenceHits + sequenceMisses) << "), "
+                    << "quality hit rate " << percent(qualityHits, qualityMisses) << " % ("
+                    << qualityHits << " / " << (qualityHits + qualityMisses) << ")\n";
+
+                os << std::defaultfloat << std::setprecision(oldPrecision);
+            }
+        };
+
+        CandidateRowCache() = default;
+
+        //numRows is rounded up to the next power of two. numRows == 0 disables the cache
+        CandidateRowCache(std::size_t numRows, std::size_t encodedSequencePitchInInts_, std::size_t qualityPitchInBytes_)
+            : encodedSequencePitchInInts(encodedSequencePitchInInts_),
+            qualityPitchInBytes(qualityPitchInBytes_)
+        {
+            if(numRows > 0){
+                numSlotsLog2 = 0;
+                while((std::size_t(1) << numSlotsLog2) < numRows){
+                    numSlotsLog2++;
+                }
+                const std::size_t numSlots = std::size_t(1) << numSlotsLog2;
+
+                sequenceTags.resize(numSlots, invalidTag);
+                sequenceLengths.resize(numSlots);
+                sequences.resize(numSlots * encodedSequencePitchInInts);
+                qualityTags.resize(numSlots, invalidTag);
+                qualities.resize(numSlots * qualityPitchInBytes);
+            }
+        }
+
+        bool isEnabled() const noexcept{
+            return sequenceTags.size() > 0;
+        }
+
+        const Statistics& getStatistics() const noexcept{
+            return statistics;
+        }
+
+        //same semantics as readStorage.gatherSequenceLengths + readStorage.gatherSequences
+        void gatherSequences(
+            const CpuReadStorage& readStorage,
+            int* lengthsOutput,
+            unsigned int* sequencesOutput,
+            std::size_t outputPitchInInts,
+            const read_number* readIds,
+            int numIds
+        ){
+            assert(outputPitchInInts >= encodedSequencePitchInInts);
+
+            if(!isEnabled()){
+                readStorage.gatherSequenceLengths(lengthsOutput, readIds, numIds);
+                readStorage.gatherSequences(sequencesOutput, outputPitchInInts, readIds, numIds);
+                return;
+            }
+
+            missPositions.clear();
+            missIds.clear();
+
+            for(int i = 0; i < numIds; i++){
+                const std::size_t slot = getSlot(readIds[i]);
+                if(sequenceTags[slot] == readIds[i]){
+                    lengthsOutput[i] = sequenceLengths[slot];
+                    std::copy_n(
+                        sequences.data() + slot * encodedSequencePitchInInts,
+                        encodedSequencePitchInInts,
+                        sequencesOutput + i * outputPitchInInts
+                    );
+                }else{
+                    missPositions.push_back(i);
+                    missIds.push_back(readIds[i]);
+                }
+            }
+
+            const int numMisses = missIds.size();
+            statistics.sequenceHits += numIds - numMisses;
+            statistics.sequenceMisses += numMisses;
+
+            if(numMisses == 0) return;
+
+            missLengths.resize(numMisses);
+            missSequences.resize(numMisses * encodedSequencePitchInInts);
+
+            readStorage.gatherSequenceLengths(missLengths.data(), missIds.data(), numMisses);
+            readStorage.gatherSequences(missSequences.data(), encodedSequencePitchInInts, missIds.data(), numMisses);
+
+            for(int m = 0; m < numMisses; m++){
+                const int i = missPositions[m];
+                const std::size_t slot = getSlot(missIds[m]);
+                const unsigned int* row = missSequences.data() + m * encodedSequencePitchInInts;
+
+                sequenceTags[slot] = missIds[m];
+                sequenceLengths[slot] = missLengths[m];
+                std::copy_n(row, encodedSequencePitchInInts, sequences.data() + slot * encodedSequencePitchInInts);
+
+                lengthsOutput[i] = missLengths[m];
+                std::copy_n(row, encodedSequencePitchInInts, sequencesOutput + i * outputPitchInInts);
+            }
+        }
+
+        //same semantics as readStorage.gatherQualities
+        void gatherQualities(
+            const CpuReadStorage& readStorage,
+            char* qualitiesOutput,
+            std::size_t outputPitchInBytes,
+            const read_number* readIds,
+            int numIds
+        ){
+            assert(outputPitchInBytes >= qualityPitchInBytes);
+
+            if(!isEnabled()){
+                readStorage.gatherQualities(qualitiesOutput, outputPitchInBytes, readIds, numIds);
+                return;
+            }
+
+            missPositions.clear();
+            missIds.clear();
+
+            for(int i = 0; i < numIds; i++){
+                const std::size_t slot = getSlot(readIds[i]);
+                if(qualityTags[slot] == readIds[i]){
+                    std::copy_n(
+                        qualities.data() + slot * qualityPitchInBytes,
+                        qualityPitchInBytes,
+                        qualitiesOutput + i * outputPitchInBytes
+                    );
+                }else{
+                    missPositions.push_back(i);
+                    missIds.push_back(readIds[i]);
+                }
+            }
+
+            const int numMisses = missIds.size();
+            statistics.qualityHits += numIds - numMisses;
+            statistics.qualityMisses += numMisses;
+
+            if(numMisses == 0) return;
+
+            missQualities.resize(numMisses * qualityPitchInBytes);
+
+            readStorage.gatherQualities(missQualities.data(), qualityPitchInBytes, missIds.data(), numMisses);
+
+            for(int m = 0; m < numMisses; m++){
+                const int i = missPositions[m];
+                const std::size_t slot = getSlot(missIds[m]);
+                const char* row = missQualities.data() + m * qualityPitchInBytes;
+
+                qualityTags[slot] = missIds[m];
+                std::copy_n(row, qualityPitchInBytes, qualities.data() + slot * qualityPitchInBytes);
+
+                std::copy_n(row, qualityPitchInBytes, qualitiesOutput + i * outputPitchInBytes);
+            }
+        }
+
+    private:
+        static constexpr read_number invalidTag = std::numeric_limits<read_number>::max();
+
+        //fibonacci hashing. avoids that the two reads of a pair, or ids with a common stride, map to the same slots
+        std::size_t getSlot(read_number readId) const noexcept{
+            if(numSlotsLog2 == 0) return 0;
+
+            const std::uint64_t h = std::uint64_t(readId) * 11400714819323198485ull;
+            return h >> (64 - numSlotsLog2);
+        }
+
+        std::size_t encodedSequencePitchInInts{};
+        std::size_t qualityPitchInBytes{};
+        int numSlotsLog2{};
+
+        std::vector<read_number> sequenceTags{};
+        std::vector<int> sequenceLengths{};
+        std::vector<unsigned int> sequences{};
+        std::vector<read_number> qualityTags{};
+        std::vector<char> qualities{};
+
+        std::vector<int> missPositions{};
+        std::vector<read_number> missIds{};
+        std::vector<int> missLengths{};
+        std::vector<unsigned int> missSequences{};
+        std::vector<char> missQualities{};
+
+        Statistics statistics{};
+    };
+
+}
+
+#endif
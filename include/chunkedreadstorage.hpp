@@ -8,9 +8,15 @@
 #include <sequencehelpers.hpp>
 #include <concurrencyhelpers.hpp>
 #include <lengthstorage.hpp>
+#include <variablepitchrows.hpp>
+#include <mappedfile.hpp>
 #include <cpureadstorage.hpp>
 #include <memorymanagement.hpp>
+#include <memoryplacement.hpp>
 #include <qualityscorecompression.hpp>
+#include <ransqualitystorage.hpp>
+#include <readheaderstorage.hpp>
+#include <parallelradixsort.hpp>
 #include <sharedmutex.hpp>
 
 #include <unordered_set>
@@ -23,8 +29,12 @@
 #include <future>
 #include <limits>
 #include <map>
+#include <memory>
 #include <set>
 #include <numeric>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
 
 namespace care{
 
@@ -85,6 +95,30 @@ public:
         ambigReadIds.insert(ambiguousIds.begin(), ambiguousIds.end());
     }
 
+    //read headers are stored if this is called before reads are appended
+    void enableReadHeaders(){
+        readHeaderStorage = std::make_unique<ReadHeaderStorage>();
+    }
+
+    //encodedHeaders of reads [firstReadId, firstReadId + numReads), encoded by ReadHeaderChunkEncoder
+    void appendReadHeaders(
+        read_number firstReadId,
+        int numReads,
+        std::vector<std::uint8_t> encodedHeaders
+    ){
+        assert(readHeaderStorage != nullptr);
+        readHeaderStorage->appendChunk(firstReadId, numReads, std::move(encodedHeaders));
+    }
+
+    //nullptr if read headers are not stored
+    ReadHeaderStorage* getReadHeaderStorage() noexcept{
+        return readHeaderStorage.get();
+    }
+
+    const ReadHeaderStorage* getReadHeaderStorage() const noexcept{
+        return readHeaderStorage.get();
+    }
+
     void appendingFinished(
         std::size_t memoryLimitBytes
     ){
@@ -147,6 +181,10 @@ public:
         deallocVector(sequenceStorageAppend);
         deallocVector(qualityStorageAppend);
 
+        if(readHeaderStorage){
+            readHeaderStorage->appendingFinished();
+        }
+
 
 
         compactSequences(memoryLimitBytes);
@@ -157,245 +195,350 @@ public:
 
     }
 
-    void loadFromFile(const std::string& filename){
-        std::ifstream stream(filename, std::ios::binary);
-        if(!stream)
-            throw std::runtime_error("Cannot open file " + filename);
+    /*
+        Returns the reads of readStorage, renumbered such that read newOrder[i] becomes read i. readStorage must have been finished
+        by appendingFinished, and is released before the renumbered reads are compacted.
+        Reads which are likely to overlap should be adjacent in newOrder, e.g. sorted by min-hash, such that candidates
+        of an anchor and the reads of hash table buckets are close in memory. Mates of a pair must stay adjacent.
+
+        The original read ids are kept (getOriginalReadIds / getInternalReadIds) to restore the input order in the output.
+        Read headers are not renumbered.
+    */
+    static std::unique_ptr<ChunkedReadStorage> reorderReads(
+        std::unique_ptr<ChunkedReadStorage> readStorage,
+        const std::vector<read_number>& newOrder, 
+        std::size_t memoryLimitBytes, 
+        int numThreads
+    ){
+        assert(newOrder.size() == readStorage->getNumberOfReads());
 
-        destroy();
+        std::vector<read_number> groupOffsets(newOrder.size() + 1);
+        std::iota(groupOffsets.begin(), groupOffsets.end(), read_number(0));
 
-        std::size_t loaded_numreads = 0;
-        int loaded_sequenceLengthLowerBound = 0;
-        int loaded_sequenceLengthUpperBound = 0;
-        bool loaded_hasQualityScores = false;        
-        int loaded_numQualityBits = 0;
-
-        stream.read(reinterpret_cast<char*>(&loaded_numreads), sizeof(std::size_t));
-        stream.read(reinterpret_cast<char*>(&loaded_sequenceLengthLowerBound), sizeof(int));
-        stream.read(reinterpret_cast<char*>(&loaded_sequenceLengthUpperBound), sizeof(int));            
-        stream.read(reinterpret_cast<char*>(&loaded_hasQualityScores), sizeof(bool));
-        stream.read(reinterpret_cast<char*>(&loaded_numQualityBits), sizeof(int));        
+        return regroupReads(std::move(readStorage), newOrder, groupOffsets, memoryLimitBytes, numThreads);
+    }
 
-        std::size_t lengthsBytes = 0;
-        std::size_t sequencesBytes = 0;
-        std::size_t qualitiesBytes = 0;       
-        std::size_t ambigBytes = 0;
+    /*
+        Returns the reads of readStorage where reads with identical sequences are stored only once. 
+        The remaining read of a group of duplicates is the one with the smallest read id, including its quality scores.
+        The order of the remaining reads is not changed. Reads with ambiguous bases are not collapsed. Single-end reads only.
+
+        Duplicates are found by sorting the hash values of the 2-bit encoded sequences. Reads with equal hash values are compared.
+        getOriginalReadIdOffsets gives the number of original reads of each read, and corrections are stored for each original read.
+        If quality scores are used, the read headers are released, because the quality scores of the duplicates are discarded.
+    */
+    static std::unique_ptr<ChunkedReadStorage> collapseDuplicateReads(
+        std::unique_ptr<ChunkedReadStorage> readStorage,
+        std::size_t memoryLimitBytes, 
+        int numThreads
+    ){
+        assert(!readStorage->isPairedEnd());
 
-        stream.read(reinterpret_cast<char*>(&lengthsBytes), sizeof(std::size_t));
-        stream.read(reinterpret_cast<char*>(&sequencesBytes), sizeof(std::size_t));
-        stream.read(reinterpret_cast<char*>(&qualitiesBytes), sizeof(std::size_t));
-        stream.read(reinterpret_cast<char*>(&ambigBytes), sizeof(std::size_t));
+        const std::size_t numReads = readStorage->getNumberOfReads();
+        const std::size_t sequencePitchInInts = SequenceHelpers::getEncodedNumInts2Bit(readStorage->getSequenceLengthUpperBound());
 
-        totalNumberOfReads = loaded_numreads;
-        offsetsPrefixSum = {0, totalNumberOfReads};
+        constexpr std::size_t chunksize = 65536;
+        const std::size_t numChunks = SDIV(numReads, chunksize);
 
-        lengthStorage.readFromStream(stream);
+        std::vector<std::uint64_t> hashes(numReads);
+        std::vector<read_number> sortedReadIds(numReads);
+        std::vector<char> isAmbiguous(numReads);
 
-        hasShrinkedSequences = true;
-        stream.read(reinterpret_cast<char*>(&encodedSequencePitchInInts), sizeof(std::size_t));
-        std::size_t numsequencedataelements = 0;
-        stream.read(reinterpret_cast<char*>(&numsequencedataelements), sizeof(std::size_t));
-        shrinkedEncodedSequences.resize(numsequencedataelements);
-        stream.read(reinterpret_cast<char*>(shrinkedEncodedSequences.data()), numsequencedataelements * sizeof(unsigned int));
+        #pragma omp parallel for num_threads(numThreads) schedule(dynamic, 1)
+        for(std::size_t chunk = 0; chunk < numChunks; chunk++){
+            const read_number firstReadId = chunk * chunksize;
+            const int num = std::min(chunksize, numReads - firstReadId);
 
+            std::vector<read_number> readIds(num);
+            std::vector<int> lengths(num);
+            std::vector<unsigned int> sequences(num * sequencePitchInInts);
+            std::unique_ptr<bool[]> ambiguous = std::make_unique<bool[]>(num);
 
-        if(canUseQualityScores() && loaded_hasQualityScores){
-            //std::cerr << "load qualities\n";
+            std::iota(readIds.begin(), readIds.end(), firstReadId);
+            readStorage->gatherSequenceLengths(lengths.data(), readIds.data(), num);
+            readStorage->gatherContiguousSequences(sequences.data(), sequencePitchInInts, firstReadId, num);
+            readStorage->areSequencesAmbiguous(ambiguous.get(), readIds.data(), num);
 
-            if(loaded_numQualityBits != numQualityBits){
-                throw std::runtime_error("preprocessed reads file uses " + std::to_string(loaded_numQualityBits) 
-                    + " bits per quality score, but setting requires " + std::to_string(numQualityBits) + " bits. Abort.");
+            for(int i = 0; i < num; i++){
+                hashes[firstReadId + i] = hashEncodedSequence(sequences.data() + i * sequencePitchInInts, lengths[i]);
+                sortedReadIds[firstReadId + i] = firstReadId + i;
+                isAmbiguous[firstReadId + i] = ambiguous[i];
             }
+        }
 
-            hasShrinkedQualities = true;
-            stream.read(reinterpret_cast<char*>(&encodedqualityPitchInInts), sizeof(std::size_t));
-            std::size_t numqualitydataelements = 0;
-            stream.read(reinterpret_cast<char*>(&numqualitydataelements), sizeof(std::size_t));
-            shrinkedEncodedQualities.resize(numqualitydataelements);
-            stream.read(reinterpret_cast<char*>(shrinkedEncodedQualities.data()), numqualitydataelements * sizeof(unsigned int));
+        {
+            //the sort is stable, so reads with equal hash values are sorted by read id
+            std::vector<std::uint64_t> hashesTmp(numReads);
+            std::vector<read_number> readIdsTmp(numReads);
+            parallelRadixSortPairs(hashes.data(), sortedReadIds.data(), hashesTmp.data(), readIdsTmp.data(), numReads, numThreads);
+        }
 
-            numQualityBits = loaded_numQualityBits;
+        //beginning of each range of equal hash values with more than one read
+        std::vector<std::size_t> rangeBegins;
+        for(std::size_t i = 0; i + 1 < numReads; ){
+            std::size_t end = i + 1;
+            while(end < numReads && hashes[end] == hashes[i]){
+                end++;
+            }
+            if(end - i > 1){
+                rangeBegins.push_back(i);
+            }
+            i = end;
+        }
 
-        }else if(canUseQualityScores() && !loaded_hasQualityScores){
-                //std::cerr << "no q in bin file\n";
-                throw std::runtime_error("Quality scores expected in preprocessed reads file to load, but none are present. Abort.");
-        }else if(!canUseQualityScores() && loaded_hasQualityScores){
-                //std::cerr << "skip qualities\n";
-                stream.ignore(qualitiesBytes);
+        //read id of the remaining read of each read
+        std::vector<read_number> representatives(numReads);
+        std::iota(representatives.begin(), representatives.end(), read_number(0));
+
+        #pragma omp parallel num_threads(numThreads)
+        {
+            std::vector<int> lengths;
+            std::vector<unsigned int> sequences;
+            std::vector<int> candidates;
+
+            #pragma omp for schedule(dynamic, 16)
+            for(std::size_t r = 0; r < rangeBegins.size(); r++){
+                const std::size_t begin = rangeBegins[r];
+                std::size_t end = begin + 1;
+                while(end < numReads && hashes[end] == hashes[begin]){
+                    end++;
+                }
+                const int num = end - begin;
+                const read_number* const readIds = sortedReadIds.data() + begin;
+
+                lengths.resize(num);
+                sequences.resize(num * sequencePitchInInts);
+                readStorage->gatherSequenceLengths(lengths.data(), readIds, num);
+                readStorage->gatherSequences(sequences.data(), sequencePitchInInts, readIds, num);
+
+                //indices of reads in this range which are not a duplicate of a previous read
+                candidates.clear();
+                for(int i = 0; i < num; i++){
+                    if(isAmbiguous[readIds[i]]){
+                        continue;
+                    }
+                    const unsigned int* const sequence = sequences.data() + i * sequencePitchInInts;
+                    const int numInts = SequenceHelpers::getEncodedNumInts2Bit(lengths[i]);
+
+                    auto isEqual = [&](int k){
+                        return lengths[k] == lengths[i] 
+                            && std::equal(sequence, sequence + numInts, sequences.data() + k * sequencePitchInInts);
+                    };
+                    auto it = std::find_if(candidates.begin(), candidates.end(), isEqual);
+
+                    if(it == candidates.end()){
+                        candidates.push_back(i);
+                    }else{
+                        representatives[readIds[i]] = readIds[*it];
+                    }
+                }
+            }
+        }
 
-                numQualityBits = loaded_numQualityBits;
-        }else{
-            //!canUseQualityScores() && !loaded_hasQualityScores
-            //std::cerr << "no q in file, and no q required. Ok\n";
-            stream.ignore(qualitiesBytes);
+        //group of each read. groups are ordered by their first read id
+        std::vector<read_number> groupOffsets(1, 0);
+        std::vector<read_number> groupIds(numReads);
+        for(std::size_t i = 0; i < numReads; i++){
+            if(representatives[i] == i){
+                groupIds[i] = groupOffsets.size() - 1;
+                groupOffsets.push_back(1);
+            }else{
+                groupIds[i] = groupIds[representatives[i]];
+                groupOffsets[groupIds[i] + 1]++;
+            }
+        }
+        std::partial_sum(groupOffsets.begin(), groupOffsets.end(), groupOffsets.begin());
 
-            numQualityBits = loaded_numQualityBits;
+        std::vector<read_number> groupMembers(numReads);
+        {
+            std::vector<read_number> insertPositions(groupOffsets.begin(), groupOffsets.end() - 1);
+            for(std::size_t i = 0; i < numReads; i++){
+                groupMembers[insertPositions[groupIds[i]]++] = i;
+            }
         }
-        
 
-        std::size_t numAmbigDataElements = 0;
-        stream.read(reinterpret_cast<char*>(&numAmbigDataElements), sizeof(std::size_t));
+        std::cout << "Collapsed " << numReads << " reads into " << (groupOffsets.size() - 1) << " reads with distinct sequences\n";
 
-        std::vector<read_number> tmpambig(numAmbigDataElements);
-        stream.read(reinterpret_cast<char*>(tmpambig.data()), numAmbigDataElements * sizeof(read_number));
+        if(readStorage->readHeaderStorage && readStorage->canUseQualityScores()){
+            std::cout << "Stored read headers are released. The output will be constructed from the input files\n";
+            readStorage->readHeaderStorage.reset();
+        }
 
-        ambigReadIds.insert(tmpambig.begin(), tmpambig.end());
+        return regroupReads(std::move(readStorage), groupMembers, groupOffsets, memoryLimitBytes, numThreads);
     }
 
+    /*
+        Original read ids of each read if the reads have been renumbered by reorderReads or collapsed by collapseDuplicateReads. nullptr otherwise.
+        If getOriginalReadIdOffsets() is nullptr, read i is the original read getOriginalReadIds()[i]
+    */
+    const read_number* getOriginalReadIds() const override{
+        return originalReadIds.empty() ? nullptr : originalReadIds.data();
+    }
 
-    void saveToFile(const std::string& filename) const{
-        std::ofstream stream(filename, std::ios::binary);
-
-        std::size_t numReads = getNumberOfReads();
-        int sequenceLengthUpperBound = getSequenceLengthUpperBound();
-        int sequenceLengthLowerBound = getSequenceLengthLowerBound();
-        bool qual = canUseQualityScores();
-
-        stream.write(reinterpret_cast<const char*>(&numReads), sizeof(std::size_t));
-        stream.write(reinterpret_cast<const char*>(&sequenceLengthUpperBound), sizeof(int));
-        stream.write(reinterpret_cast<const char*>(&sequenceLengthLowerBound), sizeof(int));
-        stream.write(reinterpret_cast<const char*>(&qual), sizeof(bool));
-        stream.write(reinterpret_cast<const char*>(&numQualityBits), sizeof(int));
-
-        auto pos = stream.tellp();
-
-        stream.seekp(sizeof(std::size_t) * 4, std::ios_base::cur);
-
-        std::size_t lengthsBytes = lengthStorage.writeToStream(stream);
-
-        std::size_t writtenSequenceBytes = 0;
-        if(hasShrinkedSequences){
-
-            std::size_t pitch = encodedSequencePitchInInts;
-            stream.write(reinterpret_cast<const char*>(&pitch), sizeof(std::size_t));
-            writtenSequenceBytes += sizeof(std::size_t); //pitch
+    //if duplicates have been collapsed, the original reads of read i are getOriginalReadIds()[offsets[i]] to getOriginalReadIds()[offsets[i+1]-1]
+    const read_number* getOriginalReadIdOffsets() const override{
+        return originalReadIdOffsets.empty() ? nullptr : originalReadIdOffsets.data();
+    }
 
-            std::size_t numelements = shrinkedEncodedSequences.size();
-            stream.write(reinterpret_cast<const char*>(&numelements), sizeof(std::size_t));
-            writtenSequenceBytes += sizeof(std::size_t); //numdataelements
+    //read id of each original read id if the reads have been renumbered or collapsed. nullptr otherwise
+    const read_number* getInternalReadIds() const noexcept{
+        return internalReadIds.empty() ? nullptr : internalReadIds.data();
+    }
 
-            stream.write(reinterpret_cast<const char*>(shrinkedEncodedSequences.data()), numelements * sizeof(unsigned int));            
-            writtenSequenceBytes += numelements * sizeof(unsigned int); //dataelements
+    /*
+        Load a file which was written by saveToFile. The file is memory mapped and the reads are served directly 
+        from the mapping, i.e. pages are only read from disk when they are accessed, and processes which load the
+        same file share the pages in the page cache. Files of the previous, unversioned format are read into memory.
+    */
+    void loadFromFile(const std::string& filename){
+        std::array<char, 8> magic{};
+        {
+            std::ifstream stream(filename, std::ios::binary);
+            if(!stream)
+                throw std::runtime_error("Cannot open file " + filename);
+            stream.read(magic.data(), magic.size());
+        }
 
-            assert(numelements == getNumberOfReads() * pitch);
+        if(magic == binaryFileMagic){
+            loadFromMappedFile(filename);
         }else{
+            loadFromLegacyFile(filename);
+        }
+    }
 
-            std::size_t pitch = 0;
-            for(const auto& s : sequenceStorage){
-                pitch = std::max(pitch, s.encodedSequencePitchInInts);
-            }
-            stream.write(reinterpret_cast<const char*>(&pitch), sizeof(std::size_t));
-            writtenSequenceBytes += sizeof(std::size_t); //pitch
+    /*
+        The file consists of a BinaryFileHeader, followed by the sections in BinaryFileSection. 
+        Each section begins at a multiple of binaryFileSectionAlignment bytes, such that it can be used directly from a memory mapping.
+    */
+    void saveToFile(const std::string& filename) const{
+        std::ofstream stream(filename, std::ios::binary);
+        if(!stream)
+            throw std::runtime_error("Cannot open file " + filename);
 
-            auto numelementspos = stream.tellp();
-            stream.seekp(sizeof(std::size_t) * 1, std::ios_base::cur);
+        BinaryFileHeader header{};
+        header.magic = binaryFileMagic;
+        header.version = binaryFileVersion;
+        header.sectionAlignment = binaryFileSectionAlignment;
+        header.numReads = getNumberOfReads();
+        header.hasQualityScores = canUseQualityScores();
+        header.numQualityBits = numQualityBits;
+        header.minLength = getSequenceLengthLowerBound();
+        header.maxLength = getSequenceLengthUpperBound();
+        header.variablePitchSequences = hasVariablePitchSequences;
+        header.variablePitchQualities = hasVariablePitchQualities;
+        header.sequencePitchInInts = SequenceHelpers::getEncodedNumInts2Bit(getSequenceLengthUpperBound());
+        header.qualityPitchInInts = QualityCompressionHelper::getNumInts(getSequenceLengthUpperBound(), numQualityBits);
+        header.numAmbiguousReadIds = getNumberOfReadsWithN();
+
+        //header is written last
+        stream.seekp(sizeof(BinaryFileHeader));
+
+        auto writeSection = [&](BinaryFileSection section, auto writeData){
+            const std::size_t position = stream.tellp();
+            const std::size_t padding = (binaryFileSectionAlignment - position % binaryFileSectionAlignment) % binaryFileSectionAlignment;
+            const std::vector<char> zeros(padding, 0);
+            stream.write(zeros.data(), padding);
+
+            const std::size_t begin = position + padding;
+            writeData();
+            const std::size_t end = stream.tellp();
+
+            header.sectionOffsets[int(section)] = begin;
+            header.sectionBytes[int(section)] = end - begin;
+        };
 
-            std::size_t numelements = 0;
+        auto writeArray = [&](const auto* data, std::size_t numElements){
+            stream.write(reinterpret_cast<const char*>(data), sizeof(*data) * numElements);
+        };
 
-            for(std::size_t c = 0; c < sequenceStorage.size(); c++){
-                const auto& s = sequenceStorage[c];
-                const std::size_t numsequencesInChunk = s.encodedSequences.size() / s.encodedSequencePitchInInts;
-                
+        //rows of a chunked storage, padded to pitch
+        auto writeChunkRowsWithPitch = [&](const auto& chunks, auto getChunkData, auto getChunkPitch, std::size_t pitch){
+            std::vector<unsigned int> temp(pitch);
 
-                if(s.encodedSequencePitchInInts == pitch){
-                    stream.write(reinterpret_cast<const char*>(s.encodedSequences.data()), s.encodedSequences.size() * sizeof(unsigned int));
-                    writtenSequenceBytes += s.encodedSequences.size() * sizeof(unsigned int); //dataelements
-                    numelements += s.encodedSequences.size();
-                }else{
-                    std::vector<unsigned int> temp(pitch);
+            for(const auto& chunk : chunks){
+                const std::vector<unsigned int>& data = getChunkData(chunk);
+                const std::size_t chunkPitch = getChunkPitch(chunk);
 
-                    for(std::size_t i = 0; i < numsequencesInChunk; i++){
-                        std::copy_n(s.encodedSequences.data() + i * s.encodedSequencePitchInInts, s.encodedSequencePitchInInts, temp.begin());
-                        stream.write(reinterpret_cast<const char*>(temp.data()), temp.size() * sizeof(unsigned int));
-                        writtenSequenceBytes += temp.size() * sizeof(unsigned int); //dataelements
-                        numelements += temp.size();
+                if(chunkPitch == pitch){
+                    writeArray(data.data(), data.size());
+                }else{
+                    const std::size_t numRows = data.size() / chunkPitch;
+                    for(std::size_t i = 0; i < numRows; i++){
+                        std::fill(temp.begin(), temp.end(), 0);
+                        std::copy_n(data.data() + i * chunkPitch, chunkPitch, temp.begin());
+                        writeArray(temp.data(), temp.size());
                     }
                 }
             }
+        };
 
-            assert(numelements == getNumberOfReads() * pitch);
-
-            auto curpos = stream.tellp();
-            stream.seekp(numelementspos);
-            stream.write(reinterpret_cast<const char*>(&numelements), sizeof(std::size_t));
-            writtenSequenceBytes += sizeof(std::size_t); //numdataelements
-            stream.seekp(curpos);
-        }
-
-
-        std::size_t writtenQualityBytes = 0;
-        if(hasShrinkedQualities){
-
-            std::size_t pitch = encodedqualityPitchInInts;
-            stream.write(reinterpret_cast<const char*>(&pitch), sizeof(std::size_t));
-            writtenQualityBytes += sizeof(std::size_t); //pitch
-
-            std::size_t numelements = shrinkedEncodedQualities.size();
-            stream.write(reinterpret_cast<const char*>(&numelements), sizeof(std::size_t));
-            writtenQualityBytes += sizeof(std::size_t); //numdataelements
-
-            stream.write(reinterpret_cast<const char*>(shrinkedEncodedQualities.data()), numelements * sizeof(unsigned int));            
-            writtenQualityBytes += numelements * sizeof(unsigned int); //dataelements
-
-            assert(numelements == getNumberOfReads() * pitch);
+        writeSection(BinaryFileSection::Lengths, [&](){
+            writeArray(lengthStorage.getRaw(), lengthStorage.getRawSizeInElements());
+        });
+
+        if(hasVariablePitchSequences){
+            const auto& rows = variablePitchEncodedSequences;
+            writeSection(BinaryFileSection::Sequences, [&](){ writeArray(rows.getData(), rows.getNumInts()); });
+            writeSection(BinaryFileSection::SequenceRowOffsets, [&](){ writeArray(rows.getRelativeOffsets(), rows.getNumRows() + 1); });
+            writeSection(BinaryFileSection::SequenceGroupOffsets, [&](){ writeArray(rows.getGroupOffsets(), VariablePitchRows::getNumGroupOffsets(rows.getNumRows())); });
+        }else if(hasShrinkedSequences){
+            assert(encodedSequencePitchInInts == header.sequencePitchInInts);
+            writeSection(BinaryFileSection::Sequences, [&](){ writeArray(getShrinkedSequenceData(), getNumberOfReads() * encodedSequencePitchInInts); });
         }else{
+            writeSection(BinaryFileSection::Sequences, [&](){
+                writeChunkRowsWithPitch(
+                    sequenceStorage,
+                    [](const auto& s) -> const auto& { return s.encodedSequences; },
+                    [](const auto& s){ return s.encodedSequencePitchInInts; },
+                    header.sequencePitchInInts
+                );
+            });
+        }
 
-            std::size_t pitch = 0;
-            for(const auto& q : qualityStorage){
-                pitch = std::max(pitch, q.encodedqualityPitchInInts);
-            }
-            stream.write(reinterpret_cast<const char*>(&pitch), sizeof(std::size_t));
-            writtenQualityBytes += sizeof(std::size_t); //pitch
-
-            auto numelementspos = stream.tellp();
-            stream.seekp(sizeof(std::size_t) * 1, std::ios_base::cur);
-
-            std::size_t numelements = 0;
-
-            for(std::size_t c = 0; c < qualityStorage.size(); c++){
-                const auto& q = qualityStorage[c];
-                const std::size_t numsequencesInChunk = q.encodedqualities.size() / q.encodedqualityPitchInInts;
-                
-
-                if(q.encodedqualityPitchInInts == pitch){
-                    stream.write(reinterpret_cast<const char*>(q.encodedqualities.data()), q.encodedqualities.size() * sizeof(unsigned int));
-                    writtenQualityBytes += q.encodedqualities.size() * sizeof(unsigned int); //dataelements
-                    numelements += q.encodedqualities.size();
-                }else{
-                    std::vector<unsigned int> temp(pitch);
-
-                    for(std::size_t i = 0; i < numsequencesInChunk; i++){
-                        std::copy_n(q.encodedqualities.data() + i * q.encodedqualityPitchInInts, q.encodedqualityPitchInInts, temp.begin());
-                        stream.write(reinterpret_cast<const char*>(temp.data()), temp.size() * sizeof(unsigned int));
-                        writtenQualityBytes += temp.size() * sizeof(unsigned int); //dataelements
-                        numelements += temp.size();
+        if(canUseQualityScores()){
+            if(hasRansQualities){
+                //the file format has no entropy coded qualities. they are decoded to fixed pitch rows
+                writeSection(BinaryFileSection::Qualities, [&](){
+                    constexpr read_number batchsize = 65536;
+                    std::vector<unsigned int> temp(batchsize * header.qualityPitchInInts);
+                    for(read_number first = 0; first < getNumberOfReads(); first += batchsize){
+                        const read_number num = std::min(batchsize, getNumberOfReads() - first);
+                        gatherContiguousEncodedQualities(temp.data(), header.qualityPitchInInts, first, num);
+                        writeArray(temp.data(), num * header.qualityPitchInInts);
                     }
-                }
+                });
+            }else if(hasVariablePitchQualities){
+                const auto& rows = variablePitchEncodedQualities;
+                writeSection(BinaryFileSection::Qualities, [&](){ writeArray(rows.getData(), rows.getNumInts()); });
+                writeSection(BinaryFileSection::QualityRowOffsets, [&](){ writeArray(rows.getRelativeOffsets(), rows.getNumRows() + 1); });
+                writeSection(BinaryFileSection::QualityGroupOffsets, [&](){ writeArray(rows.getGroupOffsets(), VariablePitchRows::getNumGroupOffsets(rows.getNumRows())); });
+            }else if(hasShrinkedQualities){
+                assert(encodedqualityPitchInInts == header.qualityPitchInInts);
+                writeSection(BinaryFileSection::Qualities, [&](){ writeArray(getShrinkedQualityData(), getNumberOfReads() * encodedqualityPitchInInts); });
+            }else{
+                writeSection(BinaryFileSection::Qualities, [&](){
+                    writeChunkRowsWithPitch(
+                        qualityStorage,
+                        [](const auto& q) -> const auto& { return q.encodedqualities; },
+                        [](const auto& q){ return q.encodedqualityPitchInInts; },
+                        header.qualityPitchInInts
+                    );
+                });
             }
-
-            assert(numelements == getNumberOfReads() * pitch);
-
-            auto curpos = stream.tellp();
-            stream.seekp(numelementspos);
-            stream.write(reinterpret_cast<const char*>(&numelements), sizeof(std::size_t));
-            writtenQualityBytes += sizeof(std::size_t); //numdataelements
-            stream.seekp(curpos);
         }
 
-        std::size_t numUndeterminedReads = ambigReadIds.size();
-        std::vector<read_number> ambigtemp(ambigReadIds.begin(), ambigReadIds.end());
-
-        stream.write(reinterpret_cast<const char*>(&numUndeterminedReads), sizeof(size_t));
-        stream.write(reinterpret_cast<const char*>(ambigtemp.data()), numUndeterminedReads * sizeof(read_number));
+        writeSection(BinaryFileSection::AmbiguousReadIds, [&](){
+            std::vector<read_number> ids(getNumberOfReadsWithN());
+            getIdsOfAmbiguousReads(ids.data());
+            std::sort(ids.begin(), ids.end());
+            writeArray(ids.data(), ids.size());
+        });
 
-        std::size_t ambigBytes = sizeof(std::size_t) + numUndeterminedReads * sizeof(read_number);
-
-        stream.seekp(pos);
-        stream.write(reinterpret_cast<const char*>(&lengthsBytes), sizeof(std::size_t));
-        stream.write(reinterpret_cast<const char*>(&writtenSequenceBytes), sizeof(std::size_t));
-        stream.write(reinterpret_cast<const char*>(&writtenQualityBytes), sizeof(std::size_t));
-        stream.write(reinterpret_cast<const char*>(&ambigBytes), sizeof(std::size_t));
+        stream.seekp(0);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(BinaryFileHeader));
 
+        if(!stream)
+            throw std::runtime_error("Cannot write file " + filename);
     }
 
 public: //inherited interface
@@ -406,7 +549,12 @@ public: //inherited interface
         int numSequences
     ) const override{
         if(numSequences > 0){
-            if(getNumberOfReadsWithN() > 0){
+            if(numMappedAmbiguousReadIds > 0){
+                const read_number* const end = mappedAmbiguousReadIds + numMappedAmbiguousReadIds;
+                for(int i = 0; i < numSequences; i++){
+                    result[i] = std::binary_search(mappedAmbiguousReadIds, end, readIds[i]);
+                }
+            }else if(getNumberOfReadsWithN() > 0){
                 for(int i = 0; i < numSequences; i++){
                     auto it = ambigReadIds.find(readIds[i]);
                     result[i] = (it != ambigReadIds.end());
@@ -432,11 +580,37 @@ public: //inherited interface
 
         constexpr int prefetch_distance = 4;
 
-        if(hasShrinkedSequences){
+        if(hasVariablePitchSequences){
+            for(int i = 0; i < numSequences && i < prefetch_distance; ++i) {
+                const int index = i;
+                const std::size_t nextReadId = readIds[index];
+                const unsigned int* const nextData = variablePitchEncodedSequences.getRow(nextReadId);
+                __builtin_prefetch(nextData, 0, 0);
+            }
+
+            std::size_t destinationPitchBytes = outSequencePitchInInts * sizeof(unsigned int);
+
+            for(int i = 0; i < numSequences; i++){
+                if(i + prefetch_distance < numSequences) {
+                    const int index = i + prefetch_distance;
+                    const std::size_t nextReadId = readIds[index];
+                    const unsigned int* const nextData = variablePitchEncodedSequences.getRow(nextReadId);
+                    __builtin_prefetch(nextData, 0, 0);
+                }
+
+                const std::size_t readId = readIds[i];
+
+                const unsigned int* const data = variablePitchEncodedSequences.getRow(readId);
+                const std::size_t l = std::min(outSequencePitchInInts, variablePitchEncodedSequences.getRowLength(readId));
+
+                unsigned int* const destData = (unsigned int*)(((char*)sequence_data) + destinationPitchBytes * i);
+                std::copy_n(data, l, destData);
+            }
+        }else if(hasShrinkedSequences){
             for(int i = 0; i < numSequences && i < prefetch_distance; ++i) {
                 const int index = i;
                 const std::size_t nextReadId = readIds[index];
-                const unsigned int* const nextData = shrinkedEncodedSequences.data() + encodedSequencePitchInInts * nextReadId;
+                const unsigned int* const nextData = getShrinkedSequenceData() + encodedSequencePitchInInts * nextReadId;
                 __builtin_prefetch(nextData, 0, 0);
             }
 
@@ -446,13 +620,13 @@ public: //inherited interface
                 if(i + prefetch_distance < numSequences) {
                     const int index = i + prefetch_distance;
                     const std::size_t nextReadId = readIds[index];
-                    const unsigned int* const nextData = shrinkedEncodedSequences.data() + encodedSequencePitchInInts * nextReadId;
+                    const unsigned int* const nextData = getShrinkedSequenceData() + encodedSequencePitchInInts * nextReadId;
                     __builtin_prefetch(nextData, 0, 0);
                 }
 
                 const std::size_t readId = readIds[i];
 
-                const unsigned int* const data = shrinkedEncodedSequences.data() + encodedSequencePitchInInts * readId;
+                const unsigned int* const data = getShrinkedSequenceData() + encodedSequencePitchInInts * readId;
 
                 unsigned int* const destData = (unsigned int*)(((char*)sequence_data) + destinationPitchBytes * i);
                 std::copy_n(data, encodedSequencePitchInInts, destData);
@@ -490,23 +664,52 @@ public: //inherited interface
         }
     }
 
+    void prefetchSequences(
+        const read_number* readIds,
+        int numSequences
+    ) const override{
+        for(int i = 0; i < numSequences; i++){
+            const std::size_t readId = readIds[i];
+            const unsigned int* data = nullptr;
+            if(hasVariablePitchSequences){
+                data = variablePitchEncodedSequences.getRow(readId);
+            }else if(hasShrinkedSequences){
+                data = getShrinkedSequenceData() + encodedSequencePitchInInts * readId;
+            }else{
+                data = getPointerToSequenceRow(readId);
+            }
+            __builtin_prefetch(data, 0, 0);
+        }
+    }
+
     void gatherContiguousSequences(
         unsigned int* sequence_data,
         std::size_t outSequencePitchInInts,
         read_number firstIndex,
         int numSequences
     ) const override{
-        if(hasShrinkedSequences){
+        if(hasVariablePitchSequences){
+            //the rows are consecutive, so the row offsets are only looked up once per row
+            std::size_t rowBegin = variablePitchEncodedSequences.getRowBegin(firstIndex);
+            for(int i = 0; i < numSequences; i++){
+                const std::size_t rowEnd = variablePitchEncodedSequences.getRowBegin(firstIndex + i + 1);
+                const unsigned int* const data = variablePitchEncodedSequences.getData() + rowBegin;
+                unsigned int* const destData = sequence_data + outSequencePitchInInts * i;
+                const std::size_t l = std::min(outSequencePitchInInts, rowEnd - rowBegin);
+                std::copy_n(data, l, destData);
+                rowBegin = rowEnd;
+            }
+        }else if(hasShrinkedSequences){
             if(encodedSequencePitchInInts == outSequencePitchInInts){
                 std::copy_n(
-                    shrinkedEncodedSequences.data() + encodedSequencePitchInInts * firstIndex,
+                    getShrinkedSequenceData() + encodedSequencePitchInInts * firstIndex,
                     encodedSequencePitchInInts * numSequences,
                     sequence_data
                 );
             }else{
                 for(int i = 0; i < numSequences; i++){
                     const std::size_t readId = firstIndex + i;
-                    const unsigned int* const data = shrinkedEncodedSequences.data() + encodedSequencePitchInInts * readId;
+                    const unsigned int* const data = getShrinkedSequenceData() + encodedSequencePitchInInts * readId;
                     unsigned int* const destData = sequence_data + outSequencePitchInInts * i;
                     const int l = std::min(outSequencePitchInInts, encodedSequencePitchInInts);
                     std::copy_n(data, l, destData);
@@ -544,11 +747,36 @@ public: //inherited interface
         QualityCompressorWrapper qualityCompressor(numQualityBits);
         const int maxLengthCompressedPitch = encodedqualityPitchInInts * sizeof(unsigned int) * 8 / numQualityBits;
 
-        if(hasShrinkedQualities){
+        if(hasRansQualities){
+            //8-bit qualities. Positions after the end of a read are filled with the zero padding of fixed pitch rows
+            const int paddedLength = std::min(maxLengthCompressedPitch, int(out_quality_pitch));
+
+            for(int i = 0; i < numSequences; i++){
+                const read_number readId = readIds[i];
+                char* const destData = quality_data + out_quality_pitch * i;
+
+                const int l = std::min(int(lengthStorage.getLength(readId)), int(out_quality_pitch));
+                ransEncodedQualities.decodeRead(destData, readId, l);
+                if(l < paddedLength){
+                    std::fill(destData + l, destData + paddedLength, char(0));
+                }
+            }
+        }else if(hasVariablePitchQualities){
+            //Positions after the end of a row are filled like the zero padding of fixed pitch rows would be decoded.
+            //Consumers may access the complete pitch, e.g. to reverse quality scores
+            char paddingQuality = 0;
+            {
+                const unsigned int zero = 0;
+                std::array<char, 32> decodedZero;
+                qualityCompressor.decodeQualityToString(decodedZero.data(), &zero, 1);
+                paddingQuality = decodedZero[0];
+            }
+            const int paddedLength = std::min(maxLengthCompressedPitch, int(out_quality_pitch));
+
             for(int i = 0; i < numSequences && i < prefetch_distance; ++i) {
                 const int index = i;
                 const std::size_t nextReadId = readIds[index];
-                const unsigned int* const nextData = shrinkedEncodedQualities.data() + encodedqualityPitchInInts * nextReadId;
+                const unsigned int* const nextData = variablePitchEncodedQualities.getRow(nextReadId);
                 __builtin_prefetch(nextData, 0, 0);
             }
 
@@ -558,13 +786,45 @@ public: //inherited interface
                 if(i + prefetch_distance < numSequences) {
                     const int index = i + prefetch_distance;
                     const std::size_t nextReadId = readIds[index];
-                    const unsigned int* const nextData = shrinkedEncodedQualities.data() + encodedqualityPitchInInts * nextReadId;
+                    const unsigned int* const nextData = variablePitchEncodedQualities.getRow(nextReadId);
                     __builtin_prefetch(nextData, 0, 0);
                 }
 
                 const std::size_t readId = readIds[i];
 
-                const unsigned int* const data = shrinkedEncodedQualities.data() + encodedqualityPitchInInts * readId;
+                const unsigned int* const data = variablePitchEncodedQualities.getRow(readId);
+                char* const destData = (char*)(((char*)quality_data) + destinationPitchBytes * i);
+
+                const int maxLengthCompressedRow = variablePitchEncodedQualities.getRowLength(readId) * sizeof(unsigned int) * 8 / numQualityBits;
+                const int maxLengthUncompressedPitch = out_quality_pitch;
+                const int l = std::min(maxLengthCompressedRow, maxLengthUncompressedPitch);
+
+                qualityCompressor.decodeQualityToString(destData, data, l);
+                if(l < paddedLength){
+                    std::fill(destData + l, destData + paddedLength, paddingQuality);
+                }
+            }
+        }else if(hasShrinkedQualities){
+            for(int i = 0; i < numSequences && i < prefetch_distance; ++i) {
+                const int index = i;
+                const std::size_t nextReadId = readIds[index];
+                const unsigned int* const nextData = getShrinkedQualityData() + encodedqualityPitchInInts * nextReadId;
+                __builtin_prefetch(nextData, 0, 0);
+            }
+
+            std::size_t destinationPitchBytes = out_quality_pitch * sizeof(char);
+
+            for(int i = 0; i < numSequences; i++){
+                if(i + prefetch_distance < numSequences) {
+                    const int index = i + prefetch_distance;
+                    const std::size_t nextReadId = readIds[index];
+                    const unsigned int* const nextData = getShrinkedQualityData() + encodedqualityPitchInInts * nextReadId;
+                    __builtin_prefetch(nextData, 0, 0);
+                }
+
+                const std::size_t readId = readIds[i];
+
+                const unsigned int* const data = getShrinkedQualityData() + encodedqualityPitchInInts * readId;
                 char* const destData = (char*)(((char*)quality_data) + destinationPitchBytes * i);
 
                 const int maxLengthUncompressedPitch = out_quality_pitch;
@@ -618,11 +878,15 @@ public: //inherited interface
 
         constexpr int prefetch_distance = 4;
 
-        if(hasShrinkedQualities){
+        if(hasRansQualities){
+            for(int i = 0; i < numSequences; i++){
+                decodeRansQualityRow(encodedQualities + outputPitchInInts * i, outputPitchInInts, readIds[i]);
+            }
+        }else if(hasVariablePitchQualities){
             for(int i = 0; i < numSequences && i < prefetch_distance; ++i) {
                 const int index = i;
                 const std::size_t nextReadId = readIds[index];
-                const unsigned int* const nextData = shrinkedEncodedQualities.data() + encodedqualityPitchInInts * nextReadId;
+                const unsigned int* const nextData = variablePitchEncodedQualities.getRow(nextReadId);
                 __builtin_prefetch(nextData, 0, 0);
             }
 
@@ -630,13 +894,37 @@ public: //inherited interface
                 if(i + prefetch_distance < numSequences) {
                     const int index = i + prefetch_distance;
                     const std::size_t nextReadId = readIds[index];
-                    const unsigned int* const nextData = shrinkedEncodedQualities.data() + encodedqualityPitchInInts * nextReadId;
+                    const unsigned int* const nextData = variablePitchEncodedQualities.getRow(nextReadId);
                     __builtin_prefetch(nextData, 0, 0);
                 }
 
                 const std::size_t readId = readIds[i];
 
-                const unsigned int* const data = shrinkedEncodedQualities.data() + encodedqualityPitchInInts * readId;
+                const unsigned int* const data = variablePitchEncodedQualities.getRow(readId);
+                unsigned int* const destData = encodedQualities + outputPitchInInts * i;
+
+                const std::size_t l = std::min(outputPitchInInts, variablePitchEncodedQualities.getRowLength(readId));
+                std::copy_n(data, l, destData);
+            }
+        }else if(hasShrinkedQualities){
+            for(int i = 0; i < numSequences && i < prefetch_distance; ++i) {
+                const int index = i;
+                const std::size_t nextReadId = readIds[index];
+                const unsigned int* const nextData = getShrinkedQualityData() + encodedqualityPitchInInts * nextReadId;
+                __builtin_prefetch(nextData, 0, 0);
+            }
+
+            for(int i = 0; i < numSequences; i++){
+                if(i + prefetch_distance < numSequences) {
+                    const int index = i + prefetch_distance;
+                    const std::size_t nextReadId = readIds[index];
+                    const unsigned int* const nextData = getShrinkedQualityData() + encodedqualityPitchInInts * nextReadId;
+                    __builtin_prefetch(nextData, 0, 0);
+                }
+
+                const std::size_t readId = readIds[i];
+
+                const unsigned int* const data = getShrinkedQualityData() + encodedqualityPitchInInts * readId;
                 unsigned int* const destData = encodedQualities + outputPitchInInts * i;
 
                 const int l = std::min(outputPitchInInts, encodedqualityPitchInInts);
@@ -676,17 +964,31 @@ public: //inherited interface
         read_number firstIndex,
         int numSequences
     ) const override{
-        if(hasShrinkedQualities){
-            if(encodedSequencePitchInInts == outputPitchInInts){
+        if(hasRansQualities){
+            for(int i = 0; i < numSequences; i++){
+                decodeRansQualityRow(encodedQualities + outputPitchInInts * i, outputPitchInInts, firstIndex + i);
+            }
+        }else if(hasVariablePitchQualities){
+            std::size_t rowBegin = variablePitchEncodedQualities.getRowBegin(firstIndex);
+            for(int i = 0; i < numSequences; i++){
+                const std::size_t rowEnd = variablePitchEncodedQualities.getRowBegin(firstIndex + i + 1);
+                const unsigned int* const data = variablePitchEncodedQualities.getData() + rowBegin;
+                unsigned int* const destData = encodedQualities + outputPitchInInts * i;
+                const std::size_t l = std::min(outputPitchInInts, rowEnd - rowBegin);
+                std::copy_n(data, l, destData);
+                rowBegin = rowEnd;
+            }
+        }else if(hasShrinkedQualities){
+            if(encodedqualityPitchInInts == outputPitchInInts){
                 std::copy_n(
-                    shrinkedEncodedQualities.data() + encodedqualityPitchInInts * firstIndex,
+                    getShrinkedQualityData() + encodedqualityPitchInInts * firstIndex,
                     encodedqualityPitchInInts * numSequences,
                     encodedQualities
                 );
             }else{
                 for(int i = 0; i < numSequences; i++){
                     const std::size_t readId = firstIndex + i;
-                    const unsigned int* const data = shrinkedEncodedQualities.data() + encodedqualityPitchInInts * readId;
+                    const unsigned int* const data = getShrinkedQualityData() + encodedqualityPitchInInts * readId;
                     unsigned int* const destData = encodedQualities + outputPitchInInts * i;
                     const int l = std::min(outputPitchInInts, encodedqualityPitchInInts);
                     std::copy_n(data, l, destData);
@@ -722,10 +1024,11 @@ public: //inherited interface
         read_number* ids
     ) const override{
         std::copy(ambigReadIds.begin(), ambigReadIds.end(), ids);
+        std::copy_n(mappedAmbiguousReadIds, numMappedAmbiguousReadIds, ids + ambigReadIds.size());
     }
 
     std::int64_t getNumberOfReadsWithN() const override{
-        return ambigReadIds.size();
+        return ambigReadIds.size() + numMappedAmbiguousReadIds;
     }
 
     MemoryUsage getMemoryInfo() const override{
@@ -736,6 +1039,9 @@ public: //inherited interface
         result.host += sizeof(std::size_t) * offsetsPrefixSum.capacity();
         result.host += sizeof(unsigned int) * shrinkedEncodedSequences.capacity();
         result.host += sizeof(unsigned int) * shrinkedEncodedQualities.capacity();
+        result += variablePitchEncodedSequences.getMemoryInfo();
+        result += variablePitchEncodedQualities.getMemoryInfo();
+        result += ransEncodedQualities.getMemoryInfo();
 
         result.host += sizeof(StoredEncodedSequences) * sequenceStorage.capacity();
         result.host += sizeof(StoredQualities) * qualityStorage.capacity();
@@ -762,6 +1068,14 @@ public: //inherited interface
             result.host += sizeof(unsigned int) * s.data.encodedqualities.capacity();
         }
 
+        if(readHeaderStorage){
+            result.host += readHeaderStorage->sizeInBytes();
+        }
+
+        result.host += sizeof(read_number) * originalReadIds.capacity();
+        result.host += sizeof(read_number) * originalReadIdOffsets.capacity();
+        result.host += sizeof(read_number) * internalReadIds.capacity();
+
         return result;
     }
 
@@ -804,12 +1118,27 @@ public: //inherited interface
         deallocVector(ambigReadIds);
         deallocVector(shrinkedEncodedSequences);
         deallocVector(shrinkedEncodedQualities);
+        variablePitchEncodedSequences.destroy();
+        variablePitchEncodedQualities.destroy();
+        ransEncodedQualities.destroy();
+        mappedEncodedSequences = nullptr;
+        mappedEncodedQualities = nullptr;
+        mappedAmbiguousReadIds = nullptr;
+        numMappedAmbiguousReadIds = 0;
+        mappedStorageFile.reset();
         //deallocVector(tempdataVector);
+        readHeaderStorage.reset();
+        deallocVector(originalReadIds);
+        deallocVector(originalReadIdOffsets);
+        deallocVector(internalReadIds);
 
         hasShrinkedSequences = false;
         encodedSequencePitchInInts = 0;
         hasShrinkedQualities = false;
         encodedqualityPitchInInts = 0;
+        hasVariablePitchSequences = false;
+        hasVariablePitchQualities = false;
+        hasRansQualities = false;
 
         counter = 0;
 
@@ -820,12 +1149,59 @@ public:
 
 
     bool compactSequences(std::size_t& availableMem){
+        auto deallocVector = [](auto& vec){
+            using W = typename std::remove_reference<decltype(vec)>::type;
+            W tmp{};
+            vec.swap(tmp);
+        };
+
         std::size_t maxLength = lengthStorage.getMaxLength();
         std::size_t numSequences = totalNumberOfReads;
 
         encodedSequencePitchInInts = SequenceHelpers::getEncodedNumInts2Bit(maxLength);
 
-        if(availableMem >= sizeof(unsigned int) * numSequences * encodedSequencePitchInInts){
+        auto rowLength = [](int length) -> std::size_t{
+            return SequenceHelpers::getEncodedNumInts2Bit(length);
+        };
+
+        const std::size_t fixedPitchBytes = sizeof(unsigned int) * numSequences * encodedSequencePitchInInts;
+        const std::size_t variablePitchBytes = getVariablePitchRowsBytes(encodedSequencePitchInInts, rowLength);
+
+        if(variablePitchBytes <= fixedPitchBytes - fixedPitchBytes / 8){
+            if(availableMem < variablePitchBytes){
+                return false;
+            }
+            availableMem -= variablePitchBytes;
+
+            variablePitchEncodedSequences = VariablePitchRows(numSequences, [&](std::size_t i){
+                return rowLength(lengthStorage.getLength(i));
+            });
+
+            for(std::size_t chunk = 0; chunk < sequenceStorage.size(); chunk++){
+                const auto& s = sequenceStorage[chunk];
+                const std::size_t offset = offsetsPrefixSum[chunk];
+                const std::size_t pitchInts = s.encodedSequencePitchInInts;
+                const std::size_t num = s.encodedSequences.size() / pitchInts;
+
+                for(std::size_t i = 0; i < num; i++){
+                    std::copy_n(
+                        s.encodedSequences.begin() + i * pitchInts,
+                        variablePitchEncodedSequences.getRowLength(offset + i),
+                        variablePitchEncodedSequences.getRow(offset + i)
+                    );
+                }
+
+                availableMem += pitchInts * num * sizeof(unsigned int);
+            }
+
+            deallocVector(sequenceStorage);
+
+            hasVariablePitchSequences = true;
+
+            return true;
+        }
+
+        if(availableMem >= fixedPitchBytes){
             shrinkedEncodedSequences.resize(numSequences * encodedSequencePitchInInts);
             availableMem -= sizeof(unsigned int) * numSequences * encodedSequencePitchInInts;
 
@@ -851,12 +1227,6 @@ public:
                 availableMem += pitchInts * num * sizeof(unsigned int);
             }
 
-            auto deallocVector = [](auto& vec){
-                using W = typename std::remove_reference<decltype(vec)>::type;
-                W tmp{};
-                vec.swap(tmp);
-            };
-
             deallocVector(sequenceStorage);
 
             hasShrinkedSequences = true;
@@ -869,12 +1239,59 @@ public:
     }
 
     bool compactQualities(std::size_t& availableMem){
+        auto deallocVector = [](auto& vec){
+            using W = typename std::remove_reference<decltype(vec)>::type;
+            W tmp{};
+            vec.swap(tmp);
+        };
+
         std::size_t maxLength = lengthStorage.getMaxLength();
         std::size_t numSequences = totalNumberOfReads;
 
         encodedqualityPitchInInts = QualityCompressionHelper::getNumInts(maxLength, numQualityBits);
 
-        if(availableMem >= numSequences * encodedqualityPitchInInts * sizeof(unsigned int)){
+        auto rowLength = [&](int length) -> std::size_t{
+            return QualityCompressionHelper::getNumInts(length, numQualityBits);
+        };
+
+        const std::size_t fixedPitchBytes = sizeof(unsigned int) * numSequences * encodedqualityPitchInInts;
+        const std::size_t variablePitchBytes = getVariablePitchRowsBytes(encodedqualityPitchInInts, rowLength);
+
+        if(variablePitchBytes <= fixedPitchBytes - fixedPitchBytes / 8){
+            if(availableMem < variablePitchBytes){
+                return false;
+            }
+            availableMem -= variablePitchBytes;
+
+            variablePitchEncodedQualities = VariablePitchRows(numSequences, [&](std::size_t i){
+                return rowLength(lengthStorage.getLength(i));
+            });
+
+            for(std::size_t chunk = 0; chunk < qualityStorage.size(); chunk++){
+                const auto& s = qualityStorage[chunk];
+                const std::size_t offset = offsetsPrefixSum[chunk];
+                const std::size_t pitchInts = s.encodedqualityPitchInInts;
+                const std::size_t num = s.encodedqualities.size() / pitchInts;
+
+                for(std::size_t i = 0; i < num; i++){
+                    std::copy_n(
+                        s.encodedqualities.begin() + i * pitchInts,
+                        variablePitchEncodedQualities.getRowLength(offset + i),
+                        variablePitchEncodedQualities.getRow(offset + i)
+                    );
+                }
+
+                availableMem += pitchInts * num * sizeof(unsigned int);
+            }
+
+            deallocVector(qualityStorage);
+
+            hasVariablePitchQualities = true;
+
+            return true;
+        }
+
+        if(availableMem >= fixedPitchBytes){
             shrinkedEncodedQualities.resize(numSequences * encodedqualityPitchInInts);
             availableMem -= numSequences * encodedqualityPitchInInts * sizeof(unsigned int);
 
@@ -900,11 +1317,6 @@ public:
                 availableMem += pitchInts * num * sizeof(unsigned int);
             }
 
-            auto deallocVector = [](auto& vec){
-                using W = typename std::remove_reference<decltype(vec)>::type;
-                W tmp{};
-                vec.swap(tmp);
-            };
             deallocVector(qualityStorage);
 
             hasShrinkedQualities = true;
@@ -916,7 +1328,57 @@ public:
         }
     }
 
-   
+    /*
+        Replace the stored 8-bit quality scores by a lossless order-1 rANS encoding (see RansQualityStorage). 
+        Must be called after appendingFinished. Quality scores with less bits are already binned to 1 or 2 bits per score 
+        and are not compressed. Returns true if the quality scores have been compressed.
+    */
+    bool compressQualities(int numThreads){
+        auto deallocVector = [](auto& vec){
+            using W = typename std::remove_reference<decltype(vec)>::type;
+            W tmp{};
+            vec.swap(tmp);
+        };
+
+        if(!canUseQualityScores() || hasRansQualities || numQualityBits != 8 || getNumberOfReads() == 0){
+            return false;
+        }
+
+        const int maxLength = getSequenceLengthUpperBound();
+        if(!RansQualityStorage::canEncode(maxLength)){
+            std::cerr << "Reads are too long to compress quality scores\n";
+            return false;
+        }
+
+        const std::size_t bytesBefore = getMemoryInfo().host;
+
+        RansQualityStorage compressed(
+            getNumberOfReads(),
+            maxLength,
+            [&](char* dest, std::size_t pitch, read_number firstReadId, int num){
+                std::vector<read_number> ids(num);
+                std::iota(ids.begin(), ids.end(), firstReadId);
+                gatherQualities(dest, pitch, ids.data(), num);
+            },
+            [&](read_number readId){ return int(lengthStorage.getLength(readId)); },
+            numThreads
+        );
+
+        deallocVector(qualityStorage);
+        deallocVector(shrinkedEncodedQualities);
+        variablePitchEncodedQualities.destroy();
+        mappedEncodedQualities = nullptr;
+        hasShrinkedQualities = false;
+        hasVariablePitchQualities = false;
+
+        ransEncodedQualities = std::move(compressed);
+        hasRansQualities = true;
+
+        const std::size_t bytesAfter = getMemoryInfo().host;
+        std::cerr << "Compressed quality scores. Read storage: " << bytesBefore << " bytes before, " << bytesAfter << " bytes after\n";
+
+        return true;
+    }
 
     void printAmbig(){
 
@@ -931,6 +1393,391 @@ public:
     
 
 private:
+    //decode a read of ransEncodedQualities to the 8-bit encoding of the other quality storages, zero-padded like a fixed pitch row
+    void decodeRansQualityRow(unsigned int* destData, std::size_t outputPitchInInts, read_number readId) const noexcept{
+        const std::size_t numInts = std::min(outputPitchInInts, encodedqualityPitchInInts);
+        std::fill_n(destData, numInts, 0u);
+
+        const int l = std::min(std::size_t(lengthStorage.getLength(readId)), numInts * sizeof(unsigned int));
+        ransEncodedQualities.decodeRead(reinterpret_cast<char*>(destData), readId, l);
+    }
+
+    static std::uint64_t hashEncodedSequence(const unsigned int* encodedSequence, int length) noexcept{
+        std::uint64_t hash = length;
+        const int numInts = SequenceHelpers::getEncodedNumInts2Bit(length);
+        for(int i = 0; i < numInts; i++){
+            hash = (hash ^ encodedSequence[i]) * 0x9E3779B97F4A7C15ull;
+            hash ^= hash >> 32;
+        }
+        return hash;
+    }
+
+    /*
+        Returns a storage in which read i consists of the reads groupMembers[groupOffsets[i]] to groupMembers[groupOffsets[i+1]-1]
+        of readStorage. Only the first read of each group is stored. The original read ids of the reads of readStorage are kept.
+    */
+    static std::unique_ptr<ChunkedReadStorage> regroupReads(
+        std::unique_ptr<ChunkedReadStorage> readStorage,
+        const std::vector<read_number>& groupMembers,
+        const std::vector<read_number>& groupOffsets,
+        std::size_t memoryLimitBytes, 
+        int numThreads
+    ){
+        const std::size_t numGroups = groupOffsets.size() - 1;
+
+        std::vector<read_number> firstMembers(numGroups);
+        for(std::size_t i = 0; i < numGroups; i++){
+            firstMembers[i] = groupMembers[groupOffsets[i]];
+        }
+
+        auto regrouped = std::make_unique<ChunkedReadStorage>(
+            readStorage->pairedEnd, 
+            readStorage->hasQualityScores, 
+            readStorage->numQualityBits
+        );
+
+        const std::size_t sequencePitchInInts = SequenceHelpers::getEncodedNumInts2Bit(readStorage->getSequenceLengthUpperBound());
+        const std::size_t qualityPitchInInts = readStorage->canUseQualityScores() 
+            ? QualityCompressionHelper::getNumInts(readStorage->getSequenceLengthUpperBound(), readStorage->numQualityBits) : 0;
+
+        constexpr std::size_t chunksize = 65536;
+        const std::size_t numChunks = SDIV(numGroups, chunksize);
+        std::mutex appendMutex;
+
+        #pragma omp parallel for num_threads(numThreads) schedule(dynamic, 1)
+        for(std::size_t chunk = 0; chunk < numChunks; chunk++){
+            const read_number firstReadId = chunk * chunksize;
+            const int num = std::min(chunksize, numGroups - firstReadId);
+            const read_number* const readIds = firstMembers.data() + firstReadId;
+
+            std::vector<int> lengths(num);
+            std::vector<unsigned int> sequences(num * sequencePitchInInts);
+            std::vector<unsigned int> qualities(num * qualityPitchInInts);
+            std::unique_ptr<bool[]> isAmbiguous = std::make_unique<bool[]>(num);
+
+            readStorage->gatherSequenceLengths(lengths.data(), readIds, num);
+            readStorage->gatherSequences(sequences.data(), sequencePitchInInts, readIds, num);
+            if(readStorage->canUseQualityScores()){
+                readStorage->gatherEncodedQualities(qualities.data(), qualityPitchInInts, readIds, num);
+            }
+            readStorage->areSequencesAmbiguous(isAmbiguous.get(), readIds, num);
+
+            std::vector<read_number> ambiguousIds;
+            for(int i = 0; i < num; i++){
+                if(isAmbiguous[i]){
+                    ambiguousIds.push_back(firstReadId + i);
+                }
+            }
+
+            std::lock_guard<std::mutex> lg(appendMutex);
+
+            regrouped->appendConsecutiveReads(
+                firstReadId,
+                num,
+                std::move(lengths),
+                std::move(sequences),
+                sequencePitchInInts,
+                std::move(qualities),
+                qualityPitchInInts
+            );
+            regrouped->appendAmbiguousReadIds(ambiguousIds);
+        }
+
+        //original reads of the reads of readStorage
+        const std::size_t numOriginalReads = readStorage->internalReadIds.empty() 
+            ? readStorage->getNumberOfReads() : readStorage->internalReadIds.size();
+
+        auto forEachOriginalReadId = [&](read_number readId, auto func){
+            if(readStorage->originalReadIds.empty()){
+                func(readId);
+            }else if(readStorage->originalReadIdOffsets.empty()){
+                func(readStorage->originalReadIds[readId]);
+            }else{
+                for(read_number k = readStorage->originalReadIdOffsets[readId]; k < readStorage->originalReadIdOffsets[readId + 1]; k++){
+                    func(readStorage->originalReadIds[k]);
+                }
+            }
+        };
+
+        regrouped->originalReadIds.reserve(numOriginalReads);
+        regrouped->originalReadIdOffsets.resize(numGroups + 1);
+        regrouped->internalReadIds.resize(numOriginalReads);
+        for(std::size_t i = 0; i < numGroups; i++){
+            regrouped->originalReadIdOffsets[i] = regrouped->originalReadIds.size();
+            for(read_number k = groupOffsets[i]; k < groupOffsets[i + 1]; k++){
+                forEachOriginalReadId(groupMembers[k], [&](read_number originalReadId){
+                    regrouped->originalReadIds.push_back(originalReadId);
+                    regrouped->internalReadIds[originalReadId] = i;
+                });
+            }
+        }
+        regrouped->originalReadIdOffsets[numGroups] = regrouped->originalReadIds.size();
+
+        //without duplicates, the original read of read i is originalReadIds[i]
+        if(numOriginalReads == numGroups){
+            std::vector<read_number>{}.swap(regrouped->originalReadIdOffsets);
+        }
+
+        std::unique_ptr<ReadHeaderStorage> headers = std::move(readStorage->readHeaderStorage);
+        readStorage.reset();
+
+        const std::size_t memoryOfRegroupedReads = regrouped->getMemoryInfo().host + (headers ? headers->sizeInBytes() : 0);
+        regrouped->appendingFinished(memoryLimitBytes - std::min(memoryLimitBytes, memoryOfRegroupedReads));
+        regrouped->readHeaderStorage = std::move(headers);
+
+        return regrouped;
+    }
+
+    static constexpr std::array<char, 8> binaryFileMagic{'C', 'A', 'R', 'E', 'R', 'E', 'A', 'D'};
+    static constexpr std::uint32_t binaryFileVersion = 1;
+    static constexpr std::size_t binaryFileSectionAlignment = 4096;
+
+    enum class BinaryFileSection : int{
+        Lengths,                //LengthStore<std::uint32_t>::getRaw()
+        Sequences,              //numReads * sequencePitchInInts, or VariablePitchRows::getData()
+        SequenceRowOffsets,     //VariablePitchRows::getRelativeOffsets() if variablePitchSequences
+        SequenceGroupOffsets,   //VariablePitchRows::getGroupOffsets() if variablePitchSequences
+        Qualities,              //like sequences, if hasQualityScores
+        QualityRowOffsets,
+        QualityGroupOffsets,
+        AmbiguousReadIds,       //sorted
+        NumSections
+    };
+
+    struct BinaryFileHeader{
+        std::array<char, 8> magic;
+        std::uint32_t version;
+        std::uint32_t sectionAlignment;
+        std::uint64_t numReads;
+        std::int32_t hasQualityScores;
+        std::int32_t numQualityBits;
+        std::int32_t minLength;
+        std::int32_t maxLength;
+        std::int32_t variablePitchSequences;
+        std::int32_t variablePitchQualities;
+        std::uint64_t sequencePitchInInts;
+        std::uint64_t qualityPitchInInts;
+        std::uint64_t numAmbiguousReadIds;
+        std::uint64_t sectionOffsets[int(BinaryFileSection::NumSections)];
+        std::uint64_t sectionBytes[int(BinaryFileSection::NumSections)];
+    };
+
+    static_assert(std::is_trivially_copyable<BinaryFileHeader>::value);
+
+    //format of files which were written before the format was versioned
+    void loadFromLegacyFile(const std::string& filename){
+        std::ifstream stream(filename, std::ios::binary);
+        if(!stream)
+            throw std::runtime_error("Cannot open file " + filename);
+
+        destroy();
+
+        std::size_t loaded_numreads = 0;
+        int loaded_sequenceLengthLowerBound = 0;
+        int loaded_sequenceLengthUpperBound = 0;
+        bool loaded_hasQualityScores = false;        
+        int loaded_numQualityBits = 0;
+
+        stream.read(reinterpret_cast<char*>(&loaded_numreads), sizeof(std::size_t));
+        stream.read(reinterpret_cast<char*>(&loaded_sequenceLengthLowerBound), sizeof(int));
+        stream.read(reinterpret_cast<char*>(&loaded_sequenceLengthUpperBound), sizeof(int));            
+        stream.read(reinterpret_cast<char*>(&loaded_hasQualityScores), sizeof(bool));
+        stream.read(reinterpret_cast<char*>(&loaded_numQualityBits), sizeof(int));        
+
+        std::size_t lengthsBytes = 0;
+        std::size_t sequencesBytes = 0;
+        std::size_t qualitiesBytes = 0;       
+        std::size_t ambigBytes = 0;
+
+        stream.read(reinterpret_cast<char*>(&lengthsBytes), sizeof(std::size_t));
+        stream.read(reinterpret_cast<char*>(&sequencesBytes), sizeof(std::size_t));
+        stream.read(reinterpret_cast<char*>(&qualitiesBytes), sizeof(std::size_t));
+        stream.read(reinterpret_cast<char*>(&ambigBytes), sizeof(std::size_t));
+
+        totalNumberOfReads = loaded_numreads;
+        offsetsPrefixSum = {0, totalNumberOfReads};
+
+        lengthStorage.readFromStream(stream);
+
+        hasShrinkedSequences = true;
+        stream.read(reinterpret_cast<char*>(&encodedSequencePitchInInts), sizeof(std::size_t));
+        std::size_t numsequencedataelements = 0;
+        stream.read(reinterpret_cast<char*>(&numsequencedataelements), sizeof(std::size_t));
+        shrinkedEncodedSequences.resize(numsequencedataelements);
+        stream.read(reinterpret_cast<char*>(shrinkedEncodedSequences.data()), numsequencedataelements * sizeof(unsigned int));
+
+
+        if(canUseQualityScores() && loaded_hasQualityScores){
+            //std::cerr << "load qualities\n";
+
+            if(loaded_numQualityBits != numQualityBits){
+                throw std::runtime_error("preprocessed reads file uses " + std::to_string(loaded_numQualityBits) 
+                    + " bits per quality score, but setting requires " + std::to_string(numQualityBits) + " bits. Abort.");
+            }
+
+            hasShrinkedQualities = true;
+            stream.read(reinterpret_cast<char*>(&encodedqualityPitchInInts), sizeof(std::size_t));
+            std::size_t numqualitydataelements = 0;
+            stream.read(reinterpret_cast<char*>(&numqualitydataelements), sizeof(std::size_t));
+            shrinkedEncodedQualities.resize(numqualitydataelements);
+            stream.read(reinterpret_cast<char*>(shrinkedEncodedQualities.data()), numqualitydataelements * sizeof(unsigned int));
+
+            numQualityBits = loaded_numQualityBits;
+
+        }else if(canUseQualityScores() && !loaded_hasQualityScores){
+                //std::cerr << "no q in bin file\n";
+                throw std::runtime_error("Quality scores expected in preprocessed reads file to load, but none are present. Abort.");
+        }else if(!canUseQualityScores() && loaded_hasQualityScores){
+                //std::cerr << "skip qualities\n";
+                stream.ignore(qualitiesBytes);
+
+                numQualityBits = loaded_numQualityBits;
+        }else{
+            //!canUseQualityScores() && !loaded_hasQualityScores
+            //std::cerr << "no q in file, and no q required. Ok\n";
+            stream.ignore(qualitiesBytes);
+
+            numQualityBits = loaded_numQualityBits;
+        }
+        
+
+        std::size_t numAmbigDataElements = 0;
+        stream.read(reinterpret_cast<char*>(&numAmbigDataElements), sizeof(std::size_t));
+
+        std::vector<read_number> tmpambig(numAmbigDataElements);
+        stream.read(reinterpret_cast<char*>(tmpambig.data()), numAmbigDataElements * sizeof(read_number));
+
+        ambigReadIds.insert(tmpambig.begin(), tmpambig.end());
+    }
+
+
+    void loadFromMappedFile(const std::string& filename){
+        destroy();
+
+        mappedStorageFile = std::make_unique<MappedFile>(filename);
+        const MappedFile& file = *mappedStorageFile;
+
+        BinaryFileHeader header{};
+        if(file.size() < sizeof(BinaryFileHeader)){
+            throw std::runtime_error("File " + filename + " is too small");
+        }
+        std::memcpy(&header, file.getData(), sizeof(BinaryFileHeader));
+
+        if(header.version != binaryFileVersion){
+            throw std::runtime_error("File " + filename + " has version " + std::to_string(header.version) 
+                + ", but version " + std::to_string(binaryFileVersion) + " is required. Abort.");
+        }
+
+        for(int i = 0; i < int(BinaryFileSection::NumSections); i++){
+            if(header.sectionBytes[i] > 0 && (header.sectionOffsets[i] % binaryFileSectionAlignment != 0 
+                    || header.sectionOffsets[i] + header.sectionBytes[i] > file.size())){
+                throw std::runtime_error("File " + filename + " is corrupted");
+            }
+        }
+
+        auto getSection = [&](BinaryFileSection section, auto* typeTag){
+            using T = std::remove_const_t<std::remove_pointer_t<decltype(typeTag)>>;
+            return reinterpret_cast<const T*>(file.getData() + header.sectionOffsets[int(section)]);
+        };
+
+        auto getSectionElements = [&](BinaryFileSection section, std::size_t elementSize){
+            return header.sectionBytes[int(section)] / elementSize;
+        };
+
+        //lengths, row offsets and ambiguous read ids are needed early. sequences and qualities are accessed randomly
+        auto adviseSection = [&](BinaryFileSection section, int advice){
+            file.advise(header.sectionOffsets[int(section)], header.sectionBytes[int(section)], advice);
+        };
+
+        totalNumberOfReads = header.numReads;
+        offsetsPrefixSum = {0, totalNumberOfReads};
+
+        using LengthData_t = std::uint32_t;
+        lengthStorage = LengthStore<std::uint32_t>::makeView(
+            header.minLength, 
+            header.maxLength, 
+            totalNumberOfReads, 
+            getSection(BinaryFileSection::Lengths, (LengthData_t*)nullptr),
+            getSectionElements(BinaryFileSection::Lengths, sizeof(LengthData_t))
+        );
+        adviseSection(BinaryFileSection::Lengths, MADV_WILLNEED);
+
+        encodedSequencePitchInInts = header.sequencePitchInInts;
+        if(header.variablePitchSequences){
+            hasVariablePitchSequences = true;
+            variablePitchEncodedSequences = VariablePitchRows::makeView(
+                totalNumberOfReads,
+                getSection(BinaryFileSection::Sequences, (unsigned int*)nullptr),
+                getSection(BinaryFileSection::SequenceRowOffsets, (std::uint32_t*)nullptr),
+                getSection(BinaryFileSection::SequenceGroupOffsets, (std::size_t*)nullptr)
+            );
+            adviseSection(BinaryFileSection::SequenceRowOffsets, MADV_WILLNEED);
+            adviseSection(BinaryFileSection::SequenceGroupOffsets, MADV_WILLNEED);
+        }else{
+            hasShrinkedSequences = true;
+            mappedEncodedSequences = getSection(BinaryFileSection::Sequences, (unsigned int*)nullptr);
+        }
+        adviseSection(BinaryFileSection::Sequences, MADV_RANDOM);
+
+        if(canUseQualityScores() && header.hasQualityScores){
+            if(header.numQualityBits != numQualityBits){
+                throw std::runtime_error("preprocessed reads file uses " + std::to_string(header.numQualityBits) 
+                    + " bits per quality score, but setting requires " + std::to_string(numQualityBits) + " bits. Abort.");
+            }
+
+            encodedqualityPitchInInts = header.qualityPitchInInts;
+            if(header.variablePitchQualities){
+                hasVariablePitchQualities = true;
+                variablePitchEncodedQualities = VariablePitchRows::makeView(
+                    totalNumberOfReads,
+                    getSection(BinaryFileSection::Qualities, (unsigned int*)nullptr),
+                    getSection(BinaryFileSection::QualityRowOffsets, (std::uint32_t*)nullptr),
+                    getSection(BinaryFileSection::QualityGroupOffsets, (std::size_t*)nullptr)
+                );
+                adviseSection(BinaryFileSection::QualityRowOffsets, MADV_WILLNEED);
+                adviseSection(BinaryFileSection::QualityGroupOffsets, MADV_WILLNEED);
+            }else{
+                hasShrinkedQualities = true;
+                mappedEncodedQualities = getSection(BinaryFileSection::Qualities, (unsigned int*)nullptr);
+            }
+            adviseSection(BinaryFileSection::Qualities, MADV_RANDOM);
+        }else if(canUseQualityScores() && !header.hasQualityScores){
+            throw std::runtime_error("Quality scores expected in preprocessed reads file to load, but none are present. Abort.");
+        }else{
+            numQualityBits = header.numQualityBits;
+        }
+
+        mappedAmbiguousReadIds = getSection(BinaryFileSection::AmbiguousReadIds, (read_number*)nullptr);
+        numMappedAmbiguousReadIds = header.numAmbiguousReadIds;
+        adviseSection(BinaryFileSection::AmbiguousReadIds, MADV_WILLNEED);
+    }
+
+    const unsigned int* getShrinkedSequenceData() const noexcept{
+        return mappedEncodedSequences != nullptr ? mappedEncodedSequences : shrinkedEncodedSequences.data();
+    }
+
+    const unsigned int* getShrinkedQualityData() const noexcept{
+        return mappedEncodedQualities != nullptr ? mappedEncodedQualities : shrinkedEncodedQualities.data();
+    }
+
+    /*
+        Bytes which are required to store the rows without padding, if rowLength(length) ints are required per row.
+        Returns the maximum value of std::size_t if all reads have the same length, or if the rows are too long.
+    */
+    template<class RowLength>
+    std::size_t getVariablePitchRowsBytes(std::size_t pitchInInts, RowLength rowLength) const{
+        if(lengthStorage.getMinLength() == lengthStorage.getMaxLength() || pitchInInts > VariablePitchRows::getMaxRowLength()){
+            return std::numeric_limits<std::size_t>::max();
+        }
+
+        std::size_t numInts = 0;
+        for(std::size_t i = 0; i < totalNumberOfReads; i++){
+            numInts += rowLength(lengthStorage.getLength(i));
+        }
+
+        return VariablePitchRows::getRequiredBytes(totalNumberOfReads, numInts);
+    }
+
     std::size_t getChunkIndexOfRow(std::size_t row) const noexcept{
         auto it = std::lower_bound(offsetsPrefixSum.begin(), offsetsPrefixSum.end(), row + 1);
         std::size_t chunkIndex = std::distance(offsetsPrefixSum.begin(), it) - 1;
@@ -1001,6 +1848,12 @@ private:
     LengthStore<std::uint32_t> lengthStorage{};
     std::vector<StoredQualities> qualityStorage{};
     std::unordered_set<read_number> ambigReadIds{};
+    std::unique_ptr<ReadHeaderStorage> readHeaderStorage{};
+
+    //set by reorderReads and collapseDuplicateReads. see getOriginalReadIds, getOriginalReadIdOffsets, getInternalReadIds
+    std::vector<read_number> originalReadIds{};
+    std::vector<read_number> originalReadIdOffsets{};
+    std::vector<read_number> internalReadIds{};
 
     std::vector<StoredSequenceLengthsAppend> lengthdataAppend{};
     std::vector<StoredEncodedSequencesAppend> sequenceStorageAppend{};
@@ -1008,11 +1861,29 @@ private:
 
     bool hasShrinkedSequences = false;
     std::size_t encodedSequencePitchInInts{};
-    std::vector<unsigned int> shrinkedEncodedSequences{};
+    PlacedVector<unsigned int> shrinkedEncodedSequences{};
 
     bool hasShrinkedQualities = false;
     std::size_t encodedqualityPitchInInts{};
-    std::vector<unsigned int> shrinkedEncodedQualities{};
+    PlacedVector<unsigned int> shrinkedEncodedQualities{};
+
+    //alternative to shrinkedEncodedSequences / shrinkedEncodedQualities without padding, for libraries with different read lengths
+    bool hasVariablePitchSequences = false;
+    VariablePitchRows variablePitchEncodedSequences{};
+
+    bool hasVariablePitchQualities = false;
+    VariablePitchRows variablePitchEncodedQualities{};
+
+    //set by compressQualities. replaces the other quality storages. encodedqualityPitchInInts is kept
+    bool hasRansQualities = false;
+    RansQualityStorage ransEncodedQualities{};
+
+    //file which was loaded by loadFromFile. The pointers point into the mapping. Its memory is not included in getMemoryInfo
+    std::unique_ptr<MappedFile> mappedStorageFile{};
+    const unsigned int* mappedEncodedSequences = nullptr;
+    const unsigned int* mappedEncodedQualities = nullptr;
+    const read_number* mappedAmbiguousReadIds = nullptr; //sorted
+    std::size_t numMappedAmbiguousReadIds = 0;
 
     mutable int counter = 0;
     mutable SharedMutex sharedmutex{};
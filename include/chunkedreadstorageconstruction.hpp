@@ -11,6 +11,8 @@
 #include <chunkedreadstorage.hpp>
 #include <options.hpp>
 #include <qualityscorecompression.hpp>
+#include <mappedsequencefile.hpp>
+#include <ingestencoding.hpp>
 
 #include <vector>
 #include <array>
@@ -20,9 +22,12 @@
 #include <string>
 #include <iostream>
 #include <future>
+#include <atomic>
+#include <string_view>
 #include <limits>
 #include <map>
 #include <set>
+#include <optional>
 
 namespace care{
 
@@ -46,6 +51,24 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
 
         const bool showProgress = programOptions.showProgress;
 
+        //the original reads can only be restored from the read storage if quality scores are stored without loss
+        bool storeReadHeaders = programOptions.storeReadHeaders;
+        if(storeReadHeaders){
+            const bool qualitiesAreLossless = useQualityScores && numQualityBits == 8;
+            for(const auto& inputfile : programOptions.inputfiles){
+                if(hasQualityScores(inputfile) && !qualitiesAreLossless){
+                    storeReadHeaders = false;
+                }
+            }
+
+            if(storeReadHeaders){
+                readStorage->enableReadHeaders();
+            }else{
+                std::cerr << "Read headers are not stored because quality scores are not stored without loss. "
+                    << "This requires useQualityScores and qualityScoreBits = 8. Input files will be parsed again to construct the output.\n";
+            }
+        }
+
         auto showProgressFunc = [showProgress](auto totalCount, auto seconds){
             if(showProgress){
                 std::cout << "Processed " << totalCount << " reads in file. Elapsed time: " 
@@ -64,39 +87,46 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
         );
                 
 
-        auto preprocessSequence = [&](std::string& sequence, int& Ncount){
-
-            auto isValidBase = [](char c){
-                constexpr std::array<char, 10> validBases{'A','C','G','T','a','c','g','t'};
-                return validBases.end() != std::find(validBases.begin(), validBases.end(), c);
-            };
-
-            const int numundeterminedBasesInSequence = std::count_if(sequence.begin(), sequence.end(), [&](char c){
-                return !isValidBase(c);
-            });
+        //single-end input files are parsed concurrently
+        constexpr int maxConcurrentInputFiles = 4;
+        const int numInputFiles = programOptions.inputfiles.size();
+        const int numParsers = programOptions.pairType == SequencePairType::SingleEnd ? 
+            std::max(1, std::min(numInputFiles, maxConcurrentInputFiles)) : 1;
+        int numEncoders = 4;
+        int numInserters = 1;
 
-            constexpr std::array<char, 4> bases = {'A', 'C', 'G', 'T'};
+        /*
+            The reads of input file i are numbered after all reads of files 0 to i-1. If files are parsed concurrently, 
+            the read id offset of a file is only known once all preceding files have been parsed. Until then, reads are encoded
+            with read ids relative to the beginning of their file, and the inserter updates the read ids later.
+        */
+        std::mutex numReadsOfParsedFilesMutex;
+        std::vector<std::optional<std::size_t>> numReadsOfParsedFiles(std::max(1, numInputFiles));
+
+        auto setNumReadsOfParsedFile = [&](int inputFile, std::size_t numReads){
+            std::lock_guard<std::mutex> lg(numReadsOfParsedFilesMutex);
+            numReadsOfParsedFiles[inputFile] = numReads;
+        };
 
-            for(auto& c : sequence){
-                if(c == 'a') c = 'A';
-                else if(c == 'c') c = 'C';
-                else if(c == 'g') c = 'G';
-                else if(c == 't') c = 'T';
-                else if(!isValidBase(c)){
-                    c = bases[Ncount];
-                    Ncount = (Ncount + 1) % 4;
+        auto getReadIdOffsetOfFile = [&](int inputFile) -> std::optional<read_number>{
+            std::lock_guard<std::mutex> lg(numReadsOfParsedFilesMutex);
+            read_number offset = 0;
+            for(int i = 0; i < inputFile; i++){
+                if(!numReadsOfParsedFiles[i].has_value()){
+                    return std::nullopt;
                 }
+                offset += *numReadsOfParsedFiles[i];
             }
-
-            return numundeterminedBasesInSequence > 0;
+            return offset;
         };
 
-
         struct BatchFromFile{
             int validItems = 0;
-            read_number firstReadId = 0;
+            int inputFile = 0;
+            read_number firstReadId = 0; //relative to the beginning of inputFile
             std::vector<std::string> sequences{};
             std::vector<std::string> qualities{};
+            std::vector<std::string> headers{};
         };
 
     
@@ -107,8 +137,9 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
 
         auto fileParserThreadFunction = [&](
             const std::string& filename, 
-            std::size_t readIdOffset
+            int inputFile
         ){
+            std::size_t readIdOffset = 0;
             int batchId = 0;
 
             BatchFromFile* sbatch = nullptr;
@@ -116,11 +147,15 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
             auto initbatch = [&](){
                 sbatch = freeBatchFromFile.pop();
                 sbatch->validItems = 0;
+                sbatch->inputFile = inputFile;
                 sbatch->firstReadId = readIdOffset;
                 sbatch->sequences.resize(fileParserMaxBatchsize);
                 if(useQualityScores){
                     sbatch->qualities.resize(fileParserMaxBatchsize);
                 }
+                if(storeReadHeaders){
+                    sbatch->headers.resize(fileParserMaxBatchsize);
+                }
             };
 
             initbatch();
@@ -137,6 +172,9 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
                     if(useQualityScores){
                         std::swap(sbatch->qualities[sbatch->validItems], read.quality);
                     }
+                    if(storeReadHeaders){
+                        std::swap(sbatch->headers[sbatch->validItems], read.header);
+                    }
                     sbatch->validItems++;
 
                     if(sbatch->validItems >= fileParserMaxBatchsize){
@@ -150,11 +188,16 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
                     }
 
                     totalNumberOfReads++;
-                }
+                },
+                //concurrent parsers share the inflate threads
+                kseqpp::ParallelGzReader::numThreadsPerReader(numParsers)
             );        
 
             sbatch->sequences.resize(sbatch->validItems);
             sbatch->qualities.resize(sbatch->validItems);
+            if(storeReadHeaders){
+                sbatch->headers.resize(sbatch->validItems);
+            }
             unprocessedBatchFromFile.push(sbatch);
 
             return totalNumberOfReads;
@@ -163,8 +206,9 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
         auto pairedfileParserThreadFunction = [&](
             const std::string& filename1, 
             const std::string& filename2,
-            std::size_t readIdOffset
+            int inputFile
         ){
+            std::size_t readIdOffset = 0;
             int batchId = 0;
 
             BatchFromFile* sbatch = nullptr;
@@ -172,11 +216,15 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
             auto initbatch = [&](){
                 sbatch = freeBatchFromFile.pop();
                 sbatch->validItems = 0;
+                sbatch->inputFile = inputFile;
                 sbatch->firstReadId = readIdOffset;
                 sbatch->sequences.resize(fileParserMaxBatchsize);
                 if(useQualityScores){
                     sbatch->qualities.resize(fileParserMaxBatchsize);
                 }
+                if(storeReadHeaders){
+                    sbatch->headers.resize(fileParserMaxBatchsize);
+                }
             };
 
             initbatch();
@@ -193,6 +241,9 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
                     if(useQualityScores){
                         std::swap(sbatch->qualities[sbatch->validItems], read.quality);
                     }
+                    if(storeReadHeaders){
+                        std::swap(sbatch->headers[sbatch->validItems], read.header);
+                    }
                     sbatch->validItems++;
 
                     if(sbatch->validItems >= fileParserMaxBatchsize){
@@ -211,6 +262,9 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
 
             sbatch->sequences.resize(sbatch->validItems);
             sbatch->qualities.resize(sbatch->validItems);
+            if(storeReadHeaders){
+                sbatch->headers.resize(sbatch->validItems);
+            }
             unprocessedBatchFromFile.push(sbatch);
 
             return totalNumberOfReads;
@@ -219,6 +273,10 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
 
         struct EncodedBatch{
             int validItems = 0;
+            int inputFile = 0;
+            //if false, read ids are relative to the beginning of inputFile. 
+            //Then, the original sequences of ambiguous reads are kept because the replacement of their invalid bases depends on the read id
+            bool hasFinalReadIds = true;
             read_number firstReadId = 0;
             std::size_t encodedSequencePitchInInts = 0;
             //std::size_t qualityPitchInBytes = 0;
@@ -228,116 +286,301 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
             //std::vector<char> qualities{};
             std::vector<unsigned int> encodedQualities{};
             std::vector<read_number> ambiguousReadIds{};
+            std::vector<std::string> ambiguousSequences{};
+            std::vector<std::uint8_t> encodedHeaders{};
         };
 
         SimpleConcurrentQueue<EncodedBatch*> freeEncodedBatches;
         SimpleConcurrentQueue<EncodedBatch*> unprocessedEncodedBatches;
 
-        auto encoderThreadFunction = [&](){
-            BatchFromFile* sbatch = unprocessedBatchFromFile.pop();
-            EncodedBatch* encbatch = nullptr;
+        //per-thread state of the encoding
+        struct EncoderState{
+            ReadHeaderChunkEncoder headerEncoder;
+        };
 
-            QualityCompressorWrapper qualityCompressor(numQualityBits);
+        //encode numReads reads of inputFile with consecutive read ids into an encoded batch and pass it to the inserter.
+        //firstReadIdInFile is relative to the beginning of inputFile. getRecord(i) returns the SequenceRecordView of the i-th read
+        auto encodeReads = [&](EncoderState& state, int inputFile, read_number firstReadIdInFile, int numReads, auto getRecord){
+            const std::optional<read_number> readIdOffset = getReadIdOffsetOfFile(inputFile);
+            const read_number firstReadId = firstReadIdInFile + readIdOffset.value_or(0);
 
-            auto initEncBatch = [&](auto sequencepitchInInts, auto qualityPitchInInts){
-                encbatch = freeEncodedBatches.pop();
-                assert(encbatch != nullptr);
+            int maxLength = 0;
+            for(int i = 0; i < numReads; i++){
+                maxLength = std::max(maxLength, int(getRecord(i).sequence.length()));
+            }
 
-                encbatch->validItems = sbatch->validItems;
-                encbatch->firstReadId = sbatch->firstReadId;
-                encbatch->encodedSequencePitchInInts = sequencepitchInInts;
-                encbatch->sequenceLengths.resize(encbatch->validItems);
-                encbatch->encodedSequences.resize(encbatch->validItems * sequencepitchInInts);
-                if(useQualityScores){
-                    encbatch->encodedQualityPitchInInts = qualityPitchInInts;
-                    encbatch->encodedQualities.resize(encbatch->validItems * qualityPitchInInts);
+            const std::size_t sequencepitchInInts = SequenceHelpers::getEncodedNumInts2Bit(maxLength);
+            const std::size_t qualityPitchInInts = QualityCompressionHelper::getNumInts(maxLength, numQualityBits);
+
+            EncodedBatch* encbatch = freeEncodedBatches.pop();
+            assert(encbatch != nullptr);
+
+            encbatch->validItems = numReads;
+            encbatch->inputFile = inputFile;
+            encbatch->hasFinalReadIds = readIdOffset.has_value();
+            encbatch->firstReadId = firstReadId;
+            encbatch->encodedSequencePitchInInts = sequencepitchInInts;
+            encbatch->sequenceLengths.resize(encbatch->validItems);
+            encbatch->encodedSequences.resize(encbatch->validItems * sequencepitchInInts);
+            if(useQualityScores){
+                encbatch->encodedQualityPitchInInts = qualityPitchInInts;
+                encbatch->encodedQualities.resize(encbatch->validItems * qualityPitchInInts);
+            }
+            encbatch->ambiguousReadIds.clear();
+            encbatch->ambiguousSequences.clear();
+            state.headerEncoder.clear();
+
+            for(int i = 0; i < numReads; i++){
+                const SequenceRecordView record = getRecord(i);
+                const read_number readId = firstReadId + i;
+                const int length = record.sequence.length();
+
+                if(storeReadHeaders){
+                    //original sequence, before it is modified for the 2-bit encoding
+                    state.headerEncoder.append(record.header, record.sequence);
                 }
-                encbatch->ambiguousReadIds.clear();
-            };
-
-            while(sbatch != nullptr){
-                int maxLength = 0;
-                int Ncount = 0;
 
-                for(int i = 0; i < sbatch->validItems; i++){
-                    const int length = sbatch->sequences[i].length();
-                    maxLength = std::max(maxLength, length);
+                //invalid bases are replaced. The k-th invalid base of a read is replaced by
+                //bases[(readId + k) % 4], so the result does not depend on how reads are grouped into batches
+                const bool isAmbig = IngestEncoding::encodeRead(
+                    encbatch->encodedSequences.data() + i * sequencepitchInInts,
+                    useQualityScores ? encbatch->encodedQualities.data() + i * qualityPitchInInts : nullptr,
+                    useQualityScores ? numQualityBits : 0,
+                    record.sequence.data(),
+                    record.quality.data(),
+                    length,
+                    readId
+                );
+                if(isAmbig){
+                    encbatch->ambiguousReadIds.emplace_back(readId);
+                    if(!encbatch->hasFinalReadIds){
+                        encbatch->ambiguousSequences.emplace_back(record.sequence);
+                    }
                 }
+                
+                encbatch->sequenceLengths[i] = length;
+            }
 
-                const std::size_t sequencepitchInInts = SequenceHelpers::getEncodedNumInts2Bit(maxLength);
-                const std::size_t qualityPitchInInts = QualityCompressionHelper::getNumInts(maxLength, numQualityBits);
+            if(storeReadHeaders){
+                encbatch->encodedHeaders.assign(state.headerEncoder.getData().begin(), state.headerEncoder.getData().end());
+            }
 
-                initEncBatch(sequencepitchInInts, qualityPitchInInts);
+            unprocessedEncodedBatches.push(encbatch);
+        };
 
-                for(int i = 0; i < sbatch->validItems; i++){
-                    const int length = sbatch->sequences[i].length();
-                    encbatch->sequenceLengths[i] = length;
+        auto encoderThreadFunction = [&](){
+            BatchFromFile* sbatch = unprocessedBatchFromFile.pop();
 
-                    bool isAmbig = preprocessSequence(sbatch->sequences[i], Ncount);
-                    if(isAmbig){
-                        const read_number readId = sbatch->firstReadId + i;
-                        encbatch->ambiguousReadIds.emplace_back(readId);
-                    }
-
-                    SequenceHelpers::encodeSequence2Bit(
-                        encbatch->encodedSequences.data() + i * sequencepitchInInts,
-                        sbatch->sequences[i].c_str(),
-                        length
-                    );
+            EncoderState state;
 
+            while(sbatch != nullptr){
+                encodeReads(state, sbatch->inputFile, sbatch->firstReadId, sbatch->validItems, [&](int i){
+                    SequenceRecordView record;
+                    record.sequence = sbatch->sequences[i];
                     if(useQualityScores){
-                        qualityCompressor.encodeQualityString(
-                            encbatch->encodedQualities.data() + i * qualityPitchInInts,
-                            sbatch->qualities[i].data(),
-                            length
-                        );
+                        record.quality = sbatch->qualities[i];
                     }
-                    
-                    encbatch->sequenceLengths[i] = length;
-                }
+                    if(storeReadHeaders){
+                        record.header = sbatch->headers[i];
+                    }
+                    return record;
+                });
 
                 freeBatchFromFile.push(sbatch);
-                unprocessedEncodedBatches.push(encbatch);           
 
                 sbatch = unprocessedBatchFromFile.pop();
             }
         };
 
+        constexpr std::size_t mappedFileChunkBytes = std::size_t(16) << 20;
+
+        /*
+            Parse an uncompressed file with numWorkers threads, using a memory mapping of the file. 
+            Each worker parses chunks of the file and encodes the records directly from the mapping.
+            The read ids of a chunk are known once the preceding chunk has been parsed.
+            Like the parsing with KseqPP, parsing stops at the first malformed record.
+        */
+        auto mappedFileParserFunction = [&](
+            const std::string& filename, 
+            int inputFile,
+            int numWorkers
+        ){
+            MappedSequenceFileParser parser(filename, mappedFileChunkBytes);
+            const std::size_t numChunks = parser.getNumChunks();
+
+            std::atomic<std::size_t> nextChunk{0};
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::size_t numChunksWithReadIds = 0;
+            std::size_t endChunk = numChunks; //chunks after a parse error are not used
+            read_number nextFirstReadId = 0;
+
+            auto workerFunction = [&](){
+                EncoderState state;
+                std::vector<SequenceRecordView> records;
+                std::vector<char> buffer;
+
+                for(std::size_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++){
+                    bool parseError = false;
+                    try{
+                        parser.parseChunk(chunk, records, buffer);
+                    }catch(const std::runtime_error& e){
+                        std::cerr << "parser error in file " << filename << ": " << e.what() << "\n";
+                        parseError = true;
+                    }
+
+                    read_number firstReadId = 0;
+                    bool useChunk = false;
+                    {
+                        std::unique_lock<std::mutex> ul(mutex);
+                        cv.wait(ul, [&](){ return numChunksWithReadIds == chunk; });
+
+                        if(parseError){
+                            endChunk = std::min(endChunk, chunk);
+                        }
+                        useChunk = chunk < endChunk;
+
+                        firstReadId = nextFirstReadId;
+                        if(useChunk){
+                            nextFirstReadId += records.size();
+                        }
+                        numChunksWithReadIds++;
+                        cv.notify_all();
+                    }
+
+                    if(useChunk && records.size() > 0){
+                        encodeReads(state, inputFile, firstReadId, records.size(), [&](int i){
+                            return records[i];
+                        });
+                    }
+                }
+            };
+
+            std::vector<std::future<void>> workerFutures;
+            for(int i = 0; i < numWorkers; i++){
+                workerFutures.emplace_back(std::async(std::launch::async, workerFunction));
+            }
+            for(auto& f : workerFutures){
+                f.wait();
+            }
+
+            return std::size_t(nextFirstReadId);
+        };
+
+        auto parseSingleFile = [&](const std::string& filename, int inputFile){
+            std::size_t numReads = 0;
+            if(MappedSequenceFileParser::canParse(filename)){
+                //the encoders are shared between concurrently parsed files
+                numReads = mappedFileParserFunction(filename, inputFile, std::max(1, numEncoders / numParsers));
+            }else{
+                numReads = fileParserThreadFunction(filename, inputFile);
+            }
+            setNumReadsOfParsedFile(inputFile, numReads);
+            return numReads;
+        };
+
+        //replace relative read ids of batch by final read ids. ambiguous reads are encoded again with their final read id
+        auto setFinalReadIds = [&](EncodedBatch& batch, read_number readIdOffset){
+            assert(!batch.hasFinalReadIds);
+            assert(batch.ambiguousReadIds.size() == batch.ambiguousSequences.size());
+
+            for(std::size_t k = 0; k < batch.ambiguousReadIds.size(); k++){
+                const std::size_t i = batch.ambiguousReadIds[k] - batch.firstReadId;
+                const std::string& sequence = batch.ambiguousSequences[k];
+
+                batch.ambiguousReadIds[k] += readIdOffset;
+
+                IngestEncoding::encodeRead(
+                    batch.encodedSequences.data() + i * batch.encodedSequencePitchInInts,
+                    nullptr,
+                    0,
+                    sequence.data(),
+                    nullptr,
+                    sequence.size(),
+                    batch.ambiguousReadIds[k]
+                );
+            }
+
+            batch.firstReadId += readIdOffset;
+            batch.ambiguousSequences.clear();
+            batch.hasFinalReadIds = true;
+        };
+
         auto inserterThreadFunction = [&](){
-            EncodedBatch* sbatch = unprocessedEncodedBatches.pop();
+            //batches of files whose read id offset was not known yet
+            std::vector<EncodedBatch> batchesWithRelativeReadIds;
 
-            while(sbatch != nullptr){
-                const int numSequences = sbatch->validItems;
+            auto insertBatch = [&](EncodedBatch& batch){
+                assert(batch.hasFinalReadIds);
 
-                if(sbatch->ambiguousReadIds.size() > 0){
+                if(batch.ambiguousReadIds.size() > 0){
                     readStorage->appendAmbiguousReadIds(
-                        sbatch->ambiguousReadIds
+                        batch.ambiguousReadIds
                     );
                 }
 
                 readStorage->appendConsecutiveReads(
-                    sbatch->firstReadId,
-                    sbatch->validItems,
-                    std::move(sbatch->sequenceLengths),
-                    std::move(sbatch->encodedSequences),
-                    sbatch->encodedSequencePitchInInts,
-                    std::move(sbatch->encodedQualities),
-                    sbatch->encodedQualityPitchInInts
+                    batch.firstReadId,
+                    batch.validItems,
+                    std::move(batch.sequenceLengths),
+                    std::move(batch.encodedSequences),
+                    batch.encodedSequencePitchInInts,
+                    std::move(batch.encodedQualities),
+                    batch.encodedQualityPitchInInts
                 );
 
+                if(storeReadHeaders){
+                    readStorage->appendReadHeaders(
+                        batch.firstReadId,
+                        batch.validItems,
+                        std::move(batch.encodedHeaders)
+                    );
+                }
+            };
+
+            auto insertBatchesWithKnownReadIdOffset = [&](){
+                for(auto& batch : batchesWithRelativeReadIds){
+                    const std::optional<read_number> readIdOffset = getReadIdOffsetOfFile(batch.inputFile);
+                    if(readIdOffset.has_value()){
+                        setFinalReadIds(batch, *readIdOffset);
+                        insertBatch(batch);
+                    }
+                }
+
+                auto it = std::remove_if(batchesWithRelativeReadIds.begin(), batchesWithRelativeReadIds.end(), [](const auto& batch){
+                    return batch.hasFinalReadIds;
+                });
+                batchesWithRelativeReadIds.erase(it, batchesWithRelativeReadIds.end());
+            };
+
+            EncodedBatch* sbatch = unprocessedEncodedBatches.pop();
+
+            while(sbatch != nullptr){
+                const int numSequences = sbatch->validItems;
+
+                if(sbatch->hasFinalReadIds){
+                    insertBatch(*sbatch);
+                }else{
+                    batchesWithRelativeReadIds.emplace_back(std::move(*sbatch));
+                }
+
+                if(batchesWithRelativeReadIds.size() > 0){
+                    insertBatchesWithKnownReadIdOffset();
+                }
+
                 progressThread.addProgress(numSequences);
 
                 freeEncodedBatches.push(sbatch);
                 sbatch = unprocessedEncodedBatches.pop();
             }
-                    
-        };
 
+            //all files have been parsed
+            insertBatchesWithKnownReadIdOffset();
+            assert(batchesWithRelativeReadIds.empty());
+        };
 
 
-        constexpr int numParsers = 1;
-        int numEncoders = 4;
-        int numInserters = 1;
 
         const int numFilebatches = numParsers + numEncoders;
 
@@ -377,30 +620,38 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
         }
 
         std::size_t totalNumReads = 0;
+        std::vector<std::size_t> numReadsPerFile;
+        bool alternatingFiles = false;
 
         if(programOptions.pairType == SequencePairType::SingleEnd){
 
-            const int numInputFiles = programOptions.inputfiles.size();
+            //each parser thread parses the next file which has not been parsed yet
+            std::atomic<int> nextInputFile{0};
 
-            for(int i = 0; i < numInputFiles; i++){
-                std::string inputfile = programOptions.inputfiles[i];
+            auto parseInputFiles = [&](){
+                for(int i = nextInputFile++; i < numInputFiles; i = nextInputFile++){
+                    parseSingleFile(programOptions.inputfiles[i], i);
+                }
+            };
 
-                std::future<std::size_t> future = std::async(
-                    std::launch::async,
-                    fileParserThreadFunction,
-                    std::move(inputfile), totalNumReads
-                );
+            std::vector<std::future<void>> parserFutures;
+            for(int i = 0; i < numParsers; i++){
+                parserFutures.emplace_back(std::async(std::launch::async, parseInputFiles));
+            }
+            for(auto& f : parserFutures){
+                f.get();
+            }
 
-                std::size_t numReads = future.get();
+            for(int i = 0; i < numInputFiles; i++){
+                const std::size_t numReads = *numReadsOfParsedFiles[i];
                 totalNumReads += numReads;
+                numReadsPerFile.push_back(numReads);
             }
 
         }else if(programOptions.pairType == SequencePairType::PairedEnd){
             //paired end may be one of the following. 1 file with interleaved reads,
             //or two files with separate reads
 
-            const int numInputFiles = programOptions.inputfiles.size();
-
             assert(numInputFiles > 0);
             assert(numInputFiles <= 2);
 
@@ -413,12 +664,13 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
 
                 std::future<std::size_t> future = std::async(
                     std::launch::async,
-                    fileParserThreadFunction,
-                    std::move(inputfile), totalNumReads
+                    parseSingleFile,
+                    std::move(inputfile), 0
                 );
 
                 std::size_t numReads = future.get();
                 totalNumReads += numReads;
+                numReadsPerFile.push_back(numReads);
             
             }else{
                 assert(numInputFiles == 2);
@@ -432,11 +684,14 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
                 std::future<std::size_t> future = std::async(
                     std::launch::async,
                     pairedfileParserThreadFunction,
-                    std::move(filename1), std::move(filename2), totalNumReads
+                    std::move(filename1), std::move(filename2), 0
                 );
 
                 std::size_t numReads = future.get();
                 totalNumReads += numReads;
+                numReadsPerFile.push_back(numReads / 2);
+                numReadsPerFile.push_back(numReads / 2);
+                alternatingFiles = true;
             
             }
         }else{
@@ -466,6 +721,10 @@ std::unique_ptr<ChunkedReadStorage> constructChunkedReadStorageFromFiles(
             std::cout << "\n";
         }
 
+        if(storeReadHeaders){
+            readStorage->getReadHeaderStorage()->setInputFileLayout(std::move(numReadsPerFile), alternatingFiles);
+        }
+
         helpers::CpuTimer footimer("init readstorage after construction");
         
         readStorage->appendingFinished(
@@ -8,16 +8,28 @@
 #include <readlibraryio.hpp>
 #include <cpureadstorage.hpp>
 #include <cpuminhasher.hpp>
+#include <orderedcorrectionresultstream.hpp>
+#include <memorybudget.hpp>
 
 namespace care{
 namespace cpu{
 
 
 
+	/*
+		If resultStream is not null, corrections are pushed to resultStream in batches of ascending read ids
+		and the returned partial results are empty. resultStream->finish() is not called.
+		In this case, anchors are processed in read id order without correction pipeline.
+
+		The memory of minhasher and readStorage must be accounted in memoryBudget. Partial results 
+		are spilled to the temp directory when the budget is exhausted.
+	*/
 	SerializedObjectStorage correct_cpu(
 		const ProgramOptions& programOptions,
 		CpuMinhasher& minhasher,
-		CpuReadStorage& readStorage
+		CpuReadStorage& readStorage,
+		MemoryBudget& memoryBudget,
+		OrderedCorrectionResultStream* resultStream = nullptr
 	);
 
 	
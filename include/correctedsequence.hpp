@@ -309,11 +309,25 @@ namespace care{
 
             target.readId = readId;
 
-            target.encodedflags = (std::uint32_t(hq) << 31);
-            target.encodedflags |= (std::uint32_t(useEdits) << 30);
-            target.encodedflags |= (std::uint32_t(int(type)) << 29);
+            const std::uint32_t numBytes = computeNumDataBytes(useEdits, type, numEdits, sequenceLength);
+            target.encodedflags = makeEncodedFlags(hq, useEdits, type, numBytes);
 
+            if(numBytes > oldNumBytes){
+                target.data = std::make_unique<std::uint8_t[]>(numBytes);
+            }else{
+                ; //reuse buffer
+            }
+
+            encodeDataIntoMemory(target.data.get(), useEdits, type, shift, numEdits, edits, sequenceLength, sequence);
+        }
 
+        //number of bytes of the data section of an encoded sequence
+        static std::uint32_t computeNumDataBytes(
+            bool useEdits,
+            TempCorrectedSequenceType type,
+            int numEdits,
+            int sequenceLength
+        ) noexcept{
             std::uint32_t numBytes = 0;
             if(useEdits){
                 numBytes += sizeof(int);
@@ -336,18 +350,69 @@ namespace care{
             assert(numBytes <= maxNumBytes);
             #endif
 
-            target.encodedflags |= numBytes;
+            return numBytes;
+        }
 
-            if(numBytes > oldNumBytes){
-                target.data = std::make_unique<std::uint8_t[]>(numBytes);
-            }else{
-                ; //reuse buffer
+        static std::uint32_t makeEncodedFlags(
+            bool hq,
+            bool useEdits,
+            TempCorrectedSequenceType type,
+            std::uint32_t numDataBytes
+        ) noexcept{
+            std::uint32_t flags = (std::uint32_t(hq) << 31);
+            flags |= (std::uint32_t(useEdits) << 30);
+            flags |= (std::uint32_t(int(type)) << 29);
+            flags |= numDataBytes;
+            return flags;
+        }
+
+        /*
+            Write the serialized representation (readId, encodedflags, data) to ptr without 
+            constructing an EncodedTempCorrectedSequence. Produces the same bytes as copyToContiguousMemory.
+            Returns pointer past the last written byte, or nullptr if [ptr, endPtr) is too small
+        */
+        static std::uint8_t* encodeDataIntoContiguousMemory(
+            std::uint8_t* ptr,
+            std::uint8_t* endPtr,
+            read_number readId,
+            bool hq,
+            bool useEdits,
+            TempCorrectedSequenceType type,
+            int shift,
+            int numEdits,
+            const CorrectionEdit* edits,
+            int sequenceLength,
+            const char* sequence
+        ){
+            const std::uint32_t numBytes = computeNumDataBytes(useEdits, type, numEdits, sequenceLength);
+
+            const std::size_t availableBytes = std::distance(ptr, endPtr);
+            const std::size_t requiredBytes = sizeof(read_number) + sizeof(std::uint32_t) + numBytes;
+            if(requiredBytes > availableBytes){
+                return nullptr;
             }
 
-            //fill buffer
+            const std::uint32_t flags = makeEncodedFlags(hq, useEdits, type, numBytes);
+
+            std::memcpy(ptr, &readId, sizeof(read_number));
+            ptr += sizeof(read_number);
+            std::memcpy(ptr, &flags, sizeof(std::uint32_t));
+            ptr += sizeof(std::uint32_t);
 
-            std::uint8_t* ptr = target.data.get();
+            return encodeDataIntoMemory(ptr, useEdits, type, shift, numEdits, edits, sequenceLength, sequence);
+        }
 
+    private:
+        static std::uint8_t* encodeDataIntoMemory(
+            std::uint8_t* ptr,
+            bool useEdits,
+            TempCorrectedSequenceType type,
+            int shift,
+            int numEdits,
+            const CorrectionEdit* edits,
+            int sequenceLength,
+            const char* sequence
+        ){
             if(useEdits){
                 std::memcpy(ptr, &numEdits, sizeof(int));
                 ptr += sizeof(int);
@@ -376,6 +441,8 @@ namespace care{
                 std::memcpy(ptr, &shift, sizeof(int));
                 ptr += sizeof(int);
             }
+
+            return ptr;
         }
 
     };
@@ -424,6 +491,28 @@ namespace care{
             );
         }
 
+        int getSerializedNumBytes() const noexcept{
+            return sizeof(read_number) + sizeof(std::uint32_t) 
+                + EncodedTempCorrectedSequence::computeNumDataBytes(useEdits, type, edits.size(), sequence.size());
+        }
+
+        //serialize in the format of EncodedTempCorrectedSequence::copyToContiguousMemory
+        std::uint8_t* copyToContiguousMemory(std::uint8_t* ptr, std::uint8_t* endPtr) const{
+            return EncodedTempCorrectedSequence::encodeDataIntoContiguousMemory(
+                ptr,
+                endPtr,
+                readId,
+                hq,
+                useEdits,
+                type,
+                shift,
+                edits.size(),
+                edits.data(),
+                sequence.size(),
+                sequence.data()
+            );
+        }
+
         EncodedTempCorrectedSequence encode() const{
             EncodedTempCorrectedSequence encoded;
             encodeInto(encoded);
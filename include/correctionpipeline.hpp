@@ -0,0 +1,372 @@
+#ifndef CARE_CORRECTIONPIPELINE_HPP
+#define CARE_CORRECTIONPIPELINE_HPP
+
+#include <config.hpp>
+
+#include <options.hpp>
+#include <corrector.hpp>
+#include <corrector_common.hpp>
+#include <candidatecorrectionaggregator.hpp>
+#include <candidaterowcache.hpp>
+#include <cpucorrectortask.hpp>
+#include <cpuminhasher.hpp>
+#include <cpureadstorage.hpp>
+#include <classification.hpp>
+#include <concurrencyhelpers.hpp>
+#include <serializedobjectstorage.hpp>
+#include <sequencehelpers.hpp>
+#include <threadpool.hpp>
+#include <workstealingscheduler.hpp>
+#include <util.hpp>
+
+#include <moodycamel/concurrentqueue/blockingconcurrentqueue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace care{
+namespace cpu{
+
+    /*
+        Pipelined single-end correction.
+
+        Gather workers determine the candidate read ids of the anchors of a batch, and gather the candidate sequences
+        (CpuErrorCorrector::prepareTask). These steps are dominated by the latency of hash table lookups and random accesses
+        to the read storage. Correction workers compute alignments, msa, and corrections of prepared batches
+        (CpuErrorCorrector::processPreparedTask) and hand serialized corrections to the output thread.
+
+        Stages are connected by lock-free queues. The number of batches in flight is bounded by a fixed pool of batches,
+        which are recycled after their corrections have been saved by the output thread.
+        After the last gather worker has finished, it waits until all batches have been returned to the pool
+        and then enqueues one nullptr per correction worker to signal the end of input. The queues are only FIFO per producer,
+        so the signals must not be enqueued while prepared batches of other gather workers could still be in the queue.
+    */
+    class CorrectionPipeline{
+    public:
+        struct Config{
+            int numGatherThreads = 1;
+            int numCorrectionThreads = 1;
+            int batchsize = 16;
+        };
+
+        //if numGatherThreads == 0, use a quarter of the threads for gathering
+        static Config makeConfig(int numThreads, int numGatherThreads, int batchsize){
+            Config config;
+            config.batchsize = std::max(1, batchsize);
+
+            if(numGatherThreads > 0){
+                config.numGatherThreads = numGatherThreads;
+            }else{
+                config.numGatherThreads = std::max(1, numThreads / 4);
+            }
+
+            config.numCorrectionThreads = std::max(1, numThreads - config.numGatherThreads);
+
+            return config;
+        }
+
+        CorrectionPipeline(
+            const Config& config_,
+            const ProgramOptions& programOptions_,
+            const CpuMinhasher& minhasher_,
+            const CpuReadStorage& readStorage_,
+            ReadCorrectionFlags& correctionFlags_,
+            const ClfAgent& clfAgent_
+        ) : config(config_),
+            programOptions(&programOptions_),
+            minhasher(&minhasher_),
+            readStorage(&readStorage_),
+            correctionFlags(&correctionFlags_),
+            clfAgent(&clfAgent_)
+        {
+            assert(!readStorage->isPairedEnd());
+        }
+
+        /*
+            Correct reads [0, numReadsToProcess). Serialized corrections are inserted into partialResults by outputThread.
+            If anchorOrder is not empty, anchors are processed in this order instead of read id order.
+            If candidateCorrectionAggregator is not null, candidate corrections are added to it instead of partialResults.
+            Returns the accumulated time measurements of all correctors.
+        */
+        CpuErrorCorrector::TimeMeasurements run(
+            std::size_t numReadsToProcess,
+            const std::vector<read_number>& anchorOrder,
+            SerializedObjectStorage& partialResults,
+            CandidateCorrectionAggregator* candidateCorrectionAggregator,
+            BackgroundThread& outputThread,
+            ProgressThread<read_number>& progressThread
+        ){
+            rowCacheStatistics = CandidateRowCache::Statistics{};
+
+            encodedSequencePitchInInts2Bit = SequenceHelpers::getEncodedNumInts2Bit(readStorage->getSequenceLengthUpperBound());
+            decodedSequencePitchInBytes = readStorage->getSequenceLengthUpperBound();
+            qualityPitchInBytes = readStorage->getSequenceLengthUpperBound();
+
+            //partial results refer to the original read ids
+            const read_number* const originalReadIds = readStorage->getOriginalReadIds();
+            const read_number* const originalReadIdOffsets = readStorage->getOriginalReadIdOffsets();
+
+            const int numBatches = 2 * (config.numGatherThreads + config.numCorrectionThreads);
+            batches.resize(numBatches);
+            for(auto& batch : batches){
+                batch = std::make_unique<Batch>();
+                batch->readIds.reserve(config.batchsize);
+                batch->encodedData.resize(config.batchsize * encodedSequencePitchInInts2Bit);
+                batch->qualities.resize(config.batchsize * qualityPitchInBytes);
+                batch->lengths.resize(config.batchsize);
+                batch->tasks.resize(config.batchsize);
+                freeBatches.push(batch.get());
+            }
+
+            WorkStealingScheduler<read_number> scheduler(0, numReadsToProcess, config.numGatherThreads);
+
+            std::cout << "Pipelined correction with " << config.numGatherThreads << " gather threads and "
+                << config.numCorrectionThreads << " correction threads\n";
+
+            CpuErrorCorrector::TimeMeasurements timingsOfAllThreads;
+            std::mutex timingsMutex;
+            std::atomic<int> numRunningGatherThreads{config.numGatherThreads};
+
+            auto gatherThreadFunction = [&](int threadId){
+                ClfAgent myClfAgent = *clfAgent;
+                CpuErrorCorrector errorCorrector = makeErrorCorrector(myClfAgent);
+
+                read_number batchBegin = 0;
+                read_number batchEnd = 0;
+
+                while(true){
+                    Batch* batch = freeBatches.pop();
+
+                    if(!scheduler.next(threadId, config.batchsize, batchBegin, batchEnd)){
+                        freeBatches.push(batch);
+                        break;
+                    }
+
+                    batch->readIds.resize(batchEnd - batchBegin);
+                    if(anchorOrder.empty()){
+                        std::iota(batch->readIds.begin(), batch->readIds.end(), batchBegin);
+                    }else{
+                        std::copy(anchorOrder.begin() + batchBegin, anchorOrder.begin() + batchEnd, batch->readIds.begin());
+                    }
+
+                    gatherAnchors(*batch);
+
+                    const int numAnchors = batch->readIds.size();
+                    for(int i = 0; i < numAnchors; i++){
+                        CpuErrorCorrectorInput input;
+                        input.anchorReadId = batch->readIds[i];
+                        input.encodedAnchor = batch->encodedData.data() + i * encodedSequencePitchInInts2Bit;
+                        input.anchorQualityscores = batch->qualities.data() + i * qualityPitchInBytes;
+                        input.anchorLength = batch->lengths[i];
+
+                        errorCorrector.prepareTaskCandidateIds(input, batch->tasks[i]);
+                    }
+
+                    //the candidate rows of the next anchor are fetched while the candidates of the current anchor are gathered
+                    if(numAnchors > 0){
+                        prefetchCandidateSequences(batch->tasks[0]);
+                    }
+                    for(int i = 0; i < numAnchors; i++){
+                        if(i + 1 < numAnchors){
+                            prefetchCandidateSequences(batch->tasks[i + 1]);
+                        }
+
+                        errorCorrector.prepareTaskCandidateData(batch->tasks[i]);
+                    }
+
+                    preparedBatches.enqueue(batch);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lg(timingsMutex);
+                    timingsOfAllThreads += errorCorrector.getTimings();
+                    rowCacheStatistics += errorCorrector.getCandidateRowCacheStatistics();
+                }
+
+                //last gather thread signals end of input to correction threads once no prepared batch is left
+                if(--numRunningGatherThreads == 0){
+                    std::vector<Batch*> returnedBatches(numBatches);
+                    for(auto& returnedBatch : returnedBatches){
+                        returnedBatch = freeBatches.pop();
+                    }
+                    for(auto returnedBatch : returnedBatches){
+                        freeBatches.push(returnedBatch);
+                    }
+
+                    for(int i = 0; i < config.numCorrectionThreads; i++){
+                        preparedBatches.enqueue(nullptr);
+                    }
+                }
+            };
+
+            auto correctionThreadFunction = [&](){
+                ClfAgent myClfAgent = *clfAgent;
+                CpuErrorCorrector errorCorrector = makeErrorCorrector(myClfAgent);
+
+                Batch* batch = nullptr;
+                preparedBatches.wait_dequeue(batch);
+
+                while(batch != nullptr){
+                    batch->corrections.clear();
+
+                    const int numAnchors = batch->readIds.size();
+                    for(int i = 0; i < numAnchors; i++){
+                        auto output = errorCorrector.processPreparedTask(batch->tasks[i]);
+
+                        if(output.hasAnchorCorrection){
+                            batch->corrections.append(output.anchorCorrection);
+                        }
+
+                        for(const auto& tmp : output.candidateCorrections){
+                            if(candidateCorrectionAggregator != nullptr){
+                                candidateCorrectionAggregator->add(tmp, batch->corrections);
+                            }else{
+                                batch->corrections.append(tmp);
+                            }
+                        }
+                    }
+
+                    if(originalReadIds != nullptr){
+                        batch->corrections.mapReadIds(originalReadIds, originalReadIdOffsets);
+                    }
+
+                    auto outputfunction = [&, batch](){
+                        const std::size_t num = batch->corrections.size();
+
+                        for(std::size_t i = 0; i < num; i++){
+                            partialResults.insert(
+                                batch->corrections.getSerializedBegin(i),
+                                batch->corrections.getSerializedEnd(i)
+                            );
+                        }
+
+                        freeBatches.push(batch);
+                    };
+
+                    outputThread.enqueue(std::move(outputfunction));
+
+                    myClfAgent.flush();
+
+                    progressThread.addProgress(numAnchors);
+
+                    preparedBatches.wait_dequeue(batch);
+                }
+
+                std::lock_guard<std::mutex> lg(timingsMutex);
+                timingsOfAllThreads += errorCorrector.getTimings();
+                rowCacheStatistics += errorCorrector.getCandidateRowCacheStatistics();
+            };
+
+            std::vector<std::thread> threads;
+
+            for(int i = 0; i < config.numGatherThreads; i++){
+                threads.emplace_back(gatherThreadFunction, i);
+            }
+            for(int i = 0; i < config.numCorrectionThreads; i++){
+                threads.emplace_back(correctionThreadFunction);
+            }
+
+            for(auto& thread : threads){
+                thread.join();
+            }
+
+            //wait until output thread has processed all batches
+            for(int i = 0; i < numBatches; i++){
+                freeBatches.pop();
+            }
+
+            //statistics per thread only with ENABLE_CPU_CORRECTOR_TIMING
+            #ifdef ENABLE_CPU_CORRECTOR_TIMING
+            scheduler.printStatistics(std::cout, true);
+            #else
+            scheduler.printStatistics(std::cout, false);
+            #endif
+
+            return timingsOfAllThreads;
+        }
+
+        //accumulated statistics of the candidate row caches of all correctors of the last run
+        const CandidateRowCache::Statistics& getCandidateRowCacheStatistics() const noexcept{
+            return rowCacheStatistics;
+        }
+
+    private:
+        struct Batch{
+            std::vector<read_number> readIds{};
+            std::vector<unsigned int> encodedData{};
+            std::vector<char> qualities{};
+            std::vector<int> lengths{};
+            std::vector<CpuErrorCorrectorTask> tasks{};
+            SerializedCorrectionBatch corrections{};
+        };
+
+        CpuErrorCorrector makeErrorCorrector(ClfAgent& agent) const{
+            return CpuErrorCorrector(
+                encodedSequencePitchInInts2Bit,
+                decodedSequencePitchInBytes,
+                qualityPitchInBytes,
+                *programOptions,
+                *minhasher,
+                *readStorage,
+                *correctionFlags,
+                agent
+            );
+        }
+
+        void prefetchCandidateSequences(const CpuErrorCorrectorTask& task) const{
+            readStorage->prefetchSequences(task.candidateReadIds.data(), task.candidateReadIds.size());
+        }
+
+        void gatherAnchors(Batch& batch) const{
+            const int numAnchors = batch.readIds.size();
+
+            readStorage->gatherSequenceLengths(
+                batch.lengths.data(),
+                batch.readIds.data(),
+                numAnchors
+            );
+
+            readStorage->gatherSequences(
+                batch.encodedData.data(),
+                encodedSequencePitchInInts2Bit,
+                batch.readIds.data(),
+                numAnchors
+            );
+
+            if(programOptions->useQualityScores){
+                readStorage->gatherQualities(
+                    batch.qualities.data(),
+                    qualityPitchInBytes,
+                    batch.readIds.data(),
+                    numAnchors
+                );
+            }
+        }
+
+        Config config{};
+        const ProgramOptions* programOptions{};
+        const CpuMinhasher* minhasher{};
+        const CpuReadStorage* readStorage{};
+        ReadCorrectionFlags* correctionFlags{};
+        const ClfAgent* clfAgent{};
+
+        std::size_t encodedSequencePitchInInts2Bit{};
+        std::size_t decodedSequencePitchInBytes{};
+        std::size_t qualityPitchInBytes{};
+
+        std::vector<std::unique_ptr<Batch>> batches{};
+        CandidateRowCache::Statistics rowCacheStatistics{};
+        MultiProducerMultiConsumerQueue<Batch*> freeBatches;
+        moodycamel::BlockingConcurrentQueue<Batch*> preparedBatches;
+    };
+
+}
+}
+
+#endif
@@ -5,6 +5,8 @@
 
 #include <readlibraryio.hpp>
 #include <serializedobjectstorage.hpp>
+#include <externalsortserializedresults.hpp>
+#include <orderedcorrectionresultstream.hpp>
 #include <options.hpp>
 
 #include <string>
@@ -12,13 +14,45 @@
 
 namespace care{
 
+    class ChunkedReadStorage;
+
+    /*
+        Estimated working memory of constructOutputFileFromCorrectionResults which is not accounted otherwise:
+        batches of decoded results and original reads, merge buffers of sorted runs, and buffers of compressed output
+    */
+    std::size_t getOutputConstructionWorkingMemoryInBytes(int maximumSequenceLength, int numThreads);
+
+    //if storedReads contains read headers, the original reads are taken from storedReads instead of originalReadFiles
     void constructOutputFileFromCorrectionResults(
         const std::vector<std::string>& originalReadFiles,
         SerializedObjectStorage& partialResults, 
         FileFormat outputFormat,
         const std::vector<std::string>& outputfiles,
         bool showProgress,
-        const ProgramOptions& programOptions
+        const ProgramOptions& programOptions,
+        const ChunkedReadStorage* storedReads = nullptr
+    );
+
+    //same as above, but the results are merged from sorted runs of an external sort
+    void constructOutputFileFromCorrectionResults(
+        const std::vector<std::string>& originalReadFiles,
+        const SortedSerializedRuns& sortedRuns, 
+        FileFormat outputFormat,
+        const std::vector<std::string>& outputfiles,
+        bool showProgress,
+        const ProgramOptions& programOptions,
+        const ChunkedReadStorage* storedReads = nullptr
+    );
+
+    //same as above, but the results are consumed from resultStream while they are being produced
+    void constructOutputFileFromCorrectionResults(
+        const std::vector<std::string>& originalReadFiles,
+        OrderedCorrectionResultStream& resultStream, 
+        FileFormat outputFormat,
+        const std::vector<std::string>& outputfiles,
+        bool showProgress,
+        const ProgramOptions& programOptions,
+        const ChunkedReadStorage* storedReads = nullptr
     );
 
 
@@ -18,6 +18,7 @@
 #include <correctedsequence.hpp>
 #include <hostdevicefunctions.cuh>
 #include <corrector_common.hpp>
+#include <candidaterowcache.hpp>
 #include <cpucorrectortask.hpp>
 #include <util.hpp>
 
@@ -133,7 +134,8 @@ public:
         readStorage{&readStorage_},
         correctionFlags(&correctionFlags_),
         clfAgent(&clfAgent_),
-        qualityCoversion(std::make_unique<cpu::QualityScoreConversion>())
+        qualityCoversion(std::make_unique<cpu::QualityScoreConversion>()),
+        candidateRowCache(programOptions_.candidateRowCacheSize, encodedSequencePitchInInts_, qualityPitchInBytes_)
     {
 
     }
@@ -143,7 +145,29 @@ public:
     }
 
     CpuErrorCorrectorOutput process(const CpuErrorCorrectorInput input){
-        CpuErrorCorrectorTask task = makeTask(input);
+        CpuErrorCorrectorTask& task = reusableTask;
+
+        prepareTask(input, task);
+
+        return processPreparedTask(task);
+    }
+
+    /*
+        First part of process(). Initializes the task, determines the candidate read ids, 
+        and gathers the candidate sequences. These steps are limited by memory latency.
+        input.encodedAnchor and input.anchorQualityscores must stay valid until processPreparedTask(task) returns.
+    */
+    void prepareTask(const CpuErrorCorrectorInput& input, CpuErrorCorrectorTask& task){
+        prepareTaskCandidateIds(input, task);
+        prepareTaskCandidateData(task);
+    }
+
+    /*
+        prepareTask in two steps. After prepareTaskCandidateIds, the candidate rows of task.candidateReadIds can be
+        prefetched from the read storage while other tasks are processed by prepareTaskCandidateData.
+    */
+    void prepareTaskCandidateIds(const CpuErrorCorrectorInput& input, CpuErrorCorrectorTask& task){
+        initTask(task, input);
     
         TimeMeasurements timings;
 
@@ -159,18 +183,48 @@ public:
 
         computePairFlags(task);
 
+        totalTime += timings;
+    }
+
+    void prepareTaskCandidateData(CpuErrorCorrectorTask& task){
+        TimeMeasurements timings;
+
+        if(task.candidateReadIds.size() > 0){
+
+            #ifdef ENABLE_CPU_CORRECTOR_TIMING
+            auto tpa = std::chrono::system_clock::now();
+            #endif
 
+            getCandidateSequenceData(task);
+
+            #ifdef ENABLE_CPU_CORRECTOR_TIMING
+            timings.copyCandidateDataToBufferTimeTotal += std::chrono::system_clock::now() - tpa;
+            #endif
+        }
+
+        totalTime += timings;
+    }
+
+    /*
+        Second part of process(). Computes alignments, builds the msa, and corrects the task
+        which has been prepared by prepareTask.
+        May be called by a different CpuErrorCorrector than the one which prepared the task.
+    */
+    CpuErrorCorrectorOutput processPreparedTask(CpuErrorCorrectorTask& task){
         if(task.candidateReadIds.size() == 0){
             //return uncorrected anchor
             return CpuErrorCorrectorOutput{};
         }
 
+        //the task may have been initialized by a different corrector
+        task.multipleSequenceAlignment.setQualityConversion(qualityCoversion.get());
+
+        TimeMeasurements timings;
+
         #ifdef ENABLE_CPU_CORRECTOR_TIMING
-        tpa = std::chrono::system_clock::now();
+        auto tpa = std::chrono::system_clock::now();
         #endif
 
-        getCandidateSequenceData(task);
-
         computeReverseComplementCandidates(task);
 
         #ifdef ENABLE_CPU_CORRECTOR_TIMING
@@ -315,6 +369,10 @@ public:
         return totalTime;
     }
 
+    const CandidateRowCache::Statistics& getCandidateRowCacheStatistics() const noexcept{
+        return candidateRowCache.getStatistics();
+    }
+
     std::stringstream& getMlStreamAnchor(){
         return ml_stream_anchor;
     }
@@ -364,7 +422,7 @@ public:
 
         for(int anchorIndex = 0; anchorIndex < numAnchors; anchorIndex++){
 
-            CpuErrorCorrectorTask task = makeTask(input, multiIds, multiCandidates, anchorIndex);
+            CpuErrorCorrectorTask& task = makeTask(input, multiIds, multiCandidates, anchorIndex);
 
             if(task.candidateReadIds.size() == 0){
                 //return uncorrected anchor
@@ -514,8 +572,8 @@ public:
 
 private:
 
-    CpuErrorCorrectorTask makeTask(const CpuErrorCorrectorInput& input){
-        CpuErrorCorrectorTask task;
+    void initTask(CpuErrorCorrectorTask& task, const CpuErrorCorrectorInput& input){
+        task.reset();
         task.active = true;
         task.input = input;
         task.multipleSequenceAlignment.setQualityConversion(qualityCoversion.get());
@@ -525,18 +583,23 @@ private:
         //decode anchor
         task.decodedAnchor.resize(length);
         SequenceHelpers::decode2BitSequence(task.decodedAnchor.data(), input.encodedAnchor, length);
+    }
 
-        return task;
+    //The task object is reused for each anchor to avoid reallocation of its buffers
+    CpuErrorCorrectorTask& makeTask(const CpuErrorCorrectorInput& input){
+        initTask(reusableTask, input);
+
+        return reusableTask;
     }
 
-    CpuErrorCorrectorTask makeTask(const CpuErrorCorrectorMultiInput& multiinput, const MultiCandidateIds& multiids, const MultiCandidateData& multicandidateData, int index){
+    CpuErrorCorrectorTask& makeTask(const CpuErrorCorrectorMultiInput& multiinput, const MultiCandidateIds& multiids, const MultiCandidateData& multicandidateData, int index){
         CpuErrorCorrectorInput input;
         input.anchorLength = multiinput.anchorLengths[index];
         input.anchorReadId = multiinput.anchorReadIds[index];
         input.encodedAnchor = multiinput.encodedAnchors[index];
         input.anchorQualityscores = multiinput.anchorQualityscores[index];
 
-        CpuErrorCorrectorTask task = makeTask(input);
+        CpuErrorCorrectorTask& task = makeTask(input);
 
         const int offsetBegin = multiids.numCandidatesPerAnchorPS[index];
         const int offsetEnd = multiids.numCandidatesPerAnchorPS[index + 1];
@@ -819,22 +882,19 @@ private:
         multiData.encodedCandidates.resize(numIds * encodedSequencePitchInInts);
         multiData.candidateQualities.resize(numIds * qualityPitchInBytes);
 
-        readStorage->gatherSequenceLengths(
+        candidateRowCache.gatherSequences(
+            *readStorage,
             multiData.candidateLengths.data(),
-            multiIds.candidateReadIds.data(),
-            numIds
-        );
-
-        readStorage->gatherSequences(
             multiData.encodedCandidates.data(),
             encodedSequencePitchInInts,
             multiIds.candidateReadIds.data(),
             numIds
-        ); 
+        );
 
         if(programOptions->useQualityScores){
 
-            readStorage->gatherQualities(
+            candidateRowCache.gatherQualities(
+                *readStorage,
                 multiData.candidateQualities.data(),
                 qualityPitchInBytes,
                 multiIds.candidateReadIds.data(),
@@ -889,18 +949,14 @@ private:
         task.candidateSequencesRevcData.clear();
         task.candidateSequencesRevcData.resize(size_t(encodedSequencePitchInInts) * numCandidates, 0);
 
-        readStorage->gatherSequenceLengths(
+        candidateRowCache.gatherSequences(
+            *readStorage,
             task.candidateSequencesLengths.data(),
-            task.candidateReadIds.data(),
-            numCandidates
-        );
-
-        readStorage->gatherSequences(
             task.candidateSequencesData.data(),
             encodedSequencePitchInInts,
             task.candidateReadIds.data(),
             numCandidates
-        );        
+        );
     }
 
     void computeReverseComplementCandidates(CpuErrorCorrectorTask& task){
@@ -1216,12 +1272,13 @@ private:
 
         task.candidateQualities.resize(qualityPitchInBytes * numCandidates);
 
-        readStorage->gatherQualities(
+        candidateRowCache.gatherQualities(
+            *readStorage,
             task.candidateQualities.data(),
             qualityPitchInBytes,
             task.candidateReadIds.data(),
             numCandidates
-        );         
+        );
     }
 
     void reverseQualitiesOfRCAlignments(CpuErrorCorrectorTask& task){
@@ -1300,6 +1357,22 @@ private:
         buildArgs.candidateLengths = task.candidateSequencesLengths.data();
         buildArgs.candidateShifts = task.alignmentShifts.data();
         buildArgs.candidateDefaultWeightFactors = task.alignmentWeights.data();
+
+        //each read of collapsed duplicates is counted once per original read
+        const read_number* const originalReadIdOffsets = readStorage->getOriginalReadIdOffsets();
+        if(originalReadIdOffsets != nullptr){
+            auto getMultiplicity = [&](read_number readId){
+                return int(originalReadIdOffsets[readId + 1] - originalReadIdOffsets[readId]);
+            };
+
+            task.candidateMultiplicities.resize(numCandidates);
+            for(int i = 0; i < numCandidates; i++){
+                task.candidateMultiplicities[i] = getMultiplicity(task.candidateReadIds[i]);
+            }
+
+            buildArgs.anchorMultiplicity = getMultiplicity(task.input.anchorReadId);
+            buildArgs.candidateMultiplicities = task.candidateMultiplicities.data();
+        }
     
         task.multipleSequenceAlignment.build(buildArgs);
     }
@@ -1782,6 +1855,11 @@ private:
 
     std::unique_ptr<cpu::QualityScoreConversion> qualityCoversion;
 
+    //rows of recently gathered candidates
+    mutable CandidateRowCache candidateRowCache{};
+
+    CpuErrorCorrectorTask reusableTask{};
+
     TimeMeasurements totalTime{};
 };
 
@@ -3,9 +3,12 @@
 
 #include <config.hpp>
 #include <correctedsequence.hpp>
+#include <memoryplacement.hpp>
 
 #include <algorithm>
+#include <cassert>
 #include <cstddef>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -51,12 +54,137 @@ namespace care{
         std::vector<EncodedTempCorrectedSequence> encodedCandidateCorrections;
     };
 
+    /*
+        Batch of corrections in the serialized format of EncodedTempCorrectedSequence, 
+        stored back to back in a single byte buffer.
+        Corrections are serialized directly from TempCorrectedSequence, no intermediate
+        EncodedTempCorrectedSequence is created.
+
+        clear() keeps the allocated capacity. A batch which is reused for each correction batch
+        of a thread acts as a bump allocator, i.e. there are no allocations in steady state.
+    */
+    class SerializedCorrectionBatch{
+    public:
+        void clear() noexcept{
+            data.clear();
+            offsets.clear();
+        }
+
+        //returns false if the correction was skipped because it does not need to be saved
+        bool append(const TempCorrectedSequence& tcs){
+            //hq anchor without edits is identical to the original read
+            if(tcs.hq && tcs.useEdits && tcs.edits.empty()){
+                return false;
+            }
+
+            const std::size_t oldBytes = data.size();
+            const std::size_t serializedSize = tcs.getSerializedNumBytes();
+            data.resize(oldBytes + serializedSize);
+
+            auto end = tcs.copyToContiguousMemory(data.data() + oldBytes, data.data() + data.size());
+            assert(end != nullptr);
+            (void)end;
+
+            offsets.push_back(oldBytes);
+            return true;
+        }
+
+        //append an already serialized correction
+        void appendSerialized(const std::uint8_t* begin, const std::uint8_t* end){
+            offsets.push_back(data.size());
+            data.insert(data.end(), begin, end);
+        }
+
+        std::size_t size() const noexcept{
+            return offsets.size();
+        }
+
+        std::size_t sizeInBytes() const noexcept{
+            return data.size();
+        }
+
+        std::size_t capacityInBytes() const noexcept{
+            return data.capacity() * sizeof(std::uint8_t) + offsets.capacity() * sizeof(std::size_t);
+        }
+
+        const std::uint8_t* getSerializedBegin(std::size_t i) const noexcept{
+            return data.data() + offsets[i];
+        }
+
+        const std::uint8_t* getSerializedEnd(std::size_t i) const noexcept{
+            return (i + 1 < offsets.size()) ? data.data() + offsets[i+1] : data.data() + data.size();
+        }
+
+        /*
+            Replace the read id of each correction by the original read id (see CpuReadStorage::getOriginalReadIds).
+            If originalReadIdOffsets is not null, each correction is copied for every original read
+        */
+        void mapReadIds(const read_number* originalReadIds, const read_number* originalReadIdOffsets = nullptr){
+            if(originalReadIdOffsets == nullptr){
+                for(std::size_t offset : offsets){
+                    read_number readId;
+                    std::memcpy(&readId, data.data() + offset, sizeof(read_number));
+                    std::memcpy(data.data() + offset, &originalReadIds[readId], sizeof(read_number));
+                }
+                return;
+            }
+
+            mappedData.clear();
+            mappedOffsets.clear();
+
+            for(std::size_t i = 0; i < size(); i++){
+                std::uint8_t* const begin = data.data() + offsets[i];
+                std::uint8_t* const end = (i + 1 < offsets.size()) ? data.data() + offsets[i+1] : data.data() + data.size();
+
+                forEachOriginalReadId(begin, end, originalReadIds, originalReadIdOffsets, [&](const std::uint8_t* b, const std::uint8_t* e){
+                    mappedOffsets.push_back(mappedData.size());
+                    mappedData.insert(mappedData.end(), b, e);
+                });
+            }
+
+            std::swap(data, mappedData);
+            std::swap(offsets, mappedOffsets);
+        }
+
+        /*
+            Calls func(begin, end) for each original read of the serialized correction [begin, end), 
+            after the read id of the correction has been replaced by the original read id. The serialized format begins with the read id
+        */
+        template<class Func>
+        static void forEachOriginalReadId(
+            std::uint8_t* begin, 
+            std::uint8_t* end, 
+            const read_number* originalReadIds, 
+            const read_number* originalReadIdOffsets, 
+            Func func
+        ){
+            read_number readId;
+            std::memcpy(&readId, begin, sizeof(read_number));
+
+            const read_number first = originalReadIdOffsets == nullptr ? readId : originalReadIdOffsets[readId];
+            const read_number last = originalReadIdOffsets == nullptr ? readId + 1 : originalReadIdOffsets[readId + 1];
+
+            for(read_number k = first; k < last; k++){
+                std::memcpy(begin, &originalReadIds[k], sizeof(read_number));
+                func(static_cast<const std::uint8_t*>(begin), static_cast<const std::uint8_t*>(end));
+            }
+        }
+
+    private:
+        std::vector<std::uint8_t> data{};
+        std::vector<std::size_t> offsets{};
+
+        //reused by mapReadIds
+        std::vector<std::uint8_t> mappedData{};
+        std::vector<std::size_t> mappedOffsets{};
+    };
+
     class ReadCorrectionFlags{
     public:
         ReadCorrectionFlags() = default;
 
         ReadCorrectionFlags(std::size_t numReads)
-            : size(numReads), flags(std::make_unique<std::uint8_t[]>(numReads)){
+            : size(numReads), flags(makePlacedArray<std::uint8_t>(numReads)){
             std::fill(flags.get(), flags.get() + size, 0);
         }
 
@@ -85,7 +213,7 @@ namespace care{
         static constexpr std::uint8_t readCouldNotBeCorrectedAsAnchor() noexcept{ return 2; };
 
         std::size_t size;
-        std::unique_ptr<std::uint8_t[]> flags{};
+        PlacedArray<std::uint8_t> flags{};
     };
 
 
@@ -44,6 +44,7 @@ namespace care{
         std::vector<cpu::SHDResult> revcAlignments{};
         std::vector<AlignmentOrientation> alignmentFlags{};
         std::vector<bool> isPairedCandidate{};
+        std::vector<int> candidateMultiplicities{};
 
         CpuErrorCorrectorInput input{};
 
@@ -51,6 +52,35 @@ namespace care{
         std::vector<CorrectedCandidate> candidateCorrections;
         MSAProperties msaProperties;
         MultipleSequenceAlignment multipleSequenceAlignment;
+
+        //reset task to initial state, but keep allocated memory
+        void reset(){
+            active = false;
+
+            candidateReadIds.clear();
+            filteredReadIds.clear();
+            candidateSequencesData.clear();
+            candidateSequencesRevcData.clear();
+            candidateSequencesLengths.clear();
+            alignmentShifts.clear();
+            alignmentOps.clear();
+            alignmentOverlaps.clear();
+            alignmentWeights.clear();
+            candidateQualities.clear();
+            decodedAnchor.clear();
+            decodedCandidateSequences.clear();
+            alignments.clear();
+            revcAlignments.clear();
+            alignmentFlags.clear();
+            isPairedCandidate.clear();
+            candidateMultiplicities.clear();
+
+            input = CpuErrorCorrectorInput{};
+
+            anchorCorrection.reset();
+            candidateCorrections.clear();
+            msaProperties = MSAProperties{};
+        }
     };
 
 }
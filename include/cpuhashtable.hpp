@@ -3,15 +3,19 @@
 
 #include <config.hpp>
 #include <memorymanagement.hpp>
+#include <memoryplacement.hpp>
 #include <threadpool.hpp>
 #include <util.hpp>
 #include <hostdevicefunctions.cuh>
 
+#include <algorithm>
+#include <array>
 #include <map>
 #include <vector>
 #include <cassert>
 #include <cstdint>
 #include <fstream>
+#include <stdexcept>
 #include <type_traits>
 #include <limits>
 #include <iostream>
@@ -22,6 +26,30 @@
 
 namespace care{
 
+    /*
+        Helpers for the mappable representation of hash tables. Each part of it is padded to a multiple of mappableAlignment bytes,
+        such that the arrays are suitably aligned if the representation begins at an aligned position of a memory mapping.
+    */
+    namespace mappablehashtable{
+
+        static constexpr std::size_t mappableAlignment = 64;
+
+        inline std::size_t paddedSize(std::size_t bytes) noexcept{
+            return SDIV(bytes, mappableAlignment) * mappableAlignment;
+        }
+
+        //returns the number of bytes written including padding
+        inline std::size_t writePadded(std::ostream& os, const void* data, std::size_t bytes){
+            const std::size_t padded = paddedSize(bytes);
+            const std::array<char, mappableAlignment> zeros{};
+
+            os.write(reinterpret_cast<const char*>(data), bytes);
+            os.write(zeros.data(), padded - bytes);
+
+            return padded;
+        }
+    }
+
     //computes the new hashtable size from the current hashtable size on automatic rehash
     struct RehashPolicyDouble {
         constexpr std::size_t operator()(const std::size_t x) noexcept { return x * 2; }
@@ -158,11 +186,12 @@ namespace care{
         QueryResult query(const Key& key) const{
             using hasher = hashers::MurmurHash<std::uint64_t>;
             
+            const Data* const slots = getStorage();
             const std::uint64_t key64 = std::uint64_t(key);
             std::size_t probes = 0;
             std::size_t pos = hasher::hash(key64) % capacity;
-            while(storage[pos].first != key){
-                if(storage[pos] == emptySlot){
+            while(slots[pos].first != key){
+                if(slots[pos] == emptySlot){
                     return {false, Value()};
                 }
                 pos++;
@@ -175,7 +204,7 @@ namespace care{
                     return {false, Value()};
                 }
             }
-            return {true, storage[pos].second};
+            return {true, slots[pos].second};
         }
 
         Value* queryPointer(const Key& key){
@@ -211,14 +240,17 @@ namespace care{
             }
         }
 
+        //the slots of a mapped table are not included
         MemoryUsage getMemoryInfo() const{
             MemoryUsage result;
-            result.host = sizeof(Data) * capacity;
+            result.host = mappedStorage != nullptr ? 0 : sizeof(Data) * capacity;
 
             return result;
         }
 
         void writeToStream(std::ostream& os) const{
+            assert(mappedStorage == nullptr);
+
             os.write(reinterpret_cast<const char*>(&load), sizeof(float));
             os.write(reinterpret_cast<const char*>(&numKeys), sizeof(std::size_t));
             os.write(reinterpret_cast<const char*>(&maxProbes), sizeof(std::size_t));
@@ -247,9 +279,57 @@ namespace care{
             is.read(reinterpret_cast<char*>(storage.data()), bytes);
         }
 
+        /*
+            Writes a representation which can be queried directly from a memory mapping, see attachToMappedMemory.
+            It consists of a padded header, followed by the padded slots. Returns the number of bytes written
+        */
+        std::size_t writeToMappableStream(std::ostream& os) const{
+            assert(mappedStorage == nullptr);
+            assert(storage.size() == capacity);
+
+            const MappableHeader header{load, numKeys, maxProbes, size, capacity};
+
+            std::size_t bytes = mappablehashtable::writePadded(os, &header, sizeof(MappableHeader));
+            bytes += mappablehashtable::writePadded(os, storage.data(), sizeof(Data) * capacity);
+
+            return bytes;
+        }
+
+        /*
+            Use the representation written by writeToMappableStream which begins at ptr. It must stay valid until the table is destroyed.
+            The table can only be queried afterwards. Returns the number of bytes of the representation.
+            Throws std::runtime_error if the representation does not fit into availableBytes
+        */
+        std::size_t attachToMappedMemory(const char* ptr, std::size_t availableBytes){
+            destroy();
+
+            const std::size_t headerBytes = mappablehashtable::paddedSize(sizeof(MappableHeader));
+            if(availableBytes < headerBytes){
+                throw std::runtime_error("Hash table header is truncated");
+            }
+
+            MappableHeader header;
+            std::copy_n(ptr, sizeof(MappableHeader), reinterpret_cast<char*>(&header));
+            if(header.capacity == 0 || header.capacity > (availableBytes - headerBytes) / sizeof(Data)
+                    || headerBytes + mappablehashtable::paddedSize(sizeof(Data) * header.capacity) > availableBytes){
+                throw std::runtime_error("Hash table slots are truncated");
+            }
+
+            load = header.load;
+            numKeys = header.numKeys;
+            maxProbes = header.maxProbes;
+            size = header.size;
+            capacity = header.capacity;
+
+            mappedStorage = reinterpret_cast<const Data*>(ptr + headerBytes);
+
+            return headerBytes + mappablehashtable::paddedSize(sizeof(Data) * capacity);
+        }
+
         void destroy(){
-            std::vector<Data> tmp;
+            PlacedVector<Data> tmp;
             std::swap(storage, tmp);
+            mappedStorage = nullptr;
 
             numKeys = 0;
             maxProbes = 0;
@@ -280,6 +360,18 @@ namespace care{
 
         using Data = std::pair<Key,Value>;
 
+        struct MappableHeader{
+            float load;
+            std::size_t numKeys;
+            std::size_t maxProbes;
+            std::size_t size;
+            std::size_t capacity;
+        };
+
+        const Data* getStorage() const noexcept{
+            return mappedStorage != nullptr ? mappedStorage : storage.data();
+        }
+
         Data emptySlot 
             = std::pair<Key,Value>{std::numeric_limits<Key>::max(), std::numeric_limits<Value>::max()};
 
@@ -288,7 +380,9 @@ namespace care{
         std::size_t maxProbes{};
         std::size_t size{};
         std::size_t capacity{};
-        std::vector<Data> storage{};        
+        PlacedVector<Data> storage{};        
+        //not null if the slots are stored in a memory mapping which is owned by the user of the table
+        const Data* mappedStorage = nullptr;
     };
 
 
@@ -510,7 +604,7 @@ namespace care{
         void init(
             GroupByKeyOp groupByKey,
             std::vector<Key> keys, 
-            std::vector<Value> vals,
+            PlacedVector<Value> vals,
             ThreadPool* threadPool
         ){
             assert(keys.size() == vals.size());
@@ -583,7 +677,7 @@ namespace care{
 
                 result.numValues = lookupQueryResult.value().second;
                 const auto valuepos = lookupQueryResult.value().first;
-                result.valuesBegin = &values[valuepos];
+                result.valuesBegin = getValues() + valuepos;
 
                 return result;
             }else{
@@ -626,6 +720,7 @@ namespace care{
 
         void writeToStream(std::ostream& os) const{
             assert(isInit);
+            assert(mappedValues == nullptr);
 
             const std::size_t elements = values.size();
             const std::size_t bytes = sizeof(Value) * elements;
@@ -648,9 +743,58 @@ namespace care{
             isInit = true;
         }
 
+        /*
+            Writes a representation which can be queried directly from a memory mapping, see attachToMappedMemory.
+            It consists of the padded number of values, the padded values, and the mappable representation of the lookup table.
+            Returns the number of bytes written
+        */
+        std::size_t writeToMappableStream(std::ostream& os) const{
+            assert(isInit);
+            assert(mappedValues == nullptr);
+
+            const std::uint64_t numValues = values.size();
+
+            std::size_t bytes = mappablehashtable::writePadded(os, &numValues, sizeof(std::uint64_t));
+            bytes += mappablehashtable::writePadded(os, values.data(), sizeof(Value) * numValues);
+            bytes += lookup.writeToMappableStream(os);
+
+            return bytes;
+        }
+
+        /*
+            Use the representation written by writeToMappableStream which begins at ptr. It must stay valid until the table is destroyed.
+            Returns the number of bytes of the representation. Throws std::runtime_error if the representation does not fit into availableBytes
+        */
+        std::size_t attachToMappedMemory(const char* ptr, std::size_t availableBytes){
+            destroy();
+
+            std::size_t bytes = mappablehashtable::paddedSize(sizeof(std::uint64_t));
+            if(availableBytes < bytes){
+                throw std::runtime_error("Hash table values are truncated");
+            }
+
+            std::uint64_t numValues = 0;
+            std::copy_n(ptr, sizeof(std::uint64_t), reinterpret_cast<char*>(&numValues));
+            if(numValues > (availableBytes - bytes) / sizeof(Value)){
+                throw std::runtime_error("Hash table values are truncated");
+            }
+
+            mappedValues = reinterpret_cast<const Value*>(ptr + bytes);
+            bytes += mappablehashtable::paddedSize(sizeof(Value) * numValues);
+            if(bytes > availableBytes){
+                throw std::runtime_error("Hash table values are truncated");
+            }
+            bytes += lookup.attachToMappedMemory(ptr + bytes, availableBytes - bytes);
+
+            isInit = true;
+
+            return bytes;
+        }
+
         void destroy(){
-            std::vector<Value> tmp;
+            PlacedVector<Value> tmp;
             std::swap(values, tmp);
+            mappedValues = nullptr;
 
             lookup.destroy();
             isInit = false;
@@ -674,11 +818,17 @@ namespace care{
         float loadfactor = 0.8f;
         std::uint64_t buildMaxNumValues = 0;
         std::vector<Key> buildkeys;
-        std::vector<Value> buildvalues;
+        PlacedVector<Value> buildvalues;
         // values with the same key are stored in contiguous memory locations
         // a single-value hashmap maps keys to the range of the corresponding values
-        std::vector<Value> values; 
+        PlacedVector<Value> values; 
+        //not null if the values are stored in a memory mapping which is owned by the user of the table
+        const Value* mappedValues = nullptr;
         AoSCpuSingleValueHashTable<Key, ValueIndex> lookup;
+
+        const Value* getValues() const noexcept{
+            return mappedValues != nullptr ? mappedValues : values.data();
+        }
     };
 
 
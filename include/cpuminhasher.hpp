@@ -7,6 +7,9 @@
 #include <threadpool.hpp>
 
 #include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace care{
@@ -85,6 +88,19 @@ public:
     virtual bool canWriteToStream() const noexcept = 0;
     virtual bool canLoadFromStream() const noexcept = 0;
 
+    /*
+        Loads a file which was written by writeToStream. Implementations may detect other formats.
+        numReads is the number of reads of the read storage. Formats which store the number of reads of the hashed read storage
+        must reject files with a different number
+    */
+    virtual int loadFromFile(const std::string& filename, int numMapsUpperLimit, std::size_t /*numReads*/){
+        std::ifstream is(filename, std::ios::binary);
+        if(!is){
+            throw std::runtime_error("Cannot open file " + filename);
+        }
+        return loadFromStream(is, numMapsUpperLimit);
+    }
+
 protected:
     MinhasherHandle constructHandle(int id) const{
         return MinhasherHandle{id};
@@ -5,6 +5,7 @@
 #include <cpuminhasher.hpp>
 #include <cpureadstorage.hpp>
 #include <options.hpp>
+#include <memorybudget.hpp>
 
 #include <memory>
 #include <utility>
@@ -24,6 +25,7 @@ namespace care{
     constructCpuMinhasherFromCpuReadStorage(
         const ProgramOptions& programOptions,
         const CpuReadStorage& cpuReadStorage,
+        const MemoryBudget& memoryBudget,
         CpuMinhasherType requestedType = CpuMinhasherType::None
     );
 
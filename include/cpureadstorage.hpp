@@ -80,6 +80,26 @@ public:
 
     virtual int getQualityBits() const = 0;
 
+    //hint that the sequences of readIds will be gathered soon. does nothing by default
+    virtual void prefetchSequences(
+        const read_number* /*readIds*/, 
+        int /*numSequences*/
+    ) const{
+    }
+
+    //if the reads have been renumbered, the original read id of each read. nullptr otherwise
+    virtual const read_number* getOriginalReadIds() const{
+        return nullptr;
+    }
+
+    /*
+        If reads with identical sequences have been collapsed, read i stands for the original reads 
+        getOriginalReadIds()[offsets[i]] to getOriginalReadIds()[offsets[i+1]-1]. nullptr otherwise
+    */
+    virtual const read_number* getOriginalReadIdOffsets() const{
+        return nullptr;
+    }
+
     //virtual void destroy() = 0;
 };
 
@@ -0,0 +1,481 @@
+#ifndef CARE_EXTERNALSORTSERIALIZEDRESULTS_HPP
+#define CARE_EXTERNALSORTSERIALIZEDRESULTS_HPP
+
+#include <config.hpp>
+
+#include <serializedobjectstorage.hpp>
+#include <parallelradixsort.hpp>
+#include <filehelpers.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+namespace care{
+
+    /*
+        Files of serialized objects, each sorted by read id. Used to sort partial results which do not fit into memory.
+        Each record in a run file is stored as [std::uint32_t numBytes][numBytes bytes of serialized object].
+        The run files are deleted on destruction.
+
+        Runs of block compressed partial results can be kept in memory instead. Their records are stored in the same format,
+        split into blocks which are compressed with serializedblockcompression.
+    */
+    class SortedSerializedRuns{
+    public:
+        SortedSerializedRuns() = default;
+        SortedSerializedRuns(const SortedSerializedRuns&) = delete;
+        SortedSerializedRuns& operator=(const SortedSerializedRuns&) = delete;
+
+        SortedSerializedRuns(SortedSerializedRuns&& rhs) noexcept
+            : numElements(std::exchange(rhs.numElements, 0)),
+            runfiles(std::move(rhs.runfiles)),
+            memoryruns(std::move(rhs.memoryruns))
+        {
+            rhs.runfiles.clear();
+            rhs.memoryruns.clear();
+        }
+
+        SortedSerializedRuns& operator=(SortedSerializedRuns&& rhs) noexcept{
+            std::swap(numElements, rhs.numElements);
+            std::swap(runfiles, rhs.runfiles);
+            std::swap(memoryruns, rhs.memoryruns);
+            return *this;
+        }
+
+        ~SortedSerializedRuns(){
+            filehelpers::deleteFiles(runfiles);
+        }
+
+        void addRun(const std::string& filename, std::size_t numElementsInRun){
+            runfiles.push_back(filename);
+            numElements += numElementsInRun;
+        }
+
+        void addRun(std::vector<std::vector<std::uint8_t>> compressedBlocks, std::size_t numElementsInRun){
+            memoryruns.push_back(std::move(compressedBlocks));
+            numElements += numElementsInRun;
+        }
+
+        std::size_t getNumElements() const noexcept{
+            return numElements;
+        }
+
+        //file runs come before memory runs
+        std::size_t getNumRuns() const noexcept{
+            return runfiles.size() + memoryruns.size();
+        }
+
+        bool isMemoryRun(std::size_t i) const noexcept{
+            return i >= runfiles.size();
+        }
+
+        const std::string& getRunFile(std::size_t i) const noexcept{
+            assert(!isMemoryRun(i));
+            return runfiles[i];
+        }
+
+        const std::vector<std::vector<std::uint8_t>>& getMemoryRunBlocks(std::size_t i) const noexcept{
+            assert(isMemoryRun(i));
+            return memoryruns[i - runfiles.size()];
+        }
+
+        std::size_t getMemoryInBytes() const noexcept{
+            std::size_t bytes = 0;
+            for(const auto& run : memoryruns){
+                for(const auto& block : run){
+                    bytes += block.capacity();
+                }
+            }
+            return bytes;
+        }
+
+    private:
+        std::size_t numElements = 0;
+        std::vector<std::string> runfiles{};
+        std::vector<std::vector<std::vector<std::uint8_t>>> memoryruns{};
+    };
+
+    /*
+        k-way merge of sorted runs. next() returns the serialized objects of all runs in ascending read id order,
+        or nullptr if all objects have been returned. The returned pointer is valid until the next call to next().
+        Objects with equal read id are returned in run order, and in order of appearance within a run.
+
+        Each run file is read sequentially through a buffer of bufferBytesPerRun bytes. Memory runs are decompressed one block at a time.
+    */
+    template<class T> // T type of serialized objects
+    class SortedSerializedRunsMerger{
+    public:
+        SortedSerializedRunsMerger(const SortedSerializedRuns& runs_, std::size_t bufferBytesPerRun_)
+            : bufferBytesPerRun(std::max(std::size_t(4096), bufferBytesPerRun_)),
+            runs(runs_),
+            readers(runs_.getNumRuns())
+        {
+            for(std::size_t r = 0; r < runs.getNumRuns(); r++){
+                RunReader& reader = readers[r];
+                if(runs.isMemoryRun(r)){
+                    reader.blocks = &runs.getMemoryRunBlocks(r);
+                }else{
+                    reader.in.open(runs.getRunFile(r), std::ios::binary);
+                    if(!reader.in){
+                        throw std::runtime_error("Cannot open run file " + runs.getRunFile(r));
+                    }
+                    reader.buffer.resize(bufferBytesPerRun);
+                }
+
+                if(readRecord(reader)){
+                    heap.push(HeapEntry{T::parseReadId(reader.record.data()), r});
+                }
+            }
+        }
+
+        std::size_t getNumElements() const noexcept{
+            return runs.getNumElements();
+        }
+
+        bool empty() const noexcept{
+            return getNumElements() == 0;
+        }
+
+        const std::uint8_t* next(){
+            //the record of the previously returned run can be replaced now
+            if(previousRun != noRun){
+                RunReader& reader = readers[previousRun];
+                if(readRecord(reader)){
+                    heap.push(HeapEntry{T::parseReadId(reader.record.data()), previousRun});
+                }
+                previousRun = noRun;
+            }
+
+            if(heap.empty()){
+                return nullptr;
+            }
+
+            const HeapEntry top = heap.top();
+            heap.pop();
+
+            previousRun = top.run;
+            return readers[top.run].record.data();
+        }
+
+    private:
+        static constexpr std::size_t noRun = std::numeric_limits<std::size_t>::max();
+
+        struct RunReader{
+            std::ifstream in{};
+            const std::vector<std::vector<std::uint8_t>>* blocks = nullptr;
+            std::size_t nextBlock = 0;
+            std::vector<char> buffer{};
+            std::size_t bufferBegin = 0;
+            std::size_t bufferEnd = 0;
+            std::vector<std::uint8_t> record{};
+        };
+
+        struct HeapEntry{
+            read_number readId;
+            std::size_t run;
+
+            //std::priority_queue is a max heap
+            bool operator<(const HeapEntry& rhs) const noexcept{
+                if(readId != rhs.readId) return readId > rhs.readId;
+                return run > rhs.run;
+            }
+        };
+
+        //copy the next numBytes bytes of the run into dest. returns false if the run ends before
+        bool readBytes(RunReader& reader, void* dest, std::size_t numBytes){
+            char* out = reinterpret_cast<char*>(dest);
+
+            while(numBytes > 0){
+                if(reader.bufferBegin == reader.bufferEnd){
+                    if(reader.blocks != nullptr){
+                        if(reader.nextBlock == reader.blocks->size()){
+                            return false;
+                        }
+                        const auto& block = (*reader.blocks)[reader.nextBlock++];
+                        serializedblockcompression::decompressBlock(block.data(), block.size(), reader.buffer);
+                        reader.bufferBegin = 0;
+                        reader.bufferEnd = reader.buffer.size();
+                        continue;
+                    }
+                    reader.in.read(reader.buffer.data(), reader.buffer.size());
+                    reader.bufferBegin = 0;
+                    reader.bufferEnd = reader.in.gcount();
+                    if(reader.bufferEnd == 0){
+                        return false;
+                    }
+                }
+
+                const std::size_t n = std::min(numBytes, reader.bufferEnd - reader.bufferBegin);
+                std::memcpy(out, reader.buffer.data() + reader.bufferBegin, n);
+                reader.bufferBegin += n;
+                out += n;
+                numBytes -= n;
+            }
+
+            return true;
+        }
+
+        bool readRecord(RunReader& reader){
+            std::uint32_t numBytes = 0;
+            if(!readBytes(reader, &numBytes, sizeof(std::uint32_t))){
+                return false;
+            }
+
+            reader.record.resize(numBytes);
+            if(!readBytes(reader, reader.record.data(), numBytes)){
+                throw std::runtime_error("Unexpected end of run file");
+            }
+            return true;
+        }
+
+        std::size_t bufferBytesPerRun{};
+        std::size_t previousRun = noRun;
+        const SortedSerializedRuns& runs;
+        std::vector<RunReader> readers{};
+        std::priority_queue<HeapEntry> heap{};
+    };
+
+    /*
+        External sort, first phase. The serialized objects of partialResults are processed in chunks of consecutive
+        objects whose size fits into memoryForSortingInBytes. Each chunk is copied from partialResults in a single
+        sequential pass, sorted by read id in memory with a stable radix sort, and written sequentially into a run file
+        in tempdirectory. The objects must be stored in partialResults in insertion order, i.e. unsorted.
+
+        If partialResults is block compressed, chunks consist of whole blocks which are decompressed in parallel.
+        If runsInMemory is true, the runs are compressed and kept in memory instead of being written to run files.
+        Their size is about the compressed size of partialResults, which is subtracted from memoryForSortingInBytes.
+    */
+    template<class T> // T type of serialized objects
+    SortedSerializedRuns makeSortedRunsByReadId(
+        const SerializedObjectStorage& partialResults,
+        std::size_t memoryForSortingInBytes,
+        int numThreads,
+        const std::string& tempdirectory,
+        bool runsInMemory = false
+    ){
+        //per object: key, temporary key, index, temporary index, offset in chunk
+        constexpr std::size_t bytesPerObject = 2 * sizeof(read_number) + 2 * sizeof(std::uint32_t) + sizeof(std::size_t);
+        constexpr std::size_t minimumRunBytes = std::size_t(16) << 20;
+        constexpr std::size_t writeBufferBytes = std::size_t(4) << 20;
+        constexpr std::size_t memoryRunBlockBytes = std::size_t(256) << 10;
+
+        if(runsInMemory){
+            assert(partialResults.isBlockCompressed());
+            memoryForSortingInBytes -= std::min(memoryForSortingInBytes, partialResults.dataBytes());
+        }
+
+        const bool compressedInput = partialResults.isBlockCompressed();
+        const std::size_t runBytes = std::max(minimumRunBytes, memoryForSortingInBytes);
+        const std::size_t numElements = partialResults.size();
+        const std::size_t numBlocks = compressedInput ? partialResults.getNumBlocks() : 0;
+        const std::size_t* const offsets = compressedInput ? nullptr : partialResults.getOffsetBuffer();
+        const std::uint8_t* const dataBuffer = compressedInput ? nullptr : partialResults.getDataBuffer();
+
+        auto getEndOffset = [&](std::size_t i){
+            return i + 1 < numElements ? offsets[i + 1] : partialResults.dataBytes();
+        };
+
+        SortedSerializedRuns runs;
+
+        std::vector<std::uint8_t> chunkData;
+        //offsets of the objects in chunkData. chunkOffsets[numInChunk] is the end of the last object
+        std::vector<std::size_t> chunkOffsets;
+        std::vector<read_number> keys;
+        std::vector<read_number> keysTmp;
+        std::vector<std::uint32_t> indices;
+        std::vector<std::uint32_t> indicesTmp;
+        std::vector<char> writeBuffer;
+        //memory runs are compressed in blocks of the size of the write buffer
+        const std::size_t writeBufferLimit = runsInMemory ? memoryRunBlockBytes : writeBufferBytes;
+        writeBuffer.reserve(writeBufferLimit);
+
+        //objects [first, last). for compressed input, blocks [firstBlock, lastBlock)
+        struct Chunk{
+            std::size_t first;
+            std::size_t last;
+            std::size_t firstBlock;
+            std::size_t lastBlock;
+        };
+
+        auto determineChunk = [&](std::size_t first, std::size_t firstBlock){
+            Chunk chunk{first, first, firstBlock, firstBlock};
+
+            if(compressedInput){
+                std::size_t chunkBytes = 0;
+                while(chunk.lastBlock < numBlocks 
+                        && partialResults.getBlockFirstElement(chunk.lastBlock) - first < std::numeric_limits<std::uint32_t>::max()){
+                    const std::size_t blockBytes = partialResults.getUncompressedBlockBytes(chunk.lastBlock) 
+                        + partialResults.getBlockNumElements(chunk.lastBlock) * bytesPerObject;
+                    if(chunk.lastBlock > firstBlock && chunkBytes + blockBytes > runBytes){
+                        break;
+                    }
+                    chunkBytes += blockBytes;
+                    chunk.lastBlock++;
+                }
+                chunk.last = chunk.lastBlock < numBlocks ? partialResults.getBlockFirstElement(chunk.lastBlock) : numElements;
+            }else{
+                std::size_t chunkBytes = 0;
+                while(chunk.last < numElements && chunk.last - first < std::numeric_limits<std::uint32_t>::max()){
+                    assert(getEndOffset(chunk.last) >= offsets[chunk.last]);
+                    const std::size_t objectBytes = getEndOffset(chunk.last) - offsets[chunk.last] + bytesPerObject;
+                    if(chunk.last > first && chunkBytes + objectBytes > runBytes){
+                        break;
+                    }
+                    chunkBytes += objectBytes;
+                    chunk.last++;
+                }
+            }
+
+            return chunk;
+        };
+
+        //if partial results have been spilled, the next chunk is read from the backing files while the current chunk is sorted
+        const bool prefetchChunks = partialResults.hasDataInFile();
+
+        Chunk chunk = determineChunk(0, 0);
+        while(chunk.first < numElements){
+            const std::size_t first = chunk.first;
+            const std::size_t last = chunk.last;
+
+            if(compressedInput){
+                const std::size_t firstBlock = chunk.firstBlock;
+                const std::size_t lastBlock = chunk.lastBlock;
+
+                std::vector<std::size_t> blockBegins(lastBlock - firstBlock + 1, 0);
+                for(std::size_t b = firstBlock; b < lastBlock; b++){
+                    blockBegins[b - firstBlock + 1] = blockBegins[b - firstBlock] + partialResults.getUncompressedBlockBytes(b);
+                }
+
+                chunkData.resize(blockBegins.back());
+                chunkOffsets.resize(last - first + 1);
+
+                #pragma omp parallel num_threads(numThreads)
+                {
+                    std::vector<std::uint8_t> block;
+
+                    #pragma omp for schedule(dynamic)
+                    for(std::size_t b = firstBlock; b < lastBlock; b++){
+                        partialResults.decompressBlock(b, block);
+                        std::copy(block.begin(), block.end(), chunkData.begin() + blockBegins[b - firstBlock]);
+
+                        const std::size_t blockFirst = partialResults.getBlockFirstElement(b);
+                        const std::size_t blockNum = partialResults.getBlockNumElements(b);
+                        for(std::size_t i = blockFirst; i < blockFirst + blockNum; i++){
+                            chunkOffsets[i - first] = blockBegins[b - firstBlock] + partialResults.getInBlockOffset(i);
+                        }
+                    }
+                }
+                chunkOffsets.back() = chunkData.size();
+            }else{
+                const std::size_t chunkBegin = offsets[first];
+                const std::size_t chunkEnd = getEndOffset(last - 1);
+
+                chunkData.assign(dataBuffer + chunkBegin, dataBuffer + chunkEnd);
+                chunkOffsets.resize(last - first + 1);
+                for(std::size_t i = first; i < last; i++){
+                    chunkOffsets[i - first] = offsets[i] - chunkBegin;
+                }
+                chunkOffsets.back() = chunkEnd - chunkBegin;
+            }
+
+            const Chunk nextChunk = determineChunk(chunk.last, chunk.lastBlock);
+            std::future<void> prefetchFuture;
+            if(prefetchChunks && nextChunk.first < numElements){
+                prefetchFuture = std::async(std::launch::async, [&](){
+                    partialResults.prefetch(nextChunk.first, nextChunk.last);
+                });
+            }
+
+            const std::size_t numInChunk = last - first;
+            keys.resize(numInChunk);
+            keysTmp.resize(numInChunk);
+            indices.resize(numInChunk);
+            indicesTmp.resize(numInChunk);
+
+            #pragma omp parallel for num_threads(numThreads) schedule(static)
+            for(std::size_t i = 0; i < numInChunk; i++){
+                keys[i] = T::parseReadId(chunkData.data() + chunkOffsets[i]);
+            }
+
+            std::iota(indices.begin(), indices.end(), std::uint32_t(0));
+
+            parallelRadixSortPairs(keys.data(), indices.data(), keysTmp.data(), indicesTmp.data(), numInChunk, numThreads);
+
+            std::string runfile;
+            std::ofstream out;
+            std::vector<std::vector<std::uint8_t>> runBlocks;
+
+            if(!runsInMemory){
+                runfile = filehelpers::makeRandomFile(tempdirectory + "/sortedrun-XXXXXX");
+                out.open(runfile, std::ios::binary);
+                if(!out){
+                    throw std::runtime_error("Cannot open run file " + runfile);
+                }
+            }
+
+            auto flushWriteBuffer = [&](){
+                if(runsInMemory){
+                    if(!writeBuffer.empty()){
+                        runBlocks.emplace_back();
+                        serializedblockcompression::compressBlock(
+                            reinterpret_cast<const std::uint8_t*>(writeBuffer.data()), writeBuffer.size(), runBlocks.back());
+                        runBlocks.back().shrink_to_fit();
+                    }
+                }else{
+                    out.write(writeBuffer.data(), writeBuffer.size());
+                }
+                writeBuffer.clear();
+            };
+
+            for(std::size_t i = 0; i < numInChunk; i++){
+                const std::size_t objectIndex = indices[i];
+                const std::uint8_t* const begin = chunkData.data() + chunkOffsets[objectIndex];
+                const std::uint32_t numBytes = chunkOffsets[objectIndex + 1] - chunkOffsets[objectIndex];
+
+                if(writeBuffer.size() + sizeof(std::uint32_t) + numBytes > writeBufferLimit){
+                    flushWriteBuffer();
+                }
+
+                const char* const numBytesPtr = reinterpret_cast<const char*>(&numBytes);
+                writeBuffer.insert(writeBuffer.end(), numBytesPtr, numBytesPtr + sizeof(std::uint32_t));
+                writeBuffer.insert(writeBuffer.end(), begin, begin + numBytes);
+            }
+            flushWriteBuffer();
+
+            if(runsInMemory){
+                runs.addRun(std::move(runBlocks), numInChunk);
+            }else{
+                if(!out){
+                    throw std::runtime_error("Cannot write run file " + runfile);
+                }
+
+                runs.addRun(runfile, numInChunk);
+            }
+
+            if(prefetchFuture.valid()){
+                prefetchFuture.wait();
+            }
+
+            chunk = nextChunk;
+        }
+
+        return runs;
+    }
+
+}
+
+#endif
@@ -66,11 +66,12 @@ namespace care{
             If there are more than maxValuesPerKey values with the same key, all of those values are removed,
             i.e. the key ends up with 0 values
         */
-        void execute(std::vector<Key_t>& keys, std::vector<Value_t>& values, std::vector<Offset_t>& offsets){
+        template<class ValueVector>
+        void execute(std::vector<Key_t>& keys, ValueVector& values, std::vector<Offset_t>& offsets){
             if(keys.size() == 0){
                 //deallocate unused memory if capacity > 0
                 keys = std::vector<Key_t>{};
-                values = std::vector<Value_t>{};
+                values = ValueVector{};
                 return;
             }
 
@@ -83,7 +84,8 @@ namespace care{
             executeWithIotaValues(keys, values, offsets);
         }
 
-        bool checkIotaValues(const std::vector<Value_t>& values){
+        template<class ValueVector>
+        bool checkIotaValues(const ValueVector& values){
             auto policy = thrust::host;
 
             bool isIotaValues = thrust::equal(
@@ -96,7 +98,8 @@ namespace care{
             return isIotaValues;
         }
 
-        void executeWithIotaValues(std::vector<Key_t>& keys, std::vector<Value_t>& values, std::vector<Offset_t>& offsets){
+        template<class ValueVector>
+        void executeWithIotaValues(std::vector<Key_t>& keys, ValueVector& values, std::vector<Offset_t>& offsets){
             assert(keys.size() == values.size()); //key value pairs
             assert(std::numeric_limits<Offset_t>::max() >= keys.size()); //total number of keys must fit into Offset_t
 
@@ -223,7 +226,7 @@ namespace care{
                 Offset_t(0)
             );
 
-            std::vector<Value_t> values_tmp(size - numValuesToRemove);
+            ValueVector values_tmp(size - numValuesToRemove);
 
             thrust::copy_if(
                 values.begin(),
@@ -276,11 +279,12 @@ namespace care{
             If there are more than maxValuesPerKey values with the same key, all of those values are removed,
             i.e. the key ends up with 0 values
         */
-        bool execute(std::vector<Key_t>& keys, std::vector<Value_t>& values, std::vector<Offset_t>& offsets){
+        template<class ValueVector>
+        bool execute(std::vector<Key_t>& keys, ValueVector& values, std::vector<Offset_t>& offsets){
             if(keys.size() == 0){
                 //deallocate unused memory if capacity > 0
                 keys = std::vector<Key_t>{};
-                values = std::vector<Value_t>{};
+                values = ValueVector{};
                 return true;
             }
 
@@ -314,7 +318,8 @@ namespace care{
             return success;
         }
 
-        bool checkIotaValues(const std::vector<Value_t>& values){
+        template<class ValueVector>
+        bool checkIotaValues(const ValueVector& values){
             auto policy = thrust::host;
 
             nvtx::push_range("checkIotaValues", 6);
@@ -331,7 +336,8 @@ namespace care{
             return isIotaValues;
         }
 
-        void executeWithIotaValues(std::vector<Key_t>& keys, std::vector<Value_t>& values, std::vector<Offset_t>& offsets){
+        template<class ValueVector>
+        void executeWithIotaValues(std::vector<Key_t>& keys, ValueVector& values, std::vector<Offset_t>& offsets){
             assert(keys.size() == values.size()); //key value pairs
             assert(std::numeric_limits<Offset_t>::max() >= keys.size()); //total number of keys must fit into Offset_t
 
@@ -0,0 +1,236 @@
+#ifndef CARE_INGESTENCODING_HPP
+#define CARE_INGESTENCODING_HPP
+
+#include <config.hpp>
+
+#include <qualityscorecompression.hpp>
+#include <sequencehelpers.hpp>
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace care{
+
+    /*
+        Encoding of a read at ingest in a single pass over blocks of 32 positions: classification of bases,
+        replacement of invalid bases, 2-bit packing of the sequence, and binning and packing of the quality scores.
+
+        The result is the same as preprocessing the sequence (lowercase bases are converted to uppercase, the k-th base of read readId
+        which is not one of A,C,G,T is replaced by ACGT[(readId + k) % 4]), followed by SequenceHelpers::encodeSequence2Bit
+        and QualityCompressorWrapper::encodeQualityString.
+
+        With AVX2, a block without invalid bases is classified and packed with vector instructions.
+        Blocks with invalid bases, the last partial block, and builds without AVX2 use a lookup table per character.
+    */
+    struct IngestEncoding{
+        static constexpr int blocksize = 32;
+
+        //returns true if the sequence contains bases other than A,C,G,T,a,c,g,t. encodedQuality is not accessed if numQualityBits is 0
+        static bool encodeRead(
+            unsigned int* encodedSequence,
+            unsigned int* encodedQuality,
+            int numQualityBits,
+            const char* sequence,
+            const char* quality,
+            int length,
+            read_number readId
+        ){
+            assert(numQualityBits == 0 || numQualityBits == 1 || numQualityBits == 2 || numQualityBits == 8);
+
+            int numInvalidBases = 0;
+
+            const int numFullBlocks = length / blocksize;
+
+            for(int block = 0; block < numFullBlocks; block++){
+                const int offset = block * blocksize;
+
+                bool done = false;
+                #ifdef __AVX2__
+                done = encodeSequenceBlockAVX2(encodedSequence + 2 * block, sequence + offset);
+                #endif
+                if(!done){
+                    encodeSequenceBlockScalar(encodedSequence + 2 * block, 2, sequence + offset, blocksize, readId, numInvalidBases);
+                }
+
+                switch(numQualityBits){
+                    case 1: encodeQualityBlock1Bit(encodedQuality + block, quality + offset); break;
+                    case 2: encodeQualityBlock2Bit(encodedQuality + 2 * block, quality + offset); break;
+                    default: break;
+                }
+            }
+
+            const int remaining = length - numFullBlocks * blocksize;
+            if(remaining > 0){
+                const int offset = numFullBlocks * blocksize;
+                const int numSequenceInts = SequenceHelpers::getEncodedNumInts2Bit(remaining);
+                encodeSequenceBlockScalar(encodedSequence + 2 * numFullBlocks, numSequenceInts, sequence + offset, remaining, readId, numInvalidBases);
+
+                switch(numQualityBits){
+                    case 1: encodeQualityBlockScalar<1>(encodedQuality + numFullBlocks, quality + offset, remaining); break;
+                    case 2: encodeQualityBlockScalar<2>(encodedQuality + 2 * numFullBlocks, quality + offset, remaining); break;
+                    default: break;
+                }
+            }
+
+            if(numQualityBits == 8){
+                std::memcpy(encodedQuality, quality, length);
+            }
+
+            return numInvalidBases > 0;
+        }
+
+    private:
+        static constexpr std::uint8_t invalidCode = 4;
+
+        static const std::array<std::uint8_t, 256>& getBaseCodeTable(){
+            static const std::array<std::uint8_t, 256> table = [](){
+                std::array<std::uint8_t, 256> t{};
+                t.fill(invalidCode);
+                t['A'] = t['a'] = SequenceHelpers::encodedbaseA();
+                t['C'] = t['c'] = SequenceHelpers::encodedbaseC();
+                t['G'] = t['g'] = SequenceHelpers::encodedbaseG();
+                t['T'] = t['t'] = SequenceHelpers::encodedbaseT();
+                return t;
+            }();
+            return table;
+        }
+
+        //encode length <= 32 bases into numInts ints, 16 bases per int, first base in the highest bits
+        static void encodeSequenceBlockScalar(
+            unsigned int* out,
+            int numInts,
+            const char* sequence,
+            int length,
+            read_number readId,
+            int& numInvalidBases
+        ){
+            constexpr std::array<char, 4> bases = {'A', 'C', 'G', 'T'};
+            const auto& table = getBaseCodeTable();
+
+            std::uint64_t data = 0;
+            for(int i = 0; i < length; i++){
+                std::uint8_t code = table[std::uint8_t(sequence[i])];
+                if(code == invalidCode){
+                    code = SequenceHelpers::encodeBase(bases[(readId + numInvalidBases) % 4]);
+                    numInvalidBases++;
+                }
+                data = (data << 2) | code;
+            }
+            data <<= 2 * (blocksize - length);
+
+            out[0] = data >> 32;
+            if(numInts > 1){
+                out[1] = data;
+            }
+        }
+
+        template<int numBits>
+        static void encodeQualityBlockScalar(unsigned int* out, const char* quality, int length){
+            QualityCompressor<numBits>::encodeQualityString(out, quality, length);
+        }
+
+        static unsigned int reverseBits(unsigned int x){
+            x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+            x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+            x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+            return __builtin_bswap32(x);
+        }
+
+        #ifdef __AVX2__
+
+        //pack 32 2-bit codes (one per byte) into two ints, first code in the highest bits
+        static void pack2BitCodesAVX2(unsigned int* out, __m256i codes){
+            //c0*4 + c1 per 16 bits, then (c0*4 + c1)*16 + c2*4 + c3 per 32 bits
+            const __m256i pairs = _mm256_maddubs_epi16(codes, _mm256_set1_epi16(0x0104));
+            const __m256i quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00010010));
+
+            //gather the lowest byte of each 32-bit lane into the first 4 bytes of each 128-bit lane
+            const __m256i gatherMask = _mm256_setr_epi8(
+                0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+            );
+            const __m256i gathered = _mm256_shuffle_epi8(quads, gatherMask);
+
+            out[0] = __builtin_bswap32(_mm256_extract_epi32(gathered, 0));
+            out[1] = __builtin_bswap32(_mm256_extract_epi32(gathered, 4));
+        }
+
+        //returns false if the block contains invalid bases. then, nothing is written
+        static bool encodeSequenceBlockAVX2(unsigned int* out, const char* sequence){
+            const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sequence));
+            const __m256i upper = _mm256_and_si256(chars, _mm256_set1_epi8(char(0xDF)));
+
+            const __m256i isA = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('A'));
+            const __m256i isC = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('C'));
+            const __m256i isG = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('G'));
+            const __m256i isT = _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('T'));
+
+            const __m256i valid = _mm256_or_si256(_mm256_or_si256(isA, isC), _mm256_or_si256(isG, isT));
+            if(_mm256_movemask_epi8(valid) != -1){
+                return false;
+            }
+
+            static_assert(SequenceHelpers::encodedbaseA() == 0);
+            const __m256i codes = _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_and_si256(isC, _mm256_set1_epi8(SequenceHelpers::encodedbaseC())),
+                    _mm256_and_si256(isG, _mm256_set1_epi8(SequenceHelpers::encodedbaseG()))
+                ),
+                _mm256_and_si256(isT, _mm256_set1_epi8(SequenceHelpers::encodedbaseT()))
+            );
+
+            pack2BitCodesAVX2(out, codes);
+
+            return true;
+        }
+
+        //quality q is in bin x if q - 33 <= binBoundary(x). compare as signed bytes, like the scalar version with signed char
+        template<class Config>
+        static __m256i greaterThanBoundary(__m256i chars, int binNumber){
+            return _mm256_cmpgt_epi8(chars, _mm256_set1_epi8(char(Config::binBoundary(binNumber) + 33)));
+        }
+
+        static void encodeQualityBlock1Bit(unsigned int* out, const char* quality){
+            using Config = QualityCompressorConfig<1>;
+
+            const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(quality));
+            const unsigned int bits = _mm256_movemask_epi8(greaterThanBoundary<Config>(chars, 0));
+            out[0] = reverseBits(bits);
+        }
+
+        static void encodeQualityBlock2Bit(unsigned int* out, const char* quality){
+            using Config = QualityCompressorConfig<2>;
+
+            const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(quality));
+            //each comparison is -1 if true
+            const __m256i negativeBins = _mm256_add_epi8(
+                _mm256_add_epi8(greaterThanBoundary<Config>(chars, 0), greaterThanBoundary<Config>(chars, 1)),
+                greaterThanBoundary<Config>(chars, 2)
+            );
+            const __m256i codes = _mm256_sub_epi8(_mm256_setzero_si256(), negativeBins);
+
+            pack2BitCodesAVX2(out, codes);
+        }
+
+        #else
+
+        static void encodeQualityBlock1Bit(unsigned int* out, const char* quality){
+            encodeQualityBlockScalar<1>(out, quality, blocksize);
+        }
+
+        static void encodeQualityBlock2Bit(unsigned int* out, const char* quality){
+            encodeQualityBlockScalar<2>(out, quality, blocksize);
+        }
+
+        #endif
+    };
+
+}
+
+#endif
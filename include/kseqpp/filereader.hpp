@@ -15,6 +15,8 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <deque>
+#include <memory>
 
 namespace kseqpp{
 
@@ -331,6 +333,399 @@ private:
 using GzReader = GzReaderBase<RawReader>;
 using AsyncGzReader = GzReaderBase<AsyncRawReader>;
 
+/*
+    Decompresses a gzip file in background threads.
+
+    If the file is BGZF (each gzip member has a BC extra field which stores the size of the member), the members are inflated in parallel:
+    an input thread reads the file and groups complete members into jobs of about jobCompressedBytes, which are inflated
+    by numThreads worker threads. Otherwise, the input thread inflates the whole stream (including multiple members) on its own,
+    which overlaps decompression with parsing.
+
+    Jobs are returned by read() in file order. At most maxJobs jobs are in flight.
+*/
+class ParallelGzReader : public FileReader{
+public:
+    ParallelGzReader(std::string filename_)
+        : ParallelGzReader(std::move(filename_), defaultNumThreads()){}
+
+    ParallelGzReader(std::string filename_, int numThreads) 
+        : filename(std::move(filename_)),
+          inputstream(filename, std::ios::binary),
+          maxJobs(2 * std::max(1, numThreads) + 2){
+
+        assert(bool(inputstream));
+
+        isBgzf = isBgzfFile(filename);
+
+        inputthread = std::thread([&](){
+            if(isBgzf){
+                bgzfInputthreadfunc();
+            }else{
+                streamInputthreadfunc();
+            }
+        });
+
+        if(isBgzf){
+            for(int i = 0; i < std::max(1, numThreads); i++){
+                workerthreads.emplace_back([&](){ bgzfWorkerthreadfunc(); });
+            }
+        }
+    }
+
+    ~ParallelGzReader(){
+        {
+            std::unique_lock<std::mutex> ul(mutex);
+            canContinue = false;
+            cv.notify_all();
+        }
+        inputthread.join();
+        for(auto& t : workerthreads){
+            t.join();
+        }
+    }
+
+    ParallelGzReader(const ParallelGzReader&) = delete;
+    ParallelGzReader(ParallelGzReader&&) = delete;
+    ParallelGzReader& operator=(const ParallelGzReader&) = delete;
+    ParallelGzReader& operator=(ParallelGzReader&&) = delete;
+
+    //total number of inflate threads of readers which are used at the same time
+    static int defaultNumThreads(){
+        return std::max(1, std::min(8, int(std::thread::hardware_concurrency())));
+    }
+
+    //share of the default number of inflate threads if numConcurrentReaders readers are used at the same time
+    static int numThreadsPerReader(int numConcurrentReaders){
+        return std::max(1, defaultNumThreads() / std::max(1, numConcurrentReaders));
+    }
+
+    static bool isBgzfFile(const std::string& filename){
+        std::ifstream is(filename, std::ios_base::binary);
+        unsigned char header[18];
+        is.read(reinterpret_cast<char*>(&header[0]), 18);
+        if(is.gcount() != 18) return false;
+
+        return getBgzfBlockSize(&header[0], 18) > 0;
+    }
+
+private:
+    static constexpr std::size_t jobCompressedBytes = 1024 * 1024;
+    static constexpr std::size_t streamInputBytes = 1024 * 64;
+    static constexpr std::size_t maxBgzfBlockBytes = 1024 * 64; //uncompressed size of a bgzf member
+
+    struct Job{
+        bool ready = false;
+        int status = 0;
+        std::size_t begin = 0; //first byte of decompressed which was not returned by read
+        std::vector<char> compressed;
+        std::vector<std::size_t> blockOffsets; //begin of each bgzf member in compressed, and end of last member
+        std::vector<char> decompressed;
+    };
+
+    //returns the size of the bgzf member which begins at header, or 0 if header is not the beginning of a bgzf member
+    static std::size_t getBgzfBlockSize(const unsigned char* header, std::size_t numBytes){
+        if(numBytes < 12) return 0;
+        if(header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || (header[3] & 4) == 0) return 0;
+
+        const std::size_t xlen = header[10] | (header[11] << 8);
+        if(numBytes < 12 + xlen) return 0;
+
+        //search subfield BC
+        std::size_t pos = 12;
+        while(pos + 4 <= 12 + xlen){
+            const std::size_t slen = header[pos + 2] | (header[pos + 3] << 8);
+            if(header[pos] == 'B' && header[pos + 1] == 'C' && slen == 2 && pos + 6 <= 12 + xlen){
+                return (header[pos + 4] | (header[pos + 5] << 8)) + 1;
+            }
+            pos += 4 + slen;
+        }
+        return 0;
+    }
+
+    static std::uint32_t readLE32(const unsigned char* ptr){
+        return std::uint32_t(ptr[0]) | (std::uint32_t(ptr[1]) << 8) | (std::uint32_t(ptr[2]) << 16) | (std::uint32_t(ptr[3]) << 24);
+    }
+
+    //wait until a job may be added. returns nullptr if reading was cancelled
+    std::unique_ptr<Job> acquireJob(){
+        std::unique_lock<std::mutex> ul(mutex);
+        cv.wait(ul, [&](){ return !canContinue || numJobsInFlight < maxJobs; });
+        if(!canContinue) return nullptr;
+
+        numJobsInFlight++;
+
+        if(!freeJobs.empty()){
+            std::unique_ptr<Job> job = std::move(freeJobs.back());
+            freeJobs.pop_back();
+            return job;
+        }
+        return std::make_unique<Job>();
+    }
+
+    void finishInput(){
+        std::unique_lock<std::mutex> ul(mutex);
+        inputFinished = true;
+        cv.notify_all();
+    }
+
+    void bgzfInputthreadfunc(){
+        std::vector<char> pending;
+        std::size_t pendingBegin = 0;
+        bool fileEnd = false;
+        bool error = false;
+
+        while(!(fileEnd && pendingBegin == pending.size()) && !error){
+            std::unique_ptr<Job> job = acquireJob();
+            if(!job) break;
+
+            job->ready = false;
+            job->status = 0;
+            job->begin = 0;
+            job->compressed.clear();
+            job->blockOffsets.clear();
+            job->decompressed.clear();
+            job->blockOffsets.push_back(0);
+
+            while(job->compressed.size() < jobCompressedBytes){
+                //make sure the header of the next member is available
+                if(pending.size() - pendingBegin < 65536 && !fileEnd){
+                    pending.erase(pending.begin(), pending.begin() + pendingBegin);
+                    pendingBegin = 0;
+                    const std::size_t oldSize = pending.size();
+                    pending.resize(oldSize + jobCompressedBytes);
+                    inputstream.read(pending.data() + oldSize, jobCompressedBytes);
+                    pending.resize(oldSize + inputstream.gcount());
+                    fileEnd = !inputstream;
+                }
+
+                const std::size_t available = pending.size() - pendingBegin;
+                if(available == 0) break;
+
+                const unsigned char* header = reinterpret_cast<const unsigned char*>(pending.data() + pendingBegin);
+                const std::size_t blockSize = getBgzfBlockSize(header, available);
+                if(blockSize == 0 || blockSize > available){
+                    std::cerr << "Error, invalid BGZF member in file " << filename << "\n";
+                    job->status = -1;
+                    error = true;
+                    break;
+                }
+
+                job->compressed.insert(job->compressed.end(), pending.data() + pendingBegin, pending.data() + pendingBegin + blockSize);
+                job->blockOffsets.push_back(job->compressed.size());
+                pendingBegin += blockSize;
+            }
+
+            std::unique_lock<std::mutex> ul(mutex);
+            if(job->status != 0){
+                job->ready = true;
+                orderedJobs.push_back(job.get());
+            }else{
+                orderedJobs.push_back(job.get());
+                uncompressedJobs.push_back(job.get());
+            }
+            ownedJobs.emplace_back(std::move(job));
+            cv.notify_all();
+        }
+
+        finishInput();
+    }
+
+    void bgzfWorkerthreadfunc(){
+        z_stream zs;
+        zs.zalloc = Z_NULL;
+        zs.zfree = Z_NULL;
+        zs.opaque = Z_NULL;
+        zs.avail_in = 0;
+        zs.next_in = Z_NULL;
+        int initstatus = inflateInit2(&zs, -MAX_WBITS);
+        assert(initstatus == Z_OK);
+        (void)initstatus;
+
+        while(true){
+            Job* job = nullptr;
+            {
+                std::unique_lock<std::mutex> ul(mutex);
+                cv.wait(ul, [&](){ return !canContinue || !uncompressedJobs.empty() || inputFinished; });
+                if(!canContinue || uncompressedJobs.empty()) break;
+
+                job = uncompressedJobs.front();
+                uncompressedJobs.pop_front();
+            }
+
+            unsigned char* compressed = reinterpret_cast<unsigned char*>(job->compressed.data());
+            int status = 0;
+
+            for(std::size_t b = 0; b + 1 < job->blockOffsets.size() && status == 0; b++){
+                unsigned char* block = compressed + job->blockOffsets[b];
+                const std::size_t blockSize = job->blockOffsets[b+1] - job->blockOffsets[b];
+                const std::size_t headerSize = 12 + (block[10] | (block[11] << 8));
+                const std::uint32_t crc = readLE32(block + blockSize - 8);
+                const std::uint32_t isize = readLE32(block + blockSize - 4);
+
+                //do not trust the trailer of a corrupt member for the size of the output
+                if(headerSize + 8 > blockSize || isize > maxBgzfBlockBytes){
+                    std::cerr << "Error, cannot decompress BGZF member in file " << filename << "\n";
+                    status = -1;
+                    break;
+                }
+
+                const std::size_t outputBegin = job->decompressed.size();
+                job->decompressed.resize(outputBegin + isize);
+                unsigned char dummy = 0; //zlib requires a valid output pointer, e.g. for the empty EOF member
+                unsigned char* output = isize > 0 ? reinterpret_cast<unsigned char*>(job->decompressed.data() + outputBegin) : &dummy;
+
+                inflateReset(&zs);
+                zs.next_in = block + headerSize;
+                zs.avail_in = blockSize - headerSize - 8;
+                zs.next_out = output;
+                zs.avail_out = isize;
+                const int inflatestatus = inflate(&zs, Z_FINISH);
+
+                if(inflatestatus != Z_STREAM_END || zs.avail_out != 0 
+                        || crc32(crc32(0L, Z_NULL, 0), output, isize) != crc){
+                    std::cerr << "Error, cannot decompress BGZF member in file " << filename << "\n";
+                    status = -1;
+                }
+            }
+
+            std::unique_lock<std::mutex> ul(mutex);
+            job->status = status;
+            job->ready = true;
+            cv.notify_all();
+        }
+
+        inflateEnd(&zs);
+    }
+
+    void streamInputthreadfunc(){
+        z_stream zs;
+        zs.zalloc = Z_NULL;
+        zs.zfree = Z_NULL;
+        zs.opaque = Z_NULL;
+        zs.avail_in = 0;
+        zs.next_in = Z_NULL;
+        int initstatus = inflateInit2(&zs, 16+MAX_WBITS);
+        assert(initstatus == Z_OK);
+        (void)initstatus;
+
+        std::vector<unsigned char> input(streamInputBytes);
+        bool fileEnd = false;
+        bool streamEnd = false;
+        bool memberEnd = false;
+
+        while(!streamEnd){
+            std::unique_ptr<Job> job = acquireJob();
+            if(!job) break;
+
+            job->ready = true;
+            job->status = 0;
+            job->begin = 0;
+            job->decompressed.resize(jobCompressedBytes);
+
+            std::size_t written = 0;
+            while(written < job->decompressed.size()){
+                if(zs.avail_in == 0 && !fileEnd){
+                    inputstream.read(reinterpret_cast<char*>(input.data()), input.size());
+                    zs.next_in = input.data();
+                    zs.avail_in = inputstream.gcount();
+                    fileEnd = !inputstream;
+                }
+
+                //truncated member, no data after the last member, or trailing data which is not a gzip member
+                if((zs.avail_in == 0 && fileEnd) || (memberEnd && zs.avail_in > 0 && zs.next_in[0] != 0x1f)){
+                    streamEnd = true;
+                    break;
+                }
+                memberEnd = false;
+
+                zs.next_out = reinterpret_cast<unsigned char*>(job->decompressed.data() + written);
+                zs.avail_out = job->decompressed.size() - written;
+                const int status = inflate(&zs, Z_NO_FLUSH);
+                written = job->decompressed.size() - zs.avail_out;
+
+                if(status == Z_STREAM_END){
+                    //continue with the next member, if any
+                    inflateReset(&zs);
+                    memberEnd = true;
+                }else if(status != Z_OK && status != Z_BUF_ERROR){
+                    std::cerr << "Error, cannot decompress file " << filename << "\n";
+                    job->status = -1;
+                    streamEnd = true;
+                    break;
+                }
+            }
+            job->decompressed.resize(written);
+
+            std::unique_lock<std::mutex> ul(mutex);
+            orderedJobs.push_back(job.get());
+            ownedJobs.emplace_back(std::move(job));
+            cv.notify_all();
+        }
+
+        inflateEnd(&zs);
+
+        finishInput();
+    }
+
+    int readImpl(char* outputbuffer, int outputsize) override{
+        int numCopied = 0;
+
+        while(numCopied < outputsize){
+            if(currentJob == nullptr){
+                std::unique_lock<std::mutex> ul(mutex);
+                cv.wait(ul, [&](){ 
+                    return (!orderedJobs.empty() && orderedJobs.front()->ready) || (orderedJobs.empty() && inputFinished); 
+                });
+                if(orderedJobs.empty()) break;
+
+                currentJob = orderedJobs.front();
+                orderedJobs.pop_front();
+            }
+
+            if(currentJob->status != 0){
+                return -1;
+            }
+
+            const std::size_t bytesToCopy = std::min(std::size_t(outputsize - numCopied), currentJob->decompressed.size() - currentJob->begin);
+            std::copy_n(currentJob->decompressed.data() + currentJob->begin, bytesToCopy, outputbuffer + numCopied);
+            currentJob->begin += bytesToCopy;
+            numCopied += bytesToCopy;
+
+            if(currentJob->begin == currentJob->decompressed.size()){
+                std::unique_lock<std::mutex> ul(mutex);
+                auto it = std::find_if(ownedJobs.begin(), ownedJobs.end(), [&](const auto& ptr){ return ptr.get() == currentJob; });
+                assert(it != ownedJobs.end());
+                freeJobs.emplace_back(std::move(*it));
+                ownedJobs.erase(it);
+                numJobsInFlight--;
+                currentJob = nullptr;
+                cv.notify_all();
+            }
+        }
+
+        return numCopied;
+    }
+
+    std::string filename;
+    std::ifstream inputstream;
+    int maxJobs;
+    bool isBgzf = false;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool canContinue = true;
+    bool inputFinished = false;
+    int numJobsInFlight = 0;
+    std::vector<std::unique_ptr<Job>> ownedJobs;
+    std::vector<std::unique_ptr<Job>> freeJobs;
+    std::deque<Job*> orderedJobs;
+    std::deque<Job*> uncompressedJobs;
+    Job* currentJob = nullptr;
+
+    std::thread inputthread;
+    std::vector<std::thread> workerthreads;
+};
+
 
 } // namespace kseqpp
 
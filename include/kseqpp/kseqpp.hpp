@@ -30,9 +30,19 @@ namespace kseqpp{
     using CompressedReader_t = AsyncGzReader;
 #else 
     //using CompressedReader_t = GzReader;
-    using CompressedReader_t = ZlibReader;
+    //using CompressedReader_t = ZlibReader;
+    using CompressedReader_t = ParallelGzReader;
 #endif   
 
+//numThreads is the number of inflate threads of ParallelGzReader. Other readers ignore it
+inline std::unique_ptr<FileReader> makeCompressedReader(const std::string& filename, int numThreads){
+#ifdef KSEQPP_ASYNC_READER
+    return std::make_unique<CompressedReader_t>(filename);
+#else 
+    return std::make_unique<CompressedReader_t>(filename, numThreads);
+#endif
+}
+
 /*
     The following code for parsing sequence files is adapted from klib/kseq.h which is available under MIT license
 */
@@ -45,7 +55,11 @@ public:
     KseqPP() = default;
 
     KseqPP(const std::string& filename)
-            : f(std::make_unique<Stream>(filename)){
+            : KseqPP(filename, ParallelGzReader::defaultNumThreads()){}
+
+    //numDecompressionThreads is the number of threads which inflate a compressed file
+    KseqPP(const std::string& filename, int numDecompressionThreads)
+            : f(std::make_unique<Stream>(filename, numDecompressionThreads)){
         // std::cerr << "KseqPP(" << filename << ")\n";
         header.reserve(256);
         seq.reserve(256);
@@ -170,11 +184,11 @@ private:
 
         kstream_t() = default;
 
-        kstream_t(const std::string& filename) : begin(0), end(0), is_eof(0){
+        kstream_t(const std::string& filename, int numDecompressionThreads) : begin(0), end(0), is_eof(0){
 
             if(hasGzipHeader(filename)){
                 //std::cerr << "assume gz file\n";
-                filereader.reset(new CompressedReader_t(filename));
+                filereader = makeCompressedReader(filename, numDecompressionThreads);
             }else{
                 //std::cerr << "assume raw file\n";
                 filereader.reset(new RawReader_t(filename));
@@ -321,11 +335,11 @@ private:
 
         asynckstream_t() = default;
 
-        asynckstream_t(const std::string& filename) : begin(0), end(0), is_eof(0){
+        asynckstream_t(const std::string& filename, int numDecompressionThreads) : begin(0), end(0), is_eof(0){
 
             if(hasGzipHeader(filename)){
                 //std::cerr << "assume gz file\n";
-                filereader.reset(new CompressedReader_t(filename));
+                filereader = makeCompressedReader(filename, numDecompressionThreads);
             }else{
                 //std::cerr << "assume raw file\n";
                 filereader.reset(new RawReader_t(filename));
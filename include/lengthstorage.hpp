@@ -4,6 +4,7 @@
 #include <config.hpp>
 #include <memorymanagement.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
@@ -54,6 +55,16 @@ struct LengthStore{
         data.resize(dataelements);
     }
 
+    //lengths in raw format (see getRaw()) in memory which is not owned by the LengthStore, e.g. a memory mapped file. 
+    //rawData must stay valid. The lengths cannot be modified
+    static LengthStore makeView(int minL, int maxL, std::int64_t numElements_, const Data_t* rawData, std::size_t rawSizeInElements){
+        LengthStore result(minL, maxL, 0);
+        result.numElements = numElements_;
+        result.externalData = rawData;
+        result.externalSizeInElements = rawSizeInElements;
+        return result;
+    }
+
     LengthStore(const LengthStore&) = default;
     LengthStore(LengthStore&&) = default;
     LengthStore& operator=(const LengthStore&) = default;
@@ -67,7 +78,8 @@ struct LengthStore{
             && maxLength == rhs.maxLength
             && bitsMask == rhs.bitsMask
             && numElements == rhs.numElements
-            && data == rhs.data;
+            && getRawSizeInElements() == rhs.getRawSizeInElements()
+            && std::equal(getRaw(), getRaw() + getRawSizeInElements(), rhs.getRaw());
     }
 
     void destroy(){
@@ -78,6 +90,8 @@ struct LengthStore{
         };
 
         deallocVector(data);
+        externalData = nullptr;
+        externalSizeInElements = 0;
         numElements = 0;
         minLength = 0;
         maxLength = 0;
@@ -102,7 +116,7 @@ struct LengthStore{
     }
 
     const Data_t* getRaw() const{
-        return data.data();
+        return externalData != nullptr ? externalData : data.data();
     }
 
     int getRawBitsPerLength() const{
@@ -110,11 +124,11 @@ struct LengthStore{
     }
 
     std::size_t getRawSizeInBytes() const{
-        return data.size() * sizeof(Data_t);
+        return getRawSizeInElements() * sizeof(Data_t);
     }
 
     std::size_t getRawSizeInElements() const{
-        return data.size();
+        return externalData != nullptr ? externalSizeInElements : data.size();
     }
 
     int getLength(read_number index) const{
@@ -130,15 +144,17 @@ struct LengthStore{
         const int begin = firstBit - firstuintindex * DataTBits;
         const int endExcl = lastBitExcl - firstuintindex * DataTBits;
         
-        const auto first = data[firstuintindex];
+        const Data_t* const raw = getRaw();
+        const auto first = raw[firstuintindex];
         //prevent oob access
-        const auto second = firstuintindex == data.size() - 1 ? data[firstuintindex] : data[firstuintindex + 1];
+        const auto second = firstuintindex == getRawSizeInElements() - 1 ? raw[firstuintindex] : raw[firstuintindex + 1];
         const Data_t lengthBits = getBits(first, second, begin, endExcl);
 
         return int(lengthBits) + minLength;
     }
 
     void setLength(read_number index, int length){
+        assert(externalData == nullptr);
         assert(index < getNumElements());
         assert(minLength <= length && length <= maxLength);
 
@@ -177,6 +193,8 @@ struct LengthStore{
         stream.read(reinterpret_cast<char*>(&rawSizeElements), sizeof(std::size_t));
         stream.read(reinterpret_cast<char*>(&rawSizeBytes), sizeof(std::size_t));
 
+        externalData = nullptr;
+        externalSizeInElements = 0;
         data.resize(rawSizeElements);        
         stream.read(reinterpret_cast<char*>(data.data()), rawSizeBytes);
     }
@@ -194,7 +212,7 @@ struct LengthStore{
         std::size_t rawSizeBytes = getRawSizeInBytes();
         stream.write(reinterpret_cast<const char*>(&rawSizeElements), sizeof(std::size_t));
         stream.write(reinterpret_cast<const char*>(&rawSizeBytes), sizeof(std::size_t));
-        stream.write(reinterpret_cast<const char*>(data.data()), rawSizeBytes);
+        stream.write(reinterpret_cast<const char*>(getRaw()), rawSizeBytes);
 
         std::size_t writtenBytes = sizeof(int) + sizeof(int) + sizeof(int) + sizeof(int);
         writtenBytes += sizeof(Data_t) + sizeof(std::int64_t);
@@ -203,9 +221,10 @@ struct LengthStore{
         return writtenBytes;
     }
 
+    //memory of views is not included
     MemoryUsage getMemoryInfo() const{
         MemoryUsage info;
-        info.host = getRawSizeInBytes();
+        info.host = data.size() * sizeof(Data_t);
         return info;
     }
 
@@ -291,6 +310,9 @@ private:
     std::int64_t numElements = 0;
 
     std::vector<Data_t> data;
+
+    const Data_t* externalData = nullptr;
+    std::size_t externalSizeInElements = 0;
 };
 
 }
@@ -0,0 +1,101 @@
+#ifndef CARE_MAPPEDFILE_HPP
+#define CARE_MAPPEDFILE_HPP
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace care{
+
+    //read-only memory mapping of a whole file. The pages are shared with other processes which map the same file
+    class MappedFile{
+    public:
+        MappedFile() = default;
+
+        //advice is applied to the whole file, e.g. MADV_SEQUENTIAL
+        MappedFile(const std::string& filename, int advice = MADV_NORMAL){
+            const int fd = open(filename.c_str(), O_RDONLY);
+            if(fd == -1){
+                perror("MappedFile open");
+                throw std::runtime_error("Cannot open file " + filename);
+            }
+
+            struct stat st;
+            if(fstat(fd, &st) != 0){
+                close(fd);
+                throw std::runtime_error("Cannot stat file " + filename);
+            }
+
+            numBytes = st.st_size;
+
+            if(numBytes > 0){
+                void* ptr = mmap(nullptr, numBytes, PROT_READ, MAP_SHARED, fd, 0);
+                if(ptr == MAP_FAILED){
+                    perror("MappedFile mmap");
+                    close(fd);
+                    throw std::runtime_error("Cannot map file " + filename);
+                }
+                data = static_cast<const char*>(ptr);
+                if(advice != MADV_NORMAL){
+                    madvise(ptr, numBytes, advice);
+                }
+            }
+
+            close(fd);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& rhs) noexcept
+            : data(std::exchange(rhs.data, nullptr)), numBytes(std::exchange(rhs.numBytes, 0)){}
+
+        MappedFile& operator=(MappedFile&& rhs) noexcept{
+            std::swap(data, rhs.data);
+            std::swap(numBytes, rhs.numBytes);
+            return *this;
+        }
+
+        ~MappedFile(){
+            if(data != nullptr){
+                munmap(const_cast<char*>(data), numBytes);
+            }
+        }
+
+        //apply advice to the pages which contain the bytes [offset, offset + bytes)
+        void advise(std::size_t offset, std::size_t bytes, int advice) const{
+            if(data == nullptr || bytes == 0 || offset >= numBytes){
+                return;
+            }
+
+            const std::size_t pagesize = sysconf(_SC_PAGESIZE);
+            const std::size_t begin = offset / pagesize * pagesize;
+            const std::size_t end = std::min(numBytes, offset + bytes);
+
+            madvise(const_cast<char*>(data) + begin, end - begin, advice);
+        }
+
+        const char* getData() const noexcept{
+            return data;
+        }
+
+        std::size_t size() const noexcept{
+            return numBytes;
+        }
+
+    private:
+        const char* data = nullptr;
+        std::size_t numBytes = 0;
+    };
+
+}
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef CARE_MAPPEDSEQUENCEFILE_HPP
+#define CARE_MAPPEDSEQUENCEFILE_HPP
+
+#include <mappedfile.hpp>
+#include <kseqpp/gziphelpers.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace care{
+
+    struct SequenceRecordView{
+        std::string_view header{};
+        std::string_view sequence{};
+        std::string_view quality{};
+    };
+
+    /*
+        Parser for uncompressed FASTA / FASTQ files which works directly on a memory mapping of the file.
+
+        The file is split into chunks of approximately chunkBytes bytes, which begin at record boundaries, such that
+        the chunks can be parsed in parallel. The format is determined by the first record of the file. A FASTA record begins
+        with a line which starts with '>'. A FASTQ record begins with a line which starts with '@', if the line after the next line
+        starts with '+', and the line after that has the same length as the line after the header. Quality lines may start with
+        '>', '@', or '+', so only the latter rule is used for FASTQ. If no record boundary is found, chunks are merged.
+
+        Records are returned as views into the mapping. Only sequences or quality scores which span multiple lines
+        are copied into a buffer which is provided by the caller. The parsed records are the same as those of KseqPP.
+    */
+    class MappedSequenceFileParser{
+    public:
+        MappedSequenceFileParser(const std::string& filename_, std::size_t chunkBytes)
+            : filename(filename_), file(filename_, MADV_SEQUENTIAL)
+        {
+            const char* const data = file.getData();
+            const std::size_t size = file.size();
+
+            //the first record determines the format
+            {
+                std::size_t pos = 0;
+                while(pos < size && data[pos] != '>' && data[pos] != '@'){
+                    pos++;
+                }
+                isFasta = pos < size && data[pos] == '>';
+            }
+
+            chunkBegins.push_back(0);
+
+            if(size > 0){
+                chunkBytes = std::max(std::size_t(1), chunkBytes);
+
+                std::size_t pos = chunkBytes;
+                while(pos < size){
+                    //continue at the next line
+                    const char* eol = static_cast<const char*>(std::memchr(data + pos - 1, '\n', size - pos + 1));
+                    if(eol == nullptr) break;
+                    pos = eol - data + 1;
+
+                    const std::size_t recordBegin = findRecordBegin(pos);
+                    if(recordBegin >= size) break;
+
+                    chunkBegins.push_back(recordBegin);
+                    pos = recordBegin + chunkBytes;
+                }
+            }
+
+            chunkBegins.push_back(size);
+        }
+
+        //returns true if the file is not gzip-compressed
+        static bool canParse(const std::string& filename){
+            return !kseqpp::hasGzipHeader(filename);
+        }
+
+        const std::string& getFilename() const noexcept{
+            return filename;
+        }
+
+        std::size_t getNumChunks() const noexcept{
+            return chunkBegins.size() - 1;
+        }
+
+        /*
+            Parse the records of chunk. Sequences and quality scores which span multiple lines are copied into buffer.
+            Throws std::runtime_error on malformed input
+        */
+        void parseChunk(std::size_t chunk, std::vector<SequenceRecordView>& records, std::vector<char>& buffer) const{
+            assert(chunk < getNumChunks());
+
+            records.clear();
+            buffer.clear();
+
+            //positions of multi-line fields in buffer. they are resolved after parsing, when buffer does not grow anymore
+            struct BufferedField{
+                std::size_t record;
+                bool isQuality;
+                std::size_t begin;
+                std::size_t length;
+            };
+            std::vector<BufferedField> bufferedFields;
+
+            const char* const data = file.getData();
+            const std::size_t end = chunkBegins[chunk + 1];
+            std::size_t pos = chunkBegins[chunk];
+
+            auto getLine = [&](std::size_t linebegin){
+                const char* eol = static_cast<const char*>(std::memchr(data + linebegin, '\n', end - linebegin));
+                const std::size_t lineend = eol == nullptr ? end : eol - data;
+                std::size_t length = lineend - linebegin;
+                //remove carriage return
+                if(length > 1 && data[linebegin + length - 1] == '\r'){
+                    length--;
+                }
+                return std::make_pair(std::string_view(data + linebegin, length), std::min(end, lineend + 1));
+            };
+
+            //skip everything before the first record
+            if(chunk == 0){
+                while(pos < end && data[pos] != '>' && data[pos] != '@'){
+                    pos++;
+                }
+            }
+
+            const char recordBeginChar = isFasta ? '>' : '@';
+
+            while(pos < end){
+                if(data[pos] != recordBeginChar){
+                    throw std::runtime_error("Unexpected character at beginning of record in file " + filename);
+                }
+
+                SequenceRecordView record;
+
+                auto headerline = getLine(pos + 1);
+                record.header = headerline.first;
+                pos = headerline.second;
+
+                //sequence lines, until a line which starts with '>', '+', or '@'. empty lines are skipped
+                std::size_t numSequenceLines = 0;
+                std::size_t sequenceLength = 0;
+                std::size_t sequenceBufferBegin = 0;
+                while(pos < end && data[pos] != '>' && data[pos] != '+' && data[pos] != '@'){
+                    auto line = getLine(pos);
+                    pos = line.second;
+                    if(line.first.empty() || line.first == "\r") continue;
+
+                    if(numSequenceLines == 0){
+                        record.sequence = line.first;
+                    }else{
+                        if(numSequenceLines == 1){
+                            sequenceBufferBegin = buffer.size();
+                            buffer.insert(buffer.end(), record.sequence.begin(), record.sequence.end());
+                        }
+                        buffer.insert(buffer.end(), line.first.begin(), line.first.end());
+                    }
+                    sequenceLength += line.first.size();
+                    numSequenceLines++;
+                }
+                if(numSequenceLines > 1){
+                    bufferedFields.push_back(BufferedField{records.size(), false, sequenceBufferBegin, sequenceLength});
+                }
+
+                if(pos < end && data[pos] == '+'){
+                    //skip the rest of '+' line
+                    pos = getLine(pos).second;
+
+                    //quality lines, until the quality string is at least as long as the sequence
+                    std::size_t numQualityLines = 0;
+                    std::size_t qualityLength = 0;
+                    std::size_t qualityBufferBegin = 0;
+                    while(pos < end && (qualityLength < sequenceLength || numQualityLines == 0)){
+                        auto line = getLine(pos);
+                        pos = line.second;
+
+                        if(numQualityLines == 0){
+                            record.quality = line.first;
+                        }else{
+                            if(numQualityLines == 1){
+                                qualityBufferBegin = buffer.size();
+                                buffer.insert(buffer.end(), record.quality.begin(), record.quality.end());
+                            }
+                            buffer.insert(buffer.end(), line.first.begin(), line.first.end());
+                        }
+                        qualityLength += line.first.size();
+                        numQualityLines++;
+                    }
+                    if(numQualityLines > 1){
+                        bufferedFields.push_back(BufferedField{records.size(), true, qualityBufferBegin, qualityLength});
+                    }
+
+                    if(qualityLength != sequenceLength){
+                        throw std::runtime_error("Length of quality scores differs from sequence length in file " + filename);
+                    }
+                }
+
+                records.push_back(record);
+            }
+
+            for(const auto& field : bufferedFields){
+                std::string_view view(buffer.data() + field.begin, field.length);
+                if(field.isQuality){
+                    records[field.record].quality = view;
+                }else{
+                    records[field.record].sequence = view;
+                }
+            }
+        }
+
+    private:
+        //returns the position of the first record which begins at or after linebegin, which must be the beginning of a line
+        std::size_t findRecordBegin(std::size_t linebegin) const{
+            const char* const data = file.getData();
+            const std::size_t size = file.size();
+
+            auto nextLine = [&](std::size_t pos){
+                const char* eol = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+                return eol == nullptr ? size : std::size_t(eol - data) + 1;
+            };
+
+            auto lineLength = [&](std::size_t pos){
+                std::size_t length = nextLine(pos) - pos;
+                while(length > 0 && (data[pos + length - 1] == '\n' || data[pos + length - 1] == '\r')){
+                    length--;
+                }
+                return length;
+            };
+
+            std::size_t pos = linebegin;
+            while(pos < size){
+                if(isFasta){
+                    if(data[pos] == '>'){
+                        return pos;
+                    }
+                }else if(data[pos] == '@'){
+                    const std::size_t seqline = nextLine(pos);
+                    const std::size_t plusline = seqline < size ? nextLine(seqline) : size;
+                    const std::size_t qualline = plusline < size ? nextLine(plusline) : size;
+                    if(plusline < size && data[plusline] == '+' && qualline <= size
+                            && lineLength(seqline) == lineLength(qualline)){
+                        return pos;
+                    }
+                }
+                pos = nextLine(pos);
+            }
+
+            return size;
+        }
+
+        bool isFasta = false;
+        std::string filename;
+        MappedFile file;
+        std::vector<std::size_t> chunkBegins;
+    };
+
+}
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef CARE_MEMORY_BUDGET_HPP
+#define CARE_MEMORY_BUDGET_HPP
+
+#include <memorymanagement.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace care{
+
+/*
+    Host memory budget of a program run, which is shared by all stages.
+
+    Long-lived data structures are registered as components. Their usage is queried when it is needed, e.g. via getMemoryInfo().
+    Working memory which is not part of a component is requested as a reservation. The available memory is the limit minus the usage
+    of all components and reservations, and at most the free memory of the system.
+
+    Components which can spill to disk are registered with a function which sets their memory limit. Whenever a component or a
+    reservation is added or removed, and on refresh(), the memory which is not used by other components and reservations
+    is distributed among them in registration order. Components which grow in between are only accounted for by the next refresh().
+
+    Peak usage is tracked per stage (beginStage): the peak of components plus reservations, which is sampled whenever the limits
+    are recomputed, and the peak resident set size of the process.
+*/
+class MemoryBudget{
+public:
+    //unregisters a component or releases a reservation on destruction
+    class Handle{
+    public:
+        Handle() = default;
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        Handle(Handle&& rhs) noexcept
+            : budget(std::exchange(rhs.budget, nullptr)), id(rhs.id){}
+
+        Handle& operator=(Handle&& rhs) noexcept{
+            release();
+            budget = std::exchange(rhs.budget, nullptr);
+            id = rhs.id;
+            return *this;
+        }
+
+        ~Handle(){
+            release();
+        }
+
+        void release(){
+            if(budget != nullptr){
+                budget->remove(id);
+                budget = nullptr;
+            }
+        }
+
+    private:
+        friend class MemoryBudget;
+
+        Handle(MemoryBudget* budget_, int id_) : budget(budget_), id(id_){}
+
+        MemoryBudget* budget = nullptr;
+        int id = 0;
+    };
+
+    explicit MemoryBudget(std::size_t limitBytes_) : limitBytes(limitBytes_){
+        resetPeakRSS();
+        stages.push_back(Stage{"start", 0, 0});
+    }
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    Handle registerComponent(std::string name, std::function<std::size_t()> getUsage){
+        return add(Entry{0, std::move(name), std::move(getUsage), {}, 0});
+    }
+
+    //setMemoryLimit(bytes) is called with the number of bytes which the component may keep in memory
+    Handle registerSpillableComponent(
+        std::string name,
+        std::function<std::size_t()> getUsage,
+        std::function<void(std::size_t)> setMemoryLimit
+    ){
+        return add(Entry{0, std::move(name), std::move(getUsage), std::move(setMemoryLimit), 0});
+    }
+
+    //the reservation is granted even if it exceeds the available memory. Spillable components are limited accordingly
+    Handle reserve(std::string name, std::size_t bytes){
+        return add(Entry{0, std::move(name), {}, {}, bytes});
+    }
+
+    //recompute the memory limits of spillable components from the current usage of all components
+    void refresh(){
+        std::lock_guard<std::mutex> lg(mutex);
+        update();
+    }
+
+    std::size_t getLimit() const noexcept{
+        return limitBytes;
+    }
+
+    //components and reservations
+    std::size_t getUsedBytes() const{
+        std::lock_guard<std::mutex> lg(mutex);
+        return getUsedBytesImpl();
+    }
+
+    std::size_t getAvailableBytes() const{
+        std::lock_guard<std::mutex> lg(mutex);
+        const std::size_t used = getUsedBytesImpl();
+        const std::size_t remaining = limitBytes - std::min(limitBytes, used);
+        return std::min(remaining, getAvailableMemoryInKB() * 1024);
+    }
+
+    void beginStage(std::string name){
+        std::lock_guard<std::mutex> lg(mutex);
+        finishStage();
+        stages.push_back(Stage{std::move(name), 0, 0});
+        samplePeak();
+    }
+
+    void printStageReport(std::ostream& os){
+        std::lock_guard<std::mutex> lg(mutex);
+        finishStage();
+
+        auto toGB = [](std::size_t bytes){
+            return bytes / 1024. / 1024. / 1024.;
+        };
+
+        os << "Peak memory usage per stage (accounted / resident), limit " << toGB(limitBytes) << " GB:\n";
+        for(const auto& stage : stages){
+            if(stage.name == "start") continue;
+            os << stage.name << ": " << toGB(stage.peakAccountedBytes) << " GB / " << toGB(stage.peakRSSBytes) << " GB\n";
+        }
+        if(!canResetPeakRSS){
+            os << "Resident peaks are cumulative since program start\n";
+        }
+    }
+
+private:
+    struct Entry{
+        int id;
+        std::string name;
+        std::function<std::size_t()> getUsage;
+        std::function<void(std::size_t)> setMemoryLimit;
+        std::size_t reservedBytes;
+
+        std::size_t getBytes() const{
+            return getUsage ? getUsage() : reservedBytes;
+        }
+    };
+
+    struct Stage{
+        std::string name;
+        std::size_t peakAccountedBytes;
+        std::size_t peakRSSBytes;
+    };
+
+    Handle add(Entry entry){
+        std::lock_guard<std::mutex> lg(mutex);
+        entry.id = nextId++;
+        const int id = entry.id;
+        entries.push_back(std::move(entry));
+        update();
+        return Handle(this, id);
+    }
+
+    void remove(int id){
+        std::lock_guard<std::mutex> lg(mutex);
+        samplePeak();
+        entries.erase(
+            std::remove_if(entries.begin(), entries.end(), [&](const auto& e){ return e.id == id; }),
+            entries.end()
+        );
+        update();
+    }
+
+    std::size_t getUsedBytesImpl() const{
+        std::size_t bytes = 0;
+        for(const auto& entry : entries){
+            bytes += entry.getBytes();
+        }
+        return bytes;
+    }
+
+    //distribute the remaining memory among spillable components, and sample the peak usage
+    void update(){
+        std::size_t fixedBytes = 0;
+        std::size_t spillableBytes = 0;
+        for(const auto& entry : entries){
+            if(entry.setMemoryLimit){
+                spillableBytes += entry.getBytes();
+            }else{
+                fixedBytes += entry.getBytes();
+            }
+        }
+
+        std::size_t remaining = std::min(
+            limitBytes - std::min(limitBytes, fixedBytes),
+            getAvailableMemoryInKB() * 1024 + spillableBytes
+        );
+        for(const auto& entry : entries){
+            if(entry.setMemoryLimit){
+                entry.setMemoryLimit(remaining);
+                remaining -= std::min(remaining, entry.getBytes());
+            }
+        }
+
+        samplePeak();
+    }
+
+    void samplePeak(){
+        Stage& stage = stages.back();
+        stage.peakAccountedBytes = std::max(stage.peakAccountedBytes, getUsedBytesImpl());
+    }
+
+    void finishStage(){
+        samplePeak();
+        Stage& stage = stages.back();
+        stage.peakRSSBytes = std::max(stage.peakRSSBytes, getPeakRSS());
+        resetPeakRSS();
+    }
+
+    //VmHWM of the process
+    static std::size_t getPeakRSS(){
+        std::ifstream is("/proc/self/status");
+        std::string token;
+        while(is >> token){
+            if(token == "VmHWM:"){
+                std::size_t kb = 0;
+                is >> kb;
+                return kb * 1024;
+            }
+        }
+        return getMaxRSSUsageInKB() * 1024;
+    }
+
+    //available since Linux 4.0
+    void resetPeakRSS(){
+        std::ofstream os("/proc/self/clear_refs");
+        os << "5";
+        os.flush();
+        canResetPeakRSS = bool(os);
+    }
+
+    std::size_t limitBytes = 0;
+    int nextId = 0;
+    bool canResetPeakRSS = false;
+    std::vector<Entry> entries{};
+    std::vector<Stage> stages{};
+    mutable std::mutex mutex{};
+};
+
+}
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef CARE_MEMORY_PLACEMENT_HPP
+#define CARE_MEMORY_PLACEMENT_HPP
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace care{
+
+    enum class HugePageMode : int{
+        None,
+        Transparent,
+        Explicit2M,
+        Explicit1G,
+        Invalid
+    };
+
+    inline std::string to_string(HugePageMode mode){
+        switch(mode){
+            case HugePageMode::None: return "none";
+            case HugePageMode::Transparent: return "transparent";
+            case HugePageMode::Explicit2M: return "2M";
+            case HugePageMode::Explicit1G: return "1G";
+            default: return "invalid";
+        }
+    }
+
+    /*
+        Placement of large long-lived arrays, e.g. the read storage, the hash tables, and the correction flags.
+        Their random accesses are dominated by TLB misses, and on multi-socket hosts by accesses to a remote NUMA node.
+
+        Allocations of at least minBytes bytes are served by anonymous memory mappings, which are backed by huge pages
+        and / or interleaved across all NUMA nodes according to the policy. Smaller allocations, and all allocations with
+        the default policy, use operator new. Explicit huge pages (MAP_HUGETLB) must be reserved by the administrator.
+        If none are available, transparent huge pages are used instead.
+
+        The policy should be set once at program start, before the arrays are allocated.
+    */
+    class MemoryPlacement{
+    public:
+        static constexpr std::size_t minBytes = std::size_t(2) << 20;
+
+        static void setPolicy(HugePageMode hugePages, bool interleaveNumaNodes){
+            State& state = getState();
+            std::lock_guard<std::mutex> lg(state.mutex);
+
+            state.hugePages = hugePages;
+            state.interleave = false;
+            state.nodemask.clear();
+
+            if(interleaveNumaNodes){
+                state.nodemask = getOnlineNumaNodes();
+                int numNodes = 0;
+                for(auto word : state.nodemask){
+                    numNodes += __builtin_popcountl(word);
+                }
+                //nothing to interleave on a single node
+                state.interleave = numNodes > 1;
+            }
+        }
+
+        static void* allocate(std::size_t bytes){
+            State& state = getState();
+
+            if(bytes < minBytes || (state.hugePages == HugePageMode::None && !state.interleave)){
+                return ::operator new(bytes);
+            }
+
+            std::size_t mappedBytes = roundUp(bytes, sysconf(_SC_PAGESIZE));
+            void* ptr = MAP_FAILED;
+
+            if(state.hugePages == HugePageMode::Explicit2M || state.hugePages == HugePageMode::Explicit1G){
+                const int shift = state.hugePages == HugePageMode::Explicit2M ? 21 : 30;
+                const std::size_t hugeBytes = roundUp(bytes, std::size_t(1) << shift);
+
+                //without MAP_NORESERVE, the mapping fails if not enough huge pages are reserved, instead of a SIGBUS on access
+                ptr = mmap(nullptr, hugeBytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+
+                if(ptr != MAP_FAILED){
+                    mappedBytes = hugeBytes;
+                }else{
+                    std::lock_guard<std::mutex> lg(state.mutex);
+                    if(!state.warnedHugeTLB){
+                        perror("MemoryPlacement mmap MAP_HUGETLB");
+                        std::cerr << "Explicit huge pages are not available. Using transparent huge pages\n";
+                        state.warnedHugeTLB = true;
+                    }
+                }
+            }
+
+            if(ptr == MAP_FAILED){
+                ptr = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                if(ptr == MAP_FAILED){
+                    throw std::bad_alloc();
+                }
+                if(state.hugePages != HugePageMode::None){
+                    madvise(ptr, mappedBytes, MADV_HUGEPAGE);
+                }
+            }
+
+            std::lock_guard<std::mutex> lg(state.mutex);
+
+            //pages are not touched yet, so they are placed on first access according to the policy
+            if(state.interleave){
+                constexpr int mpolInterleave = 3;
+                const unsigned long maxnode = state.nodemask.size() * sizeof(unsigned long) * 8;
+                //the kernel ignores the last bit of the mask
+                if(syscall(SYS_mbind, ptr, mappedBytes, mpolInterleave, state.nodemask.data(), maxnode + 1, 0) != 0
+                        && !state.warnedMbind){
+                    perror("MemoryPlacement mbind");
+                    state.warnedMbind = true;
+                }
+            }
+
+            state.mappings[ptr] = mappedBytes;
+
+            return ptr;
+        }
+
+        static void deallocate(void* ptr, std::size_t bytes) noexcept{
+            if(ptr == nullptr){
+                return;
+            }
+
+            if(bytes >= minBytes){
+                State& state = getState();
+                std::size_t mappedBytes = 0;
+                {
+                    std::lock_guard<std::mutex> lg(state.mutex);
+                    auto it = state.mappings.find(ptr);
+                    if(it != state.mappings.end()){
+                        mappedBytes = it->second;
+                        state.mappings.erase(it);
+                    }
+                }
+                if(mappedBytes > 0){
+                    munmap(ptr, mappedBytes);
+                    return;
+                }
+            }
+
+            ::operator delete(ptr);
+        }
+
+    private:
+        struct State{
+            HugePageMode hugePages = HugePageMode::None;
+            bool interleave = false;
+            bool warnedHugeTLB = false;
+            bool warnedMbind = false;
+            std::vector<unsigned long> nodemask{};
+            std::map<void*, std::size_t> mappings{};
+            std::mutex mutex{};
+        };
+
+        static State& getState(){
+            static State state;
+            return state;
+        }
+
+        static std::size_t roundUp(std::size_t bytes, std::size_t alignment) noexcept{
+            return (bytes + alignment - 1) / alignment * alignment;
+        }
+
+        //parses a node list like 0-1,4 from sysfs. empty if not available
+        static std::vector<unsigned long> getOnlineNumaNodes(){
+            constexpr int bitsPerWord = sizeof(unsigned long) * 8;
+            std::vector<unsigned long> mask;
+
+            std::ifstream is("/sys/devices/system/node/online");
+            std::string list;
+            if(!(is >> list)){
+                return mask;
+            }
+
+            std::size_t pos = 0;
+            while(pos < list.size()){
+                std::size_t end = list.find(',', pos);
+                if(end == std::string::npos){
+                    end = list.size();
+                }
+                const std::string range = list.substr(pos, end - pos);
+                const std::size_t dash = range.find('-');
+                const int first = std::stoi(range.substr(0, dash));
+                const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+                for(int node = first; node <= last; node++){
+                    if(std::size_t(node / bitsPerWord) >= mask.size()){
+                        mask.resize(node / bitsPerWord + 1, 0);
+                    }
+                    mask[node / bitsPerWord] |= 1ul << (node % bitsPerWord);
+                }
+
+                pos = end + 1;
+            }
+
+            return mask;
+        }
+    };
+
+    //std::vector allocator which uses MemoryPlacement
+    template<class T>
+    struct PlacedAllocator{
+        using value_type = T;
+
+        PlacedAllocator() = default;
+
+        template<class U>
+        PlacedAllocator(const PlacedAllocator<U>&) noexcept{}
+
+        T* allocate(std::size_t n){
+            return static_cast<T*>(MemoryPlacement::allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* ptr, std::size_t n) noexcept{
+            MemoryPlacement::deallocate(ptr, n * sizeof(T));
+        }
+
+        template<class U>
+        bool operator==(const PlacedAllocator<U>&) const noexcept{
+            return true;
+        }
+
+        template<class U>
+        bool operator!=(const PlacedAllocator<U>&) const noexcept{
+            return false;
+        }
+    };
+
+    template<class T>
+    using PlacedVector = std::vector<T, PlacedAllocator<T>>;
+
+    struct PlacedArrayDeleter{
+        std::size_t bytes = 0;
+
+        void operator()(void* ptr) const noexcept{
+            MemoryPlacement::deallocate(ptr, bytes);
+        }
+    };
+
+    //uninitialized array of trivial type, allocated with MemoryPlacement
+    template<class T>
+    using PlacedArray = std::unique_ptr<T[], PlacedArrayDeleter>;
+
+    template<class T>
+    PlacedArray<T> makePlacedArray(std::size_t n){
+        static_assert(std::is_trivial<T>::value, "T must be trivial");
+
+        return PlacedArray<T>(static_cast<T*>(MemoryPlacement::allocate(n * sizeof(T))), PlacedArrayDeleter{n * sizeof(T)});
+    }
+
+}
+
+#endif
@@ -4,7 +4,9 @@
 #include <hpc_helpers.cuh>
 
 #include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cassert>
@@ -17,6 +19,9 @@
 
 namespace care{
 
+//expected access pattern of the file-backed part of a FileBackedMMapBuffer
+enum class MMapAccessPattern{Normal, Sequential, Random};
+
 class FileBackedMMapBuffer{    
 private:
     class OpenCFile{
@@ -78,9 +83,48 @@ private:
 
     std::size_t memoryLimit = 0;
 
+    //writeback of the file has been started for the first writebackBegin bytes. writtenEnd bytes of the file have been written
+    std::size_t writebackBegin = 0;
+    std::size_t writtenEnd = 0;
+    MMapAccessPattern accessPattern = MMapAccessPattern::Normal;
+
     OpenCFile filehandle{};
     std::string filename{};
 
+    static constexpr std::size_t writebackBatchBytes = std::size_t(64) << 20;
+
+    //advise the kernel about the access pattern of the file mapping and of the page cache of the file
+    void applyAccessPattern(){
+        if(fileCapacity == 0){
+            return;
+        }
+
+        int madvice = MADV_NORMAL;
+        int fadvice = POSIX_FADV_NORMAL;
+        if(accessPattern == MMapAccessPattern::Sequential){
+            madvice = MADV_SEQUENTIAL;
+            fadvice = POSIX_FADV_SEQUENTIAL;
+        }else if(accessPattern == MMapAccessPattern::Random){
+            madvice = MADV_RANDOM;
+            fadvice = POSIX_FADV_RANDOM;
+        }
+
+        if(madvise(((char*)rawtotaldata) + memoryCapacity, fileCapacity, madvice) != 0){
+            perror("FileBackedMMapBuffer madvise");
+        }
+        posix_fadvise(filehandle.getFd(), 0, 0, fadvice);
+    }
+
+    //start asynchronous writeback of the file pages in [writebackBegin, end). does not wait for completion
+    void startWriteback(std::size_t end){
+        if(end > writebackBegin){
+            if(sync_file_range(filehandle.getFd(), writebackBegin, end - writebackBegin, SYNC_FILE_RANGE_WRITE) != 0){
+                perror("FileBackedMMapBuffer sync_file_range");
+            }
+            writebackBegin = end;
+        }
+    }
+
     //undo all mappings
     int unmapMemoryAndFile(){
         int ret = unmapFile();
@@ -100,12 +144,11 @@ private:
     //undo mappings of file
     int unmapFile(){
         if(fileCapacity > 0){
-            int ret = msync(((char*)rawtotaldata) + memoryCapacity, fileCapacity, MS_SYNC);
-            if(ret != 0){
-                return ret;
-            }
+            //dirty pages of the shared mapping stay in the page cache after munmap. 
+            //do not wait for the writeback of the whole file, which would stall every growth of the buffer
+            startWriteback(writtenEnd);
 
-            ret = munmap(((char*)rawtotaldata) + memoryCapacity, fileCapacity);
+            int ret = munmap(((char*)rawtotaldata) + memoryCapacity, fileCapacity);
             if(ret != 0){
                 return ret;
             }
@@ -178,6 +221,8 @@ private:
                 perror("FileBackedMMapBuffer::reserve file mmap");
                 throw std::runtime_error("Reserve failed");
             }
+
+            applyAccessPattern();
         }
     }
 
@@ -207,6 +252,9 @@ public:
         memoryCapacity = std::exchange(rhs.memoryCapacity, 0);
         fileCapacity = std::exchange(rhs.fileCapacity, 0);
         memoryLimit = std::exchange(rhs.memoryLimit, 0);
+        writebackBegin = std::exchange(rhs.writebackBegin, 0);
+        writtenEnd = std::exchange(rhs.writtenEnd, 0);
+        accessPattern = std::exchange(rhs.accessPattern, MMapAccessPattern::Normal);
         filehandle = std::move(rhs.filehandle);
         filename = std::exchange(rhs.filename, "");
     }
@@ -235,6 +283,9 @@ public:
         std::swap(l.memoryCapacity, r.memoryCapacity);
         std::swap(l.fileCapacity, r.fileCapacity);
         std::swap(l.memoryLimit, r.memoryLimit);
+        std::swap(l.writebackBegin, r.writebackBegin);
+        std::swap(l.writtenEnd, r.writtenEnd);
+        std::swap(l.accessPattern, r.accessPattern);
         std::swap(l.filehandle, r.filehandle);
         std::swap(l.filename, r.filename);
     }
@@ -249,6 +300,8 @@ public:
             capacity = 0;
             memoryCapacity = 0;
             memoryLimit = 0;
+            writebackBegin = 0;
+            writtenEnd = 0;
         }
     }
 
@@ -282,6 +335,8 @@ public:
                 capacity = 0;
                 memoryCapacity = 0;
                 memoryLimit = 0;
+                writebackBegin = 0;
+                writtenEnd = 0;
             }
         }else{
             if(size < capacity){
@@ -321,6 +376,68 @@ public:
         return fileCapacity;
     }
 
+    /*
+        Change the number of bytes which may be kept in memory. Affects future growth only: 
+        bytes which are already in memory stay in memory, and once the file is used, the limit cannot grow anymore
+    */
+    void setMemoryLimit(std::size_t newMemoryLimit){
+        if(fileCapacity > 0){
+            return;
+        }
+        const std::size_t pagesize = getpagesize();
+        memoryLimit = std::max((newMemoryLimit / pagesize) * pagesize, memoryCapacity);
+    }
+
+    std::size_t getMemoryLimit() const noexcept{
+        return memoryLimit;
+    }
+
+    //applies to the current and future file mappings
+    void setAccessPattern(MMapAccessPattern pattern){
+        accessPattern = pattern;
+        applyAccessPattern();
+    }
+
+    /*
+        Must be called after bytes up to position end have been written. 
+        Spilled bytes are written back to the file in batches of writebackBatchBytes, without waiting for completion,
+        to avoid that the kernel throttles the writing thread once too many pages of the file are dirty.
+    */
+    void notifyWritten(std::size_t end){
+        if(end > memoryCapacity){
+            writtenEnd = std::max(writtenEnd, std::min(fileCapacity, end - memoryCapacity));
+            if(writtenEnd >= writebackBegin + writebackBatchBytes){
+                startWriteback(writtenEnd / writebackBatchBytes * writebackBatchBytes);
+            }
+        }
+    }
+
+    /*
+        Asynchronously reads the file-backed pages of bytes [begin, end) into the page cache.
+        If touchPages is true, each page is accessed once, which blocks until it is mapped. 
+        This is meant to be called from a background thread before the range is accessed.
+    */
+    void prefetch(std::size_t begin, std::size_t end, bool touchPages) const{
+        begin = std::max(begin, memoryCapacity);
+        end = std::min(end, capacity);
+        if(begin >= end){
+            return;
+        }
+
+        const std::size_t pagesize = getpagesize();
+        begin = begin / pagesize * pagesize;
+
+        madvise(((char*)rawtotaldata) + begin, end - begin, MADV_WILLNEED);
+        posix_fadvise(filehandle.getFd(), begin - memoryCapacity, end - begin, POSIX_FADV_WILLNEED);
+
+        if(touchPages){
+            const volatile char* const ptr = (const volatile char*)rawtotaldata;
+            for(std::size_t i = begin; i < end; i += pagesize){
+                (void)ptr[i];
+            }
+        }
+    }
+
     void printStatus(std::ostream& os) const{
         os << "size: " << getSize() << ", capacity: " << getCapacity();
         os << ", memoryCapacity: " << getCapacityInMemory() << ", fileCapacity: " << getCapacityInFile();
@@ -372,6 +489,7 @@ public:
         }
 
         data()[size_++] = std::move(obj);
+        buffer.notifyWritten(sizeof(T) * size_);
     }
 
     template<class InputIt>
@@ -389,6 +507,7 @@ public:
         std::copy(first, last, begin() + where);
 
         size_ = newsize;
+        buffer.notifyWritten(sizeof(T) * size_);
 
         return begin() + where;
     }
@@ -462,6 +581,20 @@ public:
         return buffer.getCapacityInFile();
     }
 
+    //see FileBackedMMapBuffer::setMemoryLimit
+    void setMaxBytesInMemory(std::size_t maxBytesInMemory){
+        buffer.setMemoryLimit(maxBytesInMemory);
+    }
+
+    void setAccessPattern(MMapAccessPattern pattern){
+        buffer.setAccessPattern(pattern);
+    }
+
+    //see FileBackedMMapBuffer::prefetch. elements [first, last)
+    void prefetch(std::size_t first, std::size_t last, bool touchPages) const{
+        buffer.prefetch(sizeof(T) * first, sizeof(T) * last, touchPages);
+    }
+
     void clear(){
         buffer.clear();
     }
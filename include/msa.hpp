@@ -77,6 +77,9 @@ public:
         const int* candidateLengths;
         const int* candidateShifts;
         const float* candidateDefaultWeightFactors;
+        //number of reads with identical sequence which are represented by the anchor / by each candidate. nullptr means 1 for each candidate
+        int anchorMultiplicity = 1;
+        const int* candidateMultiplicities = nullptr;
     };
 
     struct PossibleSplitColumn{
@@ -169,7 +172,8 @@ public:
 
     void findOrigWeightAndCoverage(const char* anchor);
 
-    void addSequence(bool useQualityScores, const char* sequence, const char* quality, int length, int shift, float defaultWeightFactor);
+    //the sequence is counted multiplicity times
+    void addSequence(bool useQualityScores, const char* sequence, const char* quality, int length, int shift, float defaultWeightFactor, int multiplicity = 1);
 
     //void removeSequence(bool useQualityScores, const char* sequence, const char* quality, int length, int shift, float defaultWeightFactor);
 
@@ -3,12 +3,14 @@
 
 #include <config.hpp>
 #include <readlibraryio.hpp>
+#include <memoryplacement.hpp>
 
 #include "cxxopts/cxxopts.hpp"
 
 #include <string>
 #include <vector>
 #include <ostream>
+#include <limits>
 
 namespace care
 {
@@ -45,6 +47,8 @@ namespace care
         bool singlehash = false;
         bool outputCorrectionQualityLabels = false;
         bool gzoutput = false;
+        bool interleaveNumaNodes = false;
+        HugePageMode hugePages = HugePageMode::None;
         float estimatedCoverage = 1.0f;
         float estimatedErrorrate = 0.06f; //this is not the error rate of the dataset
         float m_coverage = 0.6f;
@@ -71,7 +75,20 @@ namespace care
         bool replicateGpuData = false;
         int warpcore = 0;
         int threads = 1;
+        bool correctionPipeline = false;
+        int pipelineGatherThreads = 0;
+        bool localityAwareAnchorOrder = false;
+        bool reorderReads = false;
+        bool collapseDuplicateReads = false;
+        std::size_t candidateRowCacheSize = 0;
+        bool aggregateCandidateCorrections = false;
+        bool streamingOutput = false;
+        bool storeReadHeaders = false;
+        bool compressQualityScores = false;
+        bool compressPartialResults = false;
         std::size_t fixedNumberOfReads = 0;
+        read_number readIdRangeBegin = 0;
+        read_number readIdRangeEnd = std::numeric_limits<read_number>::max();
         std::vector<int> deviceIds;
         int qualityScoreBits = 8;
         float hashtableLoadfactor = 0.8f;
@@ -88,6 +105,7 @@ namespace care
         std::string load_binary_reads_from = "";
         std::string save_hashtables_to = "";
         std::string load_hashtables_from = "";
+        std::string publishIndexTo = "";
         std::string tempdirectory = "";
         std::string extendedReadsOutputfilename = "UNSET_";
         std::string mlForestfileAnchor = "";
@@ -0,0 +1,175 @@
+#ifndef CARE_ORDEREDCORRECTIONRESULTSTREAM_HPP
+#define CARE_ORDEREDCORRECTIONRESULTSTREAM_HPP
+
+#include <config.hpp>
+
+#include <corrector_common.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace care{
+
+    /*
+        Hands batches of serialized corrections from multiple correction threads to a single consumer in ascending read id order,
+        while correction is still running. This replaces the storage and the sort of partial results if each read has
+        at most one correction, i.e. without candidate correction.
+
+        Each pushed batch contains the corrections of the anchors [begin, end), in ascending read id order. The pushed ranges must
+        partition [0, number of anchors). Batches which arrive before all preceding batches are held in a reorder window
+        which is indexed by the first read id of a batch. A batch is released to the consumer once all preceding batches have been released.
+
+        Producers wait while maxBufferedBatches batches are buffered, unless their batch is the next one to be released.
+        Batches should be pushed in approximately ascending order, otherwise the window becomes large.
+
+        The consumer side implements the interface of a result source for the output construction: empty(), next()
+    */
+    class OrderedCorrectionResultStream{
+    public:
+        //the pushed ranges must partition [firstReadId, number of anchors)
+        OrderedCorrectionResultStream(std::size_t maxBufferedBatches_, read_number firstReadId = 0)
+            : maxBufferedBatches(std::max(std::size_t(1), maxBufferedBatches_)), nextReadId(firstReadId){}
+
+        OrderedCorrectionResultStream(const OrderedCorrectionResultStream&) = delete;
+        OrderedCorrectionResultStream& operator=(const OrderedCorrectionResultStream&) = delete;
+
+        //returns an empty batch. reuses the memory of consumed batches if possible
+        SerializedCorrectionBatch getFreeBatch(){
+            std::lock_guard<std::mutex> lg(mutex);
+
+            if(freeBatches.empty()){
+                return SerializedCorrectionBatch{};
+            }
+
+            SerializedCorrectionBatch batch = std::move(freeBatches.back());
+            freeBatches.pop_back();
+            batch.clear();
+            return batch;
+        }
+
+        void push(read_number begin, read_number end, SerializedCorrectionBatch&& batch){
+            std::unique_lock<std::mutex> ul(mutex);
+
+            assert(!finished);
+            assert(begin >= nextReadId);
+
+            producerCv.wait(ul, [&](){
+                return begin == nextReadId || numBufferedBatches < maxBufferedBatches;
+            });
+
+            numPushedCorrections += batch.size();
+            numBufferedBatches++;
+            window.emplace(begin, PendingBatch{end, std::move(batch)});
+
+            bool released = false;
+            auto it = window.find(nextReadId);
+            while(it != window.end()){
+                nextReadId = it->second.end;
+                releasedBatches.emplace_back(std::move(it->second.batch));
+                window.erase(it);
+                released = true;
+
+                it = window.find(nextReadId);
+            }
+
+            if(released){
+                consumerCv.notify_one();
+                producerCv.notify_all();
+            }
+        }
+
+        //must be called after all batches have been pushed
+        void finish(){
+            std::lock_guard<std::mutex> lg(mutex);
+            finished = true;
+            consumerCv.notify_one();
+        }
+
+        //consumer. returns true if the stream does not contain any correction. may need to wait for the first released batch
+        bool empty(){
+            return !makeCurrentBatchReadable();
+        }
+
+        //consumer. returns the next serialized correction or nullptr if all corrections have been returned.
+        //the returned pointer is valid until the next call to next()
+        const std::uint8_t* next(){
+            if(!makeCurrentBatchReadable()){
+                return nullptr;
+            }
+
+            return currentBatch.getSerializedBegin(currentIndex++);
+        }
+
+        std::size_t getNumPushedCorrections() const{
+            std::lock_guard<std::mutex> lg(mutex);
+            return numPushedCorrections;
+        }
+
+    private:
+        struct PendingBatch{
+            read_number end{};
+            SerializedCorrectionBatch batch{};
+        };
+
+        //wait until the current batch has a correction which was not returned yet. returns false if the stream is exhausted
+        bool makeCurrentBatchReadable(){
+            while(currentIndex == currentBatch.size()){
+                std::unique_lock<std::mutex> ul(mutex);
+
+                if(hasCurrentBatch){
+                    freeBatches.emplace_back(std::move(currentBatch));
+                    currentBatch = SerializedCorrectionBatch{};
+                    currentIndex = 0;
+                    hasCurrentBatch = false;
+                }
+
+                consumerCv.wait(ul, [&](){
+                    return finished || !releasedBatches.empty();
+                });
+
+                if(releasedBatches.empty()){
+                    assert(window.empty());
+                    return false;
+                }
+
+                currentBatch = std::move(releasedBatches.front());
+                releasedBatches.pop_front();
+                currentIndex = 0;
+                hasCurrentBatch = true;
+
+                numBufferedBatches--;
+                producerCv.notify_all();
+            }
+
+            return true;
+        }
+
+        std::size_t maxBufferedBatches{};
+
+        mutable std::mutex mutex{};
+        std::condition_variable producerCv{};
+        std::condition_variable consumerCv{};
+
+        bool finished = false;
+        read_number nextReadId = 0;
+        std::size_t numBufferedBatches = 0;
+        std::size_t numPushedCorrections = 0;
+        std::map<read_number, PendingBatch> window{};
+        std::deque<SerializedCorrectionBatch> releasedBatches{};
+        std::vector<SerializedCorrectionBatch> freeBatches{};
+
+        //only accessed by the consumer
+        bool hasCurrentBatch = false;
+        std::size_t currentIndex = 0;
+        SerializedCorrectionBatch currentBatch{};
+    };
+
+}
+
+#endif
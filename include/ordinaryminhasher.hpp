@@ -21,6 +21,7 @@
 #include <sharedmutex.hpp>
 
 #include <cpusequencehasher.hpp>
+#include <mappedfile.hpp>
 
 
 #include <cassert>
@@ -288,6 +289,7 @@ namespace care{
 
         void destroy() {
             minhashTables.clear();
+            mappedFile.reset();
         }
 
         void finalize(){
@@ -337,6 +339,100 @@ namespace care{
 
             return mapsToLoad;
         }
+
+        /*
+            Writes the hash tables to a file which can be used directly from a memory mapping by loadFromFile. 
+            Processes which load the same file, e.g. in /dev/shm, share a single copy of the hash tables.
+            The file consists of a MappableFileHeader, followed by the mappable representation of each table. 
+            All parts are padded to multiples of mappablehashtable::mappableAlignment bytes.
+            numReads is the number of reads of the hashed read storage, which is checked when the file is loaded.
+        */
+        void saveToMappableFile(const std::string& filename, std::size_t numReads) const{
+            std::ofstream os(filename, std::ios::binary);
+            if(!os){
+                throw std::runtime_error("Cannot open file " + filename);
+            }
+
+            MappableFileHeader header{};
+            header.magic = mappableFileMagic;
+            header.version = mappableFileVersion;
+            header.kmerSize = kmerSize;
+            header.resultsPerMapThreshold = resultsPerMapThreshold;
+            header.loadfactor = loadfactor;
+            header.numTables = getNumberOfMaps();
+            header.numReads = numReads;
+
+            mappablehashtable::writePadded(os, &header, sizeof(MappableFileHeader));
+
+            for(const auto& tableptr : minhashTables){
+                tableptr->writeToMappableStream(os);
+            }
+
+            if(!os){
+                throw std::runtime_error("Cannot write file " + filename);
+            }
+        }
+
+        //files written by saveToMappableFile are memory mapped. the tables are queried directly from the mapping
+        int loadFromFile(const std::string& filename, int numMapsUpperLimit, std::size_t numReads) override{
+            std::array<char, 8> magic{};
+            {
+                std::ifstream is(filename, std::ios::binary);
+                if(!is){
+                    throw std::runtime_error("Cannot open file " + filename);
+                }
+                is.read(magic.data(), magic.size());
+            }
+
+            if(magic != mappableFileMagic){
+                return CpuMinhasher::loadFromFile(filename, numMapsUpperLimit, numReads);
+            }
+
+            destroy();
+
+            //values and slots are accessed randomly. avoid reading ahead
+            mappedFile = std::make_unique<MappedFile>(filename, MADV_RANDOM);
+            const char* const data = mappedFile->getData();
+
+            const std::size_t fileBytes = mappedFile->size();
+
+            MappableFileHeader header;
+            if(fileBytes < mappablehashtable::paddedSize(sizeof(MappableFileHeader))){
+                throw std::runtime_error("File " + filename + " is too small");
+            }
+            std::copy_n(data, sizeof(MappableFileHeader), reinterpret_cast<char*>(&header));
+            if(header.version != mappableFileVersion){
+                throw std::runtime_error("File " + filename + " has version " + std::to_string(header.version) 
+                    + ", expected version " + std::to_string(mappableFileVersion));
+            }
+            if(header.numReads != numReads){
+                throw std::runtime_error("File " + filename + " contains hash tables of " + std::to_string(header.numReads) 
+                    + " reads, but the read storage contains " + std::to_string(numReads) + " reads");
+            }
+            if(header.numTables < 0){
+                throw std::runtime_error("File " + filename + " is corrupted");
+            }
+
+            kmerSize = header.kmerSize;
+            resultsPerMapThreshold = header.resultsPerMapThreshold;
+            loadfactor = header.loadfactor;
+
+            const int mapsToLoad = std::min(numMapsUpperLimit, header.numTables);
+
+            std::size_t offset = mappablehashtable::paddedSize(sizeof(MappableFileHeader));
+            for(int i = 0; i < mapsToLoad; i++){
+                auto ptr = std::make_unique<HashTable>();
+                try{
+                    offset += ptr->attachToMappedMemory(data + offset, fileBytes - offset);
+                }catch(const std::runtime_error& e){
+                    destroy();
+                    throw std::runtime_error("File " + filename + " is corrupted: " + e.what());
+                }
+                minhashTables.emplace_back(std::move(ptr));
+            }
+
+            return mapsToLoad;
+        }
         
 
         int addHashTables(int numAdditionalTables, const int* /*hashFunctionIds*/) override{
@@ -412,7 +508,7 @@ namespace care{
                 }
             };
 
-            forLoopExecutor(0, numSequences, hashloopbody);
+            forLoopExecutor.workStealing(0, numSequences, 1024, hashloopbody);
 
             auto insertloopbody = [&](auto begin, auto end, int /*threadid*/){
                 for(int h = begin; h < end; h++){
@@ -422,12 +518,25 @@ namespace care{
                 }
             };
 
-            forLoopExecutor(firstHashfunction, firstHashfunction + numHashfunctions, insertloopbody);
+            forLoopExecutor.workStealing(firstHashfunction, firstHashfunction + numHashfunctions, 1, insertloopbody);
         }   
 
 
     private:
 
+        static constexpr std::array<char, 8> mappableFileMagic{'C', 'A', 'R', 'E', 'H', 'T', 'B', 'L'};
+        static constexpr std::uint32_t mappableFileVersion = 2;
+
+        struct MappableFileHeader{
+            std::array<char, 8> magic;
+            std::uint32_t version;
+            int kmerSize;
+            int resultsPerMapThreshold;
+            float loadfactor;
+            int numTables;
+            std::uint64_t numReads;
+        };
+
         QueryData* getQueryDataFromHandle(const MinhasherHandle& queryHandle) const{
             std::shared_lock<SharedMutex> lock(sharedmutex);
 
@@ -460,6 +569,8 @@ namespace care{
         std::size_t memoryLimit;
         std::vector<std::unique_ptr<HashTable>> minhashTables{};
         mutable std::vector<std::unique_ptr<QueryData>> tempdataVector{};
+        //not null if the tables have been loaded from a file written by saveToMappableFile
+        std::unique_ptr<MappedFile> mappedFile{};
     };
 
 
@@ -0,0 +1,116 @@
+#ifndef CARE_PARALLELRADIXSORT_HPP
+#define CARE_PARALLELRADIXSORT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include <omp.h>
+
+namespace care{
+
+    /*
+        Stable multi-threaded LSD radix sort of key-value pairs with unsigned integral keys, 8 bits per pass.
+
+        The input is split into numThreads contiguous chunks. In each pass, every chunk computes its digit histogram,
+        the exclusive prefix sum over (digit, chunk) gives the scatter position of each chunk for each digit,
+        and every chunk scatters its elements. Passes in which all keys have the same digit are skipped,
+        so small keys (e.g. read ids of a small data set) need fewer passes.
+
+        keysTmp and valuesTmp must provide space for numElements elements. The sorted result is stored in keys and values.
+    */
+    template<class Key, class Value>
+    void parallelRadixSortPairs(
+        Key* keys,
+        Value* values,
+        Key* keysTmp,
+        Value* valuesTmp,
+        std::size_t numElements,
+        int numThreads
+    ){
+        static_assert(std::is_unsigned<Key>::value, "Key must be unsigned");
+
+        constexpr int bitsPerPass = 8;
+        constexpr std::size_t radix = std::size_t(1) << bitsPerPass;
+        constexpr int numPasses = sizeof(Key) * 8 / bitsPerPass;
+
+        if(numElements < 2) return;
+
+        const int numChunks = std::max(std::size_t(1), std::min(std::size_t(numThreads), numElements / radix + 1));
+        const std::size_t chunksize = (numElements + numChunks - 1) / numChunks;
+
+        std::vector<std::size_t> histograms(numChunks * radix);
+
+        Key* srcKeys = keys;
+        Value* srcValues = values;
+        Key* destKeys = keysTmp;
+        Value* destValues = valuesTmp;
+
+        for(int pass = 0; pass < numPasses; pass++){
+            const int shift = pass * bitsPerPass;
+
+            std::fill(histograms.begin(), histograms.end(), 0);
+
+            #pragma omp parallel for num_threads(numChunks) schedule(static, 1)
+            for(int c = 0; c < numChunks; c++){
+                const std::size_t begin = std::min(numElements, c * chunksize);
+                const std::size_t end = std::min(numElements, begin + chunksize);
+                std::size_t* const histogram = histograms.data() + c * radix;
+
+                for(std::size_t i = begin; i < end; i++){
+                    histogram[(srcKeys[i] >> shift) & (radix - 1)]++;
+                }
+            }
+
+            //if all elements have the same digit, this pass would not change the order
+            bool skipPass = false;
+            for(std::size_t d = 0; d < radix && !skipPass; d++){
+                std::size_t count = 0;
+                for(int c = 0; c < numChunks; c++){
+                    count += histograms[c * radix + d];
+                }
+                skipPass = (count == numElements);
+            }
+
+            if(skipPass) continue;
+
+            //exclusive prefix sum in (digit, chunk) order
+            std::size_t sum = 0;
+            for(std::size_t d = 0; d < radix; d++){
+                for(int c = 0; c < numChunks; c++){
+                    const std::size_t count = histograms[c * radix + d];
+                    histograms[c * radix + d] = sum;
+                    sum += count;
+                }
+            }
+
+            #pragma omp parallel for num_threads(numChunks) schedule(static, 1)
+            for(int c = 0; c < numChunks; c++){
+                const std::size_t begin = std::min(numElements, c * chunksize);
+                const std::size_t end = std::min(numElements, begin + chunksize);
+                std::size_t* const positions = histograms.data() + c * radix;
+
+                for(std::size_t i = begin; i < end; i++){
+                    const std::size_t pos = positions[(srcKeys[i] >> shift) & (radix - 1)]++;
+                    destKeys[pos] = srcKeys[i];
+                    destValues[pos] = srcValues[i];
+                }
+            }
+
+            std::swap(srcKeys, destKeys);
+            std::swap(srcValues, destValues);
+        }
+
+        if(srcKeys != keys){
+            #pragma omp parallel for num_threads(numThreads) schedule(static)
+            for(std::size_t i = 0; i < numElements; i++){
+                keys[i] = srcKeys[i];
+                values[i] = srcValues[i];
+            }
+        }
+    }
+
+}
+
+#endif
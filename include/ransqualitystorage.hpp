@@ -0,0 +1,274 @@
+#ifndef CARE_RANS_QUALITY_STORAGE_HPP
+#define CARE_RANS_QUALITY_STORAGE_HPP
+
+#include <config.hpp>
+#include <memorymanagement.hpp>
+#include <variablepitchrows.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include <omp.h>
+
+namespace care{
+
+/*
+    Lossless storage of quality score strings with an order-1 rANS coder.
+
+    The symbol probabilities are conditioned on the previous quality score of the read (the first one on a start context).
+    One frequency table per context is computed from all reads. Each read is encoded separately, such that it can be decoded
+    without decoding other reads. The encoded read (the final coder state followed by the renormalization bytes)
+    is stored as a row of a VariablePitchRows, i.e. the overhead per read is 4 bytes for the offset, 4 bytes for the state,
+    and up to 3 padding bytes.
+*/
+struct RansQualityStorage{
+    static constexpr int scaleBits = 12;
+    static constexpr std::uint32_t totalFrequency = 1u << scaleBits;
+    static constexpr std::uint32_t lowerBound = 1u << 23;
+
+    RansQualityStorage() = default;
+
+    /*
+        gatherQualities(char* dest, std::size_t pitch, read_number firstReadId, int num) writes the quality scores of reads
+        [firstReadId, firstReadId + num) to dest. getLength(readId) returns the length of a read. Positions after the end of a
+        read are not accessed.
+    */
+    template<class GatherQualities, class GetLength>
+    RansQualityStorage(std::size_t numReads, int maxLength, GatherQualities gatherQualities, GetLength getLength, int numThreads){
+        constexpr std::size_t chunksize = 4096;
+        const std::size_t numChunks = (numReads + chunksize - 1) / chunksize;
+
+        //order-1 counts. context 0 is the start of a read, context c > 0 is the previous character c
+        std::vector<std::uint64_t> counts(256 * 256, 0);
+
+        #pragma omp parallel num_threads(numThreads)
+        {
+            std::vector<std::uint64_t> myCounts(256 * 256, 0);
+            std::vector<char> qualities(chunksize * maxLength);
+
+            #pragma omp for schedule(dynamic, 1)
+            for(std::size_t chunk = 0; chunk < numChunks; chunk++){
+                const read_number first = chunk * chunksize;
+                const int num = std::min(chunksize, numReads - first);
+
+                gatherQualities(qualities.data(), maxLength, first, num);
+
+                for(int i = 0; i < num; i++){
+                    const std::uint8_t* const q = reinterpret_cast<const std::uint8_t*>(qualities.data() + i * maxLength);
+                    const int length = getLength(first + i);
+                    std::uint8_t context = 0;
+                    for(int k = 0; k < length; k++){
+                        myCounts[context * 256 + q[k]]++;
+                        context = q[k];
+                    }
+                }
+            }
+
+            #pragma omp critical
+            {
+                for(std::size_t k = 0; k < counts.size(); k++){
+                    counts[k] += myCounts[k];
+                }
+            }
+        }
+
+        makeTables(counts);
+
+        //encode each chunk into a temporary buffer, then copy the rows
+        std::vector<std::vector<unsigned int>> encodedChunks(numChunks);
+        std::vector<std::uint32_t> rowLengths(numReads);
+
+        #pragma omp parallel num_threads(numThreads)
+        {
+            std::vector<char> qualities(chunksize * maxLength);
+            std::vector<std::uint8_t> buffer(getMaxEncodedBytes(maxLength));
+
+            #pragma omp for schedule(dynamic, 1)
+            for(std::size_t chunk = 0; chunk < numChunks; chunk++){
+                const read_number first = chunk * chunksize;
+                const int num = std::min(chunksize, numReads - first);
+
+                gatherQualities(qualities.data(), maxLength, first, num);
+
+                auto& encoded = encodedChunks[chunk];
+                for(int i = 0; i < num; i++){
+                    const int numBytes = encodeRead(buffer.data(), qualities.data() + i * maxLength, getLength(first + i));
+                    const std::size_t numInts = (numBytes + sizeof(unsigned int) - 1) / sizeof(unsigned int);
+
+                    const std::size_t offset = encoded.size();
+                    encoded.resize(offset + numInts, 0);
+                    std::memcpy(encoded.data() + offset, buffer.data(), numBytes);
+                    rowLengths[first + i] = numInts;
+                }
+            }
+        }
+
+        rows = VariablePitchRows(numReads, [&](std::size_t i){ return rowLengths[i]; });
+
+        #pragma omp parallel for num_threads(numThreads) schedule(dynamic, 1)
+        for(std::size_t chunk = 0; chunk < numChunks; chunk++){
+            const read_number first = chunk * chunksize;
+            const std::size_t num = std::min(chunksize, numReads - first);
+            const std::size_t begin = rows.getRowBegin(first);
+            const std::size_t end = rows.getRowBegin(first + num);
+            std::copy_n(encodedChunks[chunk].data(), end - begin, rows.getRow(first));
+            std::vector<unsigned int>{}.swap(encodedChunks[chunk]);
+        }
+    }
+
+    //the encoded size of a read must not exceed the longest row of VariablePitchRows
+    static bool canEncode(int maxLength) noexcept{
+        return getMaxEncodedBytes(maxLength) <= VariablePitchRows::getMaxRowLength() * sizeof(unsigned int);
+    }
+
+    //decode the length quality scores of readId
+    void decodeRead(char* quality, read_number readId, int length) const noexcept{
+        const std::uint8_t* ptr = reinterpret_cast<const std::uint8_t*>(rows.getRow(readId));
+
+        std::uint32_t state;
+        std::memcpy(&state, ptr, sizeof(std::uint32_t));
+        ptr += sizeof(std::uint32_t);
+
+        std::uint8_t context = 0;
+        for(int k = 0; k < length; k++){
+            const ContextTable& table = tables[contextIndices[context]];
+
+            const std::uint32_t slot = state & (totalFrequency - 1);
+            const std::uint8_t symbol = table.slotToSymbol[slot];
+            state = table.frequencies[symbol] * (state >> scaleBits) + slot - table.cumulativeFrequencies[symbol];
+
+            while(state < lowerBound){
+                state = (state << 8) | *ptr++;
+            }
+
+            quality[k] = char(symbol);
+            context = symbol;
+        }
+    }
+
+    //encoded bytes of all reads, including offsets and padding
+    std::size_t getEncodedBytes() const noexcept{
+        return rows.getMemoryInfo().host;
+    }
+
+    MemoryUsage getMemoryInfo() const{
+        MemoryUsage info = rows.getMemoryInfo();
+        info.host += sizeof(ContextTable) * tables.capacity();
+        return info;
+    }
+
+    bool empty() const noexcept{
+        return rows.getNumRows() == 0;
+    }
+
+    void destroy(){
+        rows.destroy();
+        std::vector<ContextTable>{}.swap(tables);
+        contextIndices.fill(0);
+    }
+
+private:
+    struct ContextTable{
+        std::array<std::uint16_t, 256> frequencies{};
+        std::array<std::uint16_t, 256> cumulativeFrequencies{};
+        std::array<std::uint8_t, totalFrequency> slotToSymbol{};
+    };
+
+    //state, plus at most 2 bytes per symbol, because frequencies are at least 1 / 4096
+    static std::size_t getMaxEncodedBytes(int length) noexcept{
+        return sizeof(std::uint32_t) + 2 * std::size_t(length) + 4;
+    }
+
+    //scale the counts of each used context to totalFrequency. every symbol which occurs gets a frequency of at least 1
+    void makeTables(const std::vector<std::uint64_t>& counts){
+        tables.clear();
+        contextIndices.fill(0);
+
+        for(int context = 0; context < 256; context++){
+            const std::uint64_t* const c = counts.data() + context * 256;
+            const std::uint64_t total = std::accumulate(c, c + 256, std::uint64_t(0));
+            if(total == 0){
+                continue;
+            }
+
+            ContextTable table;
+            std::uint32_t sum = 0;
+            int mostFrequent = 0;
+            for(int s = 0; s < 256; s++){
+                if(c[s] > 0){
+                    table.frequencies[s] = std::max(std::uint64_t(1), c[s] * totalFrequency / total);
+                    sum += table.frequencies[s];
+                }
+                if(c[s] > c[mostFrequent]){
+                    mostFrequent = s;
+                }
+            }
+
+            //correct the rounding error. take from the largest frequencies until the sum fits
+            while(sum > totalFrequency){
+                const int s = std::max_element(table.frequencies.begin(), table.frequencies.end()) - table.frequencies.begin();
+                const std::uint32_t reduction = std::min<std::uint32_t>(sum - totalFrequency, table.frequencies[s] - 1);
+                assert(reduction > 0);
+                table.frequencies[s] -= reduction;
+                sum -= reduction;
+            }
+            table.frequencies[mostFrequent] += totalFrequency - sum;
+
+            std::uint32_t cumulative = 0;
+            for(int s = 0; s < 256; s++){
+                table.cumulativeFrequencies[s] = cumulative;
+                std::fill_n(table.slotToSymbol.begin() + cumulative, table.frequencies[s], std::uint8_t(s));
+                cumulative += table.frequencies[s];
+            }
+            assert(cumulative == totalFrequency);
+
+            contextIndices[context] = tables.size();
+            tables.push_back(table);
+        }
+    }
+
+    //returns the number of bytes which have been written to out
+    int encodeRead(std::uint8_t* out, const char* quality, int length) const noexcept{
+        const std::size_t maxBytes = getMaxEncodedBytes(length);
+        std::uint8_t* const end = out + maxBytes;
+        std::uint8_t* ptr = end;
+
+        //symbols are encoded in reverse order, the renormalization bytes are written backwards
+        std::uint32_t state = lowerBound;
+        for(int k = length - 1; k >= 0; k--){
+            const std::uint8_t symbol = quality[k];
+            const std::uint8_t context = k > 0 ? std::uint8_t(quality[k-1]) : 0;
+            const ContextTable& table = tables[contextIndices[context]];
+
+            const std::uint32_t frequency = table.frequencies[symbol];
+            assert(frequency > 0);
+
+            const std::uint32_t maxState = ((lowerBound >> scaleBits) << 8) * frequency;
+            while(state >= maxState){
+                *--ptr = state & 0xFF;
+                state >>= 8;
+            }
+            state = ((state / frequency) << scaleBits) + (state % frequency) + table.cumulativeFrequencies[symbol];
+        }
+
+        ptr -= sizeof(std::uint32_t);
+        std::memcpy(ptr, &state, sizeof(std::uint32_t));
+
+        const int numBytes = end - ptr;
+        std::memmove(out, ptr, numBytes);
+        return numBytes;
+    }
+
+    VariablePitchRows rows{};
+    std::vector<ContextTable> tables{};
+    std::array<std::uint16_t, 256> contextIndices{};
+};
+
+}
+
+#endif
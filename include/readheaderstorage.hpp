@@ -0,0 +1,504 @@
+#ifndef CARE_READHEADERSTORAGE_HPP
+#define CARE_READHEADERSTORAGE_HPP
+
+#include <config.hpp>
+
+#include <cpureadstorage.hpp>
+#include <readlibraryio.hpp>
+#include <sequencehelpers.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace care{
+
+    /*
+        Compact encoding of the information which is required to restore the original input records from the read storage:
+        the header of each read, and the characters of the original sequence which are not stored by the 2-bit encoding,
+        i.e. all characters other than A, C, G, T (lowercase bases, N, and other IUPAC codes).
+
+        Headers are split into tokens, which are the maximal runs of digits and of non-digits. If a header has the same token
+        structure as the previous header, only the tokens which differ are stored, numbers as difference to the previous number.
+        This reduces typical Illumina read names to a few bytes per read. Otherwise, the header is stored literally.
+
+        Encoding of a read:
+            std::uint8_t mode (0: literal header, 1: tokens relative to previous header)
+            mode 0: varint length, characters
+            mode 1: 2-bit operation per token of the previous header, packed into bytes (0: equal, 1: number difference, 2: literal token),
+                    followed by the payload of each token with operation 1 (zigzag varint) or 2 (varint length, characters)
+            varint number of sequence exceptions, followed by pairs (varint position difference to previous exception, character)
+
+        Reads are encoded in chunks of consecutive reads. Each chunk is encoded independently, which allows encoding chunks in parallel.
+    */
+    class ReadHeaderChunkEncoder{
+    public:
+        void clear(){
+            data.clear();
+            previousHeader.clear();
+            previousTokens.clear();
+            numReads = 0;
+        }
+
+        //sequence is the original sequence of the read, before conversion for the 2-bit encoding
+        void append(std::string_view header, std::string_view sequence){
+            tokenize(header, tokens);
+
+            bool sameStructure = numReads > 0 && tokens.size() == previousTokens.size();
+            if(sameStructure && tokens.size() > 0){
+                sameStructure = isDigit(header[tokens[0].begin]) == isDigit(previousHeader[previousTokens[0].begin]);
+            }
+
+            if(sameStructure){
+                data.push_back(1);
+
+                const std::size_t numTokens = tokens.size();
+                const std::size_t opsBegin = data.size();
+                data.resize(data.size() + (numTokens + 3) / 4, 0);
+
+                for(std::size_t t = 0; t < numTokens; t++){
+                    const Token& cur = tokens[t];
+                    const Token& prev = previousTokens[t];
+
+                    std::uint8_t op = 0;
+                    if(cur.length == prev.length
+                            && header.compare(cur.begin, cur.length, previousHeader, prev.begin, prev.length) == 0){
+                        op = 0;
+                    }else if(cur.isNumber && prev.isNumber){
+                        op = 1;
+                        const std::int64_t diff = std::int64_t(cur.number) - std::int64_t(prev.number);
+                        appendVarint(data, zigzagEncode(diff));
+                    }else{
+                        op = 2;
+                        appendVarint(data, cur.length);
+                        data.insert(data.end(), header.begin() + cur.begin, header.begin() + cur.begin + cur.length);
+                    }
+
+                    data[opsBegin + t / 4] |= std::uint8_t(op << (2 * (t % 4)));
+                }
+            }else{
+                data.push_back(0);
+                appendVarint(data, header.size());
+                data.insert(data.end(), header.begin(), header.end());
+            }
+
+            std::size_t numExceptions = 0;
+            for(char c : sequence){
+                numExceptions += !isStoredBase(c);
+            }
+
+            appendVarint(data, numExceptions);
+
+            std::size_t previousPosition = 0;
+            for(std::size_t i = 0; i < sequence.size(); i++){
+                if(!isStoredBase(sequence[i])){
+                    appendVarint(data, i - previousPosition);
+                    data.push_back(std::uint8_t(sequence[i]));
+                    previousPosition = i;
+                }
+            }
+
+            previousHeader = header;
+            std::swap(previousTokens, tokens);
+            numReads++;
+        }
+
+        std::size_t getNumReads() const noexcept{
+            return numReads;
+        }
+
+        std::vector<std::uint8_t>& getData() noexcept{
+            return data;
+        }
+
+    private:
+        friend class ReadHeaderChunkDecoder;
+
+        struct Token{
+            std::size_t begin = 0;
+            std::size_t length = 0;
+            bool isNumber = false;
+            std::uint64_t number = 0;
+        };
+
+        static bool isDigit(char c) noexcept{
+            return '0' <= c && c <= '9';
+        }
+
+        static bool isStoredBase(char c) noexcept{
+            return c == 'A' || c == 'C' || c == 'G' || c == 'T';
+        }
+
+        //digit runs are numbers if they can be restored from their value, i.e. no leading zeros and at most 18 digits
+        static void tokenize(std::string_view header, std::vector<Token>& result){
+            result.clear();
+
+            std::size_t pos = 0;
+            while(pos < header.size()){
+                Token token;
+                token.begin = pos;
+                const bool digits = isDigit(header[pos]);
+                while(pos < header.size() && isDigit(header[pos]) == digits){
+                    pos++;
+                }
+                token.length = pos - token.begin;
+
+                if(digits && token.length <= 18 && (token.length == 1 || header[token.begin] != '0')){
+                    token.isNumber = true;
+                    for(std::size_t i = token.begin; i < pos; i++){
+                        token.number = token.number * 10 + (header[i] - '0');
+                    }
+                }
+
+                result.push_back(token);
+            }
+        }
+
+        static std::uint64_t zigzagEncode(std::int64_t value) noexcept{
+            return (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63);
+        }
+
+        static std::int64_t zigzagDecode(std::uint64_t value) noexcept{
+            return std::int64_t(value >> 1) ^ -std::int64_t(value & 1);
+        }
+
+        static void appendVarint(std::vector<std::uint8_t>& out, std::uint64_t value){
+            while(value >= 0x80){
+                out.push_back(std::uint8_t(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(std::uint8_t(value));
+        }
+
+        std::vector<std::uint8_t> data{};
+        std::string previousHeader{};
+        std::vector<Token> previousTokens{};
+        std::vector<Token> tokens{};
+        std::size_t numReads = 0;
+    };
+
+    //sequential decoding of a chunk which was created by ReadHeaderChunkEncoder
+    class ReadHeaderChunkDecoder{
+    public:
+        ReadHeaderChunkDecoder(const std::uint8_t* data_, std::size_t numBytes)
+            : data(data_), end(data_ + numBytes){}
+
+        /*
+            Decode the next read. sequence must contain the sequence of the read which is decoded from the 2-bit encoding.
+            It is restored to the original sequence.
+        */
+        void next(std::string& header, std::string& sequence){
+            const std::uint8_t mode = readByte();
+
+            if(mode == 0){
+                const std::size_t length = readVarint();
+                checkAvailable(length);
+                header.assign(reinterpret_cast<const char*>(data), length);
+                data += length;
+            }else{
+                const std::size_t numTokens = previousTokens.size();
+                const std::uint8_t* const ops = data;
+                checkAvailable((numTokens + 3) / 4);
+                data += (numTokens + 3) / 4;
+
+                header.clear();
+                for(std::size_t t = 0; t < numTokens; t++){
+                    const std::uint8_t op = (ops[t / 4] >> (2 * (t % 4))) & 3;
+                    const Token& prev = previousTokens[t];
+
+                    if(op == 0){
+                        header.append(previousHeader, prev.begin, prev.length);
+                    }else if(op == 1){
+                        const std::int64_t diff = ReadHeaderChunkEncoder::zigzagDecode(readVarint());
+                        header.append(std::to_string(std::uint64_t(std::int64_t(prev.number) + diff)));
+                    }else{
+                        const std::size_t length = readVarint();
+                        checkAvailable(length);
+                        header.append(reinterpret_cast<const char*>(data), length);
+                        data += length;
+                    }
+                }
+            }
+
+            const std::size_t numExceptions = readVarint();
+            std::size_t position = 0;
+            for(std::size_t i = 0; i < numExceptions; i++){
+                position += readVarint();
+                const char c = char(readByte());
+                if(position >= sequence.size()){
+                    throw std::runtime_error("Invalid sequence exception in read header chunk");
+                }
+                sequence[position] = c;
+            }
+
+            previousHeader = header;
+            ReadHeaderChunkEncoder::tokenize(previousHeader, previousTokens);
+        }
+
+    private:
+        using Token = ReadHeaderChunkEncoder::Token;
+
+        void checkAvailable(std::size_t numBytes) const{
+            if(std::size_t(end - data) < numBytes){
+                throw std::runtime_error("Unexpected end of read header chunk");
+            }
+        }
+
+        std::uint8_t readByte(){
+            checkAvailable(1);
+            return *data++;
+        }
+
+        std::uint64_t readVarint(){
+            std::uint64_t value = 0;
+            int shift = 0;
+            while(true){
+                const std::uint8_t byte = readByte();
+                value |= std::uint64_t(byte & 0x7F) << shift;
+                if((byte & 0x80) == 0) break;
+                shift += 7;
+            }
+            return value;
+        }
+
+        const std::uint8_t* data{};
+        const std::uint8_t* end{};
+        std::string previousHeader{};
+        std::vector<Token> previousTokens{};
+    };
+
+    /*
+        Encoded headers and sequence exceptions of all reads, stored in chunks of consecutive reads.
+        Also stores which input file each read originates from.
+    */
+    class ReadHeaderStorage{
+    public:
+        struct Chunk{
+            read_number firstReadId = 0;
+            std::size_t numReads = 0;
+            std::vector<std::uint8_t> data{};
+        };
+
+        //chunks may be appended in any order
+        void appendChunk(read_number firstReadId, std::size_t numReads, std::vector<std::uint8_t> data){
+            Chunk chunk;
+            chunk.firstReadId = firstReadId;
+            chunk.numReads = numReads;
+            chunk.data = std::move(data);
+            chunk.data.shrink_to_fit();
+
+            chunks.emplace_back(std::move(chunk));
+        }
+
+        void appendingFinished(){
+            std::sort(chunks.begin(), chunks.end(), [](const auto& l, const auto& r){
+                return l.firstReadId < r.firstReadId;
+            });
+
+            #ifndef NDEBUG
+            read_number expectedFirstReadId = 0;
+            for(const auto& chunk : chunks){
+                assert(chunk.firstReadId == expectedFirstReadId);
+                expectedFirstReadId += chunk.numReads;
+            }
+            #endif
+        }
+
+        /*
+            Single-end reads: numReadsPerFile[i] consecutive reads are taken from file i.
+            Paired-end reads from two files: alternatingFiles = true, reads with even id are taken from file 0, odd ids from file 1.
+        */
+        void setInputFileLayout(std::vector<std::size_t> numReadsPerFile_, bool alternatingFiles_){
+            numReadsPerFile = std::move(numReadsPerFile_);
+            alternatingFiles = alternatingFiles_;
+        }
+
+        const std::vector<std::size_t>& getNumReadsPerFile() const noexcept{
+            return numReadsPerFile;
+        }
+
+        bool hasAlternatingFiles() const noexcept{
+            return alternatingFiles;
+        }
+
+        std::size_t getNumChunks() const noexcept{
+            return chunks.size();
+        }
+
+        const Chunk& getChunk(std::size_t i) const noexcept{
+            return chunks[i];
+        }
+
+        std::size_t sizeInBytes() const noexcept{
+            std::size_t bytes = chunks.capacity() * sizeof(Chunk);
+            for(const auto& chunk : chunks){
+                bytes += chunk.data.capacity();
+            }
+            return bytes;
+        }
+
+    private:
+        std::vector<Chunk> chunks{};
+        std::vector<std::size_t> numReadsPerFile{};
+        bool alternatingFiles = false;
+    };
+
+
+    /*
+        Restores the original input records from the read storage and the read header storage, in read id order.
+        Same interface as MultiInputReader. Quality scores are taken from the read storage, so they must be stored
+        without loss if the input files have quality scores. If withQualityScores is false, the quality scores are empty.
+    */
+    class StoredReadsInputReader{
+    public:
+        //if the reads have been renumbered, internalReadIds[i] is the read id of the i-th read in readStorage
+        StoredReadsInputReader(
+            const CpuReadStorage& readStorage_, 
+            const ReadHeaderStorage& headerStorage_, 
+            bool withQualityScores_,
+            const read_number* internalReadIds_ = nullptr
+        )
+            : withQualityScores(withQualityScores_),
+            readStorage(&readStorage_),
+            headerStorage(&headerStorage_),
+            internalReadIds(internalReadIds_),
+            encodedSequencePitchInInts(SequenceHelpers::getEncodedNumInts2Bit(readStorage_.getSequenceLengthUpperBound())),
+            qualityPitchInBytes(readStorage_.getSequenceLengthUpperBound()),
+            readIdsInFile(std::max(std::size_t(1), headerStorage_.getNumReadsPerFile().size()), 0)
+        {
+            const auto& numReadsPerFile = headerStorage->getNumReadsPerFile();
+            std::size_t end = 0;
+            for(std::size_t n : numReadsPerFile){
+                end += n;
+                fileEnds.push_back(end);
+            }
+        }
+
+        int next(){
+            if(positionInBatch == batchsize){
+                if(!loadNextBatch()){
+                    return -1;
+                }
+            }
+
+            const int i = positionInBatch++;
+            const read_number readId = batchFirstReadId + i;
+
+            current.read.sequence.resize(lengths[i]);
+            SequenceHelpers::decode2BitSequence(
+                &current.read.sequence[0],
+                sequences.data() + i * encodedSequencePitchInInts,
+                lengths[i]
+            );
+            if(withQualityScores){
+                current.read.quality.assign(qualities.data() + i * qualityPitchInBytes, lengths[i]);
+            }else{
+                current.read.quality.clear();
+            }
+
+            decoder.next(current.read.header, current.read.sequence);
+
+            int fileId = 0;
+            if(headerStorage->hasAlternatingFiles()){
+                fileId = readId % 2;
+            }else{
+                while(currentFile + 1 < fileEnds.size() && readId >= fileEnds[currentFile]){
+                    currentFile++;
+                }
+                fileId = currentFile;
+            }
+
+            current.fileId = fileId;
+            current.readIdInFile = readIdsInFile[fileId]++;
+            current.globalReadId = readId;
+
+            return 0;
+        }
+
+        ReadWithId& getCurrent(){
+            return current;
+        }
+
+    private:
+        static constexpr int maxBatchsize = 4096;
+
+        bool loadNextBatch(){
+            while(chunkIndex < headerStorage->getNumChunks()){
+                const auto& chunk = headerStorage->getChunk(chunkIndex);
+                if(!hasDecoder){
+                    decoder = ReadHeaderChunkDecoder(chunk.data.data(), chunk.data.size());
+                    hasDecoder = true;
+                }
+                if(positionInChunk < chunk.numReads){
+                    break;
+                }
+                chunkIndex++;
+                positionInChunk = 0;
+                hasDecoder = false;
+            }
+
+            if(chunkIndex >= headerStorage->getNumChunks()){
+                return false;
+            }
+
+            const auto& chunk = headerStorage->getChunk(chunkIndex);
+            batchFirstReadId = chunk.firstReadId + positionInChunk;
+            batchsize = std::min(std::size_t(maxBatchsize), chunk.numReads - positionInChunk);
+            positionInBatch = 0;
+            positionInChunk += batchsize;
+
+            readIds.resize(batchsize);
+            lengths.resize(batchsize);
+            sequences.resize(batchsize * encodedSequencePitchInInts);
+            for(int i = 0; i < batchsize; i++){
+                readIds[i] = internalReadIds == nullptr ? batchFirstReadId + i : internalReadIds[batchFirstReadId + i];
+            }
+
+            readStorage->gatherSequenceLengths(lengths.data(), readIds.data(), batchsize);
+            if(internalReadIds == nullptr){
+                readStorage->gatherContiguousSequences(sequences.data(), encodedSequencePitchInInts, batchFirstReadId, batchsize);
+            }else{
+                readStorage->gatherSequences(sequences.data(), encodedSequencePitchInInts, readIds.data(), batchsize);
+            }
+            if(withQualityScores){
+                qualities.resize(batchsize * qualityPitchInBytes);
+                readStorage->gatherQualities(qualities.data(), qualityPitchInBytes, readIds.data(), batchsize);
+            }
+
+            return true;
+        }
+
+        bool withQualityScores{};
+        const CpuReadStorage* readStorage{};
+        const ReadHeaderStorage* headerStorage{};
+        const read_number* internalReadIds{};
+        std::size_t encodedSequencePitchInInts{};
+        std::size_t qualityPitchInBytes{};
+
+        std::vector<std::size_t> fileEnds{};
+        std::vector<std::uint64_t> readIdsInFile{};
+        std::size_t currentFile = 0;
+
+        std::size_t chunkIndex = 0;
+        std::size_t positionInChunk = 0;
+        bool hasDecoder = false;
+        ReadHeaderChunkDecoder decoder{nullptr, 0};
+
+        read_number batchFirstReadId = 0;
+        int batchsize = 0;
+        int positionInBatch = 0;
+        std::vector<read_number> readIds{};
+        std::vector<int> lengths{};
+        std::vector<unsigned int> sequences{};
+        std::vector<char> qualities{};
+
+        ReadWithId current{};
+    };
+
+}
+
+#endif
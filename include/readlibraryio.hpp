@@ -6,7 +6,9 @@
 #include <kseqpp/kseqpp.hpp>
 
 #include <hpc_helpers.cuh>
+#include <concurrencyhelpers.hpp>
 
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
@@ -14,7 +16,12 @@
 #include <vector>
 #include <exception>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <string_view>
+#include <thread>
+
+#include <zlib.h>
 
 
 
@@ -232,52 +239,79 @@ struct UncompressedWriter : public SequenceFileWriter{
     std::ofstream ofs;
 };
 
-struct GZipWriter : public SequenceFileWriter{
-    static constexpr int maxBufferedBytes = 4*1024*1024;
+/*
+    Writes a BGZF file, i.e. a gzip file which consists of independent gzip members of at most 64 KB,
+    each with a BC extra field which stores the compressed size of the member. The output can be decompressed by any gzip tool,
+    and can be indexed by BGZF-aware tools.
+
+    Data is collected into jobs of blocksPerJob blocks. Jobs are compressed by numCompressionThreads worker threads,
+    and written to file in order by a separate writer thread. The number of jobs in flight is limited.
+*/
+struct BgzfWriter : public SequenceFileWriter{
+    static constexpr std::size_t maxBlockInputBytes = 65280;
+    static constexpr std::size_t maxBlockOutputBytes = 65536;
+    static constexpr std::size_t blocksPerJob = 16;
 
-    GZipWriter(const std::string& filename, FileFormat format);
-    ~GZipWriter();
+    BgzfWriter(const std::string& filename, FileFormat format, int numCompressionThreads);
+    ~BgzfWriter();
 
     void writeReadImpl(const std::string& name, const std::string& comment, const std::string& sequence, const std::string& quality) override;
     void writeReadImpl(const std::string& header, const std::string& sequence, const std::string& quality) override;
     void writeImpl(const std::string& data) override;
 
 private:
-
-    void flush(){
-        gzwrite(fp, charbuffer.data(), charbuffer.size());
-        charbuffer.clear();
-    }
+    struct CompressionJob{
+        std::vector<char> input{};
+        std::vector<char> output{};
+        SyncFlag compressed{};
+    };
 
     void write(std::string_view data){
-        std::size_t remaining = data.size();
-        auto src = data.begin();
-        while(remaining > 0){
-            const std::size_t free = charbuffer.size() < maxBufferedBytes ? maxBufferedBytes - charbuffer.size() : 0;
-            const std::size_t toCopy = std::min(free, remaining);
-            charbuffer.insert(charbuffer.end(), src, src + toCopy);
-            src += toCopy;
-            remaining -= toCopy;
-            if(charbuffer.size() >= maxBufferedBytes){
-                flush();
+        while(data.size() > 0){
+            const std::size_t free = jobInputBytes - currentJob->input.size();
+            const std::size_t toCopy = std::min(free, data.size());
+            currentJob->input.insert(currentJob->input.end(), data.begin(), data.begin() + toCopy);
+            data.remove_prefix(toCopy);
+            if(currentJob->input.size() == jobInputBytes){
+                submitCurrentJob();
             }
         }
     }
 
+    void submitCurrentJob();
+    void compressorThreadFunc();
+    void writerThreadFunc();
 
+    //errors of the compressor threads are reported by the thread which writes to the writer
+    void setError(const std::string& message);
+    void rethrowError() const;
+
+    static constexpr std::size_t jobInputBytes = blocksPerJob * maxBlockInputBytes;
 
     bool isFastq;
     char delimHeader;
 
-    std::vector<char> charbuffer;
+    std::ofstream ofs;
 
-    gzFile fp;
-};
+    CompressionJob* currentJob = nullptr;
+    std::vector<std::unique_ptr<CompressionJob>> jobs;
+    SimpleMultiProducerMultiConsumerQueue<CompressionJob*> freeJobs;
+    SimpleMultiProducerMultiConsumerQueue<CompressionJob*> uncompressedJobs;
+    SimpleSingleProducerSingleConsumerQueue<CompressionJob*> jobsInOutputOrder;
 
+    std::vector<std::thread> compressorThreads;
+    std::thread writerThread;
 
+    std::atomic<bool> hasError{false};
+    mutable std::mutex errorMutex;
+    std::exception_ptr error;
+};
 
 std::unique_ptr<SequenceFileWriter> makeSequenceWriter(const std::string& filename, FileFormat fileFormat);
 
+//compressed formats are written with numCompressionThreads threads
+std::unique_ptr<SequenceFileWriter> makeSequenceWriter(const std::string& filename, FileFormat fileFormat, int numCompressionThreads);
+
 bool hasQualityScores(const std::string& filename);
 FileFormat getFileFormat(const std::string& filename);
 
@@ -287,10 +321,11 @@ SequenceFileProperties getSequenceFileProperties(const std::string& filename, bo
 
 std::uint64_t getNumberOfReads(const std::string& filename);
 
+//numDecompressionThreads is the number of threads which inflate a compressed file
 template<class Func>
-void forEachReadInFile(const std::string& filename, Func f){
+void forEachReadInFile(const std::string& filename, Func f, int numDecompressionThreads = kseqpp::ParallelGzReader::defaultNumThreads()){
 
-    kseqpp::KseqPP reader(filename);
+    kseqpp::KseqPP reader(filename, numDecompressionThreads);
 
     Read read;
 
@@ -333,11 +368,12 @@ void forEachReadInFile(const std::string& filename, Func f){
 
 
 
+//numDecompressionThreads is the number of threads which inflate each of the compressed files
 template<class Func>
-void forEachReadInPairedFiles(const std::string& file1, const std::string& file2, Func f){
+void forEachReadInPairedFiles(const std::string& file1, const std::string& file2, Func f, int numDecompressionThreads = kseqpp::ParallelGzReader::numThreadsPerReader(2)){
 
-    kseqpp::KseqPP reader1(file1);
-    kseqpp::KseqPP reader2(file2);
+    kseqpp::KseqPP reader1(file1, numDecompressionThreads);
+    kseqpp::KseqPP reader2(file2, numDecompressionThreads);
 
     int which = 0;
 
@@ -5,18 +5,100 @@
 #include <filehelpers.hpp>
 #include <memorymanagement.hpp>
 
+#include <zlib.h>
+
 #include <iostream>
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 namespace care{
 
+namespace serializedblockcompression{
+
+    //zlib compression of a block. the uncompressed size is stored in the first 4 bytes of the compressed block
+    inline void compressBlock(const std::uint8_t* data, std::size_t numBytes, std::vector<std::uint8_t>& out){
+        assert(numBytes <= std::numeric_limits<std::uint32_t>::max());
+
+        uLongf compressedBytes = compressBound(numBytes);
+        out.resize(sizeof(std::uint32_t) + compressedBytes);
+
+        const std::uint32_t uncompressedBytes = numBytes;
+        std::copy_n(reinterpret_cast<const std::uint8_t*>(&uncompressedBytes), sizeof(std::uint32_t), out.data());
+
+        const int status = compress2(out.data() + sizeof(std::uint32_t), &compressedBytes, data, numBytes, Z_BEST_SPEED);
+        if(status != Z_OK){
+            throw std::runtime_error("Could not compress block of serialized objects");
+        }
+        out.resize(sizeof(std::uint32_t) + compressedBytes);
+    }
+
+    inline std::size_t getUncompressedBytes(const std::uint8_t* block) noexcept{
+        std::uint32_t uncompressedBytes = 0;
+        std::copy_n(block, sizeof(std::uint32_t), reinterpret_cast<std::uint8_t*>(&uncompressedBytes));
+        return uncompressedBytes;
+    }
+
+    //out is resized to the uncompressed size
+    template<class Vector>
+    void decompressBlock(const std::uint8_t* block, std::size_t numBytes, Vector& out){
+        assert(numBytes >= sizeof(std::uint32_t));
+
+        uLongf uncompressedBytes = getUncompressedBytes(block);
+        out.resize(uncompressedBytes);
+
+        const int status = uncompress(
+            reinterpret_cast<Bytef*>(out.data()), &uncompressedBytes, 
+            block + sizeof(std::uint32_t), numBytes - sizeof(std::uint32_t)
+        );
+        if(status != Z_OK || uncompressedBytes != out.size()){
+            throw std::runtime_error("Could not decompress block of serialized objects");
+        }
+    }
+
+}
 
+/*
+    If compressionBlockBytes > 0, serialized objects are collected in blocks of about compressionBlockBytes bytes, 
+    and each full block is compressed with zlib. The position of an object is then given by its block and a 32-bit offset
+    within the uncompressed block, and objects can only be accessed by decompressing whole blocks (getNumBlocks, decompressBlock). 
+    getPointer, getDataBuffer, and getOffsetBuffer must not be used in this case.
+*/
 class SerializedObjectStorage{
 private:
+    struct CompressedBlock{
+        std::size_t dataOffset;
+        std::size_t numBytes;
+        std::size_t firstElement;
+    };
+
     std::unique_ptr<FileBackedUVector<std::uint8_t>> databuffer;
     std::unique_ptr<FileBackedUVector<std::size_t>> offsetbuffer;
+
+    std::size_t compressionBlockBytes = 0;
+    std::size_t uncompressedBytes = 0;
+    std::unique_ptr<FileBackedUVector<std::uint32_t>> inBlockOffsetbuffer;
+    std::vector<CompressedBlock> blocks;
+    std::vector<std::uint8_t> openBlock;
+    std::size_t openBlockFirstElement = 0;
+    std::vector<std::uint8_t> compressionBuffer;
+
+    void compressOpenBlock(){
+        serializedblockcompression::compressBlock(openBlock.data(), openBlock.size(), compressionBuffer);
+
+        auto first = databuffer->insert(databuffer->end(), compressionBuffer.begin(), compressionBuffer.end());
+        blocks.push_back(CompressedBlock{std::size_t(std::distance(databuffer->begin(), first)), compressionBuffer.size(), openBlockFirstElement});
+
+        openBlock.clear();
+    }
+
 public:
-    SerializedObjectStorage(std::size_t memoryLimitData_, std::size_t memoryLimitOffsets_, std::string filedirectory){
+    SerializedObjectStorage(std::size_t memoryLimitData_, std::size_t memoryLimitOffsets_, std::string filedirectory, std::size_t compressionBlockBytes_ = 0)
+        : compressionBlockBytes(compressionBlockBytes_){
         std::string nametemplate = filedirectory + "serializedobjectstorage-XXXXXX";
         std::string databufferfilename = filehelpers::makeRandomFile(nametemplate);
         std::string offsetbufferfilename = filehelpers::makeRandomFile(nametemplate);
@@ -26,20 +108,154 @@ public:
 
         offsetbuffer = std::make_unique<FileBackedUVector<std::size_t>>(
             0, memoryLimitOffsets_, offsetbufferfilename);
+
+        if(isBlockCompressed()){
+            std::string inblockoffsetbufferfilename = filehelpers::makeRandomFile(nametemplate);
+
+            inBlockOffsetbuffer = std::make_unique<FileBackedUVector<std::uint32_t>>(
+                0, memoryLimitOffsets_, inblockoffsetbufferfilename);
+
+            openBlock.reserve(compressionBlockBytes);
+        }
     }
 
     void insert(const std::uint8_t* begin, const std::uint8_t* end){
-        auto first = databuffer->insert(databuffer->end(), begin, end);
-        offsetbuffer->push_back(std::distance(databuffer->begin(), first));
+        if(isBlockCompressed()){
+            const std::size_t numBytes = std::distance(begin, end);
+            if(!openBlock.empty() && openBlock.size() + numBytes > compressionBlockBytes){
+                compressOpenBlock();
+            }
+            if(openBlock.empty()){
+                openBlockFirstElement = size();
+            }
+            inBlockOffsetbuffer->push_back(openBlock.size());
+            openBlock.insert(openBlock.end(), begin, end);
+            uncompressedBytes += numBytes;
+        }else{
+            auto first = databuffer->insert(databuffer->end(), begin, end);
+            offsetbuffer->push_back(std::distance(databuffer->begin(), first));
+        }
     }
 
     MemoryUsage getMemoryInfo() const{
         MemoryUsage result;
         result.host += databuffer->getCapacityInMemoryInBytes();
         result.host += offsetbuffer->getCapacityInMemoryInBytes();
+        if(isBlockCompressed()){
+            result.host += inBlockOffsetbuffer->getCapacityInMemoryInBytes();
+            result.host += sizeof(CompressedBlock) * blocks.capacity();
+            result.host += openBlock.capacity() + compressionBuffer.capacity();
+        }
         return result;
     }
 
+    //objects which are inserted after the limits have been reached are stored in the backing files
+    void setMemoryLimits(std::size_t memoryLimitData, std::size_t memoryLimitOffsets){
+        databuffer->setMaxBytesInMemory(memoryLimitData);
+        if(isBlockCompressed()){
+            inBlockOffsetbuffer->setMaxBytesInMemory(memoryLimitOffsets);
+        }else{
+            offsetbuffer->setMaxBytesInMemory(memoryLimitOffsets);
+        }
+    }
+
+    //true if the memory limit has been exceeded and some objects are stored in the backing files
+    bool hasDataInFile() const noexcept{
+        return databuffer->getCapacityInFileInBytes() > 0 || offsetbuffer->getCapacityInFileInBytes() > 0
+            || (isBlockCompressed() && inBlockOffsetbuffer->getCapacityInFileInBytes() > 0);
+    }
+
+    //hint for the access to objects which are stored in the backing files
+    void setAccessPattern(MMapAccessPattern pattern){
+        databuffer->setAccessPattern(pattern);
+        offsetbuffer->setAccessPattern(pattern);
+        if(isBlockCompressed()){
+            inBlockOffsetbuffer->setAccessPattern(pattern);
+        }
+    }
+
+    /*
+        Reads the objects [first, last) from the backing files into memory, if they are stored there. 
+        Blocks until all pages are mapped, so this should be called from a background thread.
+    */
+    void prefetch(std::size_t first, std::size_t last) const{
+        if(first >= last){
+            return;
+        }
+
+        if(isBlockCompressed()){
+            inBlockOffsetbuffer->prefetch(first, last, true);
+
+            auto compareFirstElement = [](std::size_t element, const CompressedBlock& block){
+                return element < block.firstElement;
+            };
+            const std::size_t firstBlock = std::distance(blocks.begin(), 
+                std::upper_bound(blocks.begin(), blocks.end(), first, compareFirstElement)) - 1;
+            const std::size_t lastBlock = std::distance(blocks.begin(), 
+                std::upper_bound(blocks.begin(), blocks.end(), last - 1, compareFirstElement));
+            if(firstBlock < blocks.size()){
+                const std::size_t dataEnd = lastBlock < blocks.size() ? blocks[lastBlock].dataOffset : databuffer->size();
+                databuffer->prefetch(blocks[firstBlock].dataOffset, dataEnd, true);
+            }
+        }else{
+            offsetbuffer->prefetch(first, last, true);
+
+            const std::size_t dataEnd = last < size() ? getOffset(last) : databuffer->size();
+            databuffer->prefetch(getOffset(first), dataEnd, true);
+        }
+    }
+
+    bool isBlockCompressed() const noexcept{
+        return compressionBlockBytes > 0;
+    }
+
+    //the last block is not compressed yet if it is not full
+    std::size_t getNumBlocks() const noexcept{
+        assert(isBlockCompressed());
+        return blocks.size() + (openBlock.empty() ? 0 : 1);
+    }
+
+    std::size_t getBlockFirstElement(std::size_t b) const noexcept{
+        assert(b < getNumBlocks());
+        return b < blocks.size() ? blocks[b].firstElement : openBlockFirstElement;
+    }
+
+    std::size_t getBlockNumElements(std::size_t b) const noexcept{
+        return (b + 1 < getNumBlocks() ? getBlockFirstElement(b + 1) : size()) - getBlockFirstElement(b);
+    }
+
+    std::size_t getUncompressedBlockBytes(std::size_t b) const noexcept{
+        assert(b < getNumBlocks());
+        if(b < blocks.size()){
+            return serializedblockcompression::getUncompressedBytes(databuffer->data() + blocks[b].dataOffset);
+        }else{
+            return openBlock.size();
+        }
+    }
+
+    //out is resized to the uncompressed size of the block
+    template<class Vector>
+    void decompressBlock(std::size_t b, Vector& out) const{
+        assert(b < getNumBlocks());
+        if(b < blocks.size()){
+            serializedblockcompression::decompressBlock(databuffer->data() + blocks[b].dataOffset, blocks[b].numBytes, out);
+        }else{
+            out.resize(openBlock.size());
+            std::copy(openBlock.begin(), openBlock.end(), out.begin());
+        }
+    }
+
+    //offset of the i-th object within the uncompressed block which contains it
+    std::uint32_t getInBlockOffset(std::size_t i) const noexcept{
+        assert(isBlockCompressed());
+        return (*inBlockOffsetbuffer)[i];
+    }
+
+    //total size of the serialized objects without compression
+    std::size_t uncompressedDataBytes() const noexcept{
+        return isBlockCompressed() ? uncompressedBytes : dataBytes();
+    }
+
     std::uint8_t* getPointer(std::size_t i) noexcept{
         const std::size_t offset = getOffset(i);
         return databuffer->data() + offset;
@@ -51,43 +267,54 @@ public:
     }
 
     std::size_t getOffset(std::size_t i) const noexcept{
+        assert(!isBlockCompressed());
         return (*offsetbuffer)[i];
     }
 
     std::uint8_t* getDataBuffer() noexcept{
+        assert(!isBlockCompressed());
         return databuffer->data();
     }
 
     const std::uint8_t* getDataBuffer() const noexcept{
+        assert(!isBlockCompressed());
         return databuffer->data();
     }
 
     std::size_t* getOffsetBuffer() noexcept{
+        assert(!isBlockCompressed());
         return offsetbuffer->data();
     }
 
     const std::size_t* getOffsetBuffer() const noexcept{
+        assert(!isBlockCompressed());
         return offsetbuffer->data();
     }
 
     std::size_t size() const noexcept{
-        return offsetbuffer->size();
+        return isBlockCompressed() ? inBlockOffsetbuffer->size() : offsetbuffer->size();
     }
 
     std::size_t getNumElements() const noexcept{
-        return offsetbuffer->size();
+        return size();
     }    
 
     std::size_t dataBytes() const noexcept{
-        return sizeof(std::uint8_t) * databuffer->size();
+        return sizeof(std::uint8_t) * (databuffer->size() + openBlock.size());
     }
 
     std::size_t offsetBytes() const noexcept{
-        return sizeof(std::size_t) * offsetbuffer->size();
+        if(isBlockCompressed()){
+            return sizeof(std::uint32_t) * inBlockOffsetbuffer->size() + sizeof(CompressedBlock) * blocks.size();
+        }else{
+            return sizeof(std::size_t) * offsetbuffer->size();
+        }
     }
 
 
     void saveToStream(std::ostream& out) const{
+        assert(!isBlockCompressed());
+
         std::size_t dbytes = dataBytes();
         std::size_t obytes = offsetBytes();
         std::size_t delemns = databuffer->size();
@@ -103,6 +330,8 @@ public:
     }
 
     void loadFromStream(std::istream& in){
+        assert(!isBlockCompressed());
+
         std::size_t dbytes = 0;
         std::size_t obytes = 0;
         std::size_t delemns = 0;
@@ -5,21 +5,76 @@
 
 #include <serializedobjectstorage.hpp>
 #include <sortbygeneratedkeys.hpp>
+#include <parallelradixsort.hpp>
 
 #include <cstdint>
 #include <iostream>
 #include <limits>
 #include <algorithm>
+#include <vector>
+
+#include <omp.h>
 
 namespace care{
 
+    /*
+        Extracts the (read id, offset) pairs once in a single sequential pass over the data buffer
+        and sorts them with a parallel LSD radix sort. The sorted offsets are written back to the offset buffer.
+        Returns false if memoryForSortingInBytes is insufficient.
+    */
+    template<class T> // T type of serialized objects
+    bool sortSerializedResultsByReadIdAscendingRadix(
+        SerializedObjectStorage& partialResults,
+        std::size_t memoryForSortingInBytes,
+        int numThreads
+    ){
+        const std::size_t numElements = partialResults.size();
+        const std::size_t requiredBytes = numElements * (2 * sizeof(read_number) + sizeof(std::size_t));
+
+        if(requiredBytes > memoryForSortingInBytes){
+            return false;
+        }
+
+        std::vector<read_number> keys(numElements);
+        std::vector<read_number> keysTmp(numElements);
+        std::vector<std::size_t> offsetsTmp(numElements);
+
+        const std::uint8_t* const dataBuffer = partialResults.getDataBuffer();
+        std::size_t* const offsets = partialResults.getOffsetBuffer();
+
+        #pragma omp parallel for num_threads(numThreads) schedule(static)
+        for(std::size_t i = 0; i < numElements; i++){
+            keys[i] = T::parseReadId(dataBuffer + offsets[i]);
+        }
+
+        parallelRadixSortPairs(
+            keys.data(),
+            offsets,
+            keysTmp.data(),
+            offsetsTmp.data(),
+            numElements,
+            numThreads
+        );
+
+        return true;
+    }
+
     template<class T> // T type of serialized objects
     void sortSerializedResultsByReadIdAscending(
         SerializedObjectStorage& partialResults,
-        std::size_t memoryForSortingInBytes
+        std::size_t memoryForSortingInBytes,
+        int numThreads
     ){
         if(partialResults.size() < 2) return;
 
+        try{
+            if(sortSerializedResultsByReadIdAscendingRadix<T>(partialResults, memoryForSortingInBytes, numThreads)){
+                return;
+            }
+        } catch (...){
+            std::cerr << "Fallback\n";
+        }
+
         //return read id of the object serialized at ptr
         auto extractKey = [](const std::uint8_t* ptr){
             const read_number id = T::parseReadId(ptr);            
@@ -2,6 +2,7 @@
 #define CARE_THREADPOOL_HPP
 
 #include <parallel/parallel_task_queue.h>
+#include <workstealingscheduler.hpp>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
@@ -212,6 +213,38 @@ struct ThreadPool{
         return parallelFor_impl<waitForCompletion>(handle, begin, end, std::forward<Func>(loop), numThreads, false);
     }
 
+    /*
+        Like parallelFor, but iterations are distributed dynamically in batches of at most grainsize iterations
+        using a WorkStealingScheduler. Use this if the cost per iteration varies.
+        loopBody(begin, end, threadId) may be called multiple times with the same threadId, but not concurrently.
+
+        returns number of used threads
+    */
+    template<class Index_t, class Func>
+    int parallelForWorkStealing(ParallelForHandle& handle, Index_t begin, Index_t end, Index_t grainsize, Func&& loop){
+        if(end <= begin){
+            return 0;
+        }
+
+        const int numThreads = getConcurrency();
+
+        WorkStealingScheduler<Index_t> scheduler(begin, end, numThreads);
+
+        auto schedulerloop = [&](int threadsBegin, int threadsEnd, int /*chunkId*/){
+            for(int t = threadsBegin; t < threadsEnd; t++){
+                Index_t batchBegin{};
+                Index_t batchEnd{};
+                while(scheduler.next(t, grainsize, batchBegin, batchEnd)){
+                    loop(batchBegin, batchEnd, t);
+                }
+            }
+        };
+
+        parallelFor(handle, 0, numThreads, schedulerloop, numThreads);
+
+        return numThreads;
+    }
+
     void wait(){
         pq->wait();
     }
@@ -365,6 +398,17 @@ struct ParallelForLoopExecutor{
         );
     }
 
+    template<class Index_t, class Func>
+    int workStealing(Index_t begin, Index_t end, Index_t grainsize, Func&& loopbody){
+        return threadPool->parallelForWorkStealing(
+            *pforHandle, 
+            begin, 
+            end, 
+            grainsize,
+            std::move(loopbody)
+        );
+    }
+
     int getNumThreads() const{
         return threadPool->getConcurrency()+1; // the calling thread of operator() is used for processing, too.
     }
@@ -381,6 +425,11 @@ struct SequentialForLoopExecutor{
         return 1;
     }
 
+    template<class Index_t, class Func>
+    int workStealing(Index_t begin, Index_t end, Index_t /*grainsize*/, Func&& loopbody){
+        return operator()(begin, end, std::move(loopbody));
+    }
+
     int getNumThreads() const{
         return 1; // the calling thread of operator() is used for processing, too.
     }
@@ -407,6 +456,16 @@ struct ForLoopExecutor{
         }
     }
 
+    //loopbody may be called multiple times per thread id
+    template<class Index_t, class Func>
+    int workStealing(Index_t begin, Index_t end, Index_t grainsize, Func&& loopbody){
+        if(doUsePool){
+            return parLoop.workStealing(begin, end, grainsize, std::move(loopbody));
+        }else{
+            return seqLoop.workStealing(begin, end, grainsize, std::move(loopbody));
+        }
+    }
+
     int getNumThreads() const{
         if(doUsePool){
             return parLoop.getNumThreads();
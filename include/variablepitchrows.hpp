@@ -0,0 +1,175 @@
+#ifndef CARE_VARIABLE_PITCH_ROWS_HPP
+#define CARE_VARIABLE_PITCH_ROWS_HPP
+
+#include <memorymanagement.hpp>
+#include <memoryplacement.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace care{
+
+/*
+    Rows of unsigned ints of different lengths, stored consecutively without padding.
+    The begin of row i is groupOffsets[i / rowsPerGroup] + relativeOffsets[i], i.e. 4 bytes per row
+    plus 8 bytes per group of rowsPerGroup rows. A row must not be longer than getMaxRowLength() ints.
+*/
+struct VariablePitchRows{
+    static constexpr int groupBits = 16;
+    static constexpr std::size_t rowsPerGroup = std::size_t(1) << groupBits;
+
+    VariablePitchRows() = default;
+
+    //rowLength(i) returns the number of ints of row i. The rows are zero-initialized
+    template<class RowLength>
+    VariablePitchRows(std::size_t numRows_, RowLength rowLength) : numRows(numRows_){
+        groupOffsets.resize(getNumGroupOffsets(numRows));
+        relativeOffsets.resize(numRows + 1);
+
+        std::size_t offset = 0;
+        for(std::size_t i = 0; i <= numRows; i++){
+            if(i % rowsPerGroup == 0){
+                groupOffsets[i / rowsPerGroup] = offset;
+            }
+            relativeOffsets[i] = offset - groupOffsets[i / rowsPerGroup];
+
+            if(i < numRows){
+                const std::size_t length = rowLength(i);
+                assert(length <= getMaxRowLength());
+                offset += length;
+            }
+        }
+
+        data.resize(offset);
+
+        dataPtr = data.data();
+        relativeOffsetsPtr = relativeOffsets.data();
+        groupOffsetsPtr = groupOffsets.data();
+    }
+
+    //the pointers point into std::vector buffers which are moved along, or into memory which is not owned
+    VariablePitchRows(const VariablePitchRows&) = delete;
+    VariablePitchRows(VariablePitchRows&&) = default;
+    VariablePitchRows& operator=(const VariablePitchRows&) = delete;
+    VariablePitchRows& operator=(VariablePitchRows&&) = default;
+
+    /*
+        Rows in memory which is not owned by the object, e.g. a memory mapped file. The arrays must stay valid.
+        The arrays have the layout of getData(), getRelativeOffsets() and getGroupOffsets()
+    */
+    static VariablePitchRows makeView(
+        std::size_t numRows, 
+        const unsigned int* data, 
+        const std::uint32_t* relativeOffsets, 
+        const std::size_t* groupOffsets
+    ){
+        VariablePitchRows result;
+        result.numRows = numRows;
+        result.dataPtr = const_cast<unsigned int*>(data);
+        result.relativeOffsetsPtr = relativeOffsets;
+        result.groupOffsetsPtr = groupOffsets;
+        result.isView = true;
+        return result;
+    }
+
+    static std::size_t getNumGroupOffsets(std::size_t numRows) noexcept{
+        return (numRows + 1 + rowsPerGroup - 1) / rowsPerGroup;
+    }
+
+    //longest row such that relative offsets within a group fit into 32 bits
+    static constexpr std::size_t getMaxRowLength() noexcept{
+        return std::numeric_limits<std::uint32_t>::max() / rowsPerGroup;
+    }
+
+    //bytes which are required to store rows with a total of numInts ints
+    static std::size_t getRequiredBytes(std::size_t numRows, std::size_t numInts) noexcept{
+        return sizeof(unsigned int) * numInts
+            + sizeof(std::uint32_t) * (numRows + 1)
+            + sizeof(std::size_t) * getNumGroupOffsets(numRows);
+    }
+
+    std::size_t getRowBegin(std::size_t row) const noexcept{
+        return groupOffsetsPtr[row >> groupBits] + relativeOffsetsPtr[row];
+    }
+
+    std::size_t getRowLength(std::size_t row) const noexcept{
+        return getRowBegin(row + 1) - getRowBegin(row);
+    }
+
+    //rows are stored consecutively in ascending order. getNumInts() ints
+    const unsigned int* getData() const noexcept{
+        return dataPtr;
+    }
+
+    //numRows + 1 offsets, relative to the group offset
+    const std::uint32_t* getRelativeOffsets() const noexcept{
+        return relativeOffsetsPtr;
+    }
+
+    //getNumGroupOffsets(numRows) offsets
+    const std::size_t* getGroupOffsets() const noexcept{
+        return groupOffsetsPtr;
+    }
+
+    //must not be called for views
+    unsigned int* getRow(std::size_t row) noexcept{
+        assert(!isView);
+        return dataPtr + getRowBegin(row);
+    }
+
+    const unsigned int* getRow(std::size_t row) const noexcept{
+        return dataPtr + getRowBegin(row);
+    }
+
+    std::size_t getNumRows() const noexcept{
+        return numRows;
+    }
+
+    std::size_t getNumInts() const noexcept{
+        return numRows == 0 && groupOffsetsPtr == nullptr ? 0 : getRowBegin(numRows);
+    }
+
+    //memory of views is not included
+    MemoryUsage getMemoryInfo() const{
+        MemoryUsage info;
+        info.host = sizeof(unsigned int) * data.capacity()
+            + sizeof(std::uint32_t) * relativeOffsets.capacity()
+            + sizeof(std::size_t) * groupOffsets.capacity();
+        return info;
+    }
+
+    void destroy(){
+        auto deallocVector = [](auto& vec){
+            using T = typename std::remove_reference<decltype(vec)>::type;
+            T tmp{};
+            vec.swap(tmp);
+        };
+
+        numRows = 0;
+        dataPtr = nullptr;
+        relativeOffsetsPtr = nullptr;
+        groupOffsetsPtr = nullptr;
+        isView = false;
+        deallocVector(data);
+        deallocVector(relativeOffsets);
+        deallocVector(groupOffsets);
+    }
+
+private:
+    std::size_t numRows = 0;
+    PlacedVector<unsigned int> data{};
+    std::vector<std::uint32_t> relativeOffsets{};
+    std::vector<std::size_t> groupOffsets{};
+
+    bool isView = false;
+    unsigned int* dataPtr = nullptr;
+    const std::uint32_t* relativeOffsetsPtr = nullptr;
+    const std::size_t* groupOffsetsPtr = nullptr;
+};
+
+}
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef CARE_WORKSTEALINGSCHEDULER_HPP
+#define CARE_WORKSTEALINGSCHEDULER_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace care{
+
+    /*
+        Distributes the index range [begin, end) among a fixed number of threads.
+
+        Each thread initially owns one large contiguous part of the range and takes small batches
+        from the front of its part. Once the part of a thread is exhausted, the thread steals the
+        back half of the largest remaining part of any other thread. Thus, granularity is coarse while
+        work is balanced, and becomes finer only when threads run out of work.
+
+        All split points are multiples of alignment relative to begin, e.g. alignment = 2 never separates
+        the two reads of a pair.
+
+        The scheduler tracks for each thread the time spent processing batches (busy) and the time spent
+        in next() or waiting for the remaining threads to finish (idle).
+    */
+    template<class Index_t>
+    class WorkStealingScheduler{
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct ThreadStatistics{
+            double busySeconds = 0;
+            double idleSeconds = 0;
+            std::size_t processedElements = 0;
+            std::size_t numBatches = 0;
+            std::size_t numSteals = 0;
+        };
+
+        WorkStealingScheduler(Index_t begin, Index_t end, int numThreads_, Index_t alignment_ = 1)
+            : numThreads(std::max(1, numThreads_)),
+            alignment(std::max(Index_t(1), alignment_)),
+            slots(std::max(1, numThreads_)),
+            startTime(Clock::now())
+        {
+            const Index_t total = (end > begin) ? end - begin : Index_t(0);
+            const Index_t numUnits = (total + alignment - 1) / alignment;
+            const Index_t unitsPerThread = numUnits / numThreads;
+            const Index_t leftoverUnits = numUnits % numThreads;
+
+            Index_t current = begin;
+            for(int t = 0; t < numThreads; t++){
+                const Index_t units = unitsPerThread + (Index_t(t) < leftoverUnits ? 1 : 0);
+                slots[t].begin = current;
+                slots[t].end = std::min(end, current + units * alignment);
+                current = slots[t].end;
+
+                slots[t].lastReturnTime = startTime;
+            }
+            assert(current == std::max(begin, end));
+        }
+
+        WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+        WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+        int getNumThreads() const noexcept{
+            return numThreads;
+        }
+
+        /*
+            Get next batch [batchBegin, batchEnd) of at most maxBatchsize elements for thread threadId.
+            Returns false if no work remains. Must not be called concurrently with the same threadId.
+        */
+        bool next(int threadId, Index_t maxBatchsize, Index_t& batchBegin, Index_t& batchEnd){
+            assert(0 <= threadId && threadId < numThreads);
+
+            Slot& slot = slots[threadId];
+            const auto entryTime = Clock::now();
+
+            if(slot.hasOutstandingBatch){
+                slot.statistics.busySeconds += std::chrono::duration<double>(entryTime - slot.lastReturnTime).count();
+                slot.hasOutstandingBatch = false;
+            }
+
+            const Index_t batchsize = std::max(alignment, (maxBatchsize / alignment) * alignment);
+
+            bool success = takeFromOwnRange(slot, batchsize, batchBegin, batchEnd);
+
+            while(!success){
+                if(!stealInto(threadId)){
+                    break;
+                }
+                slot.statistics.numSteals++;
+                success = takeFromOwnRange(slot, batchsize, batchBegin, batchEnd);
+            }
+
+            const auto exitTime = Clock::now();
+            slot.statistics.idleSeconds += std::chrono::duration<double>(exitTime - entryTime).count();
+            slot.lastReturnTime = exitTime;
+
+            if(success){
+                slot.hasOutstandingBatch = true;
+                slot.statistics.processedElements += batchEnd - batchBegin;
+                slot.statistics.numBatches++;
+            }else{
+                slot.finished = true;
+            }
+
+            return success;
+        }
+
+        /*
+            Statistics of thread threadId. Time between finishing the last batch of the thread
+            and finishing the last batch of all threads counts as idle time.
+            Only valid after each thread has received false from next()
+        */
+        ThreadStatistics getStatistics(int threadId) const{
+            ThreadStatistics result = slots[threadId].statistics;
+
+            if(slots[threadId].finished){
+                const auto endTime = getFinishTime();
+                result.idleSeconds += std::chrono::duration<double>(endTime - slots[threadId].lastReturnTime).count();
+            }
+
+            return result;
+        }
+
+        ThreadStatistics getTotalStatistics() const{
+            ThreadStatistics result;
+            for(int t = 0; t < numThreads; t++){
+                const ThreadStatistics s = getStatistics(t);
+                result.busySeconds += s.busySeconds;
+                result.idleSeconds += s.idleSeconds;
+                result.processedElements += s.processedElements;
+                result.numBatches += s.numBatches;
+                result.numSteals += s.numSteals;
+            }
+            return result;
+        }
+
+        void printStatistics(std::ostream& os, bool perThread) const{
+            const ThreadStatistics total = getTotalStatistics();
+            const double totalTime = total.busySeconds + total.idleSeconds;
+            const double busyPercent = totalTime > 0 ? 100.0 * total.busySeconds / totalTime : 100.0;
+            const auto oldPrecision = os.precision();
+
+            os << "# scheduler: " << numThreads << " threads, busy " << std::fixed << std::setprecision(2) << busyPercent << " %, "
+                << total.numBatches << " batches, " << total.numSteals << " steals\n";
+
+            if(perThread){
+                for(int t = 0; t < numThreads; t++){
+                    const ThreadStatistics s = getStatistics(t);
+                    os << "# scheduler thread " << t << ": busy " << s.busySeconds << " s, idle " << s.idleSeconds
+                        << " s, elements " << s.processedElements << ", batches " << s.numBatches
+                        << ", steals " << s.numSteals << "\n";
+                }
+            }
+
+            os << std::defaultfloat << std::setprecision(oldPrecision);
+        }
+
+    private:
+        struct alignas(64) Slot{
+            std::mutex mutex{};
+            Index_t begin{};
+            Index_t end{};
+
+            //only accessed by owning thread
+            bool hasOutstandingBatch = false;
+            bool finished = false;
+            Clock::time_point lastReturnTime{};
+            ThreadStatistics statistics{};
+        };
+
+        bool takeFromOwnRange(Slot& slot, Index_t batchsize, Index_t& batchBegin, Index_t& batchEnd){
+            std::lock_guard<std::mutex> lg(slot.mutex);
+
+            if(slot.begin >= slot.end){
+                return false;
+            }
+
+            batchBegin = slot.begin;
+            batchEnd = std::min(slot.end, slot.begin + batchsize);
+            slot.begin = batchEnd;
+
+            return true;
+        }
+
+        //move the back half of the largest remaining range of another thread into own range.
+        //returns false if no thread has remaining work
+        bool stealInto(int threadId){
+            while(true){
+                int victim = -1;
+                Index_t victimRemaining = 0;
+
+                for(int i = 1; i < numThreads; i++){
+                    const int t = (threadId + i) % numThreads;
+                    std::lock_guard<std::mutex> lg(slots[t].mutex);
+                    const Index_t remaining = slots[t].end > slots[t].begin ? slots[t].end - slots[t].begin : Index_t(0);
+                    if(remaining > victimRemaining){
+                        victim = t;
+                        victimRemaining = remaining;
+                    }
+                }
+
+                if(victim == -1){
+                    return false;
+                }
+
+                Index_t stolenBegin = 0;
+                Index_t stolenEnd = 0;
+
+                {
+                    std::lock_guard<std::mutex> lg(slots[victim].mutex);
+                    Slot& v = slots[victim];
+                    if(v.begin >= v.end){
+                        continue; //victim finished its work in the meantime, try again
+                    }
+
+                    const Index_t remaining = v.end - v.begin;
+                    const Index_t remainingUnits = (remaining + alignment - 1) / alignment;
+                    //victim keeps the front half which is already in its cache, thief takes the back half.
+                    //a single remaining unit is taken completely
+                    const Index_t keepUnits = remainingUnits / 2;
+
+                    stolenBegin = v.begin + keepUnits * alignment;
+                    stolenEnd = v.end;
+                    v.end = stolenBegin;
+                }
+
+                std::lock_guard<std::mutex> lg(slots[threadId].mutex);
+                slots[threadId].begin = stolenBegin;
+                slots[threadId].end = stolenEnd;
+
+                return true;
+            }
+        }
+
+        Clock::time_point getFinishTime() const{
+            Clock::time_point result = startTime;
+            for(int t = 0; t < numThreads; t++){
+                result = std::max(result, slots[t].lastReturnTime);
+            }
+            return result;
+        }
+
+        int numThreads{};
+        Index_t alignment{};
+        std::vector<Slot> slots;
+        Clock::time_point startTime{};
+    };
+
+}
+
+#endif
@@ -8,13 +8,14 @@
 #include <alignmentorientation.hpp>
 #include <msa.hpp>
 #include <qualityscoreweights.hpp>
-#include <rangegenerator.hpp>
+#include <workstealingscheduler.hpp>
 #include <correctedsequence.hpp>
 
 #include <threadpool.hpp>
 #include <serializedobjectstorage.hpp>
 #include <util.hpp>
 #include <filehelpers.hpp>
+#include <concurrencyhelpers.hpp>
 #include <hostdevicefunctions.cuh>
 
 #include <classification.hpp>
@@ -22,95 +23,165 @@
 
 //#define ENABLE_CPU_CORRECTOR_TIMING
 #include <corrector.hpp>
+#include <correctionpipeline.hpp>
+#include <anchororder.hpp>
+#include <candidatecorrectionaggregator.hpp>
+#include <orderedcorrectionresultstream.hpp>
+#include <memorybudget.hpp>
 #include <cpuminhasher.hpp>
 
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <numeric>
 #include <thread>
 
 #include <vector>
 
 #include <omp.h>
 
-#include <thrust/iterator/counting_iterator.h>
-
 
 namespace care{
 namespace cpu{
 
+/*
+    Estimated working memory of a correction thread which is not accounted otherwise: the candidate ids, candidate data, 
+    and multiple sequence alignments of the anchors which are processed together, the input and correction buffers of a batch,
+    and the candidate row cache.
+    Reads which share k-mers with an anchor are mostly found by all hash tables, so the number of distinct candidates
+    of an anchor is estimated by the maximum number of results per hash table
+*/
+std::size_t getCorrectionWorkingMemoryPerThreadInBytes(
+    const ProgramOptions& programOptions,
+    const CpuMinhasher& minhasher,
+    const CpuReadStorage& readStorage
+){
+    const std::size_t maxLength = readStorage.getSequenceLengthUpperBound();
+    const std::size_t encodedBytes = SequenceHelpers::getEncodedNumInts2Bit(maxLength) * sizeof(unsigned int);
+    const std::size_t batchsize = std::max(1, programOptions.batchsize);
+    const std::size_t resultsPerMap = std::max(1, minhasher.getNumResultsPerMapThreshold());
+    const std::size_t numMaps = std::max(1, minhasher.getNumberOfMaps());
+
+    //candidate ids before and after removal of duplicates
+    const std::size_t candidateIdBytesPerAnchor = (numMaps + 1) * resultsPerMap * sizeof(read_number);
+    //sequence and its reverse complement, decoded sequence, quality scores, alignment and correction of a candidate
+    const std::size_t bytesPerCandidate = 2 * encodedBytes + 3 * maxLength + 64;
+    //columns of the multiple sequence alignment, which may extend to both sides of the anchor, with counts, weights, and consensus
+    const std::size_t msaBytesPerAnchor = 3 * maxLength * 64;
+    const std::size_t bytesPerAnchor = candidateIdBytesPerAnchor + resultsPerMap * bytesPerCandidate + msaBytesPerAnchor;
+
+    //paired-end reads are corrected batch-wise, single-end reads one at a time
+    const std::size_t anchorsInFlight = readStorage.isPairedEnd() ? batchsize : 1;
+
+    //input of a batch, and two buffers of serialized anchor and candidate corrections
+    const std::size_t correctionsPerAnchor = 1 + (programOptions.correctCandidates ? std::size_t(std::ceil(programOptions.estimatedCoverage)) : 0);
+    const std::size_t batchBytes = batchsize * (encodedBytes + maxLength + sizeof(int) + sizeof(read_number))
+        + 2 * batchsize * correctionsPerAnchor * (maxLength + 16);
+
+    const std::size_t rowCacheBytes = programOptions.candidateRowCacheSize * (encodedBytes + maxLength + sizeof(read_number));
+
+    return anchorsInFlight * bytesPerAnchor + batchBytes + rowCacheBytes;
+}
+
 
 SerializedObjectStorage correct_cpu(
     const ProgramOptions& programOptions,
     CpuMinhasher& minhasher,
-    CpuReadStorage& readStorage
+    CpuReadStorage& readStorage,
+    MemoryBudget& memoryBudget,
+    OrderedCorrectionResultStream* resultStream
 ){
 
     omp_set_num_threads(programOptions.threads);
 
-    const auto rsMemInfo = readStorage.getMemoryInfo();
-    const auto mhMemInfo = minhasher.getMemoryInfo();
-
-    std::size_t memoryAvailableBytesHost = programOptions.memoryTotalLimit;
-    if(memoryAvailableBytesHost > rsMemInfo.host){
-        memoryAvailableBytesHost -= rsMemInfo.host;
-    }else{
-        memoryAvailableBytesHost = 0;
-    }
-    if(memoryAvailableBytesHost > mhMemInfo.host){
-        memoryAvailableBytesHost -= mhMemInfo.host;
-    }else{
-        memoryAvailableBytesHost = 0;
-    }
-
-
     ReadCorrectionFlags correctionFlags(readStorage.getNumberOfReads());
 
+    auto correctionFlagsBudget = memoryBudget.registerComponent("correction flags", [&](){
+        return correctionFlags.sizeInBytes();
+    });
 
     std::cerr << "correctionStatusFlagsPerRead bytes: " << correctionFlags.sizeInBytes() / 1024. / 1024. << " MB\n";
 
-    if(memoryAvailableBytesHost > correctionFlags.sizeInBytes()){
-        memoryAvailableBytesHost -= correctionFlags.sizeInBytes();
-    }else{
-        memoryAvailableBytesHost = 0;
-    }
+    //working memory of the correction threads which is not accounted otherwise
+    const std::size_t workingMemoryInBytes = std::size_t(programOptions.threads) 
+        * getCorrectionWorkingMemoryPerThreadInBytes(programOptions, minhasher, readStorage);
+    auto workingMemoryBudget = memoryBudget.reserve("correction working memory", workingMemoryInBytes);
 
-    const std::size_t availableMemoryInBytes = memoryAvailableBytesHost; //getAvailableMemoryInKB() * 1024;
-    std::size_t memoryForPartialResultsInBytes = 0;
+    std::cerr << "Estimated working memory of correction threads: " << (workingMemoryInBytes / 1024. / 1024.) << " MB\n";
 
-    if(availableMemoryInBytes > 2*(std::size_t(1) << 30)){
-        memoryForPartialResultsInBytes = availableMemoryInBytes - 2*(std::size_t(1) << 30);
-    }
+    const std::size_t memoryForPartialResultsInBytes = memoryBudget.getAvailableBytes();
 
     std::cerr << "Partial results may occupy " << (memoryForPartialResultsInBytes /1024. / 1024. / 1024.) 
         << " GB in memory. Remaining partial results will be stored in temp directory. \n";
 
-    const std::size_t memoryLimitData = memoryForPartialResultsInBytes * 0.75;
-    const std::size_t memoryLimitOffsets = memoryForPartialResultsInBytes * 0.25;
+    const std::size_t compressionBlockBytes = programOptions.compressPartialResults ? std::size_t(256) << 10 : 0;
 
-    SerializedObjectStorage partialResults(memoryLimitData, memoryLimitOffsets, programOptions.tempdirectory + "/");
+    std::unique_ptr<CandidateCorrectionAggregator> candidateCorrectionAggregator;
 
-    const std::size_t numReadsToProcess = getNumReadsToProcess(&readStorage, programOptions);
+    if(programOptions.aggregateCandidateCorrections && programOptions.correctCandidates){
+        candidateCorrectionAggregator = std::make_unique<CandidateCorrectionAggregator>(programOptions.threads);
+    }
+
+    auto candidateCorrectionAggregatorBudget = memoryBudget.registerComponent("aggregated candidate corrections", [&](){
+        return candidateCorrectionAggregator ? candidateCorrectionAggregator->getMemoryInBytes() : 0;
+    });
 
-    IteratorRangeTraversal<thrust::counting_iterator<read_number>> readIdGenerator(
-        thrust::make_counting_iterator<read_number>(0),
-        thrust::make_counting_iterator<read_number>(0) + numReadsToProcess
+    SerializedObjectStorage partialResults(
+        memoryForPartialResultsInBytes * 0.75, 
+        memoryForPartialResultsInBytes * 0.25, 
+        programOptions.tempdirectory + "/",
+        compressionBlockBytes
     );
+
+    //the limit is recomputed periodically during correction (see showProgress), so it shrinks if other components grow.
+    //the aggregated candidate corrections may use a quarter of it. they are moved to the partial results when they exceed it
+    auto partialResultsBudget = memoryBudget.registerSpillableComponent(
+        "partial results",
+        [&](){ return partialResults.getMemoryInfo().host; },
+        [&](std::size_t bytes){ 
+            if(candidateCorrectionAggregator){
+                candidateCorrectionAggregator->setMemoryLimit(bytes / 4);
+                bytes -= bytes / 4;
+            }
+            partialResults.setMemoryLimits(bytes * 0.75, bytes * 0.25); 
+        }
+    );
+
+    const std::size_t numReadsToProcess = getNumReadsToProcess(&readStorage, programOptions);
+
+    //only the anchors of the selected read id range are corrected. candidates are taken from all reads
+    const read_number firstAnchor = std::min(std::size_t(programOptions.readIdRangeBegin), numReadsToProcess);
+    const read_number lastAnchor = std::min(std::size_t(programOptions.readIdRangeEnd), numReadsToProcess);
+    const std::size_t numAnchorsToProcess = lastAnchor - firstAnchor;
+    const bool processesAllReads = firstAnchor == 0 && lastAnchor == numReadsToProcess;
+
+    //not null if the reads have been renumbered or collapsed
+    const read_number* const originalReadIds = readStorage.getOriginalReadIds();
+    const read_number* const originalReadIdOffsets = readStorage.getOriginalReadIdOffsets();
+
     
     BackgroundThread outputThread(true);
     outputThread.setMaximumQueueSize(programOptions.threads);
 
     CpuErrorCorrector::TimeMeasurements timingsOfAllThreads;
+    CandidateRowCache::Statistics rowCacheStatisticsOfAllThreads;
 
     ClfAgent clfAgent_(programOptions);
     
     auto showProgress = [&](auto totalCount, auto seconds){
+        //called about once per second. the memory limits are recomputed by the output thread, which inserts into the partial results
+        outputThread.enqueue([&](){
+            memoryBudget.refresh();
+        });
+
         if(programOptions.showProgress){
-            std::size_t totalNumReads = numReadsToProcess;
+            std::size_t totalNumReads = numAnchorsToProcess;
 
             printf("Processed %10u of %10lu reads (Runtime: %03d:%02d:%02d)\r",
                     totalCount, totalNumReads,
@@ -129,188 +200,287 @@ SerializedObjectStorage correct_cpu(
         return duration;
     };
 
-    ProgressThread<read_number> progressThread(numReadsToProcess, showProgress, updateShowProgressInterval);
+    ProgressThread<read_number> progressThread(numAnchorsToProcess, showProgress, updateShowProgressInterval);
+
+    //order in which anchors are processed. empty if anchors are processed in read id order
+    std::vector<read_number> anchorOrder;
 
-    #pragma omp parallel
-    {
-        //const int threadId = omp_get_thread_num();
+    if(programOptions.localityAwareAnchorOrder && resultStream == nullptr){
+        helpers::CpuTimer anchorOrderTimer("anchor_order");
 
-        ClfAgent clfAgent = clfAgent_;
-        const std::size_t encodedSequencePitchInInts2Bit = SequenceHelpers::getEncodedNumInts2Bit(readStorage.getSequenceLengthUpperBound());
-        const std::size_t decodedSequencePitchInBytes = readStorage.getSequenceLengthUpperBound();
-        const std::size_t qualityPitchInBytes = readStorage.getSequenceLengthUpperBound();
+        anchorOrder = makeLocalityAwareAnchorOrder(readStorage, numReadsToProcess, minhasher.getKmerSize(), programOptions.threads);
+
+        anchorOrderTimer.print();
+    }
+
+    const bool usePipeline = programOptions.correctionPipeline && !readStorage.isPairedEnd() && resultStream == nullptr
+        && processesAllReads;
+
+    if(programOptions.correctionPipeline && readStorage.isPairedEnd() && resultStream == nullptr){
+        std::cerr << "Pipelined correction is not available for paired-end reads. Using default correction.\n";
+    }
 
-        const int myBatchsize = std::max((readStorage.isPairedEnd() ? 2 : 1), programOptions.batchsize);
+    if(programOptions.correctionPipeline && !processesAllReads && resultStream == nullptr){
+        std::cerr << "Pipelined correction is not available for a read id range. Using default correction.\n";
+    }
 
-        CpuErrorCorrector errorCorrector(
-            encodedSequencePitchInInts2Bit,
-            decodedSequencePitchInBytes,
-            qualityPitchInBytes,
+    if(usePipeline){
+        CorrectionPipeline pipeline(
+            CorrectionPipeline::makeConfig(programOptions.threads, programOptions.pipelineGatherThreads, programOptions.batchsize),
             programOptions,
             minhasher,
             readStorage,
             correctionFlags,
-            clfAgent
+            clfAgent_
         );
 
-        std::vector<read_number> batchReadIds(myBatchsize);
-        std::vector<unsigned int> batchEncodedData(myBatchsize * encodedSequencePitchInInts2Bit);
-        std::vector<char> batchQualities(myBatchsize * qualityPitchInBytes);
-        std::vector<int> batchReadLengths(myBatchsize);    
-
-        while(!(readIdGenerator.empty())){
+        timingsOfAllThreads = pipeline.run(
+            numReadsToProcess,
+            anchorOrder,
+            partialResults,
+            candidateCorrectionAggregator.get(),
+            outputThread,
+            progressThread
+        );
+        rowCacheStatisticsOfAllThreads = pipeline.getCandidateRowCacheStatistics();
+    }else{
+        //reads of a pair must be processed in the same batch
+        const read_number schedulingAlignment = readStorage.isPairedEnd() ? 2 : 1;
+
+        WorkStealingScheduler<read_number> readIdScheduler(
+            firstAnchor,
+            lastAnchor,
+            programOptions.threads,
+            schedulingAlignment
+        );
 
-            batchReadIds.resize(myBatchsize);
+        //If corrections are streamed, batches are handed out in ascending order to all threads instead,
+        //so that only few batches of other threads need to be buffered until a batch can be released.
+        const read_number streamingBatchsize = SDIV(std::max(1, programOptions.batchsize), schedulingAlignment) * schedulingAlignment;
+        std::atomic<std::size_t> nextStreamingBatchBegin{firstAnchor};
 
-            readIdGenerator.process_next_n(
-                myBatchsize, 
-                [&](auto begin, auto end){
-                    auto readIdsEnd = std::copy(begin, end, batchReadIds.begin());
-                    batchReadIds.erase(readIdsEnd, batchReadIds.end());
-                }
-            );
+        auto getNextBatch = [&](int threadId, read_number maxBatchsize, read_number& batchBegin, read_number& batchEnd){
+            if(resultStream == nullptr){
+                return readIdScheduler.next(threadId, maxBatchsize, batchBegin, batchEnd);
+            }
 
-            if(batchReadIds.empty()){
-                continue;
+            const std::size_t begin = nextStreamingBatchBegin.fetch_add(streamingBatchsize);
+            if(begin >= lastAnchor){
+                return false;
             }
+            batchBegin = begin;
+            batchEnd = std::min(begin + streamingBatchsize, std::size_t(lastAnchor));
+            return true;
+        };
 
-            //collect input data of all reads in batch
+        #pragma omp parallel
+        {
+            const int threadId = omp_get_thread_num();
+            assert(threadId < readIdScheduler.getNumThreads());
 
-            readStorage.gatherSequenceLengths(
-                batchReadLengths.data(),
-                batchReadIds.data(),
-                batchReadIds.size()
-            );
+            ClfAgent clfAgent = clfAgent_;
+            const std::size_t encodedSequencePitchInInts2Bit = SequenceHelpers::getEncodedNumInts2Bit(readStorage.getSequenceLengthUpperBound());
+            const std::size_t decodedSequencePitchInBytes = readStorage.getSequenceLengthUpperBound();
+            const std::size_t qualityPitchInBytes = readStorage.getSequenceLengthUpperBound();
+
+            const int myBatchsize = std::max((readStorage.isPairedEnd() ? 2 : 1), programOptions.batchsize);
 
-            readStorage.gatherSequences(
-                batchEncodedData.data(),
+            CpuErrorCorrector errorCorrector(
                 encodedSequencePitchInInts2Bit,
-                batchReadIds.data(),
-                batchReadIds.size()
+                decodedSequencePitchInBytes,
+                qualityPitchInBytes,
+                programOptions,
+                minhasher,
+                readStorage,
+                correctionFlags,
+                clfAgent
             );
 
-            if(programOptions.useQualityScores){
-                readStorage.gatherQualities(
-                    batchQualities.data(),
-                    qualityPitchInBytes,
-                    batchReadIds.data(),
-                    batchReadIds.size()
-                );
+            std::vector<read_number> batchReadIds(myBatchsize);
+            std::vector<unsigned int> batchEncodedData(myBatchsize * encodedSequencePitchInInts2Bit);
+            std::vector<char> batchQualities(myBatchsize * qualityPitchInBytes);
+            std::vector<int> batchReadLengths(myBatchsize);    
+
+            //Corrections are serialized into these buffers which are then handed to the output thread.
+            //Two buffers per thread allow correction of the next batch while the previous one is saved.
+            std::array<SerializedCorrectionBatch, 2> correctionBatches;
+            SimpleMultiProducerMultiConsumerQueue<SerializedCorrectionBatch*> freeCorrectionBatches;
+            for(auto& batch : correctionBatches){
+                freeCorrectionBatches.push(&batch);
             }
 
-            CorrectionOutput correctionOutput;
+            read_number batchBegin = 0;
+            read_number batchEnd = 0;
 
-            if(readStorage.isPairedEnd()){
-                assert(batchReadIds.size() % 2 == 0);
+            while(getNextBatch(threadId, myBatchsize, batchBegin, batchEnd)){
 
-                CpuErrorCorrectorMultiInput input{};
-                input.anchorLengths.resize(batchReadIds.size());
-                input.anchorReadIds.resize(batchReadIds.size());
-                input.encodedAnchors.resize(batchReadIds.size());
-                input.anchorQualityscores.resize(batchReadIds.size());
-
-                for(size_t i = 0; i < batchReadIds.size(); i++){
-                    input.anchorReadIds[i] = batchReadIds[i];
-                    input.encodedAnchors[i] = batchEncodedData.data() + i * encodedSequencePitchInInts2Bit;
-                    input.anchorQualityscores[i] = batchQualities.data() + i * qualityPitchInBytes;
-                    input.anchorLengths[i] = batchReadLengths[i];
+                batchReadIds.resize(batchEnd - batchBegin);
+                if(anchorOrder.empty()){
+                    std::iota(batchReadIds.begin(), batchReadIds.end(), batchBegin);
+                }else{
+                    std::copy(anchorOrder.begin() + batchBegin, anchorOrder.begin() + batchEnd, batchReadIds.begin());
                 }
 
-                auto outputs = errorCorrector.processMulti(input);
+                //collect input data of all reads in batch
 
-                for(auto& output : outputs){
+                readStorage.gatherSequenceLengths(
+                    batchReadLengths.data(),
+                    batchReadIds.data(),
+                    batchReadIds.size()
+                );
 
-                    if(output.hasAnchorCorrection){
-                        correctionOutput.anchorCorrections.emplace_back(std::move(output.anchorCorrection));
-                    }
+                readStorage.gatherSequences(
+                    batchEncodedData.data(),
+                    encodedSequencePitchInInts2Bit,
+                    batchReadIds.data(),
+                    batchReadIds.size()
+                );
 
-                    for(auto& tmp : output.candidateCorrections){
-                        correctionOutput.candidateCorrections.emplace_back(std::move(tmp));
-                    }
+                if(programOptions.useQualityScores){
+                    readStorage.gatherQualities(
+                        batchQualities.data(),
+                        qualityPitchInBytes,
+                        batchReadIds.data(),
+                        batchReadIds.size()
+                    );
                 }
 
-            }else{
+                SerializedCorrectionBatch streamedCorrectionBatch;
+                SerializedCorrectionBatch* correctionBatch = nullptr;
 
-                for(size_t i = 0; i < batchReadIds.size(); i++){
-                    const read_number readId = batchReadIds[i];
-
-                    CpuErrorCorrectorInput input;
-                    input.anchorReadId = readId;
-                    input.encodedAnchor = batchEncodedData.data() + i * encodedSequencePitchInInts2Bit;
-                    input.anchorQualityscores = batchQualities.data() + i * qualityPitchInBytes;
-                    input.anchorLength = batchReadLengths[i];
-
-                    auto output = errorCorrector.process(input);
+                if(resultStream != nullptr){
+                    streamedCorrectionBatch = resultStream->getFreeBatch();
+                    correctionBatch = &streamedCorrectionBatch;
+                }else{
+                    //wait until a batch buffer of this thread is no longer used by the output thread
+                    correctionBatch = freeCorrectionBatches.pop();
+                    correctionBatch->clear();
+                }
 
+                auto appendToBatch = [&](const CpuErrorCorrectorOutput& output){
                     if(output.hasAnchorCorrection){
-                        correctionOutput.anchorCorrections.emplace_back(std::move(output.anchorCorrection));
+                        correctionBatch->append(output.anchorCorrection);
                     }
 
-                    for(auto& tmp : output.candidateCorrections){
-                        correctionOutput.candidateCorrections.emplace_back(std::move(tmp));
+                    for(const auto& tmp : output.candidateCorrections){
+                        if(candidateCorrectionAggregator){
+                            candidateCorrectionAggregator->add(tmp, *correctionBatch);
+                        }else{
+                            correctionBatch->append(tmp);
+                        }
                     }
-                }
-            }
+                };
 
-            EncodedCorrectionOutput encodedCorrectionOutput = correctionOutput;
+                if(readStorage.isPairedEnd()){
+                    assert(batchReadIds.size() % 2 == 0);
 
-            auto outputfunction = [
-                &, 
-                encodedCorrectionOutput = std::move(encodedCorrectionOutput)
-            ](){
-                std::vector<std::uint8_t> tempbuffer(256);
+                    CpuErrorCorrectorMultiInput input{};
+                    input.anchorLengths.resize(batchReadIds.size());
+                    input.anchorReadIds.resize(batchReadIds.size());
+                    input.encodedAnchors.resize(batchReadIds.size());
+                    input.anchorQualityscores.resize(batchReadIds.size());
 
-                auto saveEncodedCorrectedSequence = [&](const EncodedTempCorrectedSequence* encoded){
-                    if(!(encoded->isHQ() && encoded->useEdits() && encoded->getNumEdits() == 0)){
-                        const std::size_t serializedSize = encoded->getSerializedNumBytes();
-                        tempbuffer.resize(serializedSize);
+                    for(size_t i = 0; i < batchReadIds.size(); i++){
+                        input.anchorReadIds[i] = batchReadIds[i];
+                        input.encodedAnchors[i] = batchEncodedData.data() + i * encodedSequencePitchInInts2Bit;
+                        input.anchorQualityscores[i] = batchQualities.data() + i * qualityPitchInBytes;
+                        input.anchorLengths[i] = batchReadLengths[i];
+                    }
 
-                        auto end = encoded->copyToContiguousMemory(tempbuffer.data(), tempbuffer.data() + tempbuffer.size());
-                        assert(end != nullptr);
+                    auto outputs = errorCorrector.processMulti(input);
 
-                        partialResults.insert(tempbuffer.data(), end);
+                    for(const auto& output : outputs){
+                        appendToBatch(output);
                     }
-                };
 
-                const int numA = encodedCorrectionOutput.encodedAnchorCorrections.size();
-                const int numC = encodedCorrectionOutput.encodedCandidateCorrections.size();
+                }else{
 
-                for(int i = 0; i < numA; i++){
-                    saveEncodedCorrectedSequence(
-                        &encodedCorrectionOutput.encodedAnchorCorrections[i]
-                    );
+                    for(size_t i = 0; i < batchReadIds.size(); i++){
+                        const read_number readId = batchReadIds[i];
+
+                        CpuErrorCorrectorInput input;
+                        input.anchorReadId = readId;
+                        input.encodedAnchor = batchEncodedData.data() + i * encodedSequencePitchInInts2Bit;
+                        input.anchorQualityscores = batchQualities.data() + i * qualityPitchInBytes;
+                        input.anchorLength = batchReadLengths[i];
+
+                        auto output = errorCorrector.process(input);
+
+                        appendToBatch(output);
+                    }
                 }
 
-                for(int i = 0; i < numC; i++){
-                    saveEncodedCorrectedSequence(
-                        &encodedCorrectionOutput.encodedCandidateCorrections[i]
-                    );
+                //partial results refer to the original read ids
+                if(originalReadIds != nullptr){
+                    correctionBatch->mapReadIds(originalReadIds, originalReadIdOffsets);
                 }
-            };
 
-            outputThread.enqueue(std::move(outputfunction));
+                if(resultStream != nullptr){
+                    resultStream->push(batchBegin, batchEnd, std::move(streamedCorrectionBatch));
+                }else{
+                    auto outputfunction = [&, correctionBatch](){
+                        const std::size_t num = correctionBatch->size();
 
-            clfAgent.flush();
+                        for(std::size_t i = 0; i < num; i++){
+                            partialResults.insert(
+                                correctionBatch->getSerializedBegin(i), 
+                                correctionBatch->getSerializedEnd(i)
+                            );
+                        }
 
-            progressThread.addProgress(batchReadIds.size()); 
+                        freeCorrectionBatches.push(correctionBatch);
+                    };
 
-            // if(omp_get_thread_num() == 0){
-            //     std::cerr << "getCandidatesTimeTotal: " << errorCorrector.getTimings().getCandidatesTimeTotal.count() << "\n";
-            // }
+                    outputThread.enqueue(std::move(outputfunction));
+                }
+
+                clfAgent.flush();
+
+                progressThread.addProgress(batchReadIds.size()); 
+
+                // if(omp_get_thread_num() == 0){
+                //     std::cerr << "getCandidatesTimeTotal: " << errorCorrector.getTimings().getCandidatesTimeTotal.count() << "\n";
+                // }
             
-        } //while unprocessed reads exist loop end   
+            } //while unprocessed reads exist loop end   
 
-        #pragma omp critical
-        {
-            timingsOfAllThreads += errorCorrector.getTimings();            
-        }
+            //the output thread must not access the batch buffers after they go out of scope
+            for(std::size_t i = 0; i < correctionBatches.size(); i++){
+                freeCorrectionBatches.pop();
+            }
+
+            #pragma omp critical
+            {
+                timingsOfAllThreads += errorCorrector.getTimings();            
+                rowCacheStatisticsOfAllThreads += errorCorrector.getCandidateRowCacheStatistics();
+            }
 
-    } // parallel end
+        } // parallel end
+
+        if(resultStream == nullptr){
+            //statistics per thread only with ENABLE_CPU_CORRECTOR_TIMING
+            #ifdef ENABLE_CPU_CORRECTOR_TIMING
+            readIdScheduler.printStatistics(std::cout, true);
+            #else
+            readIdScheduler.printStatistics(std::cout, false);
+            #endif
+        }
+    }
 
     progressThread.finished();
 
+    if(programOptions.candidateRowCacheSize > 0){
+        rowCacheStatisticsOfAllThreads.print(std::cout);
+    }
+
     outputThread.stopThread(BackgroundThread::StopType::FinishAndStop);
 
+    if(candidateCorrectionAggregator){
+        candidateCorrectionAggregator->moveToPartialResults(partialResults, correctionFlags, originalReadIds, originalReadIdOffsets);
+        candidateCorrectionAggregator->printStatistics(std::cout);
+        candidateCorrectionAggregator.reset();
+    }
+
     #ifdef ENABLE_CPU_CORRECTOR_TIMING
 
     auto totalDurationOfThreads = timingsOfAllThreads.getSumOfDurations();
@@ -5,6 +5,10 @@
 
 #include <hpc_helpers.cuh>
 #include <serializedobjectstorage.hpp>
+#include <externalsortserializedresults.hpp>
+#include <orderedcorrectionresultstream.hpp>
+#include <chunkedreadstorage.hpp>
+#include <readheaderstorage.hpp>
 #include <readlibraryio.hpp>
 #include <threadpool.hpp>
 #include <concurrencyhelpers.hpp>
@@ -12,6 +16,8 @@
 
 #include <cstdint>
 #include <cstring>
+#include <exception>
+#include <limits>
 #include <fstream>
 #include <memory>
 #include <string>
@@ -26,25 +32,99 @@
 
 namespace care{
 
+//sequential access to the serialized results of a SerializedObjectStorage which is sorted by read id
+class SerializedObjectStorageReader{
+public:
+    SerializedObjectStorageReader(const SerializedObjectStorage& storage_) : storage(&storage_){}
 
-template<class ResultType, class Combiner, class ProgressFunction>
+    bool empty() const noexcept{
+        return storage->size() == 0;
+    }
+
+    const std::uint8_t* next(){
+        if(nextIndex < storage->size()){
+            return storage->getPointer(nextIndex++);
+        }else{
+            return nullptr;
+        }
+    }
+
+private:
+    std::size_t nextIndex = 0;
+    const SerializedObjectStorage* storage{};
+};
+
+//batches of decoded results and of original reads which are in flight during output construction
+constexpr int outputNumBatchesInFlight = 4;
+constexpr int decoder_maxbatchsize = 100000;
+constexpr int inputreader_maxbatchsize = 200000;
+static_assert(inputreader_maxbatchsize % 2 == 0);
+
+//header bytes per read which are assumed for the working memory of output construction
+constexpr std::size_t outputEstimatedHeaderBytes = 128;
+
+//at most 4 MB per run, and at most 256 MB in total unless there are more than 4096 runs
+std::size_t getMergeBufferBytesPerRun(std::size_t numRuns){
+    return std::max(
+        std::size_t(64) << 10,
+        std::min(std::size_t(4) << 20, (std::size_t(256) << 20) / std::max(std::size_t(1), numRuns))
+    );
+}
+
+std::size_t getOutputConstructionWorkingMemoryInBytes(int maximumSequenceLength, int numThreads){
+    const std::size_t maxLength = std::max(0, maximumSequenceLength);
+
+    const std::size_t resultBatchBytes = decoder_maxbatchsize * (sizeof(TempCorrectedSequence) + maxLength);
+    const std::size_t readBatchBytes = inputreader_maxbatchsize * (sizeof(ReadWithId) + 2 * maxLength + outputEstimatedHeaderBytes);
+    //merge buffers of sorted runs. more than 256 MB only with more than 4096 runs
+    const std::size_t mergeBufferBytes = std::size_t(256) << 20;
+    //buffers of compressed output
+    const std::size_t writerBytes = std::size_t(std::max(1, numThreads)) * (std::size_t(1) << 20);
+
+    return outputNumBatchesInFlight * (resultBatchBytes + readBatchBytes) + mergeBufferBytes + writerBytes;
+}
+
+/*
+    ResultSource provides the serialized results in ascending read id order:
+    bool ResultSource::empty(), const std::uint8_t* ResultSource::next() which returns nullptr after the last result
+
+    If storedReads contains read headers, the original reads are restored from storedReads instead of parsing originalReadFiles
+
+    Only the reads [readIdBegin, readIdEnd) are written to the output files. Results of other reads are ignored
+*/
+template<class ResultType, class ResultSource, class Combiner, class ProgressFunction>
 void mergeSerializedResultsWithOriginalReads_multithreaded(
     const std::vector<std::string>& originalReadFiles,
-    SerializedObjectStorage& partialResults, 
+    ResultSource& partialResults, 
     FileFormat outputFormat,
     const std::vector<std::string>& outputfiles,
     Combiner combineResultsWithRead, /* combineResultsWithRead(std::vector<ResultType>& in, ReadWithId& in_out) */
     ProgressFunction addProgress,
     bool outputCorrectionQualityLabels,
-    SequencePairType pairType
+    SequencePairType pairType,
+    int numThreads,
+    const ChunkedReadStorage* storedReads,
+    read_number readIdBegin,
+    read_number readIdEnd
 ){
     assert(outputfiles.size() == 1 || originalReadFiles.size() == outputfiles.size());
 
-    if(partialResults.getNumElements() == 0){
+    //threads for compressed output are shared by the output files
+    const int numCompressionThreadsPerFile = std::max(1, numThreads / int(outputfiles.size()));
+
+    const bool useStoredReads = storedReads != nullptr && storedReads->getReadHeaderStorage() != nullptr;
+
+    const bool allReads = readIdBegin == 0 && readIdEnd == std::numeric_limits<read_number>::max();
+
+    auto isInRange = [&](read_number readId){
+        return readIdBegin <= readId && readId < readIdEnd;
+    };
+
+    if(partialResults.empty() && !useStoredReads && allReads){
         if(outputfiles.size() == 1){
             if(pairType == SequencePairType::SingleEnd 
                 || (pairType == SequencePairType::PairedEnd && originalReadFiles.size() == 1)){
-                auto filewriter = makeSequenceWriter(outputfiles[0], outputFormat);
+                auto filewriter = makeSequenceWriter(outputfiles[0], outputFormat, numCompressionThreadsPerFile);
 
                 MultiInputReader reader(originalReadFiles);
                 while(reader.next() >= 0){
@@ -54,7 +134,7 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
             }else{
                 assert(pairType == SequencePairType::PairedEnd);
                 assert(originalReadFiles.size() == 2);
-                auto filewriter = makeSequenceWriter(outputfiles[0], outputFormat);
+                auto filewriter = makeSequenceWriter(outputfiles[0], outputFormat, numCompressionThreadsPerFile);
 
                 //merged output
                 forEachReadInPairedFiles(originalReadFiles[0], originalReadFiles[1], 
@@ -66,7 +146,7 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
         }else{
             const int numFiles = outputfiles.size();
             for(int i = 0; i < numFiles; i++){
-                auto filewriter = makeSequenceWriter(outputfiles[i], outputFormat);
+                auto filewriter = makeSequenceWriter(outputfiles[i], outputFormat, numCompressionThreadsPerFile);
 
                 forEachReadInFile(originalReadFiles[i], 
                     [&](auto /*readnumber*/, const auto& read){
@@ -87,7 +167,7 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
         std::vector<ResultType> items;
     };
 
-    std::array<ResultTypeBatch, 4> tcsBatches;
+    std::array<ResultTypeBatch, outputNumBatchesInFlight> tcsBatches;
 
     SimpleSingleProducerSingleConsumerQueue<ResultTypeBatch*> freeTcsBatches;
     SimpleSingleProducerSingleConsumerQueue<ResultTypeBatch*> unprocessedTcsBatches;
@@ -96,7 +176,6 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
         freeTcsBatches.push(&batch);
     }
 
-    constexpr int decoder_maxbatchsize = 100000;
 
     auto decoderFuture = std::async(std::launch::async,
         [&](){
@@ -108,8 +187,9 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
 
             read_number previousId = 0;
             std::size_t itemnumber = 0;
+            const std::uint8_t* serializedPtr = partialResults.next();
 
-            while(itemnumber < partialResults.size()){
+            while(serializedPtr != nullptr){
                 ResultTypeBatch* batch = freeTcsBatches.pop();
 
                 //abegin = std::chrono::system_clock::now();
@@ -117,11 +197,15 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
                 batch->items.resize(decoder_maxbatchsize);
 
                 int batchsize = 0;
-                while(batchsize < decoder_maxbatchsize && itemnumber < partialResults.size()){
-                    const std::uint8_t* serializedPtr = partialResults.getPointer(itemnumber);
+                while(batchsize < decoder_maxbatchsize && serializedPtr != nullptr){
                     EncodedTempCorrectedSequence etcs;
                     etcs.copyFromContiguousMemory(serializedPtr);
 
+                    if(!isInRange(etcs.readId)){
+                        serializedPtr = partialResults.next();
+                        continue;
+                    }
+
                     batch->items[batchsize].decode(etcs);
 
                     if(batch->items[batchsize].readId < previousId){
@@ -131,11 +215,19 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
                     previousId = batch->items[batchsize].readId;
                     batchsize++;
                     itemnumber++;
+
+                    serializedPtr = partialResults.next();
                 }
 
                 // aend = std::chrono::system_clock::now();
                 // adelta += aend - abegin;
 
+                //the remaining results were out of range
+                if(batchsize == 0){
+                    freeTcsBatches.push(batch);
+                    break;
+                }
+
                 batch->processedItems = 0;
                 batch->validItems = batchsize;
 
@@ -157,7 +249,7 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
         std::vector<ReadWithId> items;
     };
 
-    std::array<ReadBatch, 4> readBatches;
+    std::array<ReadBatch, outputNumBatchesInFlight> readBatches;
 
     // free -> unprocessed input -> unprocessed output -> free -> ...
     SimpleSingleProducerSingleConsumerQueue<ReadBatch*> freeReadBatches;
@@ -166,13 +258,34 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
 
     std::atomic<bool> noMoreInputreadBatches{false};
 
-    constexpr int inputreader_maxbatchsize = 200000;
-    static_assert(inputreader_maxbatchsize % 2 == 0);
 
     for(auto& batch : readBatches){
         freeReadBatches.push(&batch);
     }
 
+    //advances reader to the next read in range. returns false if there is none
+    auto nextInRange = [&](auto& reader, auto getCurrentReadId){
+        while(reader.next() >= 0){
+            const read_number readId = getCurrentReadId(reader);
+            if(readId >= readIdEnd){
+                return false;
+            }
+            if(readId >= readIdBegin){
+                return true;
+            }
+        }
+        return false;
+    };
+
+    //pairs are never split by the range, readIdBegin and readIdEnd are even
+    auto nextPairInRange = [&](PairedInputReader& reader){
+        return nextInRange(reader, [](auto& r){ return read_number(r.getCurrent1().globalReadId); });
+    };
+
+    auto nextSingleInRange = [&](auto& reader){
+        return nextInRange(reader, [](auto& r){ return read_number(r.getCurrent().globalReadId); });
+    };
+
     auto pairedEndReaderFunc = [&](){
         PairedInputReader pairedInputReader(originalReadFiles);
 
@@ -181,7 +294,7 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
         // std::chrono::time_point<std::chrono::system_clock> abegin, aend;
         // std::chrono::duration<double> adelta{0};
 
-        while(pairedInputReader.next() >= 0){
+        while(nextPairInRange(pairedInputReader)){
 
             ReadBatch* batch = freeReadBatches.pop();
 
@@ -193,7 +306,7 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
             std::swap(batch->items[1], pairedInputReader.getCurrent2()); //process element from outer loop next() call
             int batchsize = 2;
 
-            while(batchsize < inputreader_maxbatchsize && pairedInputReader.next() >= 0){
+            while(batchsize < inputreader_maxbatchsize && nextPairInRange(pairedInputReader)){
                 std::swap(batch->items[batchsize], pairedInputReader.getCurrent1());                
                 batchsize++;
                 std::swap(batch->items[batchsize], pairedInputReader.getCurrent2());        
@@ -216,15 +329,13 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
         // TIMERSTOPCPU(inputparsing);
     };
 
-    auto singleEndReaderFunc = [&](){
-        MultiInputReader multiInputReader(originalReadFiles);
-
+    auto singleEndReaderFunc = [&](auto& multiInputReader){
         // TIMERSTARTCPU(inputparsing);
 
         // std::chrono::time_point<std::chrono::system_clock> abegin, aend;
         // std::chrono::duration<double> adelta{0};
 
-        while(multiInputReader.next() >= 0){
+        while(nextSingleInRange(multiInputReader)){
             ReadBatch* batch = freeReadBatches.pop();
 
             // abegin = std::chrono::system_clock::now();
@@ -234,7 +345,7 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
             std::swap(batch->items[0], multiInputReader.getCurrent()); //process element from outer loop next() call
             int batchsize = 1;
 
-            while(batchsize < inputreader_maxbatchsize && multiInputReader.next() >= 0){
+            while(batchsize < inputreader_maxbatchsize && nextSingleInRange(multiInputReader)){
                 std::swap(batch->items[batchsize], multiInputReader.getCurrent());
                 
                 batchsize++;
@@ -257,8 +368,19 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
 
     auto inputReaderFuture = std::async(std::launch::async,
         [&](){
-            if(pairType == SequencePairType::SingleEnd){
-                singleEndReaderFunc();
+            if(useStoredReads){
+                //reads of both pair types are stored in read id order
+                const bool withQualityScores = outputFormat == FileFormat::FASTQ || outputFormat == FileFormat::FASTQGZ;
+                StoredReadsInputReader storedReadsReader(
+                    *storedReads, 
+                    *storedReads->getReadHeaderStorage(), 
+                    withQualityScores, 
+                    storedReads->getInternalReadIds()
+                );
+                singleEndReaderFunc(storedReadsReader);
+            }else if(pairType == SequencePairType::SingleEnd){
+                MultiInputReader multiInputReader(originalReadFiles);
+                singleEndReaderFunc(multiInputReader);
             }else{
                 assert(pairType == SequencePairType::PairedEnd);
                 pairedEndReaderFunc();
@@ -273,7 +395,7 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
             assert(originalReadFiles.size() == outputfiles.size() || outputfiles.size() == 1);
 
             for(const auto& outputfile : outputfiles){
-                writerVector.emplace_back(makeSequenceWriter(outputfile, outputFormat));
+                writerVector.emplace_back(makeSequenceWriter(outputfile, outputFormat, numCompressionThreadsPerFile));
             }
 
             const int numOutputfiles = outputfiles.size();
@@ -283,6 +405,9 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
             // std::chrono::time_point<std::chrono::system_clock> abegin, aend;
             // std::chrono::duration<double> adelta{0};
 
+            //after a write error, the remaining batches are only returned, so that the other stages can finish
+            std::exception_ptr writeError;
+
             ReadBatch* outputBatch = unprocessedOutputreadBatches.pop();
 
             while(outputBatch != nullptr){                
@@ -291,12 +416,16 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
                 
                 int processed = outputBatch->processedItems;
                 const int valid = outputBatch->validItems;
-                while(processed < valid){
+                while(processed < valid && !writeError){
                     const auto& readWithId = outputBatch->items[processed];
                     const int writerIndex = numOutputfiles == 1 ? 0 : readWithId.fileId;
                     assert(writerIndex < numOutputfiles);
 
-                    writerVector[writerIndex]->writeRead(readWithId.read);
+                    try{
+                        writerVector[writerIndex]->writeRead(readWithId.read);
+                    }catch(...){
+                        writeError = std::current_exception();
+                    }
 
                     processed++;
                 }
@@ -318,6 +447,10 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
             // std::cout << "# elapsed time ("<< "outputwriting without queues" <<"): " << adelta.count()  << " s" << std::endl;
 
             // TIMERSTOPCPU(outputwriting);
+
+            if(writeError){
+                std::rethrow_exception(writeError);
+            }
         }
     );
 
@@ -434,7 +567,7 @@ void mergeSerializedResultsWithOriginalReads_multithreaded(
 
     decoderFuture.wait();
     inputReaderFuture.wait();
-    outputWriterFuture.wait();
+    outputWriterFuture.get();
 
     // std::cout << "\n";
 
@@ -1030,7 +1163,94 @@ void constructOutputFileFromCorrectionResults(
     FileFormat outputFormat,
     const std::vector<std::string>& outputfiles,
     bool showProgress,
-    const ProgramOptions& programOptions
+    const ProgramOptions& programOptions,
+    const ChunkedReadStorage* storedReads
+){
+
+    auto addProgress = [total = 0ull, showProgress](auto i) mutable {
+        if(showProgress){
+            total += i;
+
+            printf("Written %10llu reads\r", total);
+
+            std::cout.flush();
+        }
+    };
+
+    SerializedObjectStorageReader resultSource(partialResults);
+
+    mergeSerializedResultsWithOriginalReads_multithreaded<TempCorrectedSequence>(
+        originalReadFiles,
+        resultSource, 
+        outputFormat,
+        outputfiles,
+        combineMultipleCorrectionResults1_rawtcs2,
+        addProgress,
+        programOptions.outputCorrectionQualityLabels,
+        programOptions.pairType,
+        programOptions.threads,
+        storedReads,
+        programOptions.readIdRangeBegin,
+        programOptions.readIdRangeEnd
+    );
+
+    if(showProgress){
+        std::cout << "\n";
+    }
+}
+
+void constructOutputFileFromCorrectionResults(
+    const std::vector<std::string>& originalReadFiles,
+    const SortedSerializedRuns& sortedRuns, 
+    FileFormat outputFormat,
+    const std::vector<std::string>& outputfiles,
+    bool showProgress,
+    const ProgramOptions& programOptions,
+    const ChunkedReadStorage* storedReads
+){
+
+    auto addProgress = [total = 0ull, showProgress](auto i) mutable {
+        if(showProgress){
+            total += i;
+
+            printf("Written %10llu reads\r", total);
+
+            std::cout.flush();
+        }
+    };
+
+    const std::size_t mergeBufferBytesPerRun = getMergeBufferBytesPerRun(sortedRuns.getNumRuns());
+
+    SortedSerializedRunsMerger<EncodedTempCorrectedSequence> resultSource(sortedRuns, mergeBufferBytesPerRun);
+
+    mergeSerializedResultsWithOriginalReads_multithreaded<TempCorrectedSequence>(
+        originalReadFiles,
+        resultSource, 
+        outputFormat,
+        outputfiles,
+        combineMultipleCorrectionResults1_rawtcs2,
+        addProgress,
+        programOptions.outputCorrectionQualityLabels,
+        programOptions.pairType,
+        programOptions.threads,
+        storedReads,
+        programOptions.readIdRangeBegin,
+        programOptions.readIdRangeEnd
+    );
+
+    if(showProgress){
+        std::cout << "\n";
+    }
+}
+
+void constructOutputFileFromCorrectionResults(
+    const std::vector<std::string>& originalReadFiles,
+    OrderedCorrectionResultStream& resultStream, 
+    FileFormat outputFormat,
+    const std::vector<std::string>& outputfiles,
+    bool showProgress,
+    const ProgramOptions& programOptions,
+    const ChunkedReadStorage* storedReads
 ){
 
     auto addProgress = [total = 0ull, showProgress](auto i) mutable {
@@ -1045,13 +1265,17 @@ void constructOutputFileFromCorrectionResults(
 
     mergeSerializedResultsWithOriginalReads_multithreaded<TempCorrectedSequence>(
         originalReadFiles,
-        partialResults, 
+        resultStream, 
         outputFormat,
         outputfiles,
         combineMultipleCorrectionResults1_rawtcs2,
         addProgress,
         programOptions.outputCorrectionQualityLabels,
-        programOptions.pairType
+        programOptions.pairType,
+        programOptions.threads,
+        storedReads,
+        programOptions.readIdRangeBegin,
+        programOptions.readIdRangeEnd
     );
 
     if(showProgress){
@@ -27,6 +27,7 @@ namespace care{
     void constructCpuMinhasherFromReadStorage(
         const ProgramOptions& programOptions,
         const CpuReadStorage& cpuReadStorage,
+        const MemoryBudget& memoryBudget,
         CpuMinhasher* cpuMinhasher
     ){
         auto& readStorage = cpuReadStorage;
@@ -40,24 +41,13 @@ namespace care{
         constexpr read_number batchsize = 1000000;
         const int numBatches = SDIV(numReads, batchsize);
 
-        const MemoryUsage memoryUsageOfReadStorage = readStorage.getMemoryInfo();
-        std::size_t totalLimit = programOptions.memoryTotalLimit;
-        if(totalLimit > memoryUsageOfReadStorage.host){
-            totalLimit -= memoryUsageOfReadStorage.host;
-        }else{
-            totalLimit = 0;
-        }
-        if(totalLimit == 0){
+        //the read storage is accounted in memoryBudget
+        const std::size_t availableMemory = memoryBudget.getAvailableBytes();
+        if(availableMemory == 0){
             throw std::runtime_error("Not enough memory available for hash tables. Abort!");
         }
-        std::size_t maxMemoryForTables = getAvailableMemoryInKB() * 1024;
-        // std::cerr << "available: " << maxMemoryForTables 
-        //         << ",memoryForHashtables: " << programOptions.memoryForHashtables
-        //         << ", memoryTotalLimit: " << programOptions.memoryTotalLimit
-        //         << ", rsHostUsage: " << memoryUsageOfReadStorage.host << "\n";
 
-        maxMemoryForTables = std::min(maxMemoryForTables, 
-                                std::min(programOptions.memoryForHashtables, totalLimit));
+        const std::size_t maxMemoryForTables = std::min(availableMemory, programOptions.memoryForHashtables);
 
         std::cerr << "maxMemoryForTables = " << maxMemoryForTables << " bytes\n";
 
@@ -169,6 +159,7 @@ namespace care{
     constructCpuMinhasherFromCpuReadStorage(
         const ProgramOptions& programOptions,
         const CpuReadStorage& cpuReadStorage,
+        const MemoryBudget& memoryBudget,
         CpuMinhasherType requestedType
     ){
         std::unique_ptr<CpuMinhasher> cpuMinhasher;
@@ -194,16 +185,18 @@ namespace care{
 
         if(programOptions.load_hashtables_from != "" && cpuMinhasher->canLoadFromStream()){
 
-            std::ifstream is(programOptions.load_hashtables_from);
-            assert((bool)is);
-
-            const int loadedMaps = cpuMinhasher->loadFromStream(is, programOptions.numHashFunctions);
+            const int loadedMaps = cpuMinhasher->loadFromFile(
+                programOptions.load_hashtables_from, 
+                programOptions.numHashFunctions, 
+                cpuReadStorage.getNumberOfReads()
+            );
 
             std::cout << "Loaded " << loadedMaps << " hash tables from " << programOptions.load_hashtables_from << std::endl;
         }else{
             constructCpuMinhasherFromReadStorage(
                 programOptions,
                 cpuReadStorage,
+                memoryBudget,
                 cpuMinhasher.get()
             );
         }
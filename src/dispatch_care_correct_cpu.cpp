@@ -16,9 +16,12 @@
 #include <sortserializedresults.hpp>
 #include <chunkedreadstorageconstruction.hpp>
 #include <chunkedreadstorage.hpp>
+#include <anchororder.hpp>
+#include <memorybudget.hpp>
 
 #include <contiguousreadstorage.hpp>
 #include <vector>
+#include <future>
 #include <iostream>
 #include <mutex>
 #include <thread>
@@ -56,10 +59,18 @@ namespace care{
 
         std::cout << "STEP 1: Database construction" << std::endl;
 
+        MemoryBudget memoryBudget(programOptions.memoryTotalLimit);
+
+        memoryBudget.beginStage("build_readstorage");
+
         helpers::CpuTimer buildReadStorageTimer("build_readstorage");
 
         std::unique_ptr<ChunkedReadStorage> cpuReadStorage = constructChunkedReadStorageFromFiles(programOptions);
 
+        auto readStorageBudget = memoryBudget.registerComponent("reads", [&](){
+            return cpuReadStorage ? cpuReadStorage->getMemoryInfo().host : 0;
+        });
+
         buildReadStorageTimer.print();
 
         std::cout << "Determined the following read properties:\n";
@@ -93,6 +104,49 @@ namespace care{
             std::cout << "Will use k-mer length = " << programOptions.kmerlength << " for hashing.\n";
         }
 
+        if(programOptions.collapseDuplicateReads){
+            if(cpuReadStorage->isPairedEnd()){
+                std::cerr << "Duplicate reads cannot be collapsed for paired-end reads.\n";
+            }else{
+                helpers::CpuTimer collapseTimer("collapse_duplicate_reads");
+
+                cpuReadStorage = ChunkedReadStorage::collapseDuplicateReads(
+                    std::move(cpuReadStorage), 
+                    memoryBudget.getLimit(), 
+                    programOptions.threads
+                );
+
+                collapseTimer.print();
+            }
+        }
+
+        if(programOptions.reorderReads){
+            helpers::CpuTimer reorderTimer("reorder_reads");
+
+            const std::vector<read_number> newOrder = makeLocalityAwareAnchorOrder(
+                *cpuReadStorage, 
+                cpuReadStorage->getNumberOfReads(), 
+                programOptions.kmerlength, 
+                programOptions.threads
+            );
+            cpuReadStorage = ChunkedReadStorage::reorderReads(
+                std::move(cpuReadStorage), 
+                newOrder, 
+                memoryBudget.getLimit(), 
+                programOptions.threads
+            );
+
+            reorderTimer.print();
+        }
+
+        if(programOptions.compressQualityScores && programOptions.useQualityScores){
+            helpers::CpuTimer compressTimer("compress_quality_scores");
+
+            cpuReadStorage->compressQualities(programOptions.threads);
+
+            compressTimer.print();
+        }
+
         std::cout << "Reads with ambiguous bases: " << cpuReadStorage->getNumberOfReadsWithN() << std::endl;        
 
         printDataStructureMemoryUsage(*cpuReadStorage, "reads");
@@ -100,14 +154,21 @@ namespace care{
         //compareMaxRssToLimit(programOptions.memoryTotalLimit, "Error memorylimit after cpureadstorage");
 
 
+        memoryBudget.beginStage("build_minhasher");
+
         helpers::CpuTimer buildMinhasherTimer("build_minhasher");
 
         auto minhasherAndType = constructCpuMinhasherFromCpuReadStorage(
             programOptions,
             *cpuReadStorage,
+            memoryBudget,
             CpuMinhasherType::Ordinary
         );
 
+        auto minhasherBudget = memoryBudget.registerComponent("hash tables", [&](){
+            return minhasherAndType.first ? minhasherAndType.first->getMemoryInfo().host : 0;
+        });
+
         //compareMaxRssToLimit(programOptions.memoryTotalLimit, "Error memorylimit after cpuminhasher");
 
 
@@ -149,97 +210,258 @@ namespace care{
 
         }
 
+        if(programOptions.publishIndexTo != ""){
+            //correction processes map these files. if they are located in a tmpfs like /dev/shm, all processes share the same memory
+            OrdinaryCpuMinhasher* ordinaryCpuMinhasher = dynamic_cast<OrdinaryCpuMinhasher*>(cpuMinhasher);
+            if(ordinaryCpuMinhasher == nullptr){
+                std::cout << "Cannot publish hash tables of type " << to_string(minhasherAndType.second) << ". Abort!" << std::endl;
+                return;
+            }
+
+            const std::string readsFilename = programOptions.publishIndexTo + ".reads";
+            const std::string hashtablesFilename = programOptions.publishIndexTo + ".hashtables";
+
+            helpers::CpuTimer timer("publish_index");
+            cpuReadStorage->saveToFile(readsFilename);
+            ordinaryCpuMinhasher->saveToMappableFile(hashtablesFilename, cpuReadStorage->getNumberOfReads());
+            timer.print();
+
+            std::cout << "Published reads to " << readsFilename << " and hash tables to " << hashtablesFilename << "\n";
+            std::cout << "Run correction processes with --load-preprocessedreads-from " << readsFilename 
+                << " --load-hashtables-from " << hashtablesFilename << std::endl;
+
+            step1Timer.print();
+
+            memoryBudget.printStageReport(std::cout);
+
+            return;
+        }
+
         printDataStructureMemoryUsage(*cpuMinhasher, "hash tables");
 
         step1Timer.print();
 
+        std::vector<FileFormat> formats;
+        for(const auto& inputfile : programOptions.inputfiles){
+            formats.emplace_back(getFileFormat(inputfile));
+        }
+        std::vector<std::string> outputfiles;
+        for(const auto& outputfilename : programOptions.outputfilenames){
+            outputfiles.emplace_back(programOptions.outputdirectory + "/" + outputfilename);
+        }
+        FileFormat outputFormat = formats[0];
+        if(programOptions.gzoutput){
+            if(outputFormat == FileFormat::FASTQ){
+                outputFormat = FileFormat::FASTQGZ;
+            }else if(outputFormat == FileFormat::FASTA){
+                outputFormat = FileFormat::FASTAGZ;
+            }
+        }else{
+            if(outputFormat == FileFormat::FASTQGZ){
+                outputFormat = FileFormat::FASTQ;
+            }else if(outputFormat == FileFormat::FASTAGZ){
+                outputFormat = FileFormat::FASTA;
+            }
+        }
+
+        const bool constructOutput = programOptions.correctionType != CorrectionType::Print 
+            && programOptions.correctionTypeCands != CorrectionType::Print;
+
+        //without candidate correction, each read has at most one correction, which is produced in read id order.
+        //the output can be constructed during correction without storing and sorting the corrections
+        const bool useStreamingOutput = programOptions.streamingOutput && constructOutput 
+            && !programOptions.correctCandidates 
+            && !programOptions.localityAwareAnchorOrder 
+            && !programOptions.reorderReads
+            && !programOptions.collapseDuplicateReads
+            && !programOptions.correctionPipeline;
+
+        if(programOptions.streamingOutput && !useStreamingOutput){
+            std::cerr << "Streaming output cannot be used with the selected options. Corrections will be sorted.\n";
+        }
+
+        //the read storage may be destroyed before the output is constructed
+        const int maximumSequenceLength = cpuReadStorage->getSequenceLengthUpperBound();
+
+        //if the read storage contains the read headers, it is kept until the output has been constructed,
+        //and the input files are not parsed again
+        const bool outputFromStoredReads = constructOutput && cpuReadStorage->getReadHeaderStorage() != nullptr;
+
+        if(useStreamingOutput){
+            std::cout << "STEP 2: Error correction" << std::endl;
+            std::cout << "STEP 3: Constructing output file(s) during correction" << std::endl;
+
+            helpers::CpuTimer step2Timer("STEP2+STEP3");
+
+            memoryBudget.beginStage("correction_and_output");
+
+            OrderedCorrectionResultStream resultStream(
+                4 * programOptions.threads, 
+                std::min(programOptions.readIdRangeBegin, read_number(getNumReadsToProcess(cpuReadStorage.get(), programOptions)))
+            );
+
+            auto outputFuture = std::async(std::launch::async, [&](){
+                constructOutputFileFromCorrectionResults(
+                    programOptions.inputfiles, 
+                    resultStream, 
+                    outputFormat,
+                    outputfiles,
+                    programOptions.showProgress,
+                    programOptions,
+                    outputFromStoredReads ? cpuReadStorage.get() : nullptr
+                );
+            });
+
+            try{
+                cpu::correct_cpu(
+                    programOptions, 
+                    *cpuMinhasher, 
+                    *cpuReadStorage,
+                    memoryBudget,
+                    &resultStream
+                );
+            }catch(...){
+                resultStream.finish();
+                outputFuture.wait();
+                throw;
+            }
+
+            resultStream.finish();
+
+            std::cerr << "Constructed " << resultStream.getNumPushedCorrections() << " corrections.\n";
+
+            minhasherAndType.first.reset();
+            cpuMinhasher = nullptr;        
+            if(!outputFromStoredReads){
+                cpuReadStorage.reset();
+            }
+
+            outputFuture.get();
+
+            step2Timer.print();
+
+            std::cout << "Construction of output file(s) finished." << std::endl;
+
+            memoryBudget.printStageReport(std::cout);
+
+            return;
+        }
+
         std::cout << "STEP 2: Error correction" << std::endl;
 
         helpers::CpuTimer step2Timer("STEP2");
 
+        memoryBudget.beginStage("correction");
+
         auto partialResults = cpu::correct_cpu(
             programOptions, 
             *cpuMinhasher, 
-            *cpuReadStorage
+            *cpuReadStorage,
+            memoryBudget
         );
 
+        auto partialResultsBudget = memoryBudget.registerComponent("partial results", [&](){
+            return partialResults.getMemoryInfo().host;
+        });
+
         step2Timer.print();
 
         std::cout << "Correction throughput : ~" << (cpuReadStorage->getNumberOfReads() / step2Timer.elapsed()) << " reads/second.\n";
 
         std::cerr << "Constructed " << partialResults.size() << " corrections. ";
-        std::cerr << "They occupy a total of " << (partialResults.dataBytes() + partialResults.offsetBytes()) << " bytes\n";
+        std::cerr << "They occupy a total of " << (partialResults.dataBytes() + partialResults.offsetBytes()) << " bytes";
+        if(partialResults.isBlockCompressed()){
+            std::cerr << " (" << partialResults.uncompressedDataBytes() << " bytes of uncompressed data)";
+        }
+        std::cerr << "\n";
 
         //compareMaxRssToLimit(programOptions.memoryTotalLimit, "Error memorylimit after correction");
 
         minhasherAndType.first.reset();
         cpuMinhasher = nullptr;        
-        cpuReadStorage.reset();
+        if(!outputFromStoredReads){
+            cpuReadStorage.reset();
+        }
 
-        if(programOptions.correctionType != CorrectionType::Print && programOptions.correctionTypeCands != CorrectionType::Print){
+        if(constructOutput){
 
             //Merge corrected reads with input file to generate output file
 
-            const std::size_t availableMemoryInBytes = getAvailableMemoryInKB() * 1024;
-            const auto partialResultMemUsage = partialResults.getMemoryInfo();
-
-            // std::cerr << "availableMemoryInBytes = " << availableMemoryInBytes << "\n";
-            // std::cerr << "memoryLimitOption = " << programOptions.memoryTotalLimit << "\n";
-            // std::cerr << "partialResultMemUsage = " << partialResultMemUsage.host << "\n";
+            memoryBudget.beginStage("output");
 
-            std::size_t memoryForSorting = std::min(
-                availableMemoryInBytes,
-                programOptions.memoryTotalLimit - partialResultMemUsage.host
+            //working memory of output construction which is not accounted otherwise
+            auto outputBudget = memoryBudget.reserve(
+                "output construction", 
+                getOutputConstructionWorkingMemoryInBytes(maximumSequenceLength, programOptions.threads)
             );
 
-            if(memoryForSorting > 1*(std::size_t(1) << 30)){
-                memoryForSorting = memoryForSorting - 1*(std::size_t(1) << 30);
-            }
-            //std::cerr << "memoryForSorting = " << memoryForSorting << "\n"; 
+            const std::size_t memoryForSorting = memoryBudget.getAvailableBytes();
 
             std::cout << "STEP 3: Constructing output file(s)" << std::endl;
 
             helpers::CpuTimer step3Timer("STEP3");
 
+            //if partial results have been spilled to disk, sorting in place would cause random disk accesses.
+            //use an external sort instead. sorted runs are merged while constructing the output.
+            //compressed partial results cannot be sorted in place. Their sorted runs are kept in memory unless they have been spilled
+            const bool useExternalSort = partialResults.hasDataInFile() || partialResults.isBlockCompressed();
+            const bool sortedRunsInMemory = partialResults.isBlockCompressed() && !partialResults.hasDataInFile();
+            SortedSerializedRuns sortedRuns;
+
+            auto sortedRunsBudget = memoryBudget.registerComponent("sorted partial results", [&](){
+                return sortedRuns.getMemoryInBytes();
+            });
+
             helpers::CpuTimer sorttimer("sort_results_by_read_id");
 
-            sortSerializedResultsByReadIdAscending<EncodedTempCorrectedSequence>(
-                partialResults,
-                memoryForSorting
-            );
+            if(useExternalSort){
+                //the chunks of the external sort are read sequentially
+                partialResults.setAccessPattern(MMapAccessPattern::Sequential);
+
+                sortedRuns = makeSortedRunsByReadId<EncodedTempCorrectedSequence>(
+                    partialResults,
+                    memoryForSorting,
+                    programOptions.threads,
+                    programOptions.tempdirectory,
+                    sortedRunsInMemory
+                );
+
+                std::cout << (sortedRunsInMemory ? "Sort" : "External sort") << ": " << sortedRuns.getNumElements() 
+                    << " results in " << sortedRuns.getNumRuns() << " sorted runs\n";
+
+                //release memory and temporary files of partial results
+                partialResults = SerializedObjectStorage(0, 0, programOptions.tempdirectory + "/");
+            }else{
+                sortSerializedResultsByReadIdAscending<EncodedTempCorrectedSequence>(
+                    partialResults,
+                    memoryForSorting,
+                    programOptions.threads
+                );
+            }
 
             sorttimer.print();
             
-            std::vector<FileFormat> formats;
-            for(const auto& inputfile : programOptions.inputfiles){
-                formats.emplace_back(getFileFormat(inputfile));
-            }
-            std::vector<std::string> outputfiles;
-            for(const auto& outputfilename : programOptions.outputfilenames){
-                outputfiles.emplace_back(programOptions.outputdirectory + "/" + outputfilename);
-            }
-            FileFormat outputFormat = formats[0];
-            if(programOptions.gzoutput){
-                if(outputFormat == FileFormat::FASTQ){
-                    outputFormat = FileFormat::FASTQGZ;
-                }else if(outputFormat == FileFormat::FASTA){
-                    outputFormat = FileFormat::FASTAGZ;
-                }
+            if(useExternalSort){
+                constructOutputFileFromCorrectionResults(
+                    programOptions.inputfiles, 
+                    sortedRuns, 
+                    outputFormat,
+                    outputfiles,
+                    programOptions.showProgress,
+                    programOptions,
+                    cpuReadStorage.get()
+                );
             }else{
-                if(outputFormat == FileFormat::FASTQGZ){
-                    outputFormat = FileFormat::FASTQ;
-                }else if(outputFormat == FileFormat::FASTAGZ){
-                    outputFormat = FileFormat::FASTA;
-                }
+                constructOutputFileFromCorrectionResults(
+                    programOptions.inputfiles, 
+                    partialResults, 
+                    outputFormat,
+                    outputfiles,
+                    programOptions.showProgress,
+                    programOptions,
+                    cpuReadStorage.get()
+                );
             }
-            constructOutputFileFromCorrectionResults(
-                programOptions.inputfiles, 
-                partialResults, 
-                outputFormat,
-                outputfiles,
-                programOptions.showProgress,
-                programOptions
-            );
 
             step3Timer.print();
 
@@ -248,6 +470,8 @@ namespace care{
             std::cout << "Construction of output file(s) finished." << std::endl;
         }
 
+        memoryBudget.printStageReport(std::cout);
+
     }
 
 }
@@ -871,12 +871,35 @@ namespace care{
 
             helpers::CpuTimer step3timer("STEP3");
 
+            //if partial results have been spilled to disk, sorting in place would cause random disk accesses.
+            //use an external sort instead. sorted runs are merged while constructing the output
+            const bool useExternalSort = partialResults.hasDataInFile();
+            SortedSerializedRuns sortedRuns;
+
             helpers::CpuTimer sorttimer("sort_results_by_read_id");
 
-            sortSerializedResultsByReadIdAscending<EncodedTempCorrectedSequence>(
-                partialResults,
-                memoryForSorting
-            );
+            if(useExternalSort){
+                //the chunks of the external sort are read sequentially
+                partialResults.setAccessPattern(MMapAccessPattern::Sequential);
+
+                sortedRuns = makeSortedRunsByReadId<EncodedTempCorrectedSequence>(
+                    partialResults,
+                    memoryForSorting,
+                    programOptions.threads,
+                    programOptions.tempdirectory
+                );
+
+                std::cout << "External sort: " << sortedRuns.getNumElements() << " results in " << sortedRuns.getNumRuns() << " sorted runs\n";
+
+                //release memory and temporary files of partial results
+                partialResults = SerializedObjectStorage(0, 0, programOptions.tempdirectory + "/");
+            }else{
+                sortSerializedResultsByReadIdAscending<EncodedTempCorrectedSequence>(
+                    partialResults,
+                    memoryForSorting,
+                    programOptions.threads
+                );
+            }
 
             sorttimer.print();
             
@@ -903,14 +926,25 @@ namespace care{
                 }
             }
 
-            constructOutputFileFromCorrectionResults(
-                programOptions.inputfiles, 
-                partialResults, 
-                outputFormat,
-                outputfiles,
-                programOptions.showProgress,
-                programOptions
-            );
+            if(useExternalSort){
+                constructOutputFileFromCorrectionResults(
+                    programOptions.inputfiles, 
+                    sortedRuns, 
+                    outputFormat,
+                    outputfiles,
+                    programOptions.showProgress,
+                    programOptions
+                );
+            }else{
+                constructOutputFileFromCorrectionResults(
+                    programOptions.inputfiles, 
+                    partialResults, 
+                    outputFormat,
+                    outputfiles,
+                    programOptions.showProgress,
+                    programOptions
+                );
+            }
 
             step3timer.print();
 
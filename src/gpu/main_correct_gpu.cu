@@ -195,6 +195,8 @@ int main(int argc, char** argv){
 
 	omp_set_num_threads(numThreads);
 
+	MemoryPlacement::setPolicy(programOptions.hugePages, programOptions.interleaveNumaNodes);
+
     care::performCorrection(
 		programOptions
 	);
@@ -146,6 +146,8 @@ int main(int argc, char** argv){
 
 	omp_set_num_threads(numThreads);
 
+	MemoryPlacement::setPolicy(programOptions.hugePages, programOptions.interleaveNumaNodes);
+
     care::performCorrection(programOptions);
 
 	return 0;
@@ -36,7 +36,7 @@ void MultipleSequenceAlignment::build(const InputData& args){
 
     fillzero();
 
-    addSequence(args.useQualityScores, args.anchor, args.anchorQualities, args.anchorLength, 0, 1.0f);
+    addSequence(args.useQualityScores, args.anchor, args.anchorQualities, args.anchorLength, 0, 1.0f, args.anchorMultiplicity);
 
     for(int candidateIndex = 0; candidateIndex < nCandidates; candidateIndex++){
         const char* ptr = args.candidates + candidateIndex * args.candidatesPitch;
@@ -44,8 +44,9 @@ void MultipleSequenceAlignment::build(const InputData& args){
         const int candidateLength = args.candidateLengths[candidateIndex];
         const int shift = args.candidateShifts[candidateIndex];
         const float defaultWeightFactor = args.candidateDefaultWeightFactors[candidateIndex];
+        const int multiplicity = args.candidateMultiplicities == nullptr ? 1 : args.candidateMultiplicities[candidateIndex];
 
-        addSequence(args.useQualityScores, ptr, qptr, candidateLength, shift, defaultWeightFactor);
+        addSequence(args.useQualityScores, ptr, qptr, candidateLength, shift, defaultWeightFactor, multiplicity);
     }
 
     findConsensus();
@@ -90,22 +91,23 @@ void MultipleSequenceAlignment::fillzero(){
     zero(weightsT);
 }
 
-void MultipleSequenceAlignment::addSequence(bool useQualityScores, const char* sequence, const char* quality, int length, int shift, float defaultWeightFactor){
+void MultipleSequenceAlignment::addSequence(bool useQualityScores, const char* sequence, const char* quality, int length, int shift, float defaultWeightFactor, int multiplicity){
     assert(sequence != nullptr);
     assert(!useQualityScores || quality != nullptr);
+    assert(multiplicity > 0);
 
     for(int i = 0; i < length; i++){
         const int globalIndex = anchorColumnsBegin_incl + shift + i;
         const char base = sequence[i];
-        const float weight = defaultWeightFactor * (useQualityScores ? qualityConversion->getWeight(quality[i]) : 1.0f);
+        const float weight = multiplicity * defaultWeightFactor * (useQualityScores ? qualityConversion->getWeight(quality[i]) : 1.0f);
         switch(base){
-            case 'A': countsA[globalIndex]++; weightsA[globalIndex] += weight;break;
-            case 'C': countsC[globalIndex]++; weightsC[globalIndex] += weight;break;
-            case 'G': countsG[globalIndex]++; weightsG[globalIndex] += weight;break;
-            case 'T': countsT[globalIndex]++; weightsT[globalIndex] += weight;break;
+            case 'A': countsA[globalIndex] += multiplicity; weightsA[globalIndex] += weight;break;
+            case 'C': countsC[globalIndex] += multiplicity; weightsC[globalIndex] += weight;break;
+            case 'G': countsG[globalIndex] += multiplicity; weightsG[globalIndex] += weight;break;
+            case 'T': countsT[globalIndex] += multiplicity; weightsT[globalIndex] += weight;break;
             default: assert(false); break;
         }
-        coverage[globalIndex]++;
+        coverage[globalIndex] += multiplicity;
     }
 
     addedSequences++;
@@ -659,10 +661,12 @@ RegionSelectionResult MultipleSequenceAlignment::findCandidatesOfDifferentRegion
                 }
                 printf("\n");*/
 
-                if(base == 'A') seenCounts[0]++;
-                if(base == 'C') seenCounts[1]++;
-                if(base == 'G') seenCounts[2]++;
-                if(base == 'T') seenCounts[3]++;
+                const int multiplicity = inputData.candidateMultiplicities == nullptr ? 1 : inputData.candidateMultiplicities[candidateIndex];
+
+                if(base == 'A') seenCounts[0] += multiplicity;
+                if(base == 'C') seenCounts[1] += multiplicity;
+                if(base == 'G') seenCounts[2] += multiplicity;
+                if(base == 'T') seenCounts[3] += multiplicity;
 
                 if(notAffected){
                     result.differentRegionCandidate[candidateIndex] = false;
@@ -677,10 +681,10 @@ RegionSelectionResult MultipleSequenceAlignment::findCandidatesOfDifferentRegion
                 }
             }
 
-            if(originalbase == 'A') seenCounts[0]++;
-            if(originalbase == 'C') seenCounts[1]++;
-            if(originalbase == 'G') seenCounts[2]++;
-            if(originalbase == 'T') seenCounts[3]++;
+            if(originalbase == 'A') seenCounts[0] += inputData.anchorMultiplicity;
+            if(originalbase == 'C') seenCounts[1] += inputData.anchorMultiplicity;
+            if(originalbase == 'G') seenCounts[2] += inputData.anchorMultiplicity;
+            if(originalbase == 'T') seenCounts[3] += inputData.anchorMultiplicity;
 
             assert(seenCounts[0] == countsA[col]);
             assert(seenCounts[1] == countsC[col]);
@@ -94,6 +94,26 @@ namespace care{
             result.gzoutput = pr["gzoutput"].as<bool>();
         }
 
+        if(pr.count("hugePages")){
+            const std::string arg = pr["hugePages"].as<std::string>();
+
+            if(arg == "none"){
+                result.hugePages = HugePageMode::None;
+            }else if(arg == "transparent"){
+                result.hugePages = HugePageMode::Transparent;
+            }else if(arg == "2M"){
+                result.hugePages = HugePageMode::Explicit2M;
+            }else if(arg == "1G"){
+                result.hugePages = HugePageMode::Explicit1G;
+            }else{
+                result.hugePages = HugePageMode::Invalid;
+            }
+        }
+
+        if(pr.count("interleaveNumaNodes")){
+            result.interleaveNumaNodes = pr["interleaveNumaNodes"].as<bool>();
+        }
+
         if(pr.count("enforceHashmapCount")){
             result.mustUseAllHashfunctions = pr["enforceHashmapCount"].as<bool>();
         }
@@ -214,6 +234,80 @@ namespace care{
         }
         result.threads = std::min(result.threads, (int)std::thread::hardware_concurrency());
       
+        if(pr.count("correctionPipeline")){
+            result.correctionPipeline = pr["correctionPipeline"].as<bool>();
+        }
+
+        if(pr.count("pipelineGatherThreads")){
+            result.pipelineGatherThreads = pr["pipelineGatherThreads"].as<int>();
+        }
+
+        if(pr.count("localityAwareAnchorOrder")){
+            result.localityAwareAnchorOrder = pr["localityAwareAnchorOrder"].as<bool>();
+        }
+
+        if(pr.count("reorderReads")){
+            result.reorderReads = pr["reorderReads"].as<bool>();
+        }
+
+        if(pr.count("collapseDuplicateReads")){
+            result.collapseDuplicateReads = pr["collapseDuplicateReads"].as<bool>();
+        }
+
+        if(pr.count("compressQualityScores")){
+            result.compressQualityScores = pr["compressQualityScores"].as<bool>();
+        }
+
+        if(pr.count("compressPartialResults")){
+            result.compressPartialResults = pr["compressPartialResults"].as<bool>();
+        }
+
+        if(pr.count("readIdRange")){
+            //begin-end. end is exclusive and may be omitted. begin > end marks a malformed range
+            const std::string arg = pr["readIdRange"].as<std::string>();
+            const auto dashpos = arg.find('-');
+            try{
+                if(dashpos == std::string::npos || dashpos == 0){
+                    throw std::invalid_argument(arg);
+                }
+                std::size_t parsed = 0;
+                result.readIdRangeBegin = std::stoull(arg.substr(0, dashpos), &parsed);
+                if(parsed != dashpos){
+                    throw std::invalid_argument(arg);
+                }
+                if(dashpos + 1 < arg.size()){
+                    const std::string endstring = arg.substr(dashpos + 1);
+                    result.readIdRangeEnd = std::stoull(endstring, &parsed);
+                    if(parsed != endstring.size()){
+                        throw std::invalid_argument(arg);
+                    }
+                }
+            }catch(const std::logic_error&){
+                result.readIdRangeBegin = 1;
+                result.readIdRangeEnd = 0;
+            }
+        }
+
+        if(pr.count("publishIndexTo")){
+            result.publishIndexTo = pr["publishIndexTo"].as<std::string>();
+        }
+
+        if(pr.count("candidateRowCacheSize")){
+            result.candidateRowCacheSize = pr["candidateRowCacheSize"].as<std::size_t>();
+        }
+
+        if(pr.count("aggregateCandidateCorrections")){
+            result.aggregateCandidateCorrections = pr["aggregateCandidateCorrections"].as<bool>();
+        }
+
+        if(pr.count("streamingOutput")){
+            result.streamingOutput = pr["streamingOutput"].as<bool>();
+        }
+
+        if(pr.count("storeReadHeaders")){
+            result.storeReadHeaders = pr["storeReadHeaders"].as<bool>();
+        }
+      
         if(pr.count("showProgress")){
             result.showProgress = pr["showProgress"].as<bool>();
         }
@@ -458,11 +552,42 @@ namespace care{
             std::cout << "Error: threads must be > 0, is " + std::to_string(opt.threads) << std::endl;
         }
 
+        if(opt.pipelineGatherThreads < 0){
+            valid = false;
+            std::cout << "Error: pipelineGatherThreads must be >= 0, is " + std::to_string(opt.pipelineGatherThreads) << std::endl;
+        }
+
         if(opt.qualityScoreBits != 1 && opt.qualityScoreBits != 2 && opt.qualityScoreBits != 8){
             valid = false;
             std::cout << "Error: qualityScoreBits must be 1,2,or 8, is " + std::to_string(opt.qualityScoreBits) << std::endl;
         }
 
+        if(opt.hugePages == HugePageMode::Invalid){
+            valid = false;
+            std::cout << "Error: hugePages must be none, transparent, 2M, or 1G" << std::endl;
+        }
+
+        if(opt.readIdRangeBegin >= opt.readIdRangeEnd){
+            valid = false;
+            std::cout << "Error: readIdRange must be begin-end with begin < end" << std::endl;
+        }else if(opt.readIdRangeBegin != 0 || opt.readIdRangeEnd != std::numeric_limits<read_number>::max()){
+            if(opt.pairType == SequencePairType::PairedEnd 
+                && (opt.readIdRangeBegin % 2 != 0 
+                    || (opt.readIdRangeEnd != std::numeric_limits<read_number>::max() && opt.readIdRangeEnd % 2 != 0))){
+                valid = false;
+                std::cout << "Error: readIdRange must not split read pairs" << std::endl;
+            }
+            if(opt.localityAwareAnchorOrder || opt.reorderReads || opt.collapseDuplicateReads){
+                valid = false;
+                std::cout << "Error: readIdRange cannot be used with localityAwareAnchorOrder, reorderReads, or collapseDuplicateReads" << std::endl;
+            }
+        }
+
+        if(opt.publishIndexTo != "" && (opt.reorderReads || opt.collapseDuplicateReads)){
+            valid = false;
+            std::cout << "Error: publishIndexTo cannot be used with reorderReads or collapseDuplicateReads" << std::endl;
+        }
+
         if(!filesys::exists(opt.tempdirectory)){
             bool created = filesys::create_directories(opt.tempdirectory);
             if(!created){
@@ -534,9 +659,9 @@ namespace care{
                 }
             }
 
-            //In single end mode, a single file allowed
+            //In single end mode, one or more files are allowed. They are treated as a single read library
             if(opt.pairType == SequencePairType::SingleEnd){
-                const int countOk = opt.inputfiles.size() == 1;
+                const int countOk = opt.inputfiles.size() >= 1;
                 if(!countOk){
                     valid = false;
                     std::cout << "Error: Invalid number of input files for selected pairmode 'SingleEnd'." << std::endl;
@@ -633,6 +758,8 @@ namespace care{
         stream << "Hashtable load factor: " << hashtableLoadfactor << "\n";
         stream << "Fixed number of reads: " << fixedNumberOfReads << "\n";
         stream << "GZ compressed output: " << gzoutput << "\n";
+        stream << "Huge pages: " << to_string(hugePages) << "\n";
+        stream << "Interleave NUMA nodes: " << interleaveNumaNodes << "\n";
         //stream << "singlehash: " << singlehash << "\n";
     
     }
@@ -666,6 +793,23 @@ namespace care{
     void ProgramOptions::printAdditionalOptionsCorrectCpu(std::ostream& stream) const{
         stream << "ml-print-forestfile: " << mlForestfilePrintAnchor << "\n";
         stream << "ml-cands-print-forestfile: " << mlForestfilePrintCands << "\n";
+        stream << "Pipelined correction: " << correctionPipeline << "\n";
+        stream << "Pipeline gather threads: " << pipelineGatherThreads << "\n";
+        stream << "Locality-aware anchor order: " << localityAwareAnchorOrder << "\n";
+        stream << "Reorder reads: " << reorderReads << "\n";
+        stream << "Collapse duplicate reads: " << collapseDuplicateReads << "\n";
+        stream << "Candidate row cache size: " << candidateRowCacheSize << "\n";
+        stream << "Aggregate candidate corrections: " << aggregateCandidateCorrections << "\n";
+        stream << "Streaming output: " << streamingOutput << "\n";
+        stream << "Store read headers: " << storeReadHeaders << "\n";
+        stream << "Compress quality scores: " << compressQualityScores << "\n";
+        stream << "Compress partial results: " << compressPartialResults << "\n";
+        stream << "Read id range: " << readIdRangeBegin << "-";
+        if(readIdRangeEnd != std::numeric_limits<read_number>::max()){
+            stream << readIdRangeEnd;
+        }
+        stream << "\n";
+        stream << "Publish index to: " << publishIndexTo << "\n";
     }
 
     void ProgramOptions::printAdditionalOptionsCorrectGpu(std::ostream& stream) const{
@@ -809,7 +953,9 @@ namespace care{
             ("tempdir", "Directory to store temporary files. Default: output directory", cxxopts::value<std::string>())
             ("save-preprocessedreads-to", "Save binary dump of data structure which stores input reads to disk",
             cxxopts::value<std::string>())
-            ("load-preprocessedreads-from", "Load binary dump of read data structure from disk",
+            ("load-preprocessedreads-from", "Load binary dump of read data structure from disk. "
+                "The file is memory mapped, so reads are only read from disk when they are accessed, "
+                "and processes on the same host which load the same file share its pages.",
             cxxopts::value<std::string>())
             ("save-hashtables-to", "Save binary dump of hash tables to disk. Ignored for GPU hashtables.",
             cxxopts::value<std::string>())
@@ -823,7 +969,14 @@ namespace care{
                 "Default: " + std::to_string(ProgramOptions{}.hashtableLoadfactor), cxxopts::value<float>())
             ("fixedNumberOfReads", "Process only the first n reads. Default: " + tostring(ProgramOptions{}.fixedNumberOfReads), cxxopts::value<std::size_t>())
             ("singlehash", "Use 1 hashtables with h smallest unique hashes. Default: " + tostring(ProgramOptions{}.singlehash), cxxopts::value<bool>())
-            ("gzoutput", "gz compressed output (very slow). Default: " + tostring(ProgramOptions{}.gzoutput), cxxopts::value<bool>());
+            ("gzoutput", "gz compressed output (BGZF, multi-threaded). Default: " + tostring(ProgramOptions{}.gzoutput), cxxopts::value<bool>())
+            ("hugePages", "Page size of the large arrays of read storage, hash tables, and correction flags. "
+                "none: default allocation. transparent: transparent huge pages. 2M, 1G: explicit huge pages of this size, "
+                "which must be reserved by the administrator. Falls back to transparent huge pages if none are available. "
+                "Default: " + to_string(ProgramOptions{}.hugePages), cxxopts::value<std::string>())
+            ("interleaveNumaNodes", "If set, the pages of the large arrays of read storage, hash tables, and correction flags "
+                "are interleaved across all NUMA nodes. Default: " + tostring(ProgramOptions{}.interleaveNumaNodes), 
+                cxxopts::value<bool>()->implicit_value("true"));
             
     }
 
@@ -880,6 +1033,64 @@ namespace care{
             ("ml-print-forestfile", "The output file for extracted anchor features when correctionType = Print",
                 cxxopts::value<std::string>())
             ("ml-cands-print-forestfile", "The output file for extracted candidate features when correctionTypeCands = Print",
+                cxxopts::value<std::string>())
+            ("correctionPipeline", "If set, candidate retrieval and correction of single-end reads are performed by separate groups of threads "
+                "which are connected by queues. "
+                "Default: " + tostring(ProgramOptions{}.correctionPipeline),
+                cxxopts::value<bool>()->implicit_value("true"))
+            ("pipelineGatherThreads", "Number of threads which retrieve candidates if correctionPipeline is set. The remaining threads perform the correction. "
+                "0 means a quarter of the threads. "
+                "Default: " + tostring(ProgramOptions{}.pipelineGatherThreads),
+                cxxopts::value<int>())
+            ("localityAwareAnchorOrder", "If set, anchors are processed in the order of their min-hash instead of in input order. "
+                "Consecutively processed anchors then share many candidates which improves cache usage. The output order is not affected. "
+                "Default: " + tostring(ProgramOptions{}.localityAwareAnchorOrder),
+                cxxopts::value<bool>()->implicit_value("true"))
+            ("reorderReads", "If set, the reads are renumbered in the order of their min-hash after loading. "
+                "Overlapping reads are then stored close to each other in the read storage and in the hash tables. The output order is not affected. "
+                "Default: " + tostring(ProgramOptions{}.reorderReads),
+                cxxopts::value<bool>()->implicit_value("true"))
+            ("collapseDuplicateReads", "If set, single-end reads with identical sequences are stored, hashed, and corrected only once. "
+                "They are counted once per duplicate in the multiple sequence alignment, and the correction is written for each duplicate. "
+                "The quality scores of the first duplicate are used. "
+                "Default: " + tostring(ProgramOptions{}.collapseDuplicateReads),
+                cxxopts::value<bool>()->implicit_value("true"))
+            ("candidateRowCacheSize", "Number of reads per thread whose sequence and quality scores are cached during correction. "
+                "Rounded up to a power of two. Works best in combination with localityAwareAnchorOrder. 0 disables the cache. "
+                "Default: " + tostring(ProgramOptions{}.candidateRowCacheSize),
+                cxxopts::value<std::size_t>())
+            ("aggregateCandidateCorrections", "If set, candidate corrections of the same read are combined in memory during correction "
+                "instead of storing each of them as partial result. Only has an effect with candidateCorrection. The output is not affected. "
+                "Default: " + tostring(ProgramOptions{}.aggregateCandidateCorrections),
+                cxxopts::value<bool>()->implicit_value("true"))
+            ("streamingOutput", "If set, the output file is constructed while reads are corrected, without storing and sorting the corrections. "
+                "Only used without candidateCorrection, localityAwareAnchorOrder, reorderReads, collapseDuplicateReads, and correctionPipeline. "
+                "Default: " + tostring(ProgramOptions{}.streamingOutput),
+                cxxopts::value<bool>()->implicit_value("true"))
+            ("storeReadHeaders", "If set, read headers and non-ACGT bases are stored in compressed form when the reads are loaded, "
+                "and the output file is constructed from memory without parsing the input files again. "
+                "Requires qualityScoreBits = 8 for input files with quality scores. "
+                "Default: " + tostring(ProgramOptions{}.storeReadHeaders),
+                cxxopts::value<bool>()->implicit_value("true"))
+            ("compressQualityScores", "If set, quality scores are stored with lossless entropy coding after loading, and decoded when they are accessed. "
+                "Reduces the memory of the quality scores at the cost of correction speed. Only used with qualityScoreBits = 8. "
+                "Default: " + tostring(ProgramOptions{}.compressQualityScores),
+                cxxopts::value<bool>()->implicit_value("true"))
+            ("compressPartialResults", "If set, corrections which are stored until the output file is constructed are compressed in blocks. "
+                "More corrections fit into memory before they are stored in the temp directory, at the cost of compression time. "
+                "Not used with streamingOutput. "
+                "Default: " + tostring(ProgramOptions{}.compressPartialResults),
+                cxxopts::value<bool>()->implicit_value("true"))
+            ("readIdRange", "Only correct the reads begin-end (0-based, end exclusive, may be omitted) and write only these reads to the output file(s). "
+                "Candidates are still taken from all reads. Concatenating the outputs of disjoint ranges gives the output of all reads if candidateCorrection is not used. "
+                "Cannot be used with localityAwareAnchorOrder, reorderReads, or collapseDuplicateReads. "
+                "For paired-end reads, begin and end must be even. Default: all reads",
+                cxxopts::value<std::string>())
+            ("publishIndexTo", "Build the read storage and hash tables, save them to the files <prefix>.reads and <prefix>.hashtables, "
+                "and exit without correction. With a prefix in /dev/shm, concurrent correction processes map the same physical memory "
+                "via load-preprocessedreads-from <prefix>.reads load-hashtables-from <prefix>.hashtables, e.g. with different readIdRange. "
+                "Cannot be used with reorderReads or collapseDuplicateReads. "
+                "Default: not set",
                 cxxopts::value<std::string>());
     }
 
@@ -83,13 +83,14 @@ void UncompressedWriter::writeImpl(const std::string& data){
     ofs << data;
 }
 
-GZipWriter::GZipWriter(const std::string& filename, FileFormat format)
-        : SequenceFileWriter(filename, format){
+BgzfWriter::BgzfWriter(const std::string& filename, FileFormat format, int numCompressionThreads)
+        : SequenceFileWriter(filename, format),
+        uncompressedJobs(1){
 
     assert(format == FileFormat::FASTAGZ || format == FileFormat::FASTQGZ);
 
-    fp = gzopen(filename.c_str(), "w");
-    if(fp == NULL){
+    ofs = std::ofstream(filename, std::ios::binary);
+    if(!ofs){
         throw std::runtime_error("Cannot open file " + filename + " for writing.");
     }
 
@@ -99,23 +100,189 @@ GZipWriter::GZipWriter(const std::string& filename, FileFormat format)
         delimHeader = '@';
     }
 
-    charbuffer.reserve(2*1024*1024);
+    numCompressionThreads = std::max(1, numCompressionThreads);
+
+    //two jobs per compressor thread, one job which is filled, and one job which is written
+    const int numJobs = 2 * numCompressionThreads + 2;
+    for(int i = 0; i < numJobs; i++){
+        jobs.emplace_back(std::make_unique<CompressionJob>());
+        jobs.back()->input.reserve(jobInputBytes);
+        jobs.back()->output.reserve(blocksPerJob * maxBlockOutputBytes);
+        freeJobs.push(jobs.back().get());
+    }
+
+    currentJob = freeJobs.pop();
+
+    for(int i = 0; i < numCompressionThreads; i++){
+        compressorThreads.emplace_back([&](){ compressorThreadFunc(); });
+    }
+    writerThread = std::thread([&](){ writerThreadFunc(); });
+}
+
+BgzfWriter::~BgzfWriter(){
+    if(currentJob->input.size() > 0){
+        submitCurrentJob();
+    }
+
+    uncompressedJobs.decreaseActiveProducers();
+    jobsInOutputOrder.push(nullptr);
+
+    for(auto& thread : compressorThreads){
+        thread.join();
+    }
+    writerThread.join();
+
+    if(hasError){
+        try{
+            rethrowError();
+        }catch(const std::exception& e){
+            std::cerr << "Error writing file " << filename << ": " << e.what() << "\n";
+        }
+        return;
+    }
+
+    //empty block which marks the end of a BGZF file
+    static constexpr unsigned char eofBlock[28] = {
+        0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+        0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    ofs.write(reinterpret_cast<const char*>(&eofBlock[0]), sizeof(eofBlock));
+    ofs.flush();
+
+    if(!ofs){
+        std::cerr << "Error writing file " << filename << "\n";
+    }
 }
 
-GZipWriter::~GZipWriter(){
-    // if(numBufferedReads > 0){
-    //     writeBufferedReads();
-    // }
-    // numBufferedReads = 0;
-    flush();
-    gzclose(fp);
+void BgzfWriter::submitCurrentJob(){
+    currentJob->compressed.setBusy();
+    jobsInOutputOrder.push(currentJob);
+    uncompressedJobs.push(currentJob);
+
+    currentJob = freeJobs.pop();
+    currentJob->input.clear();
 }
 
-void GZipWriter::writeReadImpl(const std::string& header, const std::string& sequence, const std::string& quality){
+void BgzfWriter::compressorThreadFunc(){
+    constexpr std::size_t blockHeaderBytes = 18;
+    constexpr std::size_t blockFooterBytes = 8;
+
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+
+    //raw deflate, the gzip header and footer of each block are written manually
+    int status = deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    const bool isInitialized = status == Z_OK;
+    if(!isInitialized){
+        setError("BgzfWriter: deflateInit2 failed");
+    }
+
+    auto writeLE = [](unsigned char* dest, std::uint32_t value, int numBytes){
+        for(int i = 0; i < numBytes; i++){
+            dest[i] = (value >> (8 * i)) & 0xFF;
+        }
+    };
+
+    CompressionJob* job = uncompressedJobs.pop(nullptr);
+
+    while(job != nullptr){
+        job->output.clear();
+
+        //after an error, jobs are only passed on, so that no thread waits for them
+        const std::size_t numInputBytes = isInitialized && !hasError ? job->input.size() : 0;
+
+        for(std::size_t blockBegin = 0; blockBegin < numInputBytes; blockBegin += maxBlockInputBytes){
+            const std::size_t blockInputBytes = std::min(maxBlockInputBytes, job->input.size() - blockBegin);
+            unsigned char* const blockInput = reinterpret_cast<unsigned char*>(job->input.data() + blockBegin);
+
+            const std::size_t outputBegin = job->output.size();
+            job->output.resize(outputBegin + maxBlockOutputBytes);
+            unsigned char* const block = reinterpret_cast<unsigned char*>(job->output.data() + outputBegin);
+
+            const std::size_t maxDeflateBytes = maxBlockOutputBytes - blockHeaderBytes - blockFooterBytes;
+
+            //if the compressed data does not fit into a block, which can only happen for incompressible data, store it uncompressed
+            for(int level : {Z_DEFAULT_COMPRESSION, 0}){
+                deflateReset(&zs);
+                deflateParams(&zs, level, Z_DEFAULT_STRATEGY);
+                zs.next_in = blockInput;
+                zs.avail_in = blockInputBytes;
+                zs.next_out = block + blockHeaderBytes;
+                zs.avail_out = maxDeflateBytes;
+                status = deflate(&zs, Z_FINISH);
+                if(status == Z_STREAM_END) break;
+            }
+            if(status != Z_STREAM_END){
+                setError("BgzfWriter: deflate failed");
+                job->output.clear();
+                break;
+            }
+
+            const std::size_t deflateBytes = maxDeflateBytes - zs.avail_out;
+            const std::size_t blockBytes = blockHeaderBytes + deflateBytes + blockFooterBytes;
+
+            //gzip header with FEXTRA, and extra subfield BC which stores the total block size minus 1
+            static constexpr unsigned char header[16] = {
+                0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00
+            };
+            std::copy(std::begin(header), std::end(header), block);
+            writeLE(block + 16, blockBytes - 1, 2);
+
+            const std::uint32_t crc = crc32(crc32(0, Z_NULL, 0), blockInput, blockInputBytes);
+            writeLE(block + blockHeaderBytes + deflateBytes, crc, 4);
+            writeLE(block + blockHeaderBytes + deflateBytes + 4, blockInputBytes, 4);
+
+            job->output.resize(outputBegin + blockBytes);
+        }
+
+        job->compressed.signal();
+
+        job = uncompressedJobs.pop(nullptr);
+    }
+
+    if(isInitialized){
+        deflateEnd(&zs);
+    }
+}
+
+void BgzfWriter::writerThreadFunc(){
+    CompressionJob* job = jobsInOutputOrder.pop();
+
+    while(job != nullptr){
+        job->compressed.wait();
+        if(!hasError){
+            ofs.write(job->output.data(), job->output.size());
+        }
+        freeJobs.push(job);
+
+        job = jobsInOutputOrder.pop();
+    }
+}
+
+void BgzfWriter::setError(const std::string& message){
+    std::lock_guard<std::mutex> lg(errorMutex);
+    if(!error){
+        error = std::make_exception_ptr(std::runtime_error(message));
+    }
+    hasError = true;
+}
+
+void BgzfWriter::rethrowError() const{
+    if(hasError){
+        std::lock_guard<std::mutex> lg(errorMutex);
+        std::rethrow_exception(error);
+    }
+}
+
+void BgzfWriter::writeReadImpl(const std::string& header, const std::string& sequence, const std::string& quality){
     writeReadImpl(header, "", sequence, quality);
 }
 
-void GZipWriter::writeReadImpl(const std::string& name, const std::string& comment, const std::string& sequence, const std::string& quality){
+void BgzfWriter::writeReadImpl(const std::string& name, const std::string& comment, const std::string& sequence, const std::string& quality){
+    rethrowError();
+
     write({&delimHeader, 1});
     write(name);
     if(comment.size() > 0){
@@ -133,7 +300,9 @@ void GZipWriter::writeReadImpl(const std::string& name, const std::string& comme
     }
 }
 
-void GZipWriter::writeImpl(const std::string& data){
+void BgzfWriter::writeImpl(const std::string& data){
+    rethrowError();
+
     write(data);
 }
 
@@ -183,13 +352,17 @@ void GZipWriter::writeImpl(const std::string& data){
     }
 
     std::unique_ptr<SequenceFileWriter> makeSequenceWriter(const std::string& filename, FileFormat fileFormat){
+        return makeSequenceWriter(filename, fileFormat, 1);
+    }
+
+    std::unique_ptr<SequenceFileWriter> makeSequenceWriter(const std::string& filename, FileFormat fileFormat, int numCompressionThreads){
         switch (fileFormat) {
         case FileFormat::FASTA:
         case FileFormat::FASTQ:
             return std::make_unique<UncompressedWriter>(filename, fileFormat);
         case FileFormat::FASTAGZ:
         case FileFormat::FASTQGZ:
-            return std::make_unique<GZipWriter>(filename, fileFormat);
+            return std::make_unique<BgzfWriter>(filename, fileFormat, numCompressionThreads);
         case FileFormat::NONE:
     	default:
     		throw std::runtime_error("makeSequenceWriter: invalid format.");
@@ -0,0 +1,120 @@
+/*
+    Regression test for chunk boundaries of MappedSequenceFileParser.
+    Quality lines which start with '>' or '@' must not be taken as the beginning of a record.
+*/
+
+#include <mappedsequencefile.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace{
+
+    struct Record{
+        std::string header;
+        std::string sequence;
+        std::string quality;
+    };
+
+    int numFailures = 0;
+
+    void check(bool condition, const std::string& message){
+        if(!condition){
+            std::cerr << "FAILED: " << message << "\n";
+            numFailures++;
+        }
+    }
+
+    std::string makeTempFile(const std::vector<Record>& records, bool fastq){
+        std::string filename = "/tmp/mappedsequencefile_testXXXXXX";
+        const int fd = mkstemp(filename.data());
+        if(fd == -1){
+            std::perror("mkstemp");
+            std::exit(1);
+        }
+        close(fd);
+
+        std::ofstream os(filename);
+        for(const auto& record : records){
+            if(fastq){
+                os << '@' << record.header << '\n' << record.sequence << "\n+\n" << record.quality << '\n';
+            }else{
+                os << '>' << record.header << '\n' << record.sequence << '\n';
+            }
+        }
+        return filename;
+    }
+
+    void checkParsedRecords(const std::string& filename, const std::vector<Record>& expected, bool fastq, std::size_t chunkBytes){
+        const std::string name = std::string(fastq ? "fastq" : "fasta") + ", chunkBytes " + std::to_string(chunkBytes);
+
+        std::vector<Record> parsed;
+        try{
+            care::MappedSequenceFileParser parser(filename, chunkBytes);
+
+            std::vector<care::SequenceRecordView> views;
+            std::vector<char> buffer;
+            for(std::size_t chunk = 0; chunk < parser.getNumChunks(); chunk++){
+                parser.parseChunk(chunk, views, buffer);
+                for(const auto& view : views){
+                    parsed.push_back(Record{std::string(view.header), std::string(view.sequence), std::string(view.quality)});
+                }
+            }
+        }catch(const std::exception& e){
+            check(false, name + ": " + e.what());
+            return;
+        }
+
+        check(parsed.size() == expected.size(), name + ": number of records " + std::to_string(parsed.size()));
+        for(std::size_t i = 0; i < std::min(parsed.size(), expected.size()); i++){
+            const bool equal = parsed[i].header == expected[i].header
+                && parsed[i].sequence == expected[i].sequence
+                && parsed[i].quality == (fastq ? expected[i].quality : "");
+            if(!equal){
+                check(false, name + ": record " + std::to_string(i));
+                return;
+            }
+        }
+    }
+
+}
+
+int main(){
+    std::vector<Record> records;
+    for(int i = 0; i < 2000; i++){
+        Record record;
+        record.header = "read" + std::to_string(i);
+        record.sequence = std::string(50 + i % 7, "ACGT"[i % 4]);
+        record.quality = std::string(record.sequence.size(), 'I');
+        //'>' and '@' are valid quality scores
+        if(i % 3 == 0){
+            record.quality[0] = '>';
+        }else if(i % 5 == 0){
+            record.quality[0] = '@';
+        }else if(i % 7 == 0){
+            record.quality[0] = '+';
+        }
+        records.push_back(record);
+    }
+
+    for(bool fastq : {true, false}){
+        const std::string filename = makeTempFile(records, fastq);
+        for(std::size_t chunkBytes : {std::size_t(1), std::size_t(100), std::size_t(1000), std::size_t(1) << 24}){
+            checkParsedRecords(filename, records, fastq, chunkBytes);
+        }
+        std::remove(filename.c_str());
+    }
+
+    if(numFailures > 0){
+        std::cerr << numFailures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}